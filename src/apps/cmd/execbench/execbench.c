@@ -0,0 +1,61 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// NOTE: MQ 2020-08-15
+// Exec latency, forks and runs a program (e.g. `execbench 20 /bin/bash -c exit`) and reports wall time per run
+// the first run reads the binary from disk, later runs are served from page cache
+// it only uses fork/execv/waitpid, so the same binary measures a kernel before and after a loader change,
+// compare on the same QEMU setup and take `best` (average is noisy under emulation)
+#define DEFAULT_ROUNDS 10
+
+static uint64_t now_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t run(char *argv[])
+{
+	uint64_t start = now_us();
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		execv(argv[0], argv);
+		_exit(127);
+	}
+
+	int status;
+	waitpid(pid, &status, 0);
+	return now_us() - start;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3)
+	{
+		printf("usage: execbench rounds program [args...]\n");
+		return 1;
+	}
+
+	int rounds = atoi(argv[1]);
+	if (rounds <= 0)
+		rounds = DEFAULT_ROUNDS;
+
+	uint32_t first = run(argv + 2);
+	uint32_t total = 0, best = UINT32_MAX;
+	for (int i = 0; i < rounds; ++i)
+	{
+		uint32_t us = run(argv + 2);
+		total += us;
+		if (us < best)
+			best = us;
+	}
+
+	printf("%s: first %u us, average %u us, best %u us (%d rounds)\n", argv[2], first, total / rounds, best, rounds);
+	return 0;
+}
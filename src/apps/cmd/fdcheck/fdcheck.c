@@ -0,0 +1,77 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <unistd.h>
+
+// NOTE: MQ 2020-08-21
+// Fd table checks which need the real kernel, every case prints PASS/FAIL and exit code is the number of failures
+// fds are duplicated from stdout, a high one makes the table grow past its embedded arrays
+#define FIRST_FD 3
+#define LOW_FDS 4
+#define HIGH_FD 200
+
+static int failures;
+
+static void check(const char *name, bool ok)
+{
+	printf("%s %s\n", ok ? "PASS" : "FAIL", name);
+	if (!ok)
+		failures++;
+}
+
+static bool is_open(int fd)
+{
+	return fcntl(fd, F_GETFD) >= 0;
+}
+
+static bool is_cloexec(int fd)
+{
+	int flags = fcntl(fd, F_GETFD);
+	return flags >= 0 && flags & FD_CLOEXEC;
+}
+
+static void open_fds()
+{
+	for (int i = 0; i < LOW_FDS; ++i)
+		dup2(1, FIRST_FD + i);
+	dup2(1, HIGH_FD);
+}
+
+static bool all_fds(bool (*pred)(int))
+{
+	for (int i = 0; i < LOW_FDS; ++i)
+		if (!pred(FIRST_FD + i))
+			return false;
+	return pred(HIGH_FD);
+}
+
+static bool no_fds(bool (*pred)(int))
+{
+	for (int i = 0; i < LOW_FDS; ++i)
+		if (pred(FIRST_FD + i))
+			return false;
+	return !pred(HIGH_FD);
+}
+
+int main(int argc, char *argv[])
+{
+	open_fds();
+	check("close_range(3, ~0U, CLOSE_RANGE_CLOEXEC) returns 0", close_range(FIRST_FD, ~0U, CLOSE_RANGE_CLOEXEC) == 0);
+	check("close_range(3, ~0U, CLOSE_RANGE_CLOEXEC) marks every fd", all_fds(is_cloexec));
+	check("close_range(3, ~0U, CLOSE_RANGE_CLOEXEC) leaves stdout", is_open(1) && !is_cloexec(1));
+
+	check("close_range(3, ~0U, 0) returns 0", close_range(FIRST_FD, ~0U, 0) == 0);
+	check("close_range(3, ~0U, 0) closes every fd", no_fds(is_open));
+	check("close_range(3, ~0U, 0) leaves stdout", is_open(1));
+
+	open_fds();
+	check("close_range(4, 4, 0) closes one fd", close_range(FIRST_FD + 1, FIRST_FD + 1, 0) == 0 &&
+													is_open(FIRST_FD) && !is_open(FIRST_FD + 1) && is_open(FIRST_FD + 2));
+	close_range(FIRST_FD, ~0U, 0);
+
+	check("close_range(5, 4, 0) is EINVAL", close_range(FIRST_FD + 2, FIRST_FD + 1, 0) < 0 && errno == EINVAL);
+
+	printf("%d failure(s)\n", failures);
+	return failures;
+}
@@ -0,0 +1,96 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <sys/vdso.h>
+#include <time.h>
+#include <unistd.h>
+
+// NOTE: MQ 2020-08-11
+// System call latency, compares `int 0x7F`, sysenter (vdso stub) and calls which are served by vdso without trap
+#define DEFAULT_ROUNDS 100000
+
+static inline uint64_t rdtsc()
+{
+	uint32_t lo, hi;
+	__asm__ __volatile__("rdtsc"
+						 : "=a"(lo), "=d"(hi));
+	return ((uint64_t)hi << 32) | lo;
+}
+
+static int int_getppid()
+{
+	int ret;
+	__asm__ __volatile__("int $0x7F"
+						 : "=a"(ret)
+						 : "0"(__NR_getppid));
+	return ret;
+}
+
+static int int_clock_gettime(clockid_t clk_id, struct timespec *tp)
+{
+	int ret;
+	__asm__ __volatile__("int $0x7F"
+						 : "=a"(ret)
+						 : "0"(__NR_clock_gettime), "b"(clk_id), "c"(tp)
+						 : "memory");
+	return ret;
+}
+
+_syscall0(getppid);
+
+static void report(const char *name, int rounds, uint64_t start)
+{
+	uint64_t cycles = rdtsc() - start;
+	printf("%-28s %8u cycles/call\n", name, (uint32_t)(cycles / rounds));
+}
+
+int main(int argc, char *argv[])
+{
+	int rounds = argc > 1 ? atoi(argv[1]) : DEFAULT_ROUNDS;
+	if (rounds <= 0)
+		rounds = DEFAULT_ROUNDS;
+
+	struct timespec ts;
+	struct timeval tv;
+	uint64_t start;
+
+	printf("%d rounds, system call entry: %s\n", rounds, __vdso ? "vdso (sysenter if cpu supports it)" : "int 0x7F");
+
+	start = rdtsc();
+	for (int i = 0; i < rounds; ++i)
+		int_getppid();
+	report("getppid (int 0x7F)", rounds, start);
+
+	start = rdtsc();
+	for (int i = 0; i < rounds; ++i)
+		syscall_getppid();
+	report("getppid (syscall entry)", rounds, start);
+
+	start = rdtsc();
+	for (int i = 0; i < rounds; ++i)
+		int_clock_gettime(CLOCK_MONOTONIC, &ts);
+	report("clock_gettime (int 0x7F)", rounds, start);
+
+	start = rdtsc();
+	for (int i = 0; i < rounds; ++i)
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+	report("clock_gettime", rounds, start);
+
+	start = rdtsc();
+	for (int i = 0; i < rounds; ++i)
+		gettimeofday(&tv, NULL);
+	report("gettimeofday", rounds, start);
+
+	start = rdtsc();
+	for (int i = 0; i < rounds; ++i)
+		time(NULL);
+	report("time", rounds, start);
+
+	start = rdtsc();
+	for (int i = 0; i < rounds; ++i)
+		getpid();
+	report("getpid", rounds, start);
+
+	return 0;
+}
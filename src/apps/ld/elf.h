@@ -0,0 +1,133 @@
+#ifndef _LD_ELF_H
+#define _LD_ELF_H 1
+
+#include <stdint.h>
+
+// keep in sync with kernel/proc/elf.h
+typedef uint16_t Elf32_Half;
+typedef uint32_t Elf32_Off;
+typedef uint32_t Elf32_Addr;
+typedef uint32_t Elf32_Word;
+typedef int32_t Elf32_Sword;
+
+#define EI_NIDENT 16
+#define ELFMAG0 0x7F
+#define ELFMAG1 'E'
+#define ELFMAG2 'L'
+#define ELFMAG3 'F'
+
+#define ET_EXEC 2
+#define ET_DYN 3
+#define EM_386 3
+
+struct Elf32_Ehdr
+{
+	unsigned char e_ident[EI_NIDENT];
+	Elf32_Half e_type;
+	Elf32_Half e_machine;
+	Elf32_Word e_version;
+	Elf32_Addr e_entry;
+	Elf32_Off e_phoff;
+	Elf32_Off e_shoff;
+	Elf32_Word e_flags;
+	Elf32_Half e_ehsize;
+	Elf32_Half e_phentsize;
+	Elf32_Half e_phnum;
+	Elf32_Half e_shentsize;
+	Elf32_Half e_shnum;
+	Elf32_Half e_shstrndx;
+};
+
+#define PF_X 0x1
+#define PF_W 0x2
+#define PF_R 0x4
+
+#define PT_LOAD 1
+#define PT_DYNAMIC 2
+
+struct Elf32_Phdr
+{
+	Elf32_Word p_type;
+	Elf32_Off p_offset;
+	Elf32_Addr p_vaddr;
+	Elf32_Addr p_paddr;
+	Elf32_Word p_filesz;
+	Elf32_Word p_memsz;
+	Elf32_Word p_flags;
+	Elf32_Word p_align;
+};
+
+// d_tag
+#define DT_NULL 0
+#define DT_NEEDED 1
+#define DT_PLTRELSZ 2
+#define DT_PLTGOT 3
+#define DT_HASH 4
+#define DT_STRTAB 5
+#define DT_SYMTAB 6
+#define DT_STRSZ 10
+#define DT_SYMENT 11
+#define DT_INIT 12
+#define DT_REL 17
+#define DT_RELSZ 18
+#define DT_JMPREL 23
+#define DT_BIND_NOW 24
+#define DT_INIT_ARRAY 25
+#define DT_INIT_ARRAYSZ 27
+#define DT_FLAGS 30
+#define DT_GNU_HASH 0x6ffffef5
+
+// DT_FLAGS
+#define DF_BIND_NOW 0x8
+
+struct Elf32_Dyn
+{
+	Elf32_Sword d_tag;
+	Elf32_Word d_val;
+};
+
+#define SHN_UNDEF 0
+
+#define STB_LOCAL 0
+#define STB_GLOBAL 1
+#define STB_WEAK 2
+
+#define ELF32_ST_BIND(i) ((i) >> 4)
+
+struct Elf32_Sym
+{
+	Elf32_Word st_name;
+	Elf32_Addr st_value;
+	Elf32_Word st_size;
+	unsigned char st_info;
+	unsigned char st_other;
+	Elf32_Half st_shndx;
+};
+
+#define R_386_NONE 0
+#define R_386_32 1
+#define R_386_PC32 2
+#define R_386_COPY 5
+#define R_386_GLOB_DAT 6
+#define R_386_JMP_SLOT 7
+#define R_386_RELATIVE 8
+
+#define ELF32_R_SYM(i) ((i) >> 8)
+#define ELF32_R_TYPE(i) ((unsigned char)(i))
+
+struct Elf32_Rel
+{
+	Elf32_Addr r_offset;
+	Elf32_Word r_info;
+};
+
+// auxiliary vector, kernel places it above envp
+#define AT_NULL 0
+#define AT_PHDR 3
+#define AT_PHENT 4
+#define AT_PHNUM 5
+#define AT_PAGESZ 6
+#define AT_BASE 7
+#define AT_ENTRY 9
+
+#endif
@@ -1,13 +1,617 @@
-#include <stdio.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
-int main(int argc, char *argv[])
+#include "elf.h"
+
+// NOTE: MQ 2020-08-16
+// Runtime linker (/lib/ld.so), kernel maps a dynamically linked program and its PT_INTERP, then enters here
+//   - libraries in DT_NEEDED are loaded breadth first, each one is mmaped privately from its file
+//     read-only pages come from kernel's page cache so library's text is shared by every process
+//   - symbols are looked up in program then libraries in load order with DT_GNU_HASH (DT_HASH as fallback)
+//   - PLT entries are bound lazily on first call via _dl_runtime_resolve, LD_BIND_NOW=1 binds them at startup
+// ld.so cannot use libc (it is what we load), it is built with hidden visibility so it has no symbol relocations
+#define LD_LIBRARY_PATH "/lib"
+#define MAX_DSOS 16
+#define MAX_PHDRS 16
+#define MAX_PATH 256
+#define PAGE_SIZE 0x1000
+
+#define ALIGN_DOWN(x, a) ((x) & ~((a)-1))
+#define PAGE_ALIGN(x) ALIGN_DOWN((x) + PAGE_SIZE - 1, PAGE_SIZE)
+
+struct dso
+{
+	const char *name;
+	uint32_t base;	// load bias, 0 for program
+	struct Elf32_Dyn *dynamic;
+	const char *strtab;
+	struct Elf32_Sym *symtab;
+	uint32_t *hash;
+	uint32_t *gnu_hash;
+	struct Elf32_Rel *rel;
+	uint32_t relsz;
+	struct Elf32_Rel *jmprel;
+	uint32_t pltrelsz;
+	uint32_t *pltgot;
+	void (*init)();
+	void (**init_array)();
+	uint32_t init_arraysz;
+	bool bind_now;
+};
+
+// hidden symbols are reached pc-relative, so they can be used before ld.so relocates itself
+extern struct Elf32_Dyn _DYNAMIC[] __attribute__((visibility("hidden")));
+extern void _dl_runtime_resolve() __attribute__((visibility("hidden")));
+
+static struct dso dsos[MAX_DSOS];
+static int ndsos;
+static bool ld_bind_now, ld_debug;
+static const char *ld_library_path = LD_LIBRARY_PATH;
+
+// libc is not loaded yet, compiler might still emit calls to memcpy/memset
+size_t strlen(const char *s)
+{
+	size_t n = 0;
+	while (s[n])
+		n++;
+	return n;
+}
+
+int strcmp(const char *s1, const char *s2)
+{
+	for (; *s1 && *s1 == *s2; s1++, s2++)
+		;
+	return *(unsigned char *)s1 - *(unsigned char *)s2;
+}
+
+void *memcpy(void *dest, const void *src, size_t n)
+{
+	char *d = dest;
+	const char *s = src;
+	while (n--)
+		*d++ = *s++;
+	return dest;
+}
+
+void *memset(void *s, int c, size_t n)
+{
+	unsigned char *p = s;
+	while (n--)
+		*p++ = c;
+	return s;
+}
+
+static int32_t dl_syscall(uint32_t nr, uint32_t arg1, uint32_t arg2, uint32_t arg3)
+{
+	int32_t ret;
+	__asm__ __volatile__("int $0x7F"
+						 : "=a"(ret)
+						 : "0"(nr), "b"(arg1), "c"(arg2), "d"(arg3)
+						 : "memory");
+	return ret;
+}
+
+static bool dl_failed(int32_t ret)
+{
+	return (uint32_t)ret >= (uint32_t)-1024;
+}
+
+static void dl_puts(const char *s)
+{
+	dl_syscall(__NR_write, 2, (uint32_t)s, strlen(s));
+}
+
+static void dl_puthex(uint32_t value)
+{
+	char buf[11] = "0x";
+	for (int i = 0; i < 8; ++i)
+		buf[2 + i] = "0123456789abcdef"[(value >> (28 - i * 4)) & 0xf];
+	buf[10] = 0;
+	dl_puts(buf);
+}
+
+static void dl_fatal(const char *msg, const char *name)
 {
-	printf("hi, what is your name? ");
-	fflush(stdout);
+	dl_puts("ld.so: ");
+	dl_puts(msg);
+	dl_puts(name);
+	dl_puts("\n");
+	dl_syscall(__NR_exit, 127, 0, 0);
+	__builtin_unreachable();
+}
+
+static const char *dl_getenv(char **envp, const char *name)
+{
+	size_t len = strlen(name);
+	for (; envp && *envp; envp++)
+	{
+		const char *env = *envp;
+		size_t i = 0;
+		while (i < len && env[i] == name[i])
+			i++;
+		if (i == len && env[i] == '=')
+			return env + len + 1;
+	}
+	return NULL;
+}
+
+// ld.so itself is mapped at AT_BASE, only relative relocations are expected, nothing else can be used before this
+static void dl_relocate_self(uint32_t base)
+{
+	struct Elf32_Rel *rel = NULL;
+	uint32_t relsz = 0;
+	for (struct Elf32_Dyn *dyn = _DYNAMIC; dyn->d_tag != DT_NULL; dyn++)
+	{
+		if (dyn->d_tag == DT_REL)
+			rel = (struct Elf32_Rel *)(base + dyn->d_val);
+		else if (dyn->d_tag == DT_RELSZ)
+			relsz = dyn->d_val;
+	}
+
+	for (uint32_t i = 0; rel && i < relsz / sizeof(struct Elf32_Rel); ++i)
+		if (ELF32_R_TYPE(rel[i].r_info) == R_386_RELATIVE)
+			*(uint32_t *)(base + rel[i].r_offset) += base;
+}
 
-	char name[100] = {0};
-	scanf("%s", name);
-	printf("\nyour name is %s\n", name);
+static void dl_parse_dynamic(struct dso *dso)
+{
+	uint32_t base = dso->base;
+	for (struct Elf32_Dyn *dyn = dso->dynamic; dyn->d_tag != DT_NULL; dyn++)
+	{
+		switch (dyn->d_tag)
+		{
+		case DT_STRTAB:
+			dso->strtab = (const char *)(base + dyn->d_val);
+			break;
+		case DT_SYMTAB:
+			dso->symtab = (struct Elf32_Sym *)(base + dyn->d_val);
+			break;
+		case DT_HASH:
+			dso->hash = (uint32_t *)(base + dyn->d_val);
+			break;
+		case DT_GNU_HASH:
+			dso->gnu_hash = (uint32_t *)(base + dyn->d_val);
+			break;
+		case DT_REL:
+			dso->rel = (struct Elf32_Rel *)(base + dyn->d_val);
+			break;
+		case DT_RELSZ:
+			dso->relsz = dyn->d_val;
+			break;
+		case DT_JMPREL:
+			dso->jmprel = (struct Elf32_Rel *)(base + dyn->d_val);
+			break;
+		case DT_PLTRELSZ:
+			dso->pltrelsz = dyn->d_val;
+			break;
+		case DT_PLTGOT:
+			dso->pltgot = (uint32_t *)(base + dyn->d_val);
+			break;
+		case DT_INIT:
+			dso->init = (void (*)())(base + dyn->d_val);
+			break;
+		case DT_INIT_ARRAY:
+			dso->init_array = (void (**)())(base + dyn->d_val);
+			break;
+		case DT_INIT_ARRAYSZ:
+			dso->init_arraysz = dyn->d_val;
+			break;
+		case DT_BIND_NOW:
+			dso->bind_now = true;
+			break;
+		case DT_FLAGS:
+			dso->bind_now |= (dyn->d_val & DF_BIND_NOW) != 0;
+			break;
+		}
+	}
+}
+
+static uint32_t dl_gnu_hash(const char *name)
+{
+	uint32_t h = 5381;
+	for (const unsigned char *s = (const unsigned char *)name; *s; s++)
+		h = h * 33 + *s;
+	return h;
+}
+
+static uint32_t dl_elf_hash(const char *name)
+{
+	uint32_t h = 0;
+	for (const unsigned char *s = (const unsigned char *)name; *s; s++)
+	{
+		h = (h << 4) + *s;
+		uint32_t g = h & 0xf0000000;
+		if (g)
+			h ^= g >> 24;
+		h &= ~g;
+	}
+	return h;
+}
+
+static bool dl_match(struct dso *dso, struct Elf32_Sym *sym, const char *name)
+{
+	uint8_t bind = ELF32_ST_BIND(sym->st_info);
+	return sym->st_shndx != SHN_UNDEF &&
+		   (bind == STB_GLOBAL || bind == STB_WEAK) &&
+		   !strcmp(dso->strtab + sym->st_name, name);
+}
+
+// bloom filter rejects most of misses without touching buckets and chains
+static struct Elf32_Sym *dl_gnu_lookup(struct dso *dso, const char *name, uint32_t hash)
+{
+	uint32_t *table = dso->gnu_hash;
+	uint32_t nbuckets = table[0];
+	uint32_t symoffset = table[1];
+	uint32_t bloom_size = table[2];
+	uint32_t bloom_shift = table[3];
+	uint32_t *bloom = table + 4;
+	uint32_t *buckets = bloom + bloom_size;
+	uint32_t *chain = buckets + nbuckets;
+
+	uint32_t word = bloom[(hash / 32) % bloom_size];
+	uint32_t mask = (1u << (hash % 32)) | (1u << ((hash >> bloom_shift) % 32));
+	if ((word & mask) != mask)
+		return NULL;
+
+	uint32_t i = buckets[hash % nbuckets];
+	if (i < symoffset)
+		return NULL;
+
+	for (;; i++)
+	{
+		uint32_t h = chain[i - symoffset];
+		if ((hash | 1) == (h | 1) && dl_match(dso, &dso->symtab[i], name))
+			return &dso->symtab[i];
+		// the last symbol in a chain has its lowest bit set
+		if (h & 1)
+			break;
+	}
+	return NULL;
+}
+
+static struct Elf32_Sym *dl_sysv_lookup(struct dso *dso, const char *name, uint32_t hash)
+{
+	uint32_t nbuckets = dso->hash[0];
+	uint32_t *buckets = dso->hash + 2;
+	uint32_t *chain = buckets + nbuckets;
+
+	for (uint32_t i = buckets[hash % nbuckets]; i; i = chain[i])
+		if (dl_match(dso, &dso->symtab[i], name))
+			return &dso->symtab[i];
+	return NULL;
+}
+
+// global scope is program then libraries in load order, copy relocations skip program
+static struct Elf32_Sym *dl_lookup(const char *name, struct dso *skip, struct dso **def)
+{
+	uint32_t gnu_hash = dl_gnu_hash(name);
+	uint32_t elf_hash = 0;
 
+	for (int i = 0; i < ndsos; ++i)
+	{
+		struct dso *dso = &dsos[i];
+		struct Elf32_Sym *sym = NULL;
+		if (dso == skip || !dso->symtab)
+			continue;
+
+		if (dso->gnu_hash)
+			sym = dl_gnu_lookup(dso, name, gnu_hash);
+		else if (dso->hash)
+		{
+			if (!elf_hash)
+				elf_hash = dl_elf_hash(name);
+			sym = dl_sysv_lookup(dso, name, elf_hash);
+		}
+
+		if (sym)
+		{
+			*def = dso;
+			return sym;
+		}
+	}
+	return NULL;
+}
+
+static uint32_t dl_resolve(struct dso *dso, uint32_t symndx, struct dso *skip, struct Elf32_Sym **found)
+{
+	struct Elf32_Sym *sym = &dso->symtab[symndx];
+	const char *name = dso->strtab + sym->st_name;
+	if (ELF32_ST_BIND(sym->st_info) == STB_LOCAL)
+	{
+		*found = sym;
+		return dso->base + sym->st_value;
+	}
+
+	struct dso *def = NULL;
+	*found = dl_lookup(name, skip, &def);
+	if (*found)
+		return def->base + (*found)->st_value;
+	if (ELF32_ST_BIND(sym->st_info) == STB_WEAK)
+		return 0;
+
+	dl_fatal("undefined symbol ", name);
 	return 0;
 }
+
+static void dl_relocate_one(struct dso *dso, struct Elf32_Rel *rel)
+{
+	uint32_t *where = (uint32_t *)(dso->base + rel->r_offset);
+	uint32_t symndx = ELF32_R_SYM(rel->r_info);
+	uint8_t type = ELF32_R_TYPE(rel->r_info);
+	struct Elf32_Sym *sym = NULL;
+
+	switch (type)
+	{
+	case R_386_NONE:
+		break;
+	case R_386_RELATIVE:
+		*where += dso->base;
+		break;
+	case R_386_32:
+		*where += dl_resolve(dso, symndx, NULL, &sym);
+		break;
+	case R_386_PC32:
+		*where += dl_resolve(dso, symndx, NULL, &sym) - (uint32_t)where;
+		break;
+	case R_386_GLOB_DAT:
+	case R_386_JMP_SLOT:
+		*where = dl_resolve(dso, symndx, NULL, &sym);
+		break;
+	case R_386_COPY:
+	{
+		// program owns the variable, its initial value comes from the library which defines it
+		uint32_t src = dl_resolve(dso, symndx, dso, &sym);
+		if (src)
+			memcpy(where, (void *)src, dso->symtab[symndx].st_size);
+		break;
+	}
+	default:
+		dl_fatal("unsupported relocation in ", dso->name);
+	}
+}
+
+// called by _dl_runtime_resolve on the first call of a PLT entry
+uint32_t _dl_fixup(struct dso *dso, uint32_t reloc_offset)
+{
+	struct Elf32_Rel *rel = (struct Elf32_Rel *)((char *)dso->jmprel + reloc_offset);
+	struct Elf32_Sym *sym = NULL;
+	uint32_t addr = dl_resolve(dso, ELF32_R_SYM(rel->r_info), NULL, &sym);
+
+	*(uint32_t *)(dso->base + rel->r_offset) = addr;
+	return addr;
+}
+
+static void dl_relocate(struct dso *dso)
+{
+	for (uint32_t i = 0; dso->rel && i < dso->relsz / sizeof(struct Elf32_Rel); ++i)
+		dl_relocate_one(dso, &dso->rel[i]);
+
+	bool now = ld_bind_now || dso->bind_now;
+	for (uint32_t i = 0; dso->jmprel && i < dso->pltrelsz / sizeof(struct Elf32_Rel); ++i)
+	{
+		if (now)
+			dl_relocate_one(dso, &dso->jmprel[i]);
+		// GOT entry points back to its PLT entry (push offset; jmp PLT0), it only needs load bias
+		else
+			*(uint32_t *)(dso->base + dso->jmprel[i].r_offset) += dso->base;
+	}
+
+	// PLT0 pushes GOT[1] and jumps to GOT[2]
+	if (dso->pltgot && !now)
+	{
+		dso->pltgot[1] = (uint32_t)dso;
+		dso->pltgot[2] = (uint32_t)_dl_runtime_resolve;
+	}
+}
+
+static int dl_open(const char *name)
+{
+	char path[MAX_PATH];
+	for (const char *s = name; *s; s++)
+		if (*s == '/')
+			return dl_syscall(__NR_open, (uint32_t)name, O_RDONLY, 0);
+
+	// search colon separated directories
+	for (const char *dir = ld_library_path; *dir;)
+	{
+		size_t len = 0;
+		while (dir[len] && dir[len] != ':')
+			len++;
+
+		size_t name_len = strlen(name);
+		if (len + 1 + name_len < MAX_PATH)
+		{
+			memcpy(path, dir, len);
+			path[len] = '/';
+			memcpy(path + len + 1, name, name_len + 1);
+
+			int fd = dl_syscall(__NR_open, (uint32_t)path, O_RDONLY, 0);
+			if (!dl_failed(fd))
+				return fd;
+		}
+
+		dir += len;
+		if (*dir == ':')
+			dir++;
+	}
+	return -1;
+}
+
+static void *dl_mmap(uint32_t addr, uint32_t len, int prot, int flags, int fd, uint32_t off)
+{
+	struct mmap_args args = {
+		.addr = (void *)addr,
+		.len = len,
+		.prot = prot,
+		.flags = flags,
+		.fildes = fd,
+		.off = off};
+	int32_t ret = dl_syscall(__NR_mmap, (uint32_t)&args, 0, 0);
+	return dl_failed(ret) ? NULL : (void *)ret;
+}
+
+// whole image is mmaped read-only at once to reserve an area, then every segment is mapped over it
+static void dl_map(struct dso *dso, int fd)
+{
+	struct Elf32_Ehdr eh;
+	struct Elf32_Phdr phdrs[MAX_PHDRS];
+
+	if (dl_syscall(__NR_read, fd, (uint32_t)&eh, sizeof(eh)) != sizeof(eh) ||
+		eh.e_ident[0] != ELFMAG0 || eh.e_ident[1] != ELFMAG1 || eh.e_ident[2] != ELFMAG2 || eh.e_ident[3] != ELFMAG3 ||
+		eh.e_type != ET_DYN || eh.e_machine != EM_386 ||
+		eh.e_phentsize != sizeof(struct Elf32_Phdr) || eh.e_phnum > MAX_PHDRS)
+		dl_fatal("not a shared library ", dso->name);
+
+	uint32_t phsize = eh.e_phnum * sizeof(struct Elf32_Phdr);
+	if (dl_failed(dl_syscall(__NR_lseek, fd, eh.e_phoff, SEEK_SET)) ||
+		dl_syscall(__NR_read, fd, (uint32_t)phdrs, phsize) != (int32_t)phsize)
+		dl_fatal("cannot read program headers of ", dso->name);
+
+	struct Elf32_Phdr *first = NULL;
+	uint32_t low = UINT32_MAX, high = 0;
+	for (struct Elf32_Phdr *ph = phdrs; ph < phdrs + eh.e_phnum; ph++)
+	{
+		if (ph->p_type != PT_LOAD)
+			continue;
+		if (!first)
+			first = ph;
+		if (ALIGN_DOWN(ph->p_vaddr, PAGE_SIZE) < low)
+			low = ALIGN_DOWN(ph->p_vaddr, PAGE_SIZE);
+		if (PAGE_ALIGN(ph->p_vaddr + ph->p_memsz) > high)
+			high = PAGE_ALIGN(ph->p_vaddr + ph->p_memsz);
+	}
+	if (!first)
+		dl_fatal("no loadable segment in ", dso->name);
+
+	uint32_t image = (uint32_t)dl_mmap(0, high - low, PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, ALIGN_DOWN(first->p_offset, PAGE_SIZE));
+	if (!image)
+		dl_fatal("cannot map ", dso->name);
+	dso->base = image - low;
+
+	for (struct Elf32_Phdr *ph = phdrs; ph < phdrs + eh.e_phnum; ph++)
+	{
+		if (ph->p_type == PT_DYNAMIC)
+			dso->dynamic = (struct Elf32_Dyn *)(dso->base + ph->p_vaddr);
+		if (ph->p_type != PT_LOAD)
+			continue;
+
+		uint32_t start = dso->base + ALIGN_DOWN(ph->p_vaddr, PAGE_SIZE);
+		uint32_t offset = ALIGN_DOWN(ph->p_offset, PAGE_SIZE);
+		if (ph->p_flags & PF_W)
+		{
+			uint32_t end = dso->base + PAGE_ALIGN(ph->p_vaddr + ph->p_memsz);
+			if (!dl_mmap(start, end - start, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset))
+				dl_fatal("cannot map data of ", dso->name);
+			// file's bytes after data (other sections) are copied along with last page, bss is cleared
+			memset((void *)(dso->base + ph->p_vaddr + ph->p_filesz), 0, end - (dso->base + ph->p_vaddr + ph->p_filesz));
+		}
+		else if (ph != first)
+		{
+			uint32_t end = dso->base + PAGE_ALIGN(ph->p_vaddr + ph->p_filesz);
+			if (!dl_mmap(start, end - start, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_FIXED, fd, offset))
+				dl_fatal("cannot map text of ", dso->name);
+		}
+	}
+
+	if (!dso->dynamic)
+		dl_fatal("no dynamic section in ", dso->name);
+}
+
+static void dl_load(const char *name)
+{
+	for (int i = 0; i < ndsos; ++i)
+		if (!strcmp(dsos[i].name, name))
+			return;
+
+	if (ndsos == MAX_DSOS)
+		dl_fatal("too many libraries, cannot load ", name);
+
+	int fd = dl_open(name);
+	if (dl_failed(fd))
+		dl_fatal("cannot find ", name);
+
+	struct dso *dso = &dsos[ndsos++];
+	dso->name = name;
+	dl_map(dso, fd);
+	dl_syscall(__NR_close, fd, 0, 0);
+	dl_parse_dynamic(dso);
+
+	if (ld_debug)
+	{
+		dl_puts("ld.so: ");
+		dl_puts(name);
+		dl_puts(" at ");
+		dl_puthex(dso->base);
+		dl_puts("\n");
+	}
+}
+
+static void dl_init(struct dso *dso)
+{
+	if (dso->init)
+		dso->init();
+	for (uint32_t i = 0; dso->init_array && i < dso->init_arraysz / sizeof(void (*)()); ++i)
+		dso->init_array[i]();
+}
+
+uint32_t _dl_main(uint32_t *sp)
+{
+	char **envp = (char **)sp[3];
+	uint32_t *auxv = sp + 4;
+	struct Elf32_Phdr *phdrs = NULL;
+	uint32_t phnum = 0, base = 0, entry = 0;
+
+	for (; auxv[0] != AT_NULL; auxv += 2)
+	{
+		if (auxv[0] == AT_PHDR)
+			phdrs = (struct Elf32_Phdr *)auxv[1];
+		else if (auxv[0] == AT_PHNUM)
+			phnum = auxv[1];
+		else if (auxv[0] == AT_BASE)
+			base = auxv[1];
+		else if (auxv[0] == AT_ENTRY)
+			entry = auxv[1];
+	}
+	dl_relocate_self(base);
+
+	if (!phdrs || !entry)
+		dl_fatal("program is not given by kernel", "");
+
+	const char *env = dl_getenv(envp, "LD_BIND_NOW");
+	ld_bind_now = env && *env && strcmp(env, "0");
+	env = dl_getenv(envp, "LD_DEBUG");
+	ld_debug = env && *env && strcmp(env, "0");
+	env = dl_getenv(envp, "LD_LIBRARY_PATH");
+	if (env && *env)
+		ld_library_path = env;
+
+	// program is already mapped by kernel at its link addresses
+	struct dso *program = &dsos[ndsos++];
+	program->name = "";
+	for (struct Elf32_Phdr *ph = phdrs; ph < phdrs + phnum; ph++)
+		if (ph->p_type == PT_DYNAMIC)
+			program->dynamic = (struct Elf32_Dyn *)ph->p_vaddr;
+	if (!program->dynamic)
+		return entry;
+	dl_parse_dynamic(program);
+
+	// breadth first, dsos grows while it is iterated
+	for (int i = 0; i < ndsos; ++i)
+		for (struct Elf32_Dyn *dyn = dsos[i].dynamic; dyn->d_tag != DT_NULL; dyn++)
+			if (dyn->d_tag == DT_NEEDED)
+				dl_load(dsos[i].strtab + dyn->d_val);
+
+	// dependencies are relocated before their users, program's copy relocations read initialized library data
+	for (int i = ndsos - 1; i >= 0; --i)
+		dl_relocate(&dsos[i]);
+
+	// like static programs, program's own constructors are left to crt0
+	for (int i = ndsos - 1; i > 0; --i)
+		dl_init(&dsos[i]);
+
+	return entry;
+}
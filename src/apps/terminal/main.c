@@ -88,7 +88,7 @@ static void handle_master_event(struct pollfd *pfds, unsigned int nfds)
 		return;
 
 	char input[4096] = {0};
-	int ret = read(active_ptm, input, sizeof(input));
+	int ret = read(active_ptm, input, sizeof(input) - 1);
 	if (ret < 0)
 		return;
 
@@ -18,6 +18,19 @@
 
 static struct hashmap mprintable, msequence;
 
+static inline size_t keystate_hash(const unsigned int *keystate)
+{
+	return hashmap_mix32(*keystate);
+}
+
+static inline int keystate_compare(const unsigned int *a, const unsigned int *b)
+{
+	return *a != *b;
+}
+
+// looked up on every key press, hash and compare are inlined into the probe loop
+HASHMAP_INLINE_FUNCS_CREATE(keystate, unsigned int, char, keystate_hash, keystate_compare)
+
 enum
 {
 	ASCI_CURSOR_UP = 0,
@@ -266,19 +279,19 @@ struct keycode_sequence sequences[] = {
 void asci_init()
 {
 	int nitems = sizeof(asciis) / sizeof(struct keycode_ascii);
-	hashmap_init(&mprintable, hashmap_hash_uint32, hashmap_compare_uint32, nitems);
+	keystate_hashmap_init(&mprintable, nitems);
 	for (int i = 0; i < nitems; ++i)
 	{
 		struct keycode_ascii *ka = &asciis[i];
-		hashmap_put(&mprintable, &ka->keycode, &ka->ascii);
+		keystate_hashmap_put(&mprintable, &ka->keycode, (char *)&ka->ascii);
 	}
 
 	nitems = sizeof(sequences) / sizeof(struct keycode_sequence);
-	hashmap_init(&msequence, hashmap_hash_uint32, hashmap_compare_uint32, nitems);
+	keystate_hashmap_init(&msequence, nitems);
 	for (int i = 0; i < nitems; ++i)
 	{
 		struct keycode_sequence *ks = &sequences[i];
-		hashmap_put(&msequence, &ks->keycode, ks->sequence);
+		keystate_hashmap_put(&msequence, &ks->keycode, ks->sequence);
 	}
 }
 
@@ -289,13 +302,13 @@ int convert_key_event_to_code(unsigned int keycode, unsigned int state, unsigned
 	unsigned int keystate = keycode | (state << 28);
 
 	// ascii code
-	if ((value = hashmap_get(&mprintable, &keystate)))
+	if ((value = keystate_hashmap_get(&mprintable, &keystate)))
 	{
 		count = 1;
 		*buf = *value;
 	}
 	// asci escape sequence
-	else if ((value = hashmap_get(&msequence, &keystate)))
+	else if ((value = keystate_hashmap_get(&msequence, &keystate)))
 	{
 		count = strlen(value);
 		memcpy(buf, value, count);
@@ -25,6 +25,9 @@
 
 static struct desktop *desktop;
 static char *desktop_buf;
+// framebuffer pixels under cursor and where they are
+static char *cursor_under;
+static int32_t cursor_x, cursor_y;
 static uint32_t nwin = 1;
 
 static char *get_window_name()
@@ -78,6 +81,7 @@ struct window *create_window(struct msgui_window *msgwin)
 	win->graphic.width = msgwin->width;
 	win->graphic.height = msgwin->height;
 	win->graphic.transparent = msgwin->transparent;
+	win->event_fd = -1;
 
 	INIT_LIST_HEAD(&win->children);
 	hashmap_init(&win->events, hashmap_hash_string, hashmap_compare_string, 0);
@@ -108,6 +112,8 @@ void remove_window(struct window *win)
 
 	int32_t screen_size = win->graphic.height * win->graphic.width * 4;
 	munmap(win->graphic.buf, screen_size);
+	if (win->event_fd >= 0)
+		mq_close(win->event_fd);
 	// TODO: MQ 2020-09-24 Close file descriptor and memory which is openned via `shm_open`
 
 	hashmap_destroy(&win->events);
@@ -184,6 +190,8 @@ static void init_mouse()
 	char *buf = load_bmp("/usr/share/images/cursor.bmp");
 	bmp_draw(graphic, buf, 0, 0);
 	free(buf);
+
+	cursor_under = calloc(graphic->width * graphic->height * 4, sizeof(char));
 }
 
 static void init_dekstop_graphic()
@@ -300,10 +308,43 @@ static void draw_desktop_icons(char *buf)
 	}
 }
 
-static void draw_mouse(char *buf)
+static void copy_rect(char *dst, uint32_t dst_scanline, char *src, uint32_t src_scanline, uint32_t width, uint32_t height)
+{
+	for (uint32_t i = 0; i < height; ++i)
+		memcpy(dst + i * dst_scanline, src + i * src_scanline, width * 4);
+}
+
+// NOTE: MQ 2020-08-20
+// Cursor is an overlay which only lives in framebuffer, desktop_buf (composited layout) never contains it
+// moving cursor puts back pixels under its old position and saves ones under the new position
+static void show_cursor()
+{
+	struct graphic *graphic = &desktop->mouse.graphic;
+	char *fb = (char *)desktop->fb->addr;
+	uint32_t pitch = desktop->fb->pitch;
+
+	cursor_x = graphic->x;
+	cursor_y = graphic->y;
+	copy_rect(cursor_under, graphic->width * 4, fb + cursor_y * pitch + cursor_x * 4, pitch, graphic->width, graphic->height);
+	draw_alpha_graphic(fb, pitch, graphic->buf, cursor_x, cursor_y, graphic->width, graphic->height);
+}
+
+static void hide_cursor()
+{
+	struct graphic *graphic = &desktop->mouse.graphic;
+	uint32_t pitch = desktop->fb->pitch;
+
+	copy_rect((char *)desktop->fb->addr + cursor_y * pitch + cursor_x * 4, pitch, cursor_under, graphic->width * 4, graphic->width, graphic->height);
+}
+
+void draw_cursor()
 {
 	struct graphic *graphic = &desktop->mouse.graphic;
-	draw_alpha_graphic(buf, desktop->fb->pitch, graphic->buf, graphic->x, graphic->y, graphic->width, graphic->height);
+	if (graphic->x == cursor_x && graphic->y == cursor_y)
+		return;
+
+	hide_cursor();
+	show_cursor();
 }
 
 static void draw_window(char *buf, struct window *win, int32_t px, int32_t py)
@@ -329,6 +370,7 @@ void draw_window_in_layout(char *name)
 	draw_window(desktop_buf, win, 0, 0);
 
 	memcpy((char *)desktop->fb->addr, desktop_buf, desktop->fb->pitch * desktop->fb->height);
+	show_cursor();
 }
 
 // TODO: MQ 2020-03-21 Improve render speed via dirty rects
@@ -342,9 +384,21 @@ void draw_layout()
 	{
 		draw_window(desktop_buf, iter_win, 0, 0);
 	}
-	draw_mouse(desktop_buf);
 
 	memcpy((char *)desktop->fb->addr, desktop_buf, desktop->fb->pitch * desktop->fb->height);
+	show_cursor();
+}
+
+// window's queue is created by its process (enter_event_loop), it's kept open once it exists
+static void send_window_event(struct window *win, struct xevent *event)
+{
+	if (win->event_fd < 0)
+		win->event_fd = mq_open(win->name, O_WRONLY, &(struct mq_attr){
+														  .mq_msgsize = sizeof(struct xevent),
+														  .mq_maxmsg = 32,
+													  });
+	if (win->event_fd >= 0)
+		mq_send(win->event_fd, (char *)event, 0, sizeof(struct xevent));
 }
 
 static void mouse_change(struct mouse_event *event)
@@ -394,11 +448,13 @@ static struct icon *find_icon_from_mouse_position(int32_t px, int32_t py)
 	return NULL;
 }
 
-void handle_mouse_event(struct mouse_event *mevent)
+// return true if layout has to be redrawn, only moving the cursor doesn't need it
+bool handle_mouse_event(struct mouse_event *mevent)
 {
 	desktop->event_state = (desktop->event_state & ~0b1110000) | mevent->state;
 	mouse_change(mevent);
 
+	bool changed = false;
 	if ((mevent->buttons & BUTTON_LEFT) && !(desktop->event_state & BUTTON_LEFT_MASK))
 	{
 		struct ui_mouse *mouse = &desktop->mouse;
@@ -406,18 +462,17 @@ void handle_mouse_event(struct mouse_event *mevent)
 		if (active_win && active_win == desktop->active_window)
 		{
 			struct xevent *event = create_xbutton_event(BUTTON_LEFT, XBUTTON_PRESS, desktop->mouse.graphic.x, desktop->mouse.graphic.y, desktop->event_state);
-			int32_t fd = mq_open(active_win->name, O_WRONLY, &(struct mq_attr){
-																 .mq_msgsize = sizeof(struct xevent),
-																 .mq_maxmsg = 32,
-															 });
-			mq_send(fd, (char *)event, 0, sizeof(struct xevent));
-			mq_close(fd);
+			send_window_event(active_win, event);
 			free(event);
 		}
 		else if (active_win)
+		{
 			desktop->active_window = active_win;
+			changed = true;
+		}
 		else
 		{
+			changed = true;
 			struct icon *icon = find_icon_from_mouse_position(mouse->graphic.x, mouse->graphic.y);
 			struct hashmap_iter *iter = hashmap_iter(&desktop->icons);
 			while (iter)
@@ -439,6 +494,7 @@ void handle_mouse_event(struct mouse_event *mevent)
 			}
 		}
 	}
+	return changed;
 }
 
 void handle_keyboard_event(struct key_event *kevent)
@@ -447,12 +503,7 @@ void handle_keyboard_event(struct key_event *kevent)
 	if (desktop->active_window)
 	{
 		struct xevent *event = create_xkey_event(kevent->key, kevent->type, desktop->event_state);
-		int32_t fd = mq_open(desktop->active_window->name, O_WRONLY, &(struct mq_attr){
-																		 .mq_msgsize = sizeof(struct xevent),
-																		 .mq_maxmsg = 32,
-																	 });
-		mq_send(fd, (char *)event, 0, sizeof(struct xevent));
-		mq_close(fd);
+		send_window_event(desktop->active_window, event);
 		free(event);
 	}
 }
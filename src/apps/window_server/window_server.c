@@ -2,9 +2,9 @@
 #include <libgui/layout.h>
 #include <libgui/msgui.h>
 #include <mqueue.h>
-#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <unistd.h>
 
 #include "src/window_manager.h"
@@ -16,14 +16,14 @@ int main(int argc, char **argv)
 		.mq_msgsize = sizeof(struct msgui),
 		.mq_maxmsg = 32,
 	});
-	int32_t mouse_fd = open("/dev/input/mouse", O_RDONLY, 0);
+	int32_t mouse_fd = open("/dev/input/mouse", O_RDONLY | O_NONBLOCK, 0);
 	int32_t krb_fd = open("/dev/input/keyboard", O_RDONLY, 0);
 
-	struct pollfd pfds[3] = {
-		{.fd = ws_fd, .events = POLLIN},
-		{.fd = mouse_fd, .events = POLLIN},
-		{.fd = krb_fd, .events = POLLIN},
-	};
+	int32_t epfd = epoll_create(3);
+	int32_t fds[3] = {ws_fd, mouse_fd, krb_fd};
+	for (int32_t i = 0; i < 3; ++i)
+		epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i], &(struct epoll_event){.events = EPOLLIN, .data.fd = fds[i]});
+	struct epoll_event events[3];
 
 	struct msgui ws_buf;
 	struct mouse_event mouse_event;
@@ -34,16 +34,16 @@ int main(int argc, char **argv)
 
 	while (true)
 	{
-		int32_t nr = poll(pfds, 3);
+		int32_t nr = epoll_wait(epfd, events, 3, -1);
 		if (nr <= 0)
 			continue;
 
-		for (int32_t i = 0; i < 3; ++i)
+		for (int32_t i = 0; i < nr; ++i)
 		{
-			if (!(pfds[i].revents & POLLIN))
+			if (!(events[i].events & EPOLLIN))
 				continue;
 
-			if (pfds[i].fd == ws_fd)
+			if (events[i].data.fd == ws_fd)
 			{
 				memset(&ws_buf, 0, sizeof(struct msgui));
 				mq_receive(ws_fd, (char *)&ws_buf, 0, sizeof(struct msgui));
@@ -77,14 +77,19 @@ int main(int argc, char **argv)
 					draw_layout();
 				}
 			}
-			else if (pfds[i].fd == mouse_fd)
+			else if (events[i].data.fd == mouse_fd)
 			{
-				memset(&mouse_event, 0, sizeof(struct mouse_event));
-				read(mouse_fd, (char *)&mouse_event, sizeof(struct mouse_event));
-				handle_mouse_event(&mouse_event);
-				draw_layout();
+				// NOTE: MQ 2020-08-20 all pending events are handled before drawing, layout is only redrawn if a click changes it
+				bool layout_changed = false;
+				while (read(mouse_fd, (char *)&mouse_event, sizeof(struct mouse_event)) > 0)
+					layout_changed |= handle_mouse_event(&mouse_event);
+
+				if (layout_changed)
+					draw_layout();
+				else
+					draw_cursor();
 			}
-			else if (pfds[i].fd == krb_fd)
+			else if (events[i].data.fd == krb_fd)
 			{
 				read(krb_fd, (char *)&krb_event, sizeof(struct key_event));
 				handle_keyboard_event(&krb_event);
@@ -5,6 +5,8 @@ unamestr=`uname`
 
 cd libraries/libc && make clean && make
 cd ../..
+cd libraries/libgui && make clean && make
+cd ../..
 
 if [[ "$unamestr" == 'Linux' ]]; then
   dd if=/dev/zero of=hdd.img count=819200 bs=512
@@ -15,6 +17,7 @@ if [[ "$unamestr" == 'Linux' ]]; then
 
   sudo mkdir "/mnt/${DISK_NAME}/dev"
   sudo mkdir "/mnt/${DISK_NAME}/bin"
+  sudo mkdir "/mnt/${DISK_NAME}/lib"
   sudo mkdir -p "/mnt/${DISK_NAME}/usr/local/bin"
   sudo mkdir -p "/mnt/${DISK_NAME}/usr/local/sbin"
   sudo mkdir -p "/mnt/${DISK_NAME}/usr/share"
@@ -37,7 +40,7 @@ if [[ "$unamestr" == 'Linux' ]]; then
   cd ../..
   cd apps/calculator && make clean && make
   cd ../..
-  cd apps/ld && rm -f ld && i386-pc-mos-gcc -g ld.c -o ld
+  cd apps/ld && make clean && make
   cd ../..
 
   for dir in apps/cmd/*
@@ -62,7 +65,9 @@ if [[ "$unamestr" == 'Linux' ]]; then
   sudo cp apps/terminal/terminal "/mnt/${DISK_NAME}/bin"
   sudo cp apps/host/host "/mnt/${DISK_NAME}/bin"
   sudo cp apps/calculator/calculator "/mnt/${DISK_NAME}/bin"
-  sudo cp apps/ld/ld "/mnt/${DISK_NAME}/bin"
+  sudo cp apps/ld/ld.so "/mnt/${DISK_NAME}/lib"
+  sudo cp libraries/libc/libc.so "/mnt/${DISK_NAME}/lib"
+  sudo cp libraries/libgui/libgui.so "/mnt/${DISK_NAME}/lib"
 
   sudo mkdir "/mnt/${DISK_NAME}/etc"
   sudo cp assets/passwd "/mnt/${DISK_NAME}/etc"
@@ -103,11 +108,14 @@ elif [[ "$unamestr" == 'Darwin' ]]; then
   cd ../..
 
   mkdir "/Volumes/${VOLUME_NAME}/bin"
+  mkdir "/Volumes/${VOLUME_NAME}/lib"
   cp apps/window_server/window_server "/Volumes/${VOLUME_NAME}/bin"
   cp apps/terminal/terminal "/Volumes/${VOLUME_NAME}/bin"
   cp apps/host/host "/Volumes/${VOLUME_NAME}/bin"
   cp apps/calculator/calculator "/Volumes/${VOLUME_NAME}/bin"
-  cp apps/ld/ld "/Volumes/${VOLUME_NAME}/bin"
+  cp apps/ld/ld.so "/Volumes/${VOLUME_NAME}/lib"
+  cp libraries/libc/libc.so "/Volumes/${VOLUME_NAME}/lib"
+  cp libraries/libgui/libgui.so "/Volumes/${VOLUME_NAME}/lib"
 
   mkdir "/Volumes/${VOLUME_NAME}/etc"
   cp apps/window_server/desktop.ini "/Volumes/${VOLUME_NAME}/etc"
@@ -28,6 +28,15 @@ void gdt_set_descriptor(uint32_t i, uint64_t base, uint64_t limit, uint8_t acces
 	_gdt[i].grand |= grand & 0xf0;
 }
 
+//! user data descriptor which starts at running thread's tls block
+void gdt_set_tls(uint32_t base)
+{
+	gdt_set_descriptor(GDT_TLS_ENTRY, base, 0xffffffff,
+					   I86_GDT_DESC_READWRITE | I86_GDT_DESC_CODEDATA | I86_GDT_DESC_MEMORY |
+						   I86_GDT_DESC_DPL,
+					   I86_GDT_GRAND_4K | I86_GDT_GRAND_32BIT | I86_GDT_GRAND_LIMITHI_MASK);
+}
+
 void gdt_init()
 {
 	log("GDT: Initializing");
@@ -60,6 +69,8 @@ void gdt_init()
 						   I86_GDT_DESC_DPL,
 					   I86_GDT_GRAND_4K | I86_GDT_GRAND_32BIT | I86_GDT_GRAND_LIMITHI_MASK);
 
+	gdt_set_tls(0);
+
 	gdt_flush((uint32_t)&_gdtr);
 
 	log("GDT: Done");
@@ -4,7 +4,12 @@
 #include <stdint.h>
 
 //! maximum amount of descriptors allowed
-#define MAX_DESCRIPTORS 6
+#define MAX_DESCRIPTORS 7
+
+// NOTE: MQ 2020-08-19
+// 0 null, 1 kernel code, 2 kernel data, 3 user code, 4 user data, 5 tss, 6 thread local storage
+#define GDT_TLS_ENTRY 6
+#define GDT_TLS_SELECTOR (GDT_TLS_ENTRY * 8 | 3)
 
 /***	 gdt descriptor access bit flags.	***/
 
@@ -69,5 +74,6 @@ struct __attribute__((packed)) gdtr
 
 void gdt_init();
 void gdt_set_descriptor(uint32_t i, uint64_t base, uint64_t limit, uint8_t access, uint8_t grand);
+void gdt_set_tls(uint32_t base);
 
 #endif
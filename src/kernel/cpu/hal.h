@@ -26,6 +26,43 @@ static __inline void disable_interrupts()
 	__asm__ __volatile__("cli");
 }
 
+//! save eflags and disable interrupts, pair with irq_restore
+static __inline uint32_t irq_save()
+{
+	uint32_t flags;
+	__asm__ __volatile__("pushf; pop %0; cli"
+						 : "=r"(flags)
+						 :
+						 : "memory");
+	return flags;
+}
+
+//! restore eflags (and interrupt flag) saved by irq_save
+static __inline void irq_restore(uint32_t flags)
+{
+	__asm__ __volatile__("push %0; popf"
+						 :
+						 : "r"(flags)
+						 : "memory", "cc");
+}
+
+//! read time-stamp counter
+static __inline uint64_t rdtsc()
+{
+	uint32_t lo, hi;
+	__asm__ __volatile__("rdtsc"
+						 : "=a"(lo), "=d"(hi));
+	return ((uint64_t)hi << 32) | lo;
+}
+
+//! write model specific register
+static __inline void wrmsr(uint32_t msr, uint64_t value)
+{
+	__asm__ __volatile__("wrmsr"
+						 :
+						 : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
 static __inline void halt()
 {
 	__asm__ __volatile__("hlt");
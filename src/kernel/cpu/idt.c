@@ -1,8 +1,9 @@
 #include "idt.h"
 
-#include <include/list.h>
-#include <memory/vmm.h>
+#include <cpu/hal.h>
+#include <cpu/softirq.h>
 #include <utils/debug.h>
+#include <utils/trace.h>
 #include <utils/string.h>
 
 #include "pic.h"
@@ -12,13 +13,10 @@ extern void idt_flush(uint32_t);
 static struct idt_descriptor _idt[I86_MAX_INTERRUPTS];
 static struct idtr _idtr;
 
-struct interrupt_handler
-{
-	I86_IRQ_HANDLER handler;
-	struct list_head sibling;
-} interrupt_handler;
-
-static struct list_head interrupt_handlers[256];
+// NOTE: MQ 2020-08-12 Handlers are indexed by vector, the last registered handler runs first
+static I86_IRQ_HANDLER interrupt_handlers[256][IRQ_MAX_HANDLERS];
+static uint8_t interrupt_handler_count[256];
+static struct irq_stat irq_stats[256];
 
 static void idt_install_ir(uint32_t i, uint16_t flags, uint16_t sel, I86_IVT irq)
 {
@@ -68,7 +66,6 @@ void idt_init()
 	for (int i = 0; i < 256; ++i)
 	{
 		setvect(i, idt_default_handler);
-		INIT_LIST_HEAD(&interrupt_handlers[i]);
 	}
 
 	// Install the ISRs
@@ -136,29 +133,29 @@ void idt_init()
 
 void register_interrupt_handler(uint32_t n, I86_IRQ_HANDLER handler)
 {
-	struct interrupt_handler *ih = kcalloc(1, sizeof(struct interrupt_handler));
-	ih->handler = handler;
-	list_add_tail(&ih->sibling, &interrupt_handlers[n]);
+	assert(interrupt_handler_count[n] < IRQ_MAX_HANDLERS, "IDT: Too many handlers for interrupt %d", n);
+	interrupt_handlers[n][interrupt_handler_count[n]++] = handler;
+}
+
+struct irq_stat *irq_get_stat(uint32_t n)
+{
+	return &irq_stats[n];
 }
 
 static void handle_interrupt(struct interrupt_registers *regs)
 {
 	uint32_t int_no = regs->int_no & 0xff;
-	struct list_head *ihlist = &interrupt_handlers[int_no];
+	I86_IRQ_HANDLER *handlers = interrupt_handlers[int_no];
 
-	if (!list_empty(ihlist))
-	{
-		struct interrupt_handler *ih;
-		list_for_each_entry_reverse(ih, ihlist, sibling)
-		{
-			if (ih->handler(regs) == IRQ_HANDLER_STOP)
-				return;
-		}
-	}
-	else
+	if (!interrupt_handler_count[int_no])
 	{
 		err("IDT: unhandled interrupt %d", int_no);
+		return;
 	}
+
+	for (int i = interrupt_handler_count[int_no] - 1; i >= 0; --i)
+		if (handlers[i](regs) == IRQ_HANDLER_STOP)
+			return;
 }
 
 void isr_handler(struct interrupt_registers *reg)
@@ -175,5 +172,19 @@ void irq_ack(uint32_t irq_number)
 
 void irq_handler(struct interrupt_registers *reg)
 {
+	struct irq_stat *stat = &irq_stats[reg->int_no & 0xff];
+	uint64_t start = rdtsc();
+
+	irq_enter();
+	trace(TRACE_IRQ_ENTRY, reg->int_no);
 	handle_interrupt(reg);
+
+	uint32_t cycles = rdtsc() - start;
+	trace(TRACE_IRQ_EXIT, reg->int_no, cycles);
+	stat->count++;
+	stat->cycles += cycles;
+	if (cycles > stat->max_cycles)
+		stat->max_cycles = cycles;
+
+	irq_exit();
 }
@@ -44,6 +44,15 @@ struct __attribute__((packed)) interrupt_registers
 
 #define IRQ_HANDLER_CONTINUE 0
 #define IRQ_HANDLER_STOP 1
+
+#define IRQ_MAX_HANDLERS 4
+
+struct irq_stat
+{
+	uint64_t count;
+	uint64_t cycles;  // spent in handlers (tsc)
+	uint32_t max_cycles;
+};
 typedef void (*I86_IVT)(struct interrupt_registers *regs);
 typedef int32_t (*I86_IRQ_HANDLER)(struct interrupt_registers *registers);
 
@@ -51,6 +60,7 @@ void idt_init();
 void setvect(uint32_t i, I86_IVT irq);
 void setvect_flags(uint32_t i, I86_IVT irq, uint32_t flags);
 void register_interrupt_handler(uint32_t n, I86_IRQ_HANDLER handler);
+struct irq_stat *irq_get_stat(uint32_t n);
 
 /* ISRs reserved for CPU exceptions */
 extern void isr0();
@@ -1,6 +1,7 @@
 [extern isr_handler]
 [extern irq_handler]
 [extern signal_handler]
+[extern vdso_sysenter_return]
 
 ; Common ISR code
 isr_common_stub:
@@ -62,7 +63,62 @@ irq_common_stub:
     popa
     add esp, 8
     iret 
-    
+
+; Fast system call entry (the vdso stub executes sysenter)
+; sysenter loads esp from IA32_SYSENTER_ESP (follows tss.esp0) with interrupts disabled and saves nothing,
+; the stub keeps user esp in ebp and always resumes at vdso_sysenter_return.
+; We build the same frame as `int 0x7F` so syscalls, signals and fork don't tell them apart
+[global sysenter_entry]
+sysenter_entry:
+    push 0x23 ; ss
+    push ebp ; useresp
+    pushf
+    or dword [esp], 0x200 ; user code always runs with IF
+    push 0x1B ; cs
+    push dword [vdso_sysenter_return] ; eip
+    push 0
+    push 0x7F
+    pusha
+
+    push ds
+    push es
+    push fs
+    push gs
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+
+    cld
+    push esp
+    call isr_handler
+    call signal_handler
+    add esp, 4
+
+    pop gs
+    pop fs
+    pop es
+    pop ds
+
+    ; sysexit can only go back to the vdso stub (it restores ecx and edx),
+    ; a delivered signal or sigreturn changes eip -> return via iret
+    mov eax, [vdso_sysenter_return]
+    cmp [esp + 10*4], eax
+    jne .iret
+
+    popa
+    add esp, 8
+    mov edx, [esp] ; eip
+    mov ecx, [esp + 3*4] ; useresp
+    sti ; takes effect after sysexit
+    sysexit
+
+.iret:
+    popa
+    add esp, 8
+    iret
+
 ; We don't get information about which interrupt was caller
 ; when the handler is run, so we will need to have a different handler
 ; for every interrupt.
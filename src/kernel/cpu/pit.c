@@ -3,6 +3,8 @@
 #include <cpu/rtc.h>
 #include <include/list.h>
 #include <memory/vmm.h>
+#include <proc/vdso.h>
+#include <system/profile.h>
 #include <system/time.h>
 #include <utils/debug.h>
 
@@ -36,6 +38,8 @@ static int32_t pit_interrupt_handler(struct interrupt_registers *regs)
 	// adjust ticks due to overhead and latency
 	if (jiffies % (PIT_TICKS_PER_SECOND / 2) == 0 && jiffies < (current_seconds - boot_seconds) * 1000)
 		jiffies = (current_seconds - boot_seconds) * 1000;
+	vdso_update_time();
+	profile_tick(regs, jiffies);
 
 	irq_ack(regs->int_no);
 
@@ -0,0 +1,206 @@
+#include "softirq.h"
+
+#include <cpu/hal.h>
+#include <cpu/idt.h>
+#include <proc/task.h>
+#include <utils/debug.h>
+#include <utils/vsprintf.h>
+
+#define MAX_SOFTIRQ_RESTART 10
+
+extern volatile uint32_t scheduler_lock_counter;
+
+static void (*softirq_vec[NR_SOFTIRQS])();
+static struct irq_stat softirq_stats[NR_SOFTIRQS];
+static const char *softirq_names[NR_SOFTIRQS] = {
+	[TIMER_SOFTIRQ] = "TIMER",
+	[NET_RX_SOFTIRQ] = "NET_RX",
+	[TASKLET_SOFTIRQ] = "TASKLET",
+};
+
+static volatile uint32_t softirq_pending;
+static volatile bool softirq_active;
+static volatile uint32_t irq_nesting;
+static struct thread *ksoftirqd_thread;
+
+static struct tasklet_struct *tasklet_head;
+static struct tasklet_struct **tasklet_tail = &tasklet_head;
+
+void open_softirq(enum softirq_nr nr, void (*action)())
+{
+	softirq_vec[nr] = action;
+}
+
+void raise_softirq(enum softirq_nr nr)
+{
+	uint32_t flags = irq_save();
+	softirq_pending |= 1 << nr;
+	irq_restore(flags);
+}
+
+bool in_interrupt()
+{
+	return irq_nesting || softirq_active;
+}
+
+static void wakeup_softirqd()
+{
+	lock_scheduler();
+	if (ksoftirqd_thread && ksoftirqd_thread->state == THREAD_WAITING)
+		update_thread(ksoftirqd_thread, THREAD_READY);
+	unlock_scheduler();
+}
+
+// NOTE: MQ 2020-08-12
+// pending bits are grabbed with interrupts disabled, actions run with interrupts enabled
+// so a burst of hard irqs is only delayed by the time it takes to ack the device
+static void do_softirq()
+{
+	uint32_t flags = irq_save();
+	if (softirq_active)
+	{
+		irq_restore(flags);
+		return;
+	}
+	softirq_active = true;
+
+	for (int restart = 0; softirq_pending && restart < MAX_SOFTIRQ_RESTART; ++restart)
+	{
+		uint32_t pending = softirq_pending;
+		softirq_pending = 0;
+		enable_interrupts();
+
+		for (int nr = 0; pending; ++nr, pending >>= 1)
+		{
+			if (!(pending & 1) || !softirq_vec[nr])
+				continue;
+
+			uint64_t start = rdtsc();
+			softirq_vec[nr]();
+
+			uint32_t cycles = rdtsc() - start;
+			struct irq_stat *stat = &softirq_stats[nr];
+			stat->count++;
+			stat->cycles += cycles;
+			if (cycles > stat->max_cycles)
+				stat->max_cycles = cycles;
+		}
+
+		disable_interrupts();
+	}
+
+	softirq_active = false;
+	bool has_more_work = softirq_pending;
+	irq_restore(flags);
+
+	if (has_more_work)
+		wakeup_softirqd();
+}
+
+void irq_enter()
+{
+	irq_nesting++;
+}
+
+void irq_exit()
+{
+	// NOTE: MQ 2020-08-12 Nesting is dropped before running bottom halves or switching thread, other threads never see our count
+	irq_nesting--;
+	// irq which interrupts a running softirq returns straight back to it
+	if (irq_nesting || softirq_active || !current_thread)
+		return;
+
+	if (softirq_pending)
+		do_softirq();
+
+	if (current_thread->flags & TIF_NEED_RESCHED && !scheduler_lock_counter)
+	{
+		current_thread->flags &= ~TIF_NEED_RESCHED;
+		log("Scheduler: Round-robin for %d", current_thread->tid);
+		schedule();
+	}
+}
+
+void tasklet_schedule(struct tasklet_struct *t)
+{
+	uint32_t flags = irq_save();
+	if (!t->scheduled)
+	{
+		t->scheduled = true;
+		t->next = NULL;
+		*tasklet_tail = t;
+		tasklet_tail = &t->next;
+		softirq_pending |= 1 << TASKLET_SOFTIRQ;
+	}
+	irq_restore(flags);
+}
+
+static void tasklet_action()
+{
+	uint32_t flags = irq_save();
+	struct tasklet_struct *list = tasklet_head;
+	tasklet_head = NULL;
+	tasklet_tail = &tasklet_head;
+	irq_restore(flags);
+
+	while (list)
+	{
+		struct tasklet_struct *t = list;
+		list = list->next;
+
+		// tasklet can be rescheduled by its irq while func is running
+		t->scheduled = false;
+		t->func(t->data);
+	}
+}
+
+static void ksoftirqd_loop()
+{
+	// explain in kernel_init#unlock_scheduler
+	unlock_scheduler();
+
+	while (true)
+	{
+		do_softirq();
+
+		lock_scheduler();
+		update_thread(ksoftirqd_thread, softirq_pending ? THREAD_READY : THREAD_WAITING);
+		unlock_scheduler();
+		schedule();
+	}
+}
+
+static int irq_stat_show(char *buf, size_t size, const char *name, struct irq_stat *stat)
+{
+	uint32_t avg = stat->count ? stat->cycles / stat->count : 0;
+	return snprintf(buf, size, "%8s %12llu %10u %10u\n", name, stat->count, avg, stat->max_cycles);
+}
+
+int irq_stats_show(char *buf, size_t size)
+{
+	char name[16];
+	int len = snprintf(buf, size, "%8s %12s %10s %10s\n", "IRQ", "COUNT", "AVG", "MAX");
+
+	for (int i = 0; i < 256 && len < size; ++i)
+	{
+		struct irq_stat *stat = irq_get_stat(i);
+		if (!stat->count)
+			continue;
+
+		snprintf(name, sizeof(name), "%d", i);
+		len += irq_stat_show(buf + len, size - len, name, stat);
+	}
+
+	for (int i = 0; i < NR_SOFTIRQS && len < size; ++i)
+		len += irq_stat_show(buf + len, size - len, softirq_names[i], &softirq_stats[i]);
+
+	return len < size ? len : size;
+}
+
+void softirq_init()
+{
+	open_softirq(TASKLET_SOFTIRQ, tasklet_action);
+
+	log("Softirq: Setup ksoftirqd");
+	ksoftirqd_thread = create_system_process("ksoftirqd", ksoftirqd_loop, 0)->thread;
+}
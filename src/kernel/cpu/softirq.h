@@ -0,0 +1,42 @@
+#ifndef CPU_SOFTIRQ_H
+#define CPU_SOFTIRQ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// NOTE: MQ 2020-08-12
+// Bottom halves, hard irq handlers only touch the device and raise a softirq (or schedule a tasklet)
+// pending softirqs run on the outermost irq exit with interrupts enabled, leftovers go to ksoftirqd
+enum softirq_nr
+{
+	TIMER_SOFTIRQ,
+	NET_RX_SOFTIRQ,
+	TASKLET_SOFTIRQ,
+	NR_SOFTIRQS,
+};
+
+struct tasklet_struct
+{
+	struct tasklet_struct *next;
+	bool scheduled;
+	void (*func)(unsigned long);
+	unsigned long data;
+};
+
+#define DECLARE_TASKLET(name, _func, _data) \
+	struct tasklet_struct name = {          \
+		.func = (_func),                    \
+		.data = (_data),                    \
+	}
+
+void open_softirq(enum softirq_nr nr, void (*action)());
+void raise_softirq(enum softirq_nr nr);
+void tasklet_schedule(struct tasklet_struct *t);
+bool in_interrupt();
+void irq_enter();
+void irq_exit();
+int irq_stats_show(char *buf, size_t size);
+void softirq_init();
+
+#endif
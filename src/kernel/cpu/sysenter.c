@@ -0,0 +1,48 @@
+#include "sysenter.h"
+
+#include <cpu/hal.h>
+#include <utils/debug.h>
+
+#define CPUID_FEAT_EDX_SEP (1 << 11)
+
+extern void sysenter_entry();
+
+static bool enabled;
+
+void sysenter_init()
+{
+	log("Sysenter: Initializing");
+
+	uint32_t signature, features;
+	cpuid(1, &signature, &features);
+
+	uint32_t family = (signature >> 8) & 0xf;
+	uint32_t model = (signature >> 4) & 0xf;
+	uint32_t stepping = signature & 0xf;
+	// NOTE: MQ 2020-08-11 Pentium Pro reports SEP but doesn't implement it
+	if (!(features & CPUID_FEAT_EDX_SEP) || (family == 6 && model < 3 && stepping < 3))
+	{
+		log("Sysenter: Not supported, system calls use int 0x7F");
+		return;
+	}
+
+	// sysexit derives user selectors from SYSENTER_CS (cs = +16, ss = +24)
+	// which matches our gdt: kernel code 0x08, user code 0x18, user data 0x20
+	wrmsr(MSR_IA32_SYSENTER_CS, 0x08);
+	wrmsr(MSR_IA32_SYSENTER_EIP, (uint32_t)sysenter_entry);
+	enabled = true;
+
+	log("Sysenter: Done");
+}
+
+bool sysenter_enabled()
+{
+	return enabled;
+}
+
+// sysenter doesn't use tss, the stack has to follow tss.esp0 on every switch
+void sysenter_set_stack(uint32_t kernel_esp)
+{
+	if (enabled)
+		wrmsr(MSR_IA32_SYSENTER_ESP, kernel_esp);
+}
@@ -1,6 +1,7 @@
 #include "tss.h"
 
 #include <cpu/gdt.h>
+#include <cpu/sysenter.h>
 #include <utils/debug.h>
 #include <utils/string.h>
 
@@ -12,6 +13,7 @@ void tss_set_stack(uint32_t kernelSS, uint32_t kernelESP)
 {
 	TSS.ss0 = kernelSS;
 	TSS.esp0 = kernelESP;
+	sysenter_set_stack(kernelESP);
 }
 
 void install_tss(uint32_t idx, uint32_t kernelSS, uint32_t kernelESP)
@@ -1,11 +1,28 @@
+#include <cpu/softirq.h>
 #include <fs/char_dev.h>
 #include <include/errno.h>
+#include <include/fcntl.h>
+#include <locking/lockstat.h>
+#include <memory/vmm.h>
+#include <proc/task.h>
+#include <system/profile.h>
 #include <utils/debug.h>
 #include <utils/math.h>
+#include <utils/string.h>
+#include <utils/trace.h>
 
 #define MEMORY_MAJOR 1
 #define NULL_DEVICE 3
 #define RANDOM_DEVICE 8
+#define INTERRUPTS_DEVICE 12
+#define TRACE_DEVICE 13
+#define PROFILE_DEVICE 14
+#define REAPER_DEVICE 15
+#define LOCKSTAT_DEVICE 16
+
+#define INTERRUPTS_BUFFER_SIZE 4096
+#define REAPER_BUFFER_SIZE 512
+#define LOCKSTAT_BUFFER_SIZE 4096
 
 extern struct vfs_file_operations def_chr_fops;
 
@@ -76,10 +93,260 @@ static struct vfs_file_operations random_fops = {
 	.release = random_release,
 };
 
+static int interrupts_open(struct vfs_inode *inode, struct vfs_file *filp)
+{
+	return 0;
+}
+
+static int interrupts_release(struct vfs_inode *inode, struct vfs_file *filp)
+{
+	return 0;
+}
+
+static loff_t interrupts_llseek(struct vfs_file *file, loff_t ppos, int whence)
+{
+	if (whence != SEEK_SET || ppos < 0)
+		return -EINVAL;
+
+	file->f_pos = ppos;
+	return ppos;
+}
+
+// NOTE: MQ 2020-08-12 Per-vector counts and handler latency (in tsc cycles), snapshot is taken on every read
+static ssize_t interrupts_read(struct vfs_file *file, char *buf, size_t count, loff_t ppos)
+{
+	char *stats = kcalloc(INTERRUPTS_BUFFER_SIZE, sizeof(char));
+	int len = irq_stats_show(stats, INTERRUPTS_BUFFER_SIZE);
+
+	ssize_t ret = 0;
+	if (ppos < len)
+	{
+		ret = min_t(ssize_t, count, len - ppos);
+		memcpy(buf, stats + ppos, ret);
+		file->f_pos = ppos + ret;
+	}
+
+	kfree(stats);
+	return ret;
+}
+
+static ssize_t interrupts_write(struct vfs_file *file, const char *buf, size_t count, loff_t ppos)
+{
+	return -EINVAL;
+}
+
+static struct vfs_file_operations interrupts_fops = {
+	.llseek = interrupts_llseek,
+	.read = interrupts_read,
+	.write = interrupts_write,
+	.open = interrupts_open,
+	.release = interrupts_release,
+};
+
+// NOTE: MQ 2020-08-13 Each reader has its own cursor and starts at the oldest entry which is still in the ring
+static int trace_open(struct vfs_inode *inode, struct vfs_file *filp)
+{
+	uint32_t *cursor = kcalloc(1, sizeof(uint32_t));
+	*cursor = trace_first_cursor();
+	filp->private_data = cursor;
+	return 0;
+}
+
+static int trace_release(struct vfs_inode *inode, struct vfs_file *filp)
+{
+	kfree(filp->private_data);
+	return 0;
+}
+
+static loff_t trace_llseek(struct vfs_file *file, loff_t ppos, int whence)
+{
+	return -ESPIPE;
+}
+
+static ssize_t trace_read(struct vfs_file *file, char *buf, size_t count, loff_t ppos)
+{
+	int len = trace_format(file->private_data, buf, count);
+	file->f_pos = ppos + len;
+	return len;
+}
+
+// writing 0 stops tracing, anything else starts it again
+static ssize_t trace_write(struct vfs_file *file, const char *buf, size_t count, loff_t ppos)
+{
+	if (count)
+		trace_enabled = buf[0] != '0';
+	return count;
+}
+
+static struct vfs_file_operations trace_fops = {
+	.llseek = trace_llseek,
+	.read = trace_read,
+	.write = trace_write,
+	.open = trace_open,
+	.release = trace_release,
+};
+
+// NOTE: MQ 2020-08-14
+// Writing a decimal frequency (in Hz, up to 1000) starts sampling, writing 0 stops it
+// each read line is a sample, tools/flamegraph.py symbolizes and folds them on host
+static int profile_open(struct vfs_inode *inode, struct vfs_file *filp)
+{
+	uint32_t *cursor = kcalloc(1, sizeof(uint32_t));
+	*cursor = profile_first_cursor();
+	filp->private_data = cursor;
+	return 0;
+}
+
+static int profile_release(struct vfs_inode *inode, struct vfs_file *filp)
+{
+	kfree(filp->private_data);
+	return 0;
+}
+
+static loff_t profile_llseek(struct vfs_file *file, loff_t ppos, int whence)
+{
+	return -ESPIPE;
+}
+
+static ssize_t profile_read(struct vfs_file *file, char *buf, size_t count, loff_t ppos)
+{
+	int len = profile_format(file->private_data, buf, count);
+	file->f_pos = ppos + len;
+	return len;
+}
+
+static ssize_t profile_write(struct vfs_file *file, const char *buf, size_t count, loff_t ppos)
+{
+	uint32_t hz = 0;
+	for (size_t i = 0; i < count && buf[i] >= '0' && buf[i] <= '9'; ++i)
+		hz = hz * 10 + buf[i] - '0';
+
+	int ret = profile_set_frequency(hz);
+	return ret < 0 ? ret : (ssize_t)count;
+}
+
+static struct vfs_file_operations profile_fops = {
+	.llseek = profile_llseek,
+	.read = profile_read,
+	.write = profile_write,
+	.open = profile_open,
+	.release = profile_release,
+};
+
+static int reaper_open(struct vfs_inode *inode, struct vfs_file *filp)
+{
+	return 0;
+}
+
+static int reaper_release(struct vfs_inode *inode, struct vfs_file *filp)
+{
+	return 0;
+}
+
+static loff_t reaper_llseek(struct vfs_file *file, loff_t ppos, int whence)
+{
+	if (whence != SEEK_SET || ppos < 0)
+		return -EINVAL;
+
+	file->f_pos = ppos;
+	return ppos;
+}
+
+// NOTE: MQ 2020-08-20 What kreaper has reclaimed so far, one "name value" per line like /proc files
+static ssize_t reaper_read(struct vfs_file *file, char *buf, size_t count, loff_t ppos)
+{
+	char *stats = kcalloc(REAPER_BUFFER_SIZE, sizeof(char));
+	int len = reaper_stats_show(stats, REAPER_BUFFER_SIZE);
+
+	ssize_t ret = 0;
+	if (ppos < len)
+	{
+		ret = min_t(ssize_t, count, len - ppos);
+		memcpy(buf, stats + ppos, ret);
+		file->f_pos = ppos + ret;
+	}
+
+	kfree(stats);
+	return ret;
+}
+
+static ssize_t reaper_write(struct vfs_file *file, const char *buf, size_t count, loff_t ppos)
+{
+	return -EINVAL;
+}
+
+static struct vfs_file_operations reaper_fops = {
+	.llseek = reaper_llseek,
+	.read = reaper_read,
+	.write = reaper_write,
+	.open = reaper_open,
+	.release = reaper_release,
+};
+
+static int lockstat_open(struct vfs_inode *inode, struct vfs_file *filp)
+{
+	return 0;
+}
+
+static int lockstat_release(struct vfs_inode *inode, struct vfs_file *filp)
+{
+	return 0;
+}
+
+static loff_t lockstat_llseek(struct vfs_file *file, loff_t ppos, int whence)
+{
+	if (whence != SEEK_SET || ppos < 0)
+		return -EINVAL;
+
+	file->f_pos = ppos;
+	return ppos;
+}
+
+// NOTE: MQ 2020-08-23 Per lock class acquisitions, contentions and wait time (in tsc cycles)
+static ssize_t lockstat_read(struct vfs_file *file, char *buf, size_t count, loff_t ppos)
+{
+	char *stats = kcalloc(LOCKSTAT_BUFFER_SIZE, sizeof(char));
+	int len = lock_stats_show(stats, LOCKSTAT_BUFFER_SIZE);
+
+	ssize_t ret = 0;
+	if (ppos < len)
+	{
+		ret = min_t(ssize_t, count, len - ppos);
+		memcpy(buf, stats + ppos, ret);
+		file->f_pos = ppos + ret;
+	}
+
+	kfree(stats);
+	return ret;
+}
+
+static ssize_t lockstat_write(struct vfs_file *file, const char *buf, size_t count, loff_t ppos)
+{
+	return -EINVAL;
+}
+
+static struct vfs_file_operations lockstat_fops = {
+	.llseek = lockstat_llseek,
+	.read = lockstat_read,
+	.write = lockstat_write,
+	.open = lockstat_open,
+	.release = lockstat_release,
+};
+
 static struct char_device cdev_null = (struct char_device)DECLARE_CHRDEV("null", MEMORY_MAJOR, NULL_DEVICE, 1, &null_fops);
 
 static struct char_device cdev_random = (struct char_device)DECLARE_CHRDEV("random", MEMORY_MAJOR, RANDOM_DEVICE, 1, &random_fops);
 
+static struct char_device cdev_interrupts = (struct char_device)DECLARE_CHRDEV("interrupts", MEMORY_MAJOR, INTERRUPTS_DEVICE, 1, &interrupts_fops);
+
+static struct char_device cdev_trace = (struct char_device)DECLARE_CHRDEV("trace", MEMORY_MAJOR, TRACE_DEVICE, 1, &trace_fops);
+
+static struct char_device cdev_profile = (struct char_device)DECLARE_CHRDEV("profile", MEMORY_MAJOR, PROFILE_DEVICE, 1, &profile_fops);
+
+static struct char_device cdev_reaper = (struct char_device)DECLARE_CHRDEV("reaper", MEMORY_MAJOR, REAPER_DEVICE, 1, &reaper_fops);
+
+static struct char_device cdev_lockstat = (struct char_device)DECLARE_CHRDEV("lockstat", MEMORY_MAJOR, LOCKSTAT_DEVICE, 1, &lockstat_fops);
+
 void chrdev_memory_init()
 {
 	log("Devfs: Mount null");
@@ -89,4 +356,24 @@ void chrdev_memory_init()
 	log("Devfs: Mount random");
 	register_chrdev(&cdev_random);
 	vfs_mknod("/dev/random", S_IFCHR, cdev_random.dev);
+
+	log("Devfs: Mount interrupts");
+	register_chrdev(&cdev_interrupts);
+	vfs_mknod("/dev/interrupts", S_IFCHR, cdev_interrupts.dev);
+
+	log("Devfs: Mount trace");
+	register_chrdev(&cdev_trace);
+	vfs_mknod("/dev/trace", S_IFCHR, cdev_trace.dev);
+
+	log("Devfs: Mount profile");
+	register_chrdev(&cdev_profile);
+	vfs_mknod("/dev/profile", S_IFCHR, cdev_profile.dev);
+
+	log("Devfs: Mount reaper");
+	register_chrdev(&cdev_reaper);
+	vfs_mknod("/dev/reaper", S_IFCHR, cdev_reaper.dev);
+
+	log("Devfs: Mount lockstat");
+	register_chrdev(&cdev_lockstat);
+	vfs_mknod("/dev/lockstat", S_IFCHR, cdev_lockstat.dev);
 }
@@ -6,67 +6,92 @@
 #include <proc/task.h>
 #include <utils/debug.h>
 #include <utils/math.h>
+#include <utils/string.h>
 
 #include "tty.h"
 
-static void put_tty_queue(struct tty_struct *tty, char ch)
+// NOTE: MQ 2020-08-23
+// read_buf is a ring, read_head is the first and read_tail is the last queued char (both are equal when it is empty)
+// a span goes in and out with at most two memcpy (before and after wrapping around)
+// -> raw input (pty master) is queued as a whole and the reader drains up to N_TTY_BUF_SIZE per read
+static void put_tty_queue_span(struct tty_struct *tty, const char *cp, int count)
 {
-	if (tty->read_count >= N_TTY_BUF_SIZE)
+	if (!count)
+		return;
+	if (tty->read_count + count > N_TTY_BUF_SIZE)
 		assert_not_reached();
 
-	if (tty->read_count)
-		tty->read_tail = N_TTY_BUF_ALIGN(tty->read_tail + 1);
-	else
-		assert(tty->read_head == tty->read_tail);
-	tty->read_buf[tty->read_tail] = ch;
-	tty->read_count++;
+	int pos = tty->read_count ? N_TTY_BUF_ALIGN(tty->read_tail + 1) : tty->read_tail;
+	int first = min_t(int, count, N_TTY_BUF_SIZE - pos);
+	memcpy(tty->read_buf + pos, cp, first);
+	memcpy(tty->read_buf, cp + first, count - first);
+	tty->read_tail = N_TTY_BUF_ALIGN(pos + count - 1);
+	tty->read_count += count;
+}
+
+static void put_tty_queue(struct tty_struct *tty, char ch)
+{
+	put_tty_queue_span(tty, &ch, 1);
+}
+
+static bool opost_special(struct tty_struct *tty, char ch)
+{
+	return (ch == '\n' && O_ONLCR(tty)) || (ch == '\r' && O_OCRNL(tty));
 }
 
+// returns how many chars of buf are written, output (after OPOST) is limited by what driver can take
 static ssize_t opost_block(struct tty_struct *tty, const char *buf, ssize_t nr)
 {
-	int room = tty->ldisc->receive_room(tty);
+	int room = tty->driver->tops->write_room ? tty->driver->tops->write_room(tty) : N_TTY_BUF_SIZE;
 
 	if (!room)
 		return 0;
-	if (nr > room)
-		nr = room;
 
-	if (O_OPOST(tty))
+	if (!O_OPOST(tty) || !(O_ONLCR(tty) || O_OCRNL(tty) || O_OLCUC(tty)))
 	{
-		char *wbuf = kcalloc(1, N_TTY_BUF_SIZE);
-		char *ibuf = wbuf;
-		int wlength = 0;
+		nr = min_t(ssize_t, nr, room);
+		tty->driver->tops->write(tty, buf, nr);
+		return nr;
+	}
 
-		for (int i = 0; i < nr; ++i)
+	// write_buf is preallocated, runs of ordinary chars are copied as a whole
+	room = min_t(int, room, N_TTY_BUF_SIZE);
+	char *wbuf = tty->write_buf;
+	int i = 0, wlength = 0;
+	while (i < nr && wlength < room)
+	{
+		int span = 0;
+		if (!O_OLCUC(tty))
 		{
-			char ch = buf[i];
-			if (O_ONLCR(tty) && ch == '\n')
-			{
-				*ibuf++ = '\r';
-				*ibuf++ = ch;
-				wlength += 2;
-			}
-			else if (O_OCRNL(tty) && ch == '\r')
-			{
-				*ibuf++ = '\n';
-				wlength++;
-			}
-			else
-			{
-				*ibuf++ = O_OLCUC(tty) ? toupper(ch) : ch;
-				wlength++;
-			}
+			int limit = min_t(int, nr - i, room - wlength);
+			while (span < limit && !opost_special(tty, buf[i + span]))
+				span++;
+		}
+		if (span)
+		{
+			memcpy(wbuf + wlength, buf + i, span);
+			wlength += span;
+			i += span;
+			continue;
 		}
 
-		tty->driver->tops->write(tty, wbuf, wlength);
-		kfree(wbuf);
-		return wlength;
-	}
-	else
-	{
-		tty->driver->tops->write(tty, buf, nr);
-		return nr;
+		char ch = buf[i];
+		if (O_ONLCR(tty) && ch == '\n')
+		{
+			if (wlength + 2 > room)
+				break;
+			wbuf[wlength++] = '\r';
+			wbuf[wlength++] = ch;
+		}
+		else if (O_OCRNL(tty) && ch == '\r')
+			wbuf[wlength++] = '\n';
+		else
+			wbuf[wlength++] = O_OLCUC(tty) ? toupper(ch) : ch;
+		i++;
 	}
+
+	tty->driver->tops->write(tty, wbuf, wlength);
+	return i;
 }
 
 static void eraser(struct tty_struct *tty, char ch)
@@ -112,8 +137,9 @@ static void eraser(struct tty_struct *tty, char ch)
 
 static void copy_from_read_buf(struct tty_struct *tty, int length, char *buf)
 {
-	for (int i = 0; i < length; ++i)
-		buf[i] = tty->read_buf[N_TTY_BUF_ALIGN(tty->read_head + i)];
+	int first = min_t(int, length, N_TTY_BUF_SIZE - tty->read_head);
+	memcpy(buf, tty->read_buf + tty->read_head, first);
+	memcpy(buf + first, tty->read_buf, length - first);
 }
 
 static void assert_from_read_buf(struct tty_struct *tty, int length)
@@ -136,6 +162,7 @@ static void assert_from_read_buf(struct tty_struct *tty, int length)
 int ntty_open(struct tty_struct *tty)
 {
 	tty->read_buf = kcalloc(1, N_TTY_BUF_SIZE);
+	tty->write_buf = kcalloc(1, N_TTY_BUF_SIZE);
 	INIT_LIST_HEAD(&tty->read_wait.list);
 	INIT_LIST_HEAD(&tty->write_wait.list);
 
@@ -145,6 +172,7 @@ int ntty_open(struct tty_struct *tty)
 void ntty_close(struct tty_struct *tty)
 {
 	kfree(tty->read_buf);
+	kfree(tty->write_buf);
 }
 
 ssize_t ntty_read(struct tty_struct *tty, struct vfs_file *file, char *buf, size_t nr)
@@ -187,11 +215,16 @@ ssize_t ntty_read(struct tty_struct *tty, struct vfs_file *file, char *buf, size
 			length = tty->read_count;
 			break;
 		}
+		if (fatal_signal_pending(current_thread))
+			break;
 		update_thread(current_thread, THREAD_WAITING);
 		schedule();
 	}
 	list_del(&wait.sibling);
 
+	if (!length && fatal_signal_pending(current_thread))
+		return -EINTR;
+
 	if (!length || length > tty->read_count)
 		return -EFAULT;
 
@@ -209,6 +242,8 @@ ssize_t ntty_read(struct tty_struct *tty, struct vfs_file *file, char *buf, size
 		tty->read_count -= count;
 	}
 	wake_up(&tty->write_wait);
+	if (tty->driver->tops->unthrottle)
+		tty->driver->tops->unthrottle(tty);
 
 	return count;
 }
@@ -224,19 +259,22 @@ ssize_t ntty_write(struct tty_struct *tty, struct vfs_file *file, const char *bu
 	DEFINE_WAIT(wait);
 	list_add_tail(&wait.sibling, &tty->write_wait.list);
 
-	while (true)
+	// more than driver's room (e.g. cat of a large file) goes in chunks, reader of the other side makes room
+	size_t written = 0;
+	while (written < nr)
 	{
-		if (tty->ldisc->receive_room(tty) >= nr)
-		{
-			opost_block(tty, buf, nr);
+		written += opost_block(tty, buf + written, nr - written);
+		if (written == nr || fatal_signal_pending(current_thread))
 			break;
-		}
 		update_thread(current_thread, THREAD_WAITING);
 		schedule();
 	}
 
 	list_del(&wait.sibling);
-	return nr;
+	// killed before anything went through
+	if (nr && !written)
+		return -EINTR;
+	return written;
 }
 
 int ntty_receive_room(struct tty_struct *tty)
@@ -315,8 +353,7 @@ void ntty_receive_buf(struct tty_struct *tty, const char *cp, int count)
 	}
 	else
 	{
-		for (int i = 0; i < count; ++i)
-			put_tty_queue(tty, cp[i]);
+		put_tty_queue_span(tty, cp, count);
 		if (L_ECHO(tty))
 			opost_block(tty, cp, count);
 		if (tty->read_count >= MIN_CHAR(tty))
@@ -1,5 +1,7 @@
 #include "tty.h"
 
+#include <proc/task.h>
+
 #define NR_PTY_MAX (1 << MINORBITS)
 
 struct tty_driver *ptm_driver, *pts_driver;
@@ -40,10 +42,20 @@ static int pty_write_room(struct tty_struct *tty)
 	return to->ldisc->receive_room(to);
 }
 
+// room of a pty is the read buffer of its other side
+static void pty_unthrottle(struct tty_struct *tty)
+{
+	struct tty_struct *to = tty->link;
+
+	if (to)
+		wake_up(&to->write_wait);
+}
+
 static struct tty_operations pty_ops = {
 	.open = pty_open,
 	.write = pty_write,
 	.write_room = pty_write_room,
+	.unthrottle = pty_unthrottle,
 };
 
 void pty_init()
@@ -64,12 +64,19 @@ static int tiocsctty(struct tty_struct *tty, int arg)
 		if (arg != 1)
 			return -EPERM;
 
+		// only processes of the old session can have it as controlling terminal
+		lock_scheduler();
+		struct pid *session = find_pid(tty->session);
 		struct process *proc;
-		for_each_process(proc)
+		if (session)
 		{
-			if (proc->tty == tty)
-				proc->tty = NULL;
+			for_each_pid_task(proc, session, PIDTYPE_SID)
+			{
+				if (proc->tty == tty)
+					proc->tty = NULL;
+			}
 		}
+		unlock_scheduler();
 	}
 
 	current_process->tty = tty;
@@ -93,7 +100,9 @@ static int tiocgpgrp(struct tty_struct *tty, int arg)
 static int tiocspgrp(struct tty_struct *tty, int arg)
 {
 	pid_t pgrp = *(uint32_t *)arg;
-	struct process *p = find_process_by_pid(pgrp);
+	lock_scheduler();
+	struct process *p = pid_task(find_pid(pgrp), PIDTYPE_PGID);
+	unlock_scheduler();
 
 	if (!p)
 		return -EINVAL;
@@ -165,6 +165,8 @@ struct tty_operations
 	int (*write)(struct tty_struct *tty, const char *buf, int count);
 	void (*put_char)(struct tty_struct *tty, const char ch);
 	int (*write_room)(struct tty_struct *tty);
+	// ldisc has consumed input, writers which wait for room can continue
+	void (*unthrottle)(struct tty_struct *tty);
 };
 
 struct tty_struct
@@ -2,6 +2,7 @@
 
 #include <cpu/hal.h>
 #include <cpu/idt.h>
+#include <cpu/softirq.h>
 #include <devices/kybrd.h>
 #include <devices/mouse.h>
 #include <fs/char_dev.h>
@@ -14,6 +15,11 @@
 
 static void kybrd_notify_readers(struct key_event *event);
 
+#define KYBRD_SCANCODE_RING_SIZE 64
+
+static uint8_t scancode_ring[KYBRD_SCANCODE_RING_SIZE];
+static volatile uint32_t scancode_head, scancode_tail;
+
 // keyboard encoder ------------------------------------------
 
 enum KYBRD_ENCODER_IO
@@ -256,103 +262,126 @@ void kybrd_set_event_state()
 		clear_bit(3, &current_kybrd_event.state);
 }
 
-int32_t i86_kybrd_irq(struct interrupt_registers *regs)
+static void kybrd_handle_scancode(int code)
 {
-	int code = 0;
+	//! test if this is a break code (Original XT Scan Code Set specific)
+	if (code & 0x80)
+	{  //test bit 7
+
+		//! covert the break code into its make code equivelant
+		code -= 0x80;
+
+		//! grab the key
+		int key = _kkybrd_scancode_std[code];
+
+		//! test if a special key has been released & set it
+		switch (key)
+		{
+		case KEY_LEFTCTRL:
+		case KEY_RIGHTCTRL:
+			_ctrl = false;
+			break;
+
+		case KEY_LEFTSHIFT:
+		case KEY_RIGHTSHIFT:
+			_shift = false;
+			break;
+
+		case KEY_LEFTALT:
+		case KEY_RIGHTALT:
+			_alt = false;
+			break;
+		}
+
+		current_kybrd_event.type = KEY_RELEASE;
+		current_kybrd_event.key = key;
+		kybrd_set_event_state();
+		kybrd_notify_readers(&current_kybrd_event);
+	}
+	else
+	{
+		//! this is a make code - set the scan code
+		_scancode = code;
+
+		//! grab the key
+		int key = _kkybrd_scancode_std[code];
+
+		//! test if user is holding down any special keys & set it
+		switch (key)
+		{
+		case KEY_LEFTCTRL:
+		case KEY_RIGHTCTRL:
+			_ctrl = true;
+			break;
+
+		case KEY_LEFTSHIFT:
+		case KEY_RIGHTSHIFT:
+			_shift = true;
+			break;
 
+		case KEY_LEFTALT:
+		case KEY_RIGHTALT:
+			_alt = true;
+			break;
+
+		case KEY_CAPSLOCK:
+			_capslock = (_capslock) ? false : true;
+			kkybrd_set_leds(_numlock, _capslock, _scrolllock);
+			break;
+
+		case KEY_NUMLOCK:
+			_numlock = (_numlock) ? false : true;
+			kkybrd_set_leds(_numlock, _capslock, _scrolllock);
+			break;
+
+		case KEY_SCROLLLOCK:
+			_scrolllock = (_scrolllock) ? false : true;
+			kkybrd_set_leds(_numlock, _capslock, _scrolllock);
+			break;
+		}
+
+		current_kybrd_event.type = KEY_PRRESS;
+		current_kybrd_event.key = key;
+		kybrd_set_event_state();
+		kybrd_notify_readers(&current_kybrd_event);
+	}
+}
+
+// NOTE: MQ 2020-08-12
+// irq only reads and acks scancode, decoding (and waking readers) is done in tasklet
+static void kybrd_tasklet_func(unsigned long data)
+{
+	while (scancode_tail != scancode_head)
+	{
+		int code = scancode_ring[scancode_tail % KYBRD_SCANCODE_RING_SIZE];
+		scancode_tail++;
+		kybrd_handle_scancode(code);
+	}
+}
+
+static DECLARE_TASKLET(kybrd_tasklet, kybrd_tasklet_func, 0);
+
+int32_t i86_kybrd_irq(struct interrupt_registers *regs)
+{
 	//! read scan code only if the kkybrd controller output buffer is full (scan code is in it)
 	if (kybrd_ctrl_read_status() & KYBRD_CTRL_STATS_MASK_OUT_BUF)
 	{
 		//! read the scan code
-		code = kybrd_enc_read_buf();
+		int code = kybrd_enc_read_buf();
 
 		irq_ack(regs->int_no);
 
-		//! is this an extended code? If so, set it and return
+		//! is this an extended code? If so, ignore it
 		if (code == 0xE0 || code == 0xE1)
 			return IRQ_HANDLER_CONTINUE;
 
-		//! test if this is a break code (Original XT Scan Code Set specific)
-		if (code & 0x80)
-		{  //test bit 7
-
-			//! covert the break code into its make code equivelant
-			code -= 0x80;
-
-			//! grab the key
-			int key = _kkybrd_scancode_std[code];
-
-			//! test if a special key has been released & set it
-			switch (key)
-			{
-			case KEY_LEFTCTRL:
-			case KEY_RIGHTCTRL:
-				_ctrl = false;
-				break;
-
-			case KEY_LEFTSHIFT:
-			case KEY_RIGHTSHIFT:
-				_shift = false;
-				break;
-
-			case KEY_LEFTALT:
-			case KEY_RIGHTALT:
-				_alt = false;
-				break;
-			}
-
-			current_kybrd_event.type = KEY_RELEASE;
-			current_kybrd_event.key = key;
-			kybrd_set_event_state();
-			kybrd_notify_readers(&current_kybrd_event);
-		}
-		else
+		// drop scancode if tasklet is too far behind
+		if (scancode_head - scancode_tail < KYBRD_SCANCODE_RING_SIZE)
 		{
-			//! this is a make code - set the scan code
-			_scancode = code;
-
-			//! grab the key
-			int key = _kkybrd_scancode_std[code];
-
-			//! test if user is holding down any special keys & set it
-			switch (key)
-			{
-			case KEY_LEFTCTRL:
-			case KEY_RIGHTCTRL:
-				_ctrl = true;
-				break;
-
-			case KEY_LEFTSHIFT:
-			case KEY_RIGHTSHIFT:
-				_shift = true;
-				break;
-
-			case KEY_LEFTALT:
-			case KEY_RIGHTALT:
-				_alt = true;
-				break;
-
-			case KEY_CAPSLOCK:
-				_capslock = (_capslock) ? false : true;
-				kkybrd_set_leds(_numlock, _capslock, _scrolllock);
-				break;
-
-			case KEY_NUMLOCK:
-				_numlock = (_numlock) ? false : true;
-				kkybrd_set_leds(_numlock, _capslock, _scrolllock);
-				break;
-
-			case KEY_SCROLLLOCK:
-				_scrolllock = (_scrolllock) ? false : true;
-				kkybrd_set_leds(_numlock, _capslock, _scrolllock);
-				break;
-			}
-
-			current_kybrd_event.type = KEY_PRRESS;
-			current_kybrd_event.key = key;
-			kybrd_set_event_state();
-			kybrd_notify_readers(&current_kybrd_event);
+			scancode_ring[scancode_head % KYBRD_SCANCODE_RING_SIZE] = code;
+			scancode_head++;
 		}
+		tasklet_schedule(&kybrd_tasklet);
 	}
 	else
 		irq_ack(regs->int_no);
@@ -410,7 +439,9 @@ static int kybrd_open(struct vfs_inode *inode, struct vfs_file *file)
 static ssize_t kybrd_read(struct vfs_file *file, char *buf, size_t count, loff_t ppos)
 {
 	struct kybrd_inode *mi = (struct kybrd_inode *)file->private_data;
-	wait_event(&hwait, mi->ready);
+	int ret = wait_event(&hwait, mi->ready);
+	if (ret < 0)
+		return ret;
 
 	memcpy(buf, &mi->packets[mi->head], sizeof(struct key_event));
 
@@ -3,10 +3,12 @@
 #include <cpu/hal.h>
 #include <cpu/idt.h>
 #include <cpu/pic.h>
+#include <cpu/softirq.h>
 #include <fs/char_dev.h>
 #include <fs/poll.h>
 #include <fs/vfs.h>
 #include <include/errno.h>
+#include <include/fcntl.h>
 #include <memory/vmm.h>
 #include <proc/task.h>
 #include <utils/debug.h>
@@ -26,11 +28,29 @@ static struct mouse_event current_mouse_motion;
 static struct list_head nodelist;
 static struct wait_queue_head hwait;
 
+static bool is_motion_event(struct mouse_event *event)
+{
+	return event->buttons == event->state;
+}
+
+// NOTE: MQ 2020-08-20
+// Relative motion is merged into the latest queued event if buttons haven't changed in between
+// -> reader only gets where mouse has ended up, button transitions are always kept
 void mouse_notify_readers(struct mouse_event *mm)
 {
+	lock_scheduler();
+
 	struct mouse_inode *iter;
 	list_for_each_entry(iter, &nodelist, sibling)
 	{
+		struct mouse_event *last = &iter->packets[iter->tail];
+		if (iter->ready && is_motion_event(last) && is_motion_event(mm) && last->buttons == mm->buttons)
+		{
+			last->x += mm->x;
+			last->y += mm->y;
+			continue;
+		}
+
 		if (iter->ready == true)
 		{
 			iter->tail = (iter->tail + 1) % MOUSE_PACKET_QUEUE_LEN;
@@ -43,6 +63,8 @@ void mouse_notify_readers(struct mouse_event *mm)
 		iter->packets[iter->tail] = *mm;
 		iter->ready = true;
 	}
+
+	unlock_scheduler();
 	wake_up(&hwait);
 }
 
@@ -59,7 +81,17 @@ static int mouse_open(struct vfs_inode *inode, struct vfs_file *file)
 static ssize_t mouse_read(struct vfs_file *file, char *buf, size_t count, loff_t ppos)
 {
 	struct mouse_inode *mi = (struct mouse_inode *)file->private_data;
-	wait_event(&hwait, mi->ready);
+	if (count < sizeof(struct mouse_event))
+		return -EINVAL;
+	if (!mi->ready && file->f_flags & O_NONBLOCK)
+		return -EAGAIN;
+
+	int ret = wait_event(&hwait, mi->ready);
+	if (ret < 0)
+		return ret;
+
+	// tasklet might merge motion into the event which is being copied
+	lock_scheduler();
 
 	memcpy(buf, &mi->packets[mi->head], sizeof(struct mouse_event));
 
@@ -68,7 +100,9 @@ static ssize_t mouse_read(struct vfs_file *file, char *buf, size_t count, loff_t
 	else
 		mi->ready = false;
 
-	return 0;
+	unlock_scheduler();
+
+	return sizeof(struct mouse_event);
 }
 
 static unsigned int mouse_poll(struct vfs_file *file, struct poll_table *pt)
@@ -141,6 +175,52 @@ static void mouse_calculate_position()
 	}
 }
 
+// NOTE: MQ 2020-08-12
+// irq assembles packets into events, waking readers is done in tasklet
+#define MOUSE_EVENT_RING_SIZE 32
+
+static struct mouse_event mouse_event_ring[MOUSE_EVENT_RING_SIZE];
+static volatile uint32_t mouse_event_head, mouse_event_tail;
+
+static void mouse_tasklet_func(unsigned long data)
+{
+	while (true)
+	{
+		// irq merges motion into the newest pending event, it has to be taken out atomically
+		lock_scheduler();
+		bool empty = mouse_event_tail == mouse_event_head;
+		struct mouse_event event;
+		if (!empty)
+		{
+			event = mouse_event_ring[mouse_event_tail % MOUSE_EVENT_RING_SIZE];
+			mouse_event_tail++;
+		}
+		unlock_scheduler();
+
+		if (empty)
+			break;
+		mouse_notify_readers(&event);
+	}
+}
+
+static DECLARE_TASKLET(mouse_tasklet, mouse_tasklet_func, 0);
+
+static void mouse_queue_event(struct mouse_event *event)
+{
+	struct mouse_event *last = &mouse_event_ring[(mouse_event_head - 1) % MOUSE_EVENT_RING_SIZE];
+	if (mouse_event_head != mouse_event_tail && is_motion_event(last) && is_motion_event(event) && last->buttons == event->buttons)
+	{
+		last->x += event->x;
+		last->y += event->y;
+	}
+	else if (mouse_event_head - mouse_event_tail < MOUSE_EVENT_RING_SIZE)
+	{
+		mouse_event_ring[mouse_event_head % MOUSE_EVENT_RING_SIZE] = *event;
+		mouse_event_head++;
+	}
+	tasklet_schedule(&mouse_tasklet);
+}
+
 static int32_t irq_mouse_handler(struct interrupt_registers *regs)
 {
 	uint8_t status = inportb(MOUSE_STATUS);
@@ -166,7 +246,7 @@ static int32_t irq_mouse_handler(struct interrupt_registers *regs)
 			mouse_calculate_position();
 			if (current_mouse_motion.x != 0 || current_mouse_motion.y != 0 ||
 				current_mouse_motion.buttons != 0 || prev_buttons != current_mouse_motion.buttons)
-				mouse_notify_readers(&current_mouse_motion);
+				mouse_queue_event(&current_mouse_motion);
 			break;
 		}
 	}
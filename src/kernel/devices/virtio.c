@@ -0,0 +1,176 @@
+#include "virtio.h"
+
+#include <cpu/hal.h>
+#include <include/errno.h>
+#include <memory/pmm.h>
+#include <memory/vmm.h>
+#include <utils/debug.h>
+#include <utils/string.h>
+
+// NOTE: MQ 2020-08-05 x86 doesn't reorder stores with other stores, only prevent compiler from doing it
+#define virtio_wmb() __asm__ __volatile__("" \
+										  :  \
+										  :  \
+										  : "memory")
+
+uint32_t virtio_get_features(uint32_t iobase)
+{
+	return inportl(iobase + VIRTIO_PCI_HOST_FEATURES);
+}
+
+void virtio_set_features(uint32_t iobase, uint32_t features)
+{
+	outportl(iobase + VIRTIO_PCI_GUEST_FEATURES, features);
+}
+
+void virtio_set_status(uint32_t iobase, uint8_t status)
+{
+	outportb(iobase + VIRTIO_PCI_STATUS, status);
+}
+
+// reading isr also acknowledges the interrupt
+uint8_t virtio_read_isr(uint32_t iobase)
+{
+	return inportb(iobase + VIRTIO_PCI_ISR);
+}
+
+// vring has to be physically contiguous, aligned by VIRTIO_PCI_VRING_ALIGN and VRING_SIZE(VIRTQ_MAX_SIZE) bytes
+int virtqueue_setup(struct virtqueue *vq, uint32_t iobase, uint16_t index, void *vring)
+{
+	outportw(iobase + VIRTIO_PCI_QUEUE_SEL, index);
+	uint16_t num = inportw(iobase + VIRTIO_PCI_QUEUE_NUM);
+	if (!num || num > VIRTQ_MAX_SIZE)
+	{
+		err("Virtio: queue %d has unsupported size %d", index, num);
+		return -EINVAL;
+	}
+
+	memset(vq, 0, sizeof(struct virtqueue));
+	memset(vring, 0, VRING_SIZE(num));
+	vq->iobase = iobase;
+	vq->index = index;
+	vq->num = num;
+	vq->desc = vring;
+	vq->avail = (struct vring_avail *)((uint8_t *)vring + sizeof(struct vring_desc) * num);
+	vq->used = (struct vring_used *)ALIGN_UP((uint32_t)&vq->avail->ring[num + 1], VIRTIO_PCI_VRING_ALIGN);
+
+	// free descriptors are chained via next
+	for (uint16_t i = 0; i < num - 1; ++i)
+		vq->desc[i].next = i + 1;
+	vq->free_head = 0;
+	vq->num_free = num;
+
+	outportl(iobase + VIRTIO_PCI_QUEUE_PFN, vmm_get_physical_address((uint32_t)vring, false) / PMM_FRAME_SIZE);
+	return 0;
+}
+
+// number of descriptors for a buffer, a descriptor never crosses a page (virtual -> physical is per page)
+static uint32_t virtqueue_count_desc(struct virtq_sg *sg)
+{
+	uint32_t start = (uint32_t)sg->addr;
+	if (!sg->len)
+		return 0;
+	return div_ceil(start + sg->len, PMM_FRAME_SIZE) - start / PMM_FRAME_SIZE;
+}
+
+// NOTE: MQ 2020-08-05
+// out buffers (device reads) go first then in buffers (device writes)
+// returns -ENOSPC if there are not enough free descriptors
+int virtqueue_add_buf(struct virtqueue *vq, struct virtq_sg *sg, uint32_t out, uint32_t in, void *token)
+{
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < out + in; ++i)
+		count += virtqueue_count_desc(&sg[i]);
+
+	if (!count || count > vq->num_free)
+		return -ENOSPC;
+
+	uint16_t head = vq->free_head;
+	uint16_t idx = head;
+	uint16_t prev = head;
+	for (uint32_t i = 0; i < out + in; ++i)
+	{
+		uint32_t addr = (uint32_t)sg[i].addr;
+		uint32_t remain = sg[i].len;
+		while (remain > 0)
+		{
+			uint32_t len = min(remain, (uint32_t)(PMM_FRAME_SIZE - (addr & (PMM_FRAME_SIZE - 1))));
+			struct vring_desc *desc = &vq->desc[idx];
+			desc->addr = vmm_get_physical_address(addr, false);
+			desc->len = len;
+			desc->flags = VRING_DESC_F_NEXT | (i >= out ? VRING_DESC_F_WRITE : 0);
+
+			addr += len;
+			remain -= len;
+			prev = idx;
+			idx = desc->next;
+		}
+	}
+	vq->desc[prev].flags &= ~VRING_DESC_F_NEXT;
+
+	vq->free_head = idx;
+	vq->num_free -= count;
+	vq->data[head] = token;
+
+	vq->avail->ring[(vq->avail->idx + vq->num_added) % vq->num] = head;
+	vq->num_added++;
+	return 0;
+}
+
+// publish added buffers and notify the device (unless it tells us not to)
+void virtqueue_kick(struct virtqueue *vq)
+{
+	virtio_wmb();
+	vq->avail->idx += vq->num_added;
+	vq->num_added = 0;
+	virtio_wmb();
+
+	if (!(vq->used->flags & VRING_USED_F_NO_NOTIFY))
+		outportw(vq->iobase + VIRTIO_PCI_QUEUE_NOTIFY, vq->index);
+}
+
+static void virtqueue_detach_buf(struct virtqueue *vq, uint16_t head)
+{
+	uint16_t idx = head;
+	uint16_t count = 1;
+	while (vq->desc[idx].flags & VRING_DESC_F_NEXT)
+	{
+		idx = vq->desc[idx].next;
+		count++;
+	}
+
+	vq->desc[idx].next = vq->free_head;
+	vq->free_head = head;
+	vq->num_free += count;
+	vq->data[head] = NULL;
+}
+
+// returns token of the next used buffer (or NULL), len is number of bytes device has written
+void *virtqueue_get_buf(struct virtqueue *vq, uint32_t *len)
+{
+	if (!virtqueue_has_used(vq))
+		return NULL;
+
+	struct vring_used_elem *elem = &vq->used->ring[vq->last_used_idx % vq->num];
+	uint16_t head = elem->id;
+	void *token = vq->data[head];
+	if (len)
+		*len = elem->len;
+
+	virtqueue_detach_buf(vq, head);
+	vq->last_used_idx++;
+	return token;
+}
+
+void virtqueue_disable_cb(struct virtqueue *vq)
+{
+	vq->avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
+}
+
+// re-enable interrupts, returns false if there are pending used buffers (caller should poll again)
+bool virtqueue_enable_cb(struct virtqueue *vq)
+{
+	vq->avail->flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+	virtio_wmb();
+	return !virtqueue_has_used(vq);
+}
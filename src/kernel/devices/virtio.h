@@ -0,0 +1,114 @@
+#ifndef DEVICES_VIRTIO_H
+#define DEVICES_VIRTIO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <utils/math.h>
+
+#define VIRTIO_VENDOR_ID 0x1AF4
+
+// legacy virtio pci (io bar0) registers
+#define VIRTIO_PCI_HOST_FEATURES 0x00
+#define VIRTIO_PCI_GUEST_FEATURES 0x04
+#define VIRTIO_PCI_QUEUE_PFN 0x08
+#define VIRTIO_PCI_QUEUE_NUM 0x0C
+#define VIRTIO_PCI_QUEUE_SEL 0x0E
+#define VIRTIO_PCI_QUEUE_NOTIFY 0x10
+#define VIRTIO_PCI_STATUS 0x12
+#define VIRTIO_PCI_ISR 0x13
+// device specific configuration (without msi-x)
+#define VIRTIO_PCI_CONFIG 0x14
+
+#define VIRTIO_PCI_VRING_ALIGN 4096
+
+#define VIRTIO_CONFIG_S_ACKNOWLEDGE 1
+#define VIRTIO_CONFIG_S_DRIVER 2
+#define VIRTIO_CONFIG_S_DRIVER_OK 4
+#define VIRTIO_CONFIG_S_FAILED 0x80
+
+#define VIRTIO_PCI_ISR_QUEUE 0x1
+#define VIRTIO_PCI_ISR_CONFIG 0x2
+
+#define VRING_DESC_F_NEXT 1
+#define VRING_DESC_F_WRITE 2
+
+#define VRING_AVAIL_F_NO_INTERRUPT 1
+#define VRING_USED_F_NO_NOTIFY 1
+
+// the biggest queue our static vring memory can hold
+#define VIRTQ_MAX_SIZE 256
+#define VRING_SIZE(num) (ALIGN_UP(sizeof(struct vring_desc) * (num) + sizeof(uint16_t) * (3 + (num)), VIRTIO_PCI_VRING_ALIGN) + \
+						 ALIGN_UP(sizeof(uint16_t) * 3 + sizeof(struct vring_used_elem) * (num), VIRTIO_PCI_VRING_ALIGN))
+
+struct vring_desc
+{
+	uint64_t addr;
+	uint32_t len;
+	uint16_t flags;
+	uint16_t next;
+};
+
+struct vring_avail
+{
+	uint16_t flags;
+	uint16_t idx;
+	uint16_t ring[];
+};
+
+struct vring_used_elem
+{
+	uint32_t id;
+	uint32_t len;
+};
+
+struct vring_used
+{
+	uint16_t flags;
+	uint16_t idx;
+	struct vring_used_elem ring[];
+};
+
+// scatter-gather entry, addr is kernel virtual address
+struct virtq_sg
+{
+	void *addr;
+	uint32_t len;
+};
+
+struct virtqueue
+{
+	uint32_t iobase;
+	uint16_t index;
+	uint16_t num;
+
+	struct vring_desc *desc;
+	struct vring_avail *avail;
+	struct vring_used *used;
+
+	uint16_t free_head;
+	uint16_t num_free;
+	uint16_t last_used_idx;
+	// number of buffers are added since the last notification
+	uint16_t num_added;
+
+	// token (e.g. sk_buff) is returned by virtqueue_get_buf
+	void *data[VIRTQ_MAX_SIZE];
+};
+
+uint32_t virtio_get_features(uint32_t iobase);
+void virtio_set_features(uint32_t iobase, uint32_t features);
+void virtio_set_status(uint32_t iobase, uint8_t status);
+uint8_t virtio_read_isr(uint32_t iobase);
+int virtqueue_setup(struct virtqueue *vq, uint32_t iobase, uint16_t index, void *vring);
+int virtqueue_add_buf(struct virtqueue *vq, struct virtq_sg *sg, uint32_t out, uint32_t in, void *token);
+void virtqueue_kick(struct virtqueue *vq);
+void *virtqueue_get_buf(struct virtqueue *vq, uint32_t *len);
+void virtqueue_disable_cb(struct virtqueue *vq);
+bool virtqueue_enable_cb(struct virtqueue *vq);
+
+static inline bool virtqueue_has_used(struct virtqueue *vq)
+{
+	return vq->last_used_idx != *(volatile uint16_t *)&vq->used->idx;
+}
+
+#endif
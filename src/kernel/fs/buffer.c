@@ -3,9 +3,11 @@
 #include <devices/ata.h>
 #include <memory/vmm.h>
 #include <utils/math.h>
+#include <utils/trace.h>
 
 char *bread(char *dev_name, sector_t sector, uint32_t size)
 {
+	trace(TRACE_BREAD, sector, size);
 	struct ata_device *device = get_ata_device(dev_name);
 	char *buf = kcalloc(div_ceil(size, BYTES_PER_SECTOR) * BYTES_PER_SECTOR, sizeof(char));
 	ata_read(device, sector, div_ceil(size, BYTES_PER_SECTOR), (uint16_t *)buf);
@@ -0,0 +1,372 @@
+#include "eventpoll.h"
+
+#include <cpu/hal.h>
+#include <fs/vfs.h>
+#include <include/errno.h>
+#include <include/fcntl.h>
+#include <memory/vmm.h>
+#include <proc/task.h>
+#include <system/time.h>
+#include <utils/debug.h>
+
+struct ep_pqueue
+{
+	struct poll_table pt;
+	struct epitem *epi;
+};
+
+static struct vfs_file_operations eventpoll_fops;
+
+static bool is_file_epoll(struct vfs_file *file)
+{
+	return file->f_op == &eventpoll_fops;
+}
+
+// item's file has new events -> put it into ready list and wake up waiters
+static void ep_poll_callback(struct wait_queue_entry *wait)
+{
+	struct eppoll_entry *pwq = container_of(wait, struct eppoll_entry, wait);
+	struct epitem *epi = pwq->epi;
+	struct eventpoll *ep = epi->ep;
+
+	uint32_t flags = irq_save();
+	// oneshot item is disabled after reporting until it is re-armed via EPOLL_CTL_MOD
+	if ((epi->event.events & ~EP_PRIVATE_BITS) && list_empty(&epi->rdllink))
+		list_add_tail(&epi->rdllink, &ep->rdllist);
+	irq_restore(flags);
+
+	wake_up(&ep->wq);
+	wake_up(&ep->poll_wait);
+}
+
+static void ep_ptable_queue_proc(struct vfs_file *file, struct wait_queue_head *wh, struct poll_table *pt)
+{
+	struct epitem *epi = container_of(pt, struct ep_pqueue, pt)->epi;
+
+	struct eppoll_entry *pwq = kcalloc(1, sizeof(struct eppoll_entry));
+	pwq->epi = epi;
+	pwq->whead = wh;
+	pwq->wait.func = ep_poll_callback;
+
+	uint32_t flags = irq_save();
+	list_add_tail(&pwq->wait.sibling, &wh->list);
+	irq_restore(flags);
+
+	list_add_tail(&pwq->sibling, &epi->pwqlist);
+}
+
+static void ep_mark_ready(struct eventpoll *ep, struct epitem *epi)
+{
+	uint32_t flags = irq_save();
+	if (list_empty(&epi->rdllink))
+		list_add_tail(&epi->rdllink, &ep->rdllist);
+	irq_restore(flags);
+
+	wake_up(&ep->wq);
+	wake_up(&ep->poll_wait);
+}
+
+static struct epitem *ep_find(struct eventpoll *ep, int32_t fd, struct vfs_file *file)
+{
+	struct epitem *epi;
+	list_for_each_entry(epi, &ep->items, sibling)
+	{
+		if (epi->fd == fd && epi->file == file)
+			return epi;
+	}
+	return NULL;
+}
+
+static int ep_insert(struct eventpoll *ep, struct epoll_event *event, struct vfs_file *file, int32_t fd)
+{
+	struct epitem *epi = kcalloc(1, sizeof(struct epitem));
+	epi->fd = fd;
+	epi->file = file;
+	epi->ep = ep;
+	epi->event = *event;
+	INIT_LIST_HEAD(&epi->rdllink);
+	INIT_LIST_HEAD(&epi->pwqlist);
+	list_add_tail(&epi->sibling, &ep->items);
+	list_add_tail(&epi->fllink, &file->f_ep_links);
+
+	// wait queue entries are registered once and stay until item is removed
+	struct ep_pqueue epq = {.epi = epi};
+	INIT_LIST_HEAD(&epq.pt.list);
+	epq.pt.qproc = ep_ptable_queue_proc;
+
+	uint32_t revents = file->f_op->poll(file, &epq.pt);
+	if (revents & event->events)
+		ep_mark_ready(ep, epi);
+
+	return 0;
+}
+
+static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_event *event)
+{
+	epi->event = *event;
+
+	uint32_t revents = epi->file->f_op->poll(epi->file, NULL);
+	if (revents & event->events)
+		ep_mark_ready(ep, epi);
+
+	return 0;
+}
+
+static void ep_remove(struct eventpoll *ep, struct epitem *epi)
+{
+	struct eppoll_entry *pwq, *next;
+	list_for_each_entry_safe(pwq, next, &epi->pwqlist, sibling)
+	{
+		uint32_t flags = irq_save();
+		list_del(&pwq->wait.sibling);
+		irq_restore(flags);
+
+		list_del(&pwq->sibling);
+		kfree(pwq);
+	}
+
+	uint32_t flags = irq_save();
+	if (!list_empty(&epi->rdllink))
+		list_del(&epi->rdllink);
+	irq_restore(flags);
+
+	list_del(&epi->sibling);
+	list_del(&epi->fllink);
+	kfree(epi);
+}
+
+// NOTE: MQ 2020-08-08
+// only ready items are polled again, level-triggered ones which are still ready go back to ready list
+// edge-triggered ones wait for the next wakeup from their file
+static int ep_send_events(struct eventpoll *ep, struct epoll_event *events, int32_t maxevents)
+{
+	struct list_head txlist;
+	INIT_LIST_HEAD(&txlist);
+
+	uint32_t flags = irq_save();
+	list_splice_init(&ep->rdllist, &txlist);
+	irq_restore(flags);
+
+	int32_t nr = 0;
+	struct epitem *epi, *next;
+	list_for_each_entry_safe(epi, next, &txlist, rdllink)
+	{
+		if (nr >= maxevents)
+			break;
+
+		flags = irq_save();
+		list_del_init(&epi->rdllink);
+		irq_restore(flags);
+
+		uint32_t revents = epi->file->f_op->poll(epi->file, NULL) & epi->event.events;
+		if (!revents)
+			continue;
+
+		events[nr].events = revents;
+		events[nr].data = epi->event.data;
+		nr++;
+
+		if (epi->event.events & EPOLLONESHOT)
+			epi->event.events &= EP_PRIVATE_BITS;
+		else if (!(epi->event.events & EPOLLET))
+		{
+			flags = irq_save();
+			if (list_empty(&epi->rdllink))
+				list_add_tail(&epi->rdllink, &ep->rdllist);
+			irq_restore(flags);
+		}
+	}
+
+	// items which don't fit into events are reported first next time
+	flags = irq_save();
+	list_splice(&txlist, &ep->rdllist);
+	irq_restore(flags);
+
+	return nr;
+}
+
+static unsigned int ep_eventpoll_poll(struct vfs_file *file, struct poll_table *pt)
+{
+	struct eventpoll *ep = file->private_data;
+	poll_wait(file, &ep->poll_wait, pt);
+
+	return list_empty(&ep->rdllist) ? 0 : POLLIN | POLLRDNORM;
+}
+
+static int ep_eventpoll_release(struct vfs_inode *inode, struct vfs_file *file)
+{
+	struct eventpoll *ep = file->private_data;
+
+	mutex_lock(&ep->mtx);
+	struct epitem *epi, *next;
+	list_for_each_entry_safe(epi, next, &ep->items, sibling)
+	{
+		ep_remove(ep, epi);
+	}
+	mutex_unlock(&ep->mtx);
+
+	kfree(ep);
+	return 0;
+}
+
+static struct vfs_file_operations eventpoll_fops = {
+	.poll = ep_eventpoll_poll,
+	.release = ep_eventpoll_release,
+};
+
+int do_epoll_create(int32_t size)
+{
+	if (size <= 0)
+		return -EINVAL;
+
+	int32_t fd = find_unused_fd_slot(0);
+	if (fd < 0)
+		return fd;
+
+	struct eventpoll *ep = kcalloc(1, sizeof(struct eventpoll));
+	mutex_init(&ep->mtx);
+	INIT_LIST_HEAD(&ep->wq.list);
+	INIT_LIST_HEAD(&ep->poll_wait.list);
+	INIT_LIST_HEAD(&ep->rdllist);
+	INIT_LIST_HEAD(&ep->items);
+
+	struct vfs_inode *inode = init_inode();
+	inode->i_fop = &eventpoll_fops;
+	struct vfs_dentry *dentry = kcalloc(1, sizeof(struct vfs_dentry));
+	dentry->d_inode = inode;
+
+	struct vfs_file *file = get_empty_filp();
+	file->f_flags = O_RDWR;
+	file->f_op = &eventpoll_fops;
+	file->f_dentry = dentry;
+	file->private_data = ep;
+
+	fd_install(fd, file);
+	return fd;
+}
+
+int do_epoll_ctl(int32_t epfd, int32_t op, int32_t fd, struct epoll_event *event)
+{
+	struct vfs_file *epfile = fcheck(epfd);
+	struct vfs_file *file = fcheck(fd);
+	if (!epfile || !file)
+		return -EBADF;
+
+	if (!file->f_op || !file->f_op->poll)
+		return -EPERM;
+
+	if (!is_file_epoll(epfile) || file == epfile)
+		return -EINVAL;
+
+	// nested epoll is not supported
+	if (is_file_epoll(file))
+		return -EINVAL;
+
+	if (op != EPOLL_CTL_DEL && !event)
+		return -EFAULT;
+
+	struct eventpoll *ep = epfile->private_data;
+	mutex_lock(&ep->mtx);
+
+	int ret = 0;
+	struct epitem *epi = ep_find(ep, fd, file);
+	struct epoll_event epds;
+	if (event)
+	{
+		epds = *event;
+		// errors and hang up are always reported
+		epds.events |= EPOLLERR | EPOLLHUP;
+	}
+
+	switch (op)
+	{
+	case EPOLL_CTL_ADD:
+		ret = epi ? -EEXIST : ep_insert(ep, &epds, file, fd);
+		break;
+
+	case EPOLL_CTL_DEL:
+		if (epi)
+			ep_remove(ep, epi);
+		else
+			ret = -ENOENT;
+		break;
+
+	case EPOLL_CTL_MOD:
+		ret = epi ? ep_modify(ep, epi, &epds) : -ENOENT;
+		break;
+
+	default:
+		ret = -EINVAL;
+		break;
+	}
+
+	mutex_unlock(&ep->mtx);
+	return ret;
+}
+
+// timeout in milliseconds, negative value means waiting forever, zero returns immediately
+int do_epoll_wait(int32_t epfd, struct epoll_event *events, int32_t maxevents, int32_t timeout)
+{
+	if (maxevents <= 0)
+		return -EINVAL;
+
+	struct vfs_file *epfile = fcheck(epfd);
+	if (!epfile)
+		return -EBADF;
+	if (!is_file_epoll(epfile))
+		return -EINVAL;
+
+	struct eventpoll *ep = epfile->private_data;
+	uint64_t expires = timeout > 0 ? get_milliseconds(NULL) + timeout : 0;
+	if (expires)
+		mod_timer(&current_thread->sleep_timer, expires);
+
+	DEFINE_WAIT(wait);
+	uint32_t flags = irq_save();
+	list_add_tail(&wait.sibling, &ep->wq.list);
+	irq_restore(flags);
+
+	int32_t nr;
+	while (true)
+	{
+		mutex_lock(&ep->mtx);
+		nr = ep_send_events(ep, events, maxevents);
+		mutex_unlock(&ep->mtx);
+
+		if (nr || !timeout || (expires && get_milliseconds(NULL) >= expires))
+			break;
+		if (fatal_signal_pending(current_thread))
+		{
+			nr = -EINTR;
+			break;
+		}
+
+		// interrupts are disabled -> wakeup between collecting events and going to sleep is not lost
+		lock_scheduler();
+		if (list_empty(&ep->rdllist) && !(expires && get_milliseconds(NULL) >= expires))
+			update_thread(current_thread, THREAD_WAITING);
+		unlock_scheduler();
+		schedule();
+	}
+
+	flags = irq_save();
+	list_del(&wait.sibling);
+	irq_restore(flags);
+
+	if (expires)
+		del_timer(&current_thread->sleep_timer);
+	return nr;
+}
+
+// file is about to be freed, remove it from all interest lists
+void eventpoll_release(struct vfs_file *file)
+{
+	struct epitem *epi, *next;
+	list_for_each_entry_safe(epi, next, &file->f_ep_links, fllink)
+	{
+		struct eventpoll *ep = epi->ep;
+		mutex_lock(&ep->mtx);
+		ep_remove(ep, epi);
+		mutex_unlock(&ep->mtx);
+	}
+}
@@ -0,0 +1,87 @@
+#ifndef FS_EVENTPOLL_H
+#define FS_EVENTPOLL_H
+
+#include <fs/poll.h>
+#include <include/list.h>
+#include <locking/mutex.h>
+#include <proc/wait.h>
+#include <stdint.h>
+
+#define EPOLLIN POLLIN
+#define EPOLLPRI POLLPRI
+#define EPOLLOUT POLLOUT
+#define EPOLLERR POLLERR
+#define EPOLLHUP POLLHUP
+#define EPOLLRDNORM POLLRDNORM
+#define EPOLLRDBAND POLLRDBAND
+#define EPOLLWRNORM POLLWRNORM
+#define EPOLLWRBAND POLLWRBAND
+#define EPOLLMSG POLLMSG
+#define EPOLLONESHOT (1u << 30)
+#define EPOLLET (1u << 31)
+
+// flags which only change how an item is reported
+#define EP_PRIVATE_BITS (EPOLLONESHOT | EPOLLET)
+
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+typedef union epoll_data
+{
+	void *ptr;
+	int32_t fd;
+	uint32_t u32;
+	uint64_t u64;
+} epoll_data_t;
+
+struct __attribute__((packed)) epoll_event
+{
+	uint32_t events;
+	epoll_data_t data;
+};
+
+// NOTE: MQ 2020-08-08
+// Interest list lives as long as epoll file, each item keeps its wait queue entries registered
+// file's wake_up only moves the item into ready list -> epoll_wait only looks at ready items
+struct eventpoll
+{
+	struct mutex mtx;
+	// threads in epoll_wait
+	struct wait_queue_head wq;
+	// epoll file itself is polled
+	struct wait_queue_head poll_wait;
+	struct list_head rdllist;
+	struct list_head items;
+};
+
+struct epitem
+{
+	int32_t fd;
+	struct vfs_file *file;
+	struct eventpoll *ep;
+	struct epoll_event event;
+	// in eventpoll's items
+	struct list_head sibling;
+	// in eventpoll's rdllist, empty if item is not ready
+	struct list_head rdllink;
+	// in file's f_ep_links
+	struct list_head fllink;
+	struct list_head pwqlist;
+};
+
+// wait queue entry of an item in one of file's wait queues
+struct eppoll_entry
+{
+	struct epitem *epi;
+	struct wait_queue_head *whead;
+	struct wait_queue_entry wait;
+	struct list_head sibling;
+};
+
+int do_epoll_create(int32_t size);
+int do_epoll_ctl(int32_t epfd, int32_t op, int32_t fd, struct epoll_event *event);
+int do_epoll_wait(int32_t epfd, struct epoll_event *events, int32_t maxevents, int32_t timeout);
+void eventpoll_release(struct vfs_file *file);
+
+#endif
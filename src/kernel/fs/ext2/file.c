@@ -37,7 +37,8 @@ static ssize_t ext2_read_file(struct vfs_file *file, char *buf, size_t count, lo
 	struct ext2_inode *ei = EXT2_INODE(inode);
 	struct vfs_superblock *sb = inode->i_sb;
 
-	count = min_t(size_t, ppos + count, ei->i_size) - ppos;
+	// raw inode's size is only updated at write-back
+	count = min_t(size_t, ppos + count, inode->i_size) - ppos;
 	uint32_t p = (ppos / sb->s_blocksize) * sb->s_blocksize;
 	char *iter_buf = buf;
 	while (p < ppos + count)
@@ -69,8 +70,10 @@ static ssize_t ext2_write_file(struct vfs_file *file, const char *buf, size_t co
 	{
 		inode->i_size = ppos + count;
 		inode->i_blocks = div_ceil(ppos + count, BYTES_PER_SECTOR);
-		sb->s_op->write_inode(inode);
+		mark_inode_dirty(inode, I_DIRTY_DATASYNC);
 	}
+	inode->i_mtime.tv_sec = get_seconds(NULL);
+	mark_inode_dirty(inode, I_DIRTY_SYNC);
 
 	uint32_t p = (ppos / sb->s_blocksize) * sb->s_blocksize;
 	char *iter_buf = buf;
@@ -86,8 +89,7 @@ static ssize_t ext2_write_file(struct vfs_file *file, const char *buf, size_t co
 			{
 				block = ext2_create_block(sb);
 				ei->i_block[relative_block] = block;
-				inode->i_mtime.tv_sec = get_seconds(NULL);
-				sb->s_op->write_inode(inode);
+				mark_inode_dirty(inode, I_DIRTY_DATASYNC);
 			}
 		}
 		else
@@ -132,8 +134,9 @@ static int ext2_readdir(struct vfs_file *file, struct dirent *dirent, unsigned i
 static int ext2_mmap_file(struct vfs_file *file, struct vm_area_struct *new_vma)
 {
 	int length = new_vma->vm_end - new_vma->vm_start;
-	kalign_heap(PMM_FRAME_SIZE);
-	char *buf = kcalloc(length, sizeof(char));
+	char *buf = vmalloc(length);
+	if (!buf)
+		return -ENOMEM;
 	loff_t pos = file->f_pos;
 	ext2_read_file(file, buf, length, file->f_pos);
 	file->f_pos = pos;
@@ -129,7 +129,7 @@ static int ext2_create_entry(struct vfs_superblock *sb, struct vfs_inode *dir, s
 			ei->i_block[i] = block;
 			dir->i_blocks += 1;
 			dir->i_size += sb->s_blocksize;
-			ext2_write_inode(dir);
+			mark_inode_dirty(dir, I_DIRTY_DATASYNC);
 		}
 		if (ext2_add_entry(sb, block, dentry) >= 0)
 			return 0;
@@ -251,6 +251,7 @@ static struct vfs_inode *ext2_create_inode(struct vfs_inode *dir, struct vfs_den
 	inode->i_size = 0;
 	inode->i_fs_info = ei_new;
 	inode->i_sb = sb;
+	insert_inode_hash(inode);
 	inode->i_atime.tv_sec = get_seconds(NULL);
 	inode->i_ctime.tv_sec = get_seconds(NULL);
 	inode->i_mtime.tv_sec = get_seconds(NULL);
@@ -274,7 +275,6 @@ static struct vfs_inode *ext2_create_inode(struct vfs_inode *dir, struct vfs_den
 		ei->i_block[0] = block;
 		inode->i_blocks += 1;
 		inode->i_size += sb->s_blocksize;
-		ext2_write_inode(inode);
 
 		char *block_buf = ext2_bread_block(inode->i_sb, block);
 
@@ -297,6 +297,7 @@ static struct vfs_inode *ext2_create_inode(struct vfs_inode *dir, struct vfs_den
 	else
 		assert_not_reached();
 
+	// written right away, inode table slot might still contain a deleted inode
 	sb->s_op->write_inode(inode);
 	dentry->d_inode = inode;
 
@@ -310,7 +311,7 @@ static struct vfs_inode *ext2_lookup_inode(struct vfs_inode *dir, struct vfs_den
 	struct ext2_inode *ei = EXT2_INODE(dir);
 	struct vfs_superblock *sb = dir->i_sb;
 
-	for (int i = 0, ino = 0; i < ei->i_blocks; ++i)
+	for (int i = 0, ino = 0; i < dir->i_blocks; ++i)
 	{
 		if (!ei->i_block[i])
 			continue;
@@ -320,10 +321,7 @@ static struct vfs_inode *ext2_lookup_inode(struct vfs_inode *dir, struct vfs_den
 			((EXT2_INO_UPPER_LEVEL1 <= i && i < EXT2_INO_UPPER_LEVEL2) && (ino = ext2_recursive_block_action(sb, 2, ei->i_block[13], dentry->d_name, ext2_find_ino)) > 0) ||
 			((EXT2_INO_UPPER_LEVEL2 <= i && i < EXT2_INO_UPPER_LEVEL3) && (ino = ext2_recursive_block_action(sb, 3, ei->i_block[14], dentry->d_name, ext2_find_ino)) > 0))
 		{
-			struct vfs_inode *inode = dir->i_sb->s_op->alloc_inode(dir->i_sb);
-			inode->i_ino = ino;
-			ext2_read_inode(inode);
-			return inode;
+			return iget(dir->i_sb, ino);
 		}
 	}
 	return NULL;
@@ -336,7 +334,7 @@ static int ext2_mknod(struct vfs_inode *dir, struct vfs_dentry *dentry, int mode
 		inode = ext2_create_inode(dir, dentry, mode);
 	inode->i_rdev = dev;
 	init_special_inode(inode, mode, dev);
-	ext2_write_inode(inode);
+	mark_inode_dirty(inode, I_DIRTY_SYNC);
 
 	dentry->d_inode = inode;
 	return 0;
@@ -347,7 +345,7 @@ static int ext2_unlink(struct vfs_inode *dir, struct vfs_dentry *dentry)
 	struct ext2_inode *ei = EXT2_INODE(dir);
 	struct vfs_superblock *sb = dir->i_sb;
 
-	for (int i = 0, ino = 0; i < ei->i_blocks; ++i)
+	for (int i = 0, ino = 0; i < dir->i_blocks; ++i)
 	{
 		if (!ei->i_block[i])
 			continue;
@@ -357,13 +355,11 @@ static int ext2_unlink(struct vfs_inode *dir, struct vfs_dentry *dentry)
 			((EXT2_INO_UPPER_LEVEL1 <= i && i < EXT2_INO_UPPER_LEVEL2) && (ino = ext2_recursive_block_action(sb, 2, ei->i_block[13], dentry->d_name, ext2_delete_entry)) > 0) ||
 			((EXT2_INO_UPPER_LEVEL2 <= i && i < EXT2_INO_UPPER_LEVEL3) && (ino = ext2_recursive_block_action(sb, 3, ei->i_block[14], dentry->d_name, ext2_delete_entry)) > 0))
 		{
-			struct vfs_inode *inode = dir->i_sb->s_op->alloc_inode(dir->i_sb);
-			inode->i_ino = ino;
-			ext2_read_inode(inode);
-
+			struct vfs_inode *inode = iget(dir->i_sb, ino);
 			inode->i_nlink -= 1;
-			ext2_write_inode(inode);
+			mark_inode_dirty(inode, I_DIRTY_SYNC);
 			// TODO: If i_nlink == 0, should we delete ext2 inode?
+			iput(inode);
 			break;
 		}
 	}
@@ -373,8 +369,17 @@ static int ext2_unlink(struct vfs_inode *dir, struct vfs_dentry *dentry)
 static int ext2_rename(struct vfs_inode *old_dir, struct vfs_dentry *old_dentry,
 					   struct vfs_inode *new_dir, struct vfs_dentry *new_dentry)
 {
-	new_dentry->d_inode = old_dentry->d_inode;
-	return ext2_create_entry(new_dir->i_sb, new_dir, new_dentry);
+	struct vfs_inode *inode = old_dentry->d_inode;
+	new_dentry->d_inode = inode;
+
+	int ret = ext2_create_entry(new_dir->i_sb, new_dir, new_dentry);
+	// old entry is unlinked afterward
+	if (ret >= 0)
+	{
+		inode->i_nlink += 1;
+		mark_inode_dirty(inode, I_DIRTY_SYNC);
+	}
+	return ret;
 }
 
 static void ext2_truncate_inode(struct vfs_inode *i)
@@ -32,16 +32,17 @@ void ext2_write_group_desc(struct vfs_superblock *sb, struct ext2_group_desc *gd
 	ext2_bwrite_block(sb, block, group_block_buf);
 }
 
-static struct ext2_inode *ext2_get_inode(struct vfs_superblock *sb, ino_t ino)
+// inode table block which holds `ino` and inode's offset in it
+static uint32_t ext2_inode_block(struct vfs_superblock *sb, ino_t ino, uint32_t *offset)
 {
 	struct ext2_superblock *ext2_sb = EXT2_SB(sb);
 	uint32_t group = get_group_from_inode(ext2_sb, ino);
 	struct ext2_group_desc *gdp = ext2_get_group_desc(sb, group);
 	uint32_t block = gdp->bg_inode_table + get_relative_inode_in_group(ext2_sb, ino) / EXT2_INODES_PER_BLOCK(ext2_sb);
-	uint32_t offset = (get_relative_inode_in_group(ext2_sb, ino) % EXT2_INODES_PER_BLOCK(ext2_sb)) * sizeof(struct ext2_inode);
-	char *table_buf = ext2_bread_block(sb, block);
+	*offset = (get_relative_inode_in_group(ext2_sb, ino) % EXT2_INODES_PER_BLOCK(ext2_sb)) * sizeof(struct ext2_inode);
+	kfree(gdp);
 
-	return (struct ext2_inode *)(table_buf + offset);
+	return block;
 }
 
 struct vfs_inode *ext2_alloc_inode(struct vfs_superblock *sb)
@@ -53,9 +54,15 @@ struct vfs_inode *ext2_alloc_inode(struct vfs_superblock *sb)
 	return i;
 }
 
+// raw inode is copied out of inode table block, cached inode doesn't pin the whole block
 void ext2_read_inode(struct vfs_inode *i)
 {
-	struct ext2_inode *raw_node = ext2_get_inode(i->i_sb, i->i_ino);
+	uint32_t offset;
+	uint32_t block = ext2_inode_block(i->i_sb, i->i_ino, &offset);
+	char *table_buf = ext2_bread_block(i->i_sb, block);
+	struct ext2_inode *raw_node = kcalloc(1, sizeof(struct ext2_inode));
+	memcpy(raw_node, table_buf + offset, sizeof(struct ext2_inode));
+	kfree(table_buf);
 
 	i->i_mode = raw_node->i_mode;
 	i->i_gid = raw_node->i_gid;
@@ -92,7 +99,6 @@ void ext2_read_inode(struct vfs_inode *i)
 
 void ext2_write_inode(struct vfs_inode *i)
 {
-	struct ext2_superblock *ext2_sb = EXT2_SB(i->i_sb);
 	struct ext2_inode *ei = EXT2_INODE(i);
 
 	ei->i_mode = i->i_mode;
@@ -111,14 +117,19 @@ void ext2_write_inode(struct vfs_inode *i)
 	if (S_ISCHR(i->i_mode))
 		ei->i_block[0] = i->i_rdev;
 
-	uint32_t group = get_group_from_inode(ext2_sb, i->i_ino);
-	struct ext2_group_desc *gdp = ext2_get_group_desc(i->i_sb, group);
-	uint32_t block = gdp->bg_inode_table + get_relative_inode_in_group(ext2_sb, i->i_ino) / EXT2_INODES_PER_BLOCK(ext2_sb);
-	uint32_t offset = (get_relative_inode_in_group(ext2_sb, i->i_ino) % EXT2_INODES_PER_BLOCK(ext2_sb)) * sizeof(struct ext2_inode);
+	uint32_t offset;
+	uint32_t block = ext2_inode_block(i->i_sb, i->i_ino, &offset);
 	char *buf = ext2_bread_block(i->i_sb, block);
 
 	memcpy(buf + offset, ei, sizeof(struct ext2_inode));
 	ext2_bwrite_block(i->i_sb, block, buf);
+	kfree(buf);
+}
+
+static void ext2_destroy_inode(struct vfs_inode *i)
+{
+	kfree(i->i_fs_info);
+	kfree(i);
 }
 
 static void ext2_write_super(struct vfs_superblock *sb)
@@ -131,6 +142,7 @@ struct vfs_super_operations ext2_super_operations = {
 	.alloc_inode = ext2_alloc_inode,
 	.read_inode = ext2_read_inode,
 	.write_inode = ext2_write_inode,
+	.destroy_inode = ext2_destroy_inode,
 	.write_super = ext2_write_super,
 };
 
@@ -160,9 +172,7 @@ static struct vfs_mount *ext2_mount(struct vfs_file_system_type *fs_type,
 	sb->s_type = fs_type;
 	ext2_fill_super(sb);
 
-	struct vfs_inode *i_root = ext2_alloc_inode(sb);
-	i_root->i_ino = EXT2_ROOT_INO;
-	ext2_read_inode(i_root);
+	struct vfs_inode *i_root = iget(sb, EXT2_ROOT_INO);
 
 	struct vfs_dentry *d_root = alloc_dentry(NULL, dir_name);
 	d_root->d_inode = i_root;
@@ -5,7 +5,7 @@
 
 int do_fcntl(int fd, int cmd, unsigned long arg)
 {
-	struct vfs_file *filp = current_process->files->fd[fd];
+	struct vfs_file *filp = fcheck(fd);
 	if (!filp)
 		return -EBADF;
 
@@ -13,15 +13,20 @@ int do_fcntl(int fd, int cmd, unsigned long arg)
 	switch (cmd)
 	{
 	case F_DUPFD:
+	case F_DUPFD_CLOEXEC:
 		if ((ret = find_unused_fd_slot(arg)) < 0)
-			return -EMFILE;
-		current_process->files->fd[ret] = filp;
+			return ret == -EINVAL ? ret : -EMFILE;
+		atomic_inc(&filp->f_count);
+		fd_install(ret, filp);
+		if (cmd == F_DUPFD_CLOEXEC)
+			set_close_on_exec(ret, true);
 		break;
+	// close-on-exec belongs to descriptor, not to file which might be shared by dup/fork
 	case F_GETFD:
-		ret = filp->f_flags;
+		ret = get_close_on_exec(fd) ? FD_CLOEXEC : 0;
 		break;
 	case F_SETFD:
-		filp->f_flags = arg;
+		set_close_on_exec(fd, arg & FD_CLOEXEC);
 		break;
 	case F_GETFL:
 		ret = filp->f_mode;
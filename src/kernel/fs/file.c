@@ -0,0 +1,365 @@
+#include <fs/eventpoll.h>
+#include <include/errno.h>
+#include <proc/task.h>
+#include <utils/debug.h>
+#include <utils/math.h>
+#include <utils/string.h>
+
+#include "vfs.h"
+
+// NOTE: MQ 2020-08-21
+// File descriptor table starts with NR_OPEN_DEFAULT embedded slots and is doubled when it is full
+// open_fds has a bit per used (or reserved) slot -> allocation is find-first-zero from next_fd,
+// fork/exit/close_range/exec only visit set bits instead of every slot
+#define BITS_PER_WORD 32
+
+static uint32_t find_next_bit_with(const uint32_t *map, uint32_t size, uint32_t start, uint32_t invert)
+{
+	for (uint32_t idx = start / BITS_PER_WORD; idx * BITS_PER_WORD < size; ++idx)
+	{
+		uint32_t word = map[idx] ^ invert;
+		if (idx == start / BITS_PER_WORD)
+			word &= ~0u << (start % BITS_PER_WORD);
+		if (word)
+			return min_t(uint32_t, idx * BITS_PER_WORD + __builtin_ctz(word), size);
+	}
+	return size;
+}
+
+static uint32_t find_next_bit(const uint32_t *map, uint32_t size, uint32_t start)
+{
+	return find_next_bit_with(map, size, start, 0);
+}
+
+static uint32_t find_next_zero_bit(const uint32_t *map, uint32_t size, uint32_t start)
+{
+	return find_next_bit_with(map, size, start, ~0u);
+}
+
+#define for_each_set_bit(bit, map, size) \
+	for ((bit) = find_next_bit((map), (size), 0); (bit) < (size); (bit) = find_next_bit((map), (size), (bit) + 1))
+
+static void set_bit(uint32_t nr, uint32_t *map)
+{
+	map[nr / BITS_PER_WORD] |= 1u << (nr % BITS_PER_WORD);
+}
+
+static void clear_bit(uint32_t nr, uint32_t *map)
+{
+	map[nr / BITS_PER_WORD] &= ~(1u << (nr % BITS_PER_WORD));
+}
+
+static bool test_bit(uint32_t nr, const uint32_t *map)
+{
+	return map[nr / BITS_PER_WORD] & (1u << (nr % BITS_PER_WORD));
+}
+
+static bool is_embedded_table(struct files_struct *files)
+{
+	return files->fd == files->fd_array;
+}
+
+static void free_table(struct files_struct *files)
+{
+	if (is_embedded_table(files))
+		return;
+
+	kfree(files->fd);
+	kfree(files->open_fds);
+	kfree(files->close_on_exec);
+}
+
+static void init_files(struct files_struct *files)
+{
+	mutex_init(&files->lock);
+	files->max_fds = NR_OPEN_DEFAULT;
+	files->fd = files->fd_array;
+	files->open_fds = files->open_fds_init;
+	files->close_on_exec = files->close_on_exec_init;
+}
+
+static int resize_table(struct files_struct *files, uint32_t max_fds)
+{
+	struct vfs_file **fd = kcalloc(max_fds, sizeof(struct vfs_file *));
+	uint32_t *open_fds = kcalloc(max_fds / BITS_PER_WORD, sizeof(uint32_t));
+	uint32_t *close_on_exec = kcalloc(max_fds / BITS_PER_WORD, sizeof(uint32_t));
+	if (!fd || !open_fds || !close_on_exec)
+	{
+		kfree(fd);
+		kfree(open_fds);
+		kfree(close_on_exec);
+		return -ENOMEM;
+	}
+
+	memcpy(fd, files->fd, files->max_fds * sizeof(struct vfs_file *));
+	memcpy(open_fds, files->open_fds, files->max_fds / BITS_PER_WORD * sizeof(uint32_t));
+	memcpy(close_on_exec, files->close_on_exec, files->max_fds / BITS_PER_WORD * sizeof(uint32_t));
+
+	free_table(files);
+	files->fd = fd;
+	files->open_fds = open_fds;
+	files->close_on_exec = close_on_exec;
+	files->max_fds = max_fds;
+	return 0;
+}
+
+// files->lock has to be held, make sure `nr` is a valid slot
+static int expand_files(struct files_struct *files, uint32_t nr)
+{
+	if (nr < files->max_fds)
+		return 0;
+	if (nr >= NR_OPEN_MAX)
+		return -EMFILE;
+
+	uint32_t max_fds = files->max_fds;
+	while (max_fds <= nr)
+		max_fds *= 2;
+	return resize_table(files, min_t(uint32_t, max_fds, NR_OPEN_MAX));
+}
+
+struct files_struct *alloc_files()
+{
+	struct files_struct *files = kcalloc(1, sizeof(struct files_struct));
+	init_files(files);
+	return files;
+}
+
+// NOTE: MQ 2019-12-30 Increasing file description usage when forking because child refers to the same one
+struct files_struct *dup_files(struct files_struct *old)
+{
+	struct files_struct *files = alloc_files();
+
+	mutex_lock(&old->lock);
+	if (old->max_fds > files->max_fds && resize_table(files, old->max_fds) < 0)
+	{
+		mutex_unlock(&old->lock);
+		free_files(files);
+		return NULL;
+	}
+
+	uint32_t fd;
+	for_each_set_bit(fd, old->open_fds, old->max_fds)
+	{
+		struct vfs_file *file = old->fd[fd];
+		// reserved by another thread but not installed yet
+		if (!file)
+			continue;
+
+		atomic_inc(&file->f_count);
+		files->fd[fd] = file;
+		set_bit(fd, files->open_fds);
+		if (test_bit(fd, old->close_on_exec))
+			set_bit(fd, files->close_on_exec);
+	}
+	files->next_fd = old->next_fd;
+	mutex_unlock(&old->lock);
+
+	return files;
+}
+
+void free_files(struct files_struct *files)
+{
+	free_table(files);
+	kfree(files);
+}
+
+// the last reference releases file
+int fput(struct vfs_file *file)
+{
+	if (!atomic_dec_and_test(&file->f_count))
+		return 0;
+
+	int ret = 0;
+	eventpoll_release(file);
+	if (file->f_op && file->f_op->release)
+		ret = file->f_op->release(file->f_dentry->d_inode, file);
+	if (file->f_dentry)
+		iput(file->f_dentry->d_inode);
+	kfree(file);
+	return ret;
+}
+
+// files->lock has to be held, return file which was in slot
+static struct vfs_file *pick_file(struct files_struct *files, uint32_t fd)
+{
+	struct vfs_file *file = files->fd[fd];
+
+	files->fd[fd] = NULL;
+	clear_bit(fd, files->open_fds);
+	clear_bit(fd, files->close_on_exec);
+	if (fd < files->next_fd)
+		files->next_fd = fd;
+
+	return file;
+}
+
+struct vfs_file *fcheck(int32_t fd)
+{
+	struct files_struct *files = current_process->files;
+
+	if (fd < 0 || fd >= files->max_fds)
+		return NULL;
+	return files->fd[fd];
+}
+
+// slot is reserved until file is installed (fd_install) or it is given back (put_unused_fd)
+int find_unused_fd_slot(int lowerlimit)
+{
+	struct files_struct *files = current_process->files;
+	if (lowerlimit < 0)
+		return -EINVAL;
+
+	mutex_lock(&files->lock);
+
+	uint32_t start = max_t(uint32_t, lowerlimit, files->next_fd);
+	uint32_t fd = start < files->max_fds ? find_next_zero_bit(files->open_fds, files->max_fds, start) : start;
+	int ret = expand_files(files, fd);
+	if (ret < 0)
+	{
+		mutex_unlock(&files->lock);
+		return ret;
+	}
+
+	set_bit(fd, files->open_fds);
+	if (start == files->next_fd)
+		files->next_fd = fd + 1;
+
+	mutex_unlock(&files->lock);
+	return fd;
+}
+
+void put_unused_fd(int32_t fd)
+{
+	struct files_struct *files = current_process->files;
+
+	mutex_lock(&files->lock);
+	pick_file(files, fd);
+	mutex_unlock(&files->lock);
+}
+
+void fd_install(int32_t fd, struct vfs_file *file)
+{
+	current_process->files->fd[fd] = file;
+}
+
+void set_close_on_exec(int32_t fd, bool flag)
+{
+	struct files_struct *files = current_process->files;
+
+	mutex_lock(&files->lock);
+	if (flag)
+		set_bit(fd, files->close_on_exec);
+	else
+		clear_bit(fd, files->close_on_exec);
+	mutex_unlock(&files->lock);
+}
+
+bool get_close_on_exec(int32_t fd)
+{
+	return test_bit(fd, current_process->files->close_on_exec);
+}
+
+int32_t vfs_close(int32_t fd)
+{
+	struct files_struct *files = current_process->files;
+
+	mutex_lock(&files->lock);
+	struct vfs_file *file = fd >= 0 && fd < files->max_fds ? files->fd[fd] : NULL;
+	if (!file)
+	{
+		mutex_unlock(&files->lock);
+		return -EBADF;
+	}
+	pick_file(files, fd);
+	mutex_unlock(&files->lock);
+
+	return fput(file);
+}
+
+int do_dup2(int32_t oldfd, int32_t newfd)
+{
+	struct files_struct *files = current_process->files;
+	struct vfs_file *file = fcheck(oldfd);
+	if (!file || newfd < 0)
+		return -EBADF;
+	if (oldfd == newfd)
+		return newfd;
+
+	mutex_lock(&files->lock);
+	int ret = expand_files(files, newfd);
+	if (ret < 0)
+	{
+		mutex_unlock(&files->lock);
+		return ret == -EMFILE ? -EBADF : ret;
+	}
+
+	struct vfs_file *old = pick_file(files, newfd);
+	atomic_inc(&file->f_count);
+	files->fd[newfd] = file;
+	set_bit(newfd, files->open_fds);
+	if (files->next_fd == newfd)
+		files->next_fd = find_next_zero_bit(files->open_fds, files->max_fds, newfd);
+	mutex_unlock(&files->lock);
+
+	if (old)
+		fput(old);
+	return newfd;
+}
+
+// files which are picked under lock are released after, release might sleep or touch fd table (e.g. epoll)
+// exclusive end of [from, to] inside the table, to + 1 would wrap for close_range(fd, ~0U, ...)
+static uint32_t fd_range_end(struct files_struct *files, uint32_t to)
+{
+	return to >= files->max_fds ? files->max_fds : to + 1;
+}
+
+static void close_files_in_range(struct files_struct *files, uint32_t from, uint32_t to, bool only_cloexec)
+{
+	while (true)
+	{
+		mutex_lock(&files->lock);
+		// table might be resized by release
+		uint32_t *map = only_cloexec ? files->close_on_exec : files->open_fds;
+		uint32_t end = fd_range_end(files, to);
+		uint32_t fd = from < end ? find_next_bit(map, end, from) : end;
+		struct vfs_file *file = fd < end ? pick_file(files, fd) : NULL;
+		mutex_unlock(&files->lock);
+
+		if (fd >= end)
+			break;
+		if (file)
+			fput(file);
+		from = fd + 1;
+	}
+}
+
+int do_close_range(uint32_t fd, uint32_t max_fd, uint32_t flags)
+{
+	struct files_struct *files = current_process->files;
+	if (fd > max_fd || flags & ~CLOSE_RANGE_CLOEXEC)
+		return -EINVAL;
+
+	if (flags & CLOSE_RANGE_CLOEXEC)
+	{
+		mutex_lock(&files->lock);
+		uint32_t end = fd_range_end(files, max_fd);
+		for (uint32_t i = find_next_bit(files->open_fds, end, fd); i < end; i = find_next_bit(files->open_fds, end, i + 1))
+			set_bit(i, files->close_on_exec);
+		mutex_unlock(&files->lock);
+	}
+	else
+		close_files_in_range(files, fd, max_fd, false);
+
+	return 0;
+}
+
+void do_close_on_exec(struct files_struct *files)
+{
+	close_files_in_range(files, 0, NR_OPEN_MAX - 1, true);
+}
+
+// process exits, nobody else can install files
+void close_files(struct files_struct *files)
+{
+	close_files_in_range(files, 0, NR_OPEN_MAX - 1, false);
+}
@@ -0,0 +1,96 @@
+#include <fs/vfs.h>
+#include <include/errno.h>
+#include <memory/vmm.h>
+#include <proc/task.h>
+#include <utils/math.h>
+#include <utils/string.h>
+
+// NOTE: MQ 2020-08-15
+// Page cache for executables, a cached page is a page-aligned kernel page holding one file page
+// its frame is mapped read-only into every process which runs the file (text, rodata) and is the source for private data pages
+// pages are dropped from the cache when file is written or truncated, but never freed because processes might still map them
+static void filemap_init(struct address_space *mapping)
+{
+	if (!mapping->page_cache.next)
+		INIT_LIST_HEAD(&mapping->page_cache);
+}
+
+struct page *find_get_page(struct vfs_inode *inode, uint32_t index)
+{
+	filemap_init(&inode->i_data);
+
+	struct page *iter;
+	list_for_each_entry(iter, &inode->i_data.page_cache, sibling)
+	{
+		if (iter->index == index)
+			return iter;
+	}
+	return NULL;
+}
+
+struct page *read_cache_page(struct vfs_file *file, uint32_t index)
+{
+	struct vfs_inode *inode = file->f_dentry->d_inode;
+	struct page *page = find_get_page(inode, index);
+	if (page)
+		return page;
+
+	char *buf = vmalloc(PMM_FRAME_SIZE);
+	if (!buf)
+		return NULL;
+
+	loff_t pos = index * PMM_FRAME_SIZE;
+	if (pos < inode->i_size)
+	{
+		ssize_t ret = file->f_op->read(file, buf, min_t(uint32_t, PMM_FRAME_SIZE, inode->i_size - pos), pos);
+		if (ret < 0)
+		{
+			vfree(buf);
+			return NULL;
+		}
+	}
+
+	page = kcalloc(1, sizeof(struct page));
+	page->index = index;
+	page->virtual = (uint32_t)buf;
+	page->frame = vmm_get_physical_address((uint32_t)buf, false);
+	list_add_tail(&page->sibling, &inode->i_data.page_cache);
+	inode->i_data.ncached++;
+
+	return page;
+}
+
+void invalidate_inode_pages(struct vfs_inode *inode)
+{
+	filemap_init(&inode->i_data);
+
+	struct page *iter, *next;
+	list_for_each_entry_safe(iter, next, &inode->i_data.page_cache, sibling)
+	{
+		list_del(&iter->sibling);
+		kfree(iter);
+	}
+	inode->i_data.ncached = 0;
+}
+
+// NOTE: MQ 2020-08-16
+// Private file mapping (mmap with MAP_PRIVATE), it is how runtime linker maps shared libraries
+// read-only pages are page cache frames so library's text is shared by every process, writable ones are private copies
+int filemap_map_private(struct vfs_file *file, uint32_t addr, uint32_t len, uint32_t pgoff, bool writable)
+{
+	for (uint32_t vaddr = addr; vaddr < addr + len; vaddr += PMM_FRAME_SIZE, pgoff++)
+	{
+		struct page *p = read_cache_page(file, pgoff);
+		if (!p)
+			return -EIO;
+
+		if (writable)
+		{
+			vmm_map_address(current_process->pdir, vaddr, (uint32_t)pmm_alloc_block(), I86_PTE_PRESENT | I86_PTE_WRITABLE | I86_PTE_USER);
+			memcpy((char *)vaddr, (char *)p->virtual, PMM_FRAME_SIZE);
+		}
+		else
+			vmm_map_address(current_process->pdir, vaddr, p->frame, I86_PTE_PRESENT | I86_PTE_USER);
+	}
+	return 0;
+}
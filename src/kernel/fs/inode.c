@@ -0,0 +1,260 @@
+#include <include/errno.h>
+#include <proc/task.h>
+#include <system/time.h>
+#include <utils/debug.h>
+
+#include "vfs.h"
+
+// NOTE: MQ 2020-08-21
+// Inodes of disk file systems are cached by (sb, ino), every dentry and opened file holds a reference
+// updates only mark inode dirty, kflushd writes it back once it has been dirty for DIRTY_EXPIRE_MS,
+// sync/fsync write it back immediately -> a burst of appends costs one inode write instead of one per call
+// unreferenced inodes stay in lru (lookup might need them again), the oldest ones are evicted above MAX_UNUSED_INODES
+// inode_lock only guards hash/lru/dirty lists, disk writes (write_inode) are done after dropping it
+#define INODE_HASH_BITS 7
+#define INODE_HASH_SIZE (1 << INODE_HASH_BITS)
+#define MAX_UNUSED_INODES 64
+#define DIRTY_EXPIRE_MS 5000
+#define DIRTY_WRITEBACK_MS 1000
+
+static struct list_head inode_hashtable[INODE_HASH_SIZE];
+static LIST_HEAD(inode_unused);
+static LIST_HEAD(inode_dirty);
+static DEFINE_MUTEX(inode_lock);
+static uint32_t nr_unused;
+
+static struct list_head *inode_hash(struct vfs_superblock *sb, unsigned long ino)
+{
+	uint32_t key = ((uint32_t)sb >> 4) ^ ino;
+	return &inode_hashtable[(key * 0x9E3779B9) >> (32 - INODE_HASH_BITS)];
+}
+
+static struct vfs_inode *find_inode(struct vfs_superblock *sb, unsigned long ino)
+{
+	struct vfs_inode *iter;
+	list_for_each_entry(iter, inode_hash(sb, ino), i_hash)
+	{
+		if (iter->i_sb == sb && iter->i_ino == ino)
+			return iter;
+	}
+	return NULL;
+}
+
+// inode_lock has to be held, caller writes inode back (write_inode) after dropping the lock
+static bool take_dirty(struct vfs_inode *inode)
+{
+	if (!(inode->i_state & I_DIRTY))
+		return false;
+
+	// clear before writing, a concurrent update marks it dirty again and is written by the next round
+	inode->i_state &= ~I_DIRTY;
+	list_del(&inode->i_dirty);
+	return true;
+}
+
+// inode_lock has to be held
+static void __iget(struct vfs_inode *inode)
+{
+	if (!atomic_read(&inode->i_count))
+	{
+		list_del(&inode->i_lru);
+		nr_unused--;
+	}
+	atomic_inc(&inode->i_count);
+}
+
+// inode_lock has to be held, the oldest clean unused inodes are unhashed and moved to `dispose`
+// dirty ones are skipped, they would be re-read stale from disk before being written, kflushd cleans them
+static void prune_icache(struct list_head *dispose)
+{
+	struct vfs_inode *inode, *next;
+	list_for_each_entry_safe(inode, next, &inode_unused, i_lru)
+	{
+		if (nr_unused <= MAX_UNUSED_INODES)
+			break;
+		if (inode->i_state & I_DIRTY)
+			continue;
+
+		list_move_tail(&inode->i_lru, dispose);
+		list_del(&inode->i_hash);
+		inode->i_state &= ~I_HASHED;
+		nr_unused--;
+	}
+}
+
+// inodes are clean and not reachable anymore, freeing them (page cache, fs private part) doesn't need inode_lock
+static void dispose_list(struct list_head *dispose)
+{
+	struct vfs_inode *inode, *next;
+	list_for_each_entry_safe(inode, next, dispose, i_lru)
+	{
+		list_del(&inode->i_lru);
+
+		if (inode->i_data.ncached)
+			invalidate_inode_pages(inode);
+
+		if (inode->i_sb->s_op->destroy_inode)
+			inode->i_sb->s_op->destroy_inode(inode);
+		else
+			kfree(inode);
+	}
+}
+
+struct vfs_inode *iget(struct vfs_superblock *sb, unsigned long ino)
+{
+	mutex_lock(&inode_lock);
+
+	struct vfs_inode *inode = find_inode(sb, ino);
+	if (inode)
+		__iget(inode);
+	else
+	{
+		inode = sb->s_op->alloc_inode(sb);
+		inode->i_ino = ino;
+		sb->s_op->read_inode(inode);
+
+		atomic_set(&inode->i_count, 1);
+		inode->i_state = I_HASHED;
+		list_add_tail(&inode->i_hash, inode_hash(sb, ino));
+	}
+
+	mutex_unlock(&inode_lock);
+	return inode;
+}
+
+// new inode (not on disk yet) is cached, caller owns the first reference
+void insert_inode_hash(struct vfs_inode *inode)
+{
+	mutex_lock(&inode_lock);
+
+	atomic_set(&inode->i_count, 1);
+	inode->i_state |= I_HASHED;
+	list_add_tail(&inode->i_hash, inode_hash(inode->i_sb, inode->i_ino));
+
+	mutex_unlock(&inode_lock);
+}
+
+// inodes which are not cached (pipe, socket, in-memory file systems) are owned by their file system
+void iput(struct vfs_inode *inode)
+{
+	if (!inode || !(inode->i_state & I_HASHED))
+		return;
+
+	LIST_HEAD(dispose);
+	mutex_lock(&inode_lock);
+
+	if (atomic_dec_and_test(&inode->i_count))
+	{
+		list_add_tail(&inode->i_lru, &inode_unused);
+		nr_unused++;
+		prune_icache(&dispose);
+	}
+
+	mutex_unlock(&inode_lock);
+
+	dispose_list(&dispose);
+}
+
+void mark_inode_dirty(struct vfs_inode *inode, uint32_t flags)
+{
+	if (!(inode->i_state & I_HASHED) || !inode->i_sb->s_op->write_inode)
+		return;
+
+	// fast path, a dirty inode is written back with its latest state anyway
+	if ((inode->i_state & flags) == flags)
+		return;
+
+	mutex_lock(&inode_lock);
+
+	if (!(inode->i_state & I_DIRTY))
+	{
+		inode->i_dirtied_when = get_milliseconds(NULL);
+		list_add_tail(&inode->i_dirty, &inode_dirty);
+	}
+	inode->i_state |= flags;
+
+	mutex_unlock(&inode_lock);
+}
+
+// datasync skips an inode which only has timestamps changed (fdatasync)
+void write_inode_now(struct vfs_inode *inode, bool datasync)
+{
+	if (!(inode->i_state & (datasync ? I_DIRTY_DATASYNC : I_DIRTY)))
+		return;
+
+	// caller holds a reference, inode can't be evicted under us
+	mutex_lock(&inode_lock);
+	bool dirty = take_dirty(inode);
+	mutex_unlock(&inode_lock);
+
+	if (dirty)
+		inode->i_sb->s_op->write_inode(inode);
+}
+
+// dirty list is ordered by dirtied time, only inodes which are dirty before `older_than` are written
+// one inode at a time, it's pinned by a reference while being written without inode_lock
+static void writeback_inodes(uint64_t older_than)
+{
+	while (true)
+	{
+		mutex_lock(&inode_lock);
+
+		struct vfs_inode *inode = list_first_entry_or_null(&inode_dirty, struct vfs_inode, i_dirty);
+		if (!inode || inode->i_dirtied_when > older_than)
+		{
+			mutex_unlock(&inode_lock);
+			break;
+		}
+		take_dirty(inode);
+		__iget(inode);
+
+		mutex_unlock(&inode_lock);
+
+		inode->i_sb->s_op->write_inode(inode);
+		iput(inode);
+	}
+}
+
+void sync_inodes()
+{
+	writeback_inodes(UINT64_MAX);
+}
+
+int vfs_fsync(int32_t fd, bool datasync)
+{
+	struct vfs_file *file = fcheck(fd);
+	if (!file)
+		return -EBADF;
+
+	struct vfs_inode *inode = file->f_dentry ? file->f_dentry->d_inode : NULL;
+	if (!inode || S_ISFIFO(inode->i_mode) || S_ISSOCK(inode->i_mode))
+		return -EINVAL;
+
+	// file data is written through by file system, only its inode might be behind
+	write_inode_now(inode, datasync);
+	return 0;
+}
+
+static void flusher_loop()
+{
+	// explain in kernel_init#unlock_scheduler
+	unlock_scheduler();
+
+	while (true)
+	{
+		thread_sleep(DIRTY_WRITEBACK_MS);
+
+		uint64_t now = get_milliseconds(NULL);
+		if (now > DIRTY_EXPIRE_MS)
+			writeback_inodes(now - DIRTY_EXPIRE_MS);
+	}
+}
+
+void inode_cache_init()
+{
+	log("VFS: Setup inode cache");
+	for (int i = 0; i < INODE_HASH_SIZE; ++i)
+		INIT_LIST_HEAD(&inode_hashtable[i]);
+
+	create_system_process("kflushd", flusher_loop, 0);
+}
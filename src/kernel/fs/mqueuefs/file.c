@@ -12,10 +12,7 @@ static int mqueue_file_open(struct vfs_inode *inode, struct vfs_file *file)
 	if (!mq)
 	{
 		mq = kcalloc(1, sizeof(struct message_queue));
-		INIT_LIST_HEAD(&mq->senders);
-		INIT_LIST_HEAD(&mq->receivers);
-		INIT_LIST_HEAD(&mq->messages);
-		INIT_LIST_HEAD(&mq->wait.list);
+		mq_init_queue(mq);
 
 		if (!hashmap_put(&mq_map, &mqi->key, mq))
 			return -EINVAL;
@@ -29,7 +26,7 @@ static unsigned int mqueue_file_poll(struct vfs_file *file, struct poll_table *p
 {
 	struct message_queue *mq = (struct message_queue *)file->private_data;
 	poll_wait(file, &mq->wait, pt);
-	return (!list_empty(&mq->messages) ? POLLIN : 0) | POLLOUT;
+	return (mq_is_readable(mq) ? POLLIN : 0) | (mq_is_writable(mq) ? POLLOUT : 0);
 }
 
 struct vfs_file_operations mqueuefs_file_operations = {
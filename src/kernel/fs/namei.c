@@ -51,7 +51,7 @@ int vfs_unlink(const char *path, int flag)
 	int ret = vfs_open(abs_path, O_RDONLY);
 	if (ret >= 0)
 	{
-		struct vfs_file *file = current_process->files->fd[ret];
+		struct vfs_file *file = fcheck(ret);
 		if (!file)
 			ret = -EBADF;
 		else if (flag & AT_REMOVEDIR && file->f_dentry->d_inode->i_mode & S_IFREG)
@@ -59,9 +59,13 @@ int vfs_unlink(const char *path, int flag)
 		else
 		{
 			struct vfs_inode *dir = file->f_dentry->d_parent->d_inode;
+			down_write(&dir->i_rwsem);
 			if (dir->i_op && dir->i_op->unlink)
 				ret = dir->i_op->unlink(dir, file->f_dentry);
 			list_del(&file->f_dentry->d_sibling);
+			up_write(&dir->i_rwsem);
+			// dentry is unreachable, its reference is dropped (opened files still keep theirs)
+			iput(file->f_dentry->d_inode);
 		}
 		vfs_close(ret);
 	}
@@ -72,6 +76,30 @@ int vfs_unlink(const char *path, int flag)
 	return ret;
 }
 
+// both directories are locked in address order, two renames in opposite directions can't deadlock
+static void lock_rename(struct vfs_inode *old_dir, struct vfs_inode *new_dir)
+{
+	if (old_dir == new_dir)
+		down_write(&old_dir->i_rwsem);
+	else if (old_dir < new_dir)
+	{
+		down_write(&old_dir->i_rwsem);
+		down_write(&new_dir->i_rwsem);
+	}
+	else
+	{
+		down_write(&new_dir->i_rwsem);
+		down_write(&old_dir->i_rwsem);
+	}
+}
+
+static void unlock_rename(struct vfs_inode *old_dir, struct vfs_inode *new_dir)
+{
+	up_write(&old_dir->i_rwsem);
+	if (old_dir != new_dir)
+		up_write(&new_dir->i_rwsem);
+}
+
 int vfs_rename(const char *oldpath, const char *newpath)
 {
 	log("File system: Rename from %s to %s", oldpath, newpath);
@@ -83,7 +111,7 @@ int vfs_rename(const char *oldpath, const char *newpath)
 	if ((oldfd = vfs_open(abs_oldpath, O_RDONLY)) < 0)
 		return oldfd;
 
-	struct vfs_file *oldfilp = current_process->files->fd[oldfd];
+	struct vfs_file *oldfilp = fcheck(oldfd);
 	struct vfs_dentry *old_dentry = oldfilp->f_dentry;
 	struct vfs_inode *old_dir = old_dentry->d_parent->d_inode;
 
@@ -95,7 +123,7 @@ int vfs_rename(const char *oldpath, const char *newpath)
 		vfs_fstat(oldfd, &old_stat);
 		struct kstat new_stat;
 		vfs_fstat(newfd, &new_stat);
-		struct vfs_file *newfilp = current_process->files->fd[newfd];
+		struct vfs_file *newfilp = fcheck(newfd);
 		struct vfs_dentry *new_dentry = newfilp->f_dentry;
 		mode_t new_mode = newfilp->f_dentry->d_inode->i_mode;
 
@@ -129,7 +157,11 @@ int vfs_rename(const char *oldpath, const char *newpath)
 		if (oldfilp->f_vfsmnt != nd.mnt)
 			ret = -EXDEV;
 		else if (old_dir->i_op && old_dir->i_op->rename)
+		{
+			lock_rename(old_dir, new_dir);
 			ret = old_dir->i_op->rename(old_dir, old_dentry, new_dir, new_dentry);
+			unlock_rename(old_dir, new_dir);
+		}
 	}
 	else
 		ret = -ENOENT;
@@ -21,6 +21,48 @@ struct vfs_dentry *alloc_dentry(struct vfs_dentry *parent, char *name)
 	return d;
 }
 
+// cached children only, parent's i_rwsem has to be held (read is enough)
+static struct vfs_dentry *d_lookup(struct vfs_dentry *parent, const char *name)
+{
+	struct vfs_dentry *iter;
+	list_for_each_entry(iter, &parent->d_subdirs, d_sibling)
+	{
+		if (!strcmp(name, iter->d_name))
+			return iter;
+	}
+	return NULL;
+}
+
+// parent's i_rwsem is held for write, flags only have effect for the last component
+// child is looked up again, another thread might have added it between dropping read lock and taking write lock
+static int d_alloc_child(struct vfs_dentry *parent, char *name, int32_t flags, mode_t mode, struct vfs_dentry **child)
+{
+	if ((*child = d_lookup(parent, name)))
+		return flags & O_CREAT && flags & O_EXCL ? -EEXIST : 0;
+
+	struct vfs_inode *dir = parent->d_inode;
+	struct vfs_dentry *d_child = alloc_dentry(parent, name);
+
+	struct vfs_inode *inode = NULL;
+	if (dir->i_op->lookup)
+		inode = dir->i_op->lookup(dir, d_child);
+
+	if (inode == NULL)
+	{
+		if (flags & O_CREAT)
+			inode = dir->i_op->create(dir, d_child, mode);
+		else
+			return -ENOENT;
+	}
+	else if (flags & O_CREAT && flags & O_EXCL)
+		return -EEXIST;
+
+	d_child->d_inode = inode;
+	list_add_tail(&d_child->d_sibling, &parent->d_subdirs);
+	*child = d_child;
+	return 0;
+}
+
 int path_walk(struct nameidata *nd, const char *path, int32_t flags, mode_t mode)
 {
 	nd->mnt = current_process->fs->mnt_root;
@@ -43,48 +85,28 @@ int path_walk(struct nameidata *nd, const char *path, int32_t flags, mode_t mode
 		for (; path[i] == '/' && i < length; ++i)
 			;
 
-		struct vfs_dentry *iter = NULL;
-		struct vfs_dentry *d_child = NULL;
-		list_for_each_entry(iter, &nd->dentry->d_subdirs, d_sibling)
-		{
-			if (!strcmp(part_name, iter->d_name))
-			{
-				d_child = iter;
-				break;
-			}
-		}
+		bool last = i == length;
+		struct vfs_inode *dir = nd->dentry->d_inode;
+		down_read(&dir->i_rwsem);
+		struct vfs_dentry *d_child = d_lookup(nd->dentry, part_name);
+		up_read(&dir->i_rwsem);
 
 		if (d_child)
 		{
-			nd->dentry = d_child;
-			if (i == length && flags & O_CREAT && flags & O_EXCL)
+			if (last && flags & O_CREAT && flags & O_EXCL)
 				return -EEXIST;
 		}
 		else
 		{
-			d_child = alloc_dentry(nd->dentry, part_name);
-
-			struct vfs_inode *inode = NULL;
-			if (nd->dentry->d_inode->i_op->lookup)
-				inode = nd->dentry->d_inode->i_op->lookup(nd->dentry->d_inode, d_child);
-
-			if (inode == NULL)
-			{
-				if (i == length && flags & O_CREAT)
-					inode = nd->dentry->d_inode->i_op->create(nd->dentry->d_inode, d_child, i == length ? mode : S_IFDIR);
-				else
-				{
-					log("%s is not exist", path);
-					return -ENOENT;
-				}
-			}
-			else if (i == length && flags & O_CREAT && flags & O_EXCL)
-				return -EEXIST;
-
-			d_child->d_inode = inode;
-			list_add_tail(&d_child->d_sibling, &nd->dentry->d_subdirs);
-			nd->dentry = d_child;
+			down_write(&dir->i_rwsem);
+			int ret = d_alloc_child(nd->dentry, part_name, last ? flags : 0, mode, &d_child);
+			up_write(&dir->i_rwsem);
+			if (ret == -ENOENT)
+				log("%s is not exist", path);
+			if (ret < 0)
+				return ret;
 		}
+		nd->dentry = d_child;
 
 		struct vfs_mount *mnt = lookup_mnt(nd->dentry);
 		if (mnt)
@@ -99,6 +121,7 @@ struct vfs_file *get_empty_filp()
 	struct vfs_file *file = kcalloc(1, sizeof(struct vfs_file));
 	file->f_maxcount = INT_MAX;
 	atomic_set(&file->f_count, 1);
+	INIT_LIST_HEAD(&file->f_ep_links);
 
 	return file;
 }
@@ -106,6 +129,9 @@ struct vfs_file *get_empty_filp()
 int32_t vfs_open(const char *path, int32_t flags, ...)
 {
 	int fd = find_unused_fd_slot(0);
+	if (fd < 0)
+		return fd;
+
 	mode_t mode = 0;
 	if (flags & O_CREAT)
 	{
@@ -118,7 +144,10 @@ int32_t vfs_open(const char *path, int32_t flags, ...)
 	struct nameidata nd;
 	int ret = path_walk(&nd, path, flags, mode);
 	if (ret < 0)
+	{
+		put_unused_fd(fd);
 		return ret;
+	}
 
 	struct vfs_file *file = get_empty_filp();
 	file->f_dentry = nd.dentry;
@@ -138,40 +167,18 @@ int32_t vfs_open(const char *path, int32_t flags, ...)
 		if (ret < 0)
 		{
 			kfree(file);
+			put_unused_fd(fd);
 			return ret;
 		}
 	}
 
 	atomic_inc(&file->f_dentry->d_inode->i_count);
-	current_process->files->fd[fd] = file;
+	fd_install(fd, file);
+	if (flags & O_CLOEXEC)
+		set_close_on_exec(fd, true);
 	return fd;
 }
 
-int32_t vfs_close(int32_t fd)
-{
-	struct files_struct *files = current_process->files;
-	acquire_semaphore(&files->lock);
-
-	int ret = 0;
-	struct vfs_file *file = files->fd[fd];
-	if (file)
-	{
-		atomic_dec(&file->f_count);
-		if (!atomic_read(&file->f_count))
-		{
-			if (file->f_op && file->f_op->release)
-				ret = file->f_op->release(file->f_dentry->d_inode, file);
-			kfree(file);
-		}
-	}
-	else
-		ret = -EBADF;
-
-	files->fd[fd] = NULL;
-	release_semaphore(&files->lock);
-	return ret;
-}
-
 static void generic_fillattr(struct vfs_inode *inode, struct kstat *stat)
 {
 	stat->st_dev = inode->i_sb->s_dev;
@@ -219,7 +226,7 @@ int vfs_stat(const char *path, struct kstat *stat)
 
 int vfs_fstat(int32_t fd, struct kstat *stat)
 {
-	struct vfs_file *file = current_process->files->fd[fd];
+	struct vfs_file *file = fcheck(fd);
 	if (fd < 0 || !file)
 		return -EBADF;
 
@@ -237,12 +244,13 @@ int vfs_mknod(const char *path, int mode, dev_t dev)
 	if (ret < 0)
 		return ret;
 
+	struct vfs_inode *inode = nd.dentry->d_inode;
 	struct vfs_dentry *d_child = alloc_dentry(nd.dentry, name);
-	ret = nd.dentry->d_inode->i_op->mknod(nd.dentry->d_inode, d_child, mode, dev);
-	if (ret < 0)
-		return ret;
-
-	list_add_tail(&d_child->d_sibling, &nd.dentry->d_subdirs);
+	down_write(&inode->i_rwsem);
+	ret = inode->i_op->mknod(inode, d_child, mode, dev);
+	if (ret >= 0)
+		list_add_tail(&d_child->d_sibling, &nd.dentry->d_subdirs);
+	up_write(&inode->i_rwsem);
 
 	return ret;
 }
@@ -260,6 +268,7 @@ int vfs_setattr(struct vfs_dentry *dentry, struct iattr *attrs)
 			inode->i_size = attrs->ia_size;
 		if (attrs->ia_valid & ATTR_MODE)
 			inode->i_mode = attrs->ia_mode;
+		mark_inode_dirty(inode, attrs->ia_valid & ATTR_SIZE ? I_DIRTY_DATASYNC : I_DIRTY_SYNC);
 	}
 	return ret;
 }
@@ -270,6 +279,8 @@ static int do_truncate(struct vfs_dentry *dentry, int32_t length)
 	attrs->ia_valid = ATTR_SIZE;
 	attrs->ia_size = length;
 
+	if (dentry->d_inode->i_data.ncached)
+		invalidate_inode_pages(dentry->d_inode);
 	return vfs_setattr(dentry, attrs);
 }
 
@@ -288,7 +299,7 @@ int vfs_truncate(const char *path, int32_t length)
 int vfs_ftruncate(int32_t fd, int32_t length)
 {
 	log("File system: Truncate %d with length=%d", fd, length);
-	struct vfs_file *f = current_process->files->fd[fd];
+	struct vfs_file *f = fcheck(fd);
 	return do_truncate(f->f_dentry, length);
 }
 
@@ -340,7 +351,7 @@ int vfs_access(const char *path, int amode)
 	if (fd < 0)
 		return -ENOENT;
 
-	struct vfs_file *file = current_process->files->fd[fd];
+	struct vfs_file *file = fcheck(fd);
 	if (!(amode & R_OK && file->f_mode & FMODE_CAN_READ) || !(amode & W_OK && file->f_mode & FMODE_CAN_WRITE))
 		return -EACCES;
 
@@ -3,7 +3,7 @@
 #include <fs/vfs.h>
 #include <include/errno.h>
 #include <include/fcntl.h>
-#include <locking/semaphore.h>
+#include <locking/mutex.h>
 #include <memory/vmm.h>
 #include <proc/task.h>
 #include <system/time.h>
@@ -16,10 +16,10 @@ static ssize_t pipe_read(struct vfs_file *file, char *buf, size_t count, loff_t
 		return -EINVAL;
 
 	struct pipe *p = file->f_dentry->d_inode->i_pipe;
-	acquire_semaphore(&p->mutex);
+	mutex_lock(&p->mutex);
 	for (uint32_t i = 0; i < count; ++i)
 		circular_buf_get(p->buf, buf + i);
-	release_semaphore(&p->mutex);
+	mutex_unlock(&p->mutex);
 	return 0;
 }
 
@@ -29,10 +29,10 @@ static ssize_t pipe_write(struct vfs_file *file, const char *buf, size_t count,
 		return -EINVAL;
 
 	struct pipe *p = file->f_dentry->d_inode->i_pipe;
-	acquire_semaphore(&p->mutex);
+	mutex_lock(&p->mutex);
 	for (uint32_t i = 0; i < count; ++i)
 		circular_buf_put(p->buf, buf[i]);
-	release_semaphore(&p->mutex);
+	mutex_unlock(&p->mutex);
 	return 0;
 }
 
@@ -40,7 +40,7 @@ static int pipe_open(struct vfs_inode *inode, struct vfs_file *file)
 {
 	struct pipe *p = inode->i_pipe;
 
-	acquire_semaphore(&p->mutex);
+	mutex_lock(&p->mutex);
 	switch (file->f_flags)
 	{
 	case O_RDONLY:
@@ -55,7 +55,7 @@ static int pipe_open(struct vfs_inode *inode, struct vfs_file *file)
 		assert_not_implemented();
 		break;
 	}
-	release_semaphore(&p->mutex);
+	mutex_unlock(&p->mutex);
 	return 0;
 }
 
@@ -63,7 +63,7 @@ static int pipe_release(struct vfs_inode *inode, struct vfs_file *file)
 {
 	struct pipe *p = inode->i_pipe;
 
-	acquire_semaphore(&p->mutex);
+	mutex_lock(&p->mutex);
 	p->files--;
 	switch (file->f_flags)
 	{
@@ -79,7 +79,7 @@ static int pipe_release(struct vfs_inode *inode, struct vfs_file *file)
 		assert_not_implemented();
 		break;
 	}
-	release_semaphore(&p->mutex);
+	mutex_unlock(&p->mutex);
 
 	if (!p->files && !p->writers && !p->readers)
 	{
@@ -104,7 +104,7 @@ static struct pipe *alloc_pipe()
 	p->readers = 0;
 	p->writers = 0;
 
-	sema_init(&p->mutex, 1);
+	mutex_init(&p->mutex);
 
 	char *buf = kcalloc(PIPE_SIZE, sizeof(char));
 	p->buf = circular_buf_init(buf, PIPE_SIZE);
@@ -125,7 +125,7 @@ static struct vfs_inode *get_pipe_inode()
 	inode->i_ctime.tv_sec = get_seconds(NULL);
 	inode->i_mtime.tv_sec = get_seconds(NULL);
 	inode->i_pipe = p;
-	sema_init(&inode->i_sem, 1);
+	init_rwsem(&inode->i_rwsem);
 	inode->i_fop = &pipe_fops;
 
 	return inode;
@@ -134,6 +134,17 @@ static struct vfs_inode *get_pipe_inode()
 // TODO: MQ 2020-11-17 Support unidirectional data channel
 int32_t do_pipe(int32_t *fd)
 {
+	int32_t ufd1 = find_unused_fd_slot(0);
+	if (ufd1 < 0)
+		return ufd1;
+
+	int32_t ufd2 = find_unused_fd_slot(0);
+	if (ufd2 < 0)
+	{
+		put_unused_fd(ufd1);
+		return ufd2;
+	}
+
 	struct vfs_inode *inode = get_pipe_inode();
 	struct vfs_dentry *dentry = kcalloc(1, sizeof(struct vfs_dentry));
 	dentry->d_inode = inode;
@@ -148,12 +159,10 @@ int32_t do_pipe(int32_t *fd)
 	f2->f_op = &pipe_fops;
 	f2->f_dentry = dentry;
 
-	int32_t ufd1 = find_unused_fd_slot(0);
-	current_process->files->fd[ufd1] = f1;
+	fd_install(ufd1, f1);
 	fd[0] = ufd1;
 
-	int32_t ufd2 = find_unused_fd_slot(0);
-	current_process->files->fd[ufd2] = f2;
+	fd_install(ufd2, f2);
 	fd[1] = ufd2;
 
 	return 0;
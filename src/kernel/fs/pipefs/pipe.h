@@ -2,7 +2,7 @@
 #define FS_PIPE_H
 
 #include <fs/vfs.h>
-#include <locking/semaphore.h>
+#include <locking/mutex.h>
 #include <utils/circular_buffer.h>
 
 #define PIPE_SIZE 0x10000
@@ -10,7 +10,7 @@
 struct pipe
 {
 	struct circular_buf_t *buf;
-	struct semaphore mutex;
+	struct mutex mutex;
 	uint32_t files;
 	uint32_t readers;
 	uint32_t writers;
@@ -1,7 +1,9 @@
 #include "poll.h"
 
+#include <include/errno.h>
 #include <memory/vmm.h>
 #include <proc/task.h>
+#include <system/time.h>
 
 static void poll_table_free(struct poll_table *pt)
 {
@@ -16,12 +18,12 @@ static void poll_table_free(struct poll_table *pt)
 	kfree(pt);
 }
 
-void poll_wakeup(struct thread *t)
+void poll_wakeup(struct wait_queue_entry *wait)
 {
-	update_thread(t, THREAD_READY);
+	update_thread(wait->thread, THREAD_READY);
 }
 
-void poll_wait(struct vfs_file *file, struct wait_queue_head *wh, struct poll_table *pt)
+static void __pollwait(struct vfs_file *file, struct wait_queue_head *wh, struct poll_table *pt)
 {
 	struct poll_table_entry *pe = kcalloc(sizeof(struct poll_table_entry), 1);
 	pe->file = file;
@@ -31,14 +33,25 @@ void poll_wait(struct vfs_file *file, struct wait_queue_head *wh, struct poll_ta
 	list_add_tail(&pe->sibling, &pt->list);
 }
 
-int do_poll(struct pollfd *fds, uint32_t nfds)
+void poll_wait(struct vfs_file *file, struct wait_queue_head *wh, struct poll_table *pt)
+{
+	if (pt && pt->qproc)
+		pt->qproc(file, wh, pt);
+}
+
+// timeout in milliseconds, negative value means waiting forever, zero returns immediately
+int do_poll(struct pollfd *fds, uint32_t nfds, int32_t timeout)
 {
 	int32_t nr;
+	uint64_t expires = timeout > 0 ? get_milliseconds(NULL) + timeout : 0;
+	if (expires)
+		mod_timer(&current_thread->sleep_timer, expires);
 
 	while (true)
 	{
 		struct poll_table *pt = kcalloc(sizeof(struct poll_table), 1);
 		INIT_LIST_HEAD(&pt->list);
+		pt->qproc = __pollwait;
 
 		nr = 0;
 		for (uint32_t i = 0; i < nfds; ++i)
@@ -47,7 +60,7 @@ int do_poll(struct pollfd *fds, uint32_t nfds)
 
 			if (pfd->fd >= 0)
 			{
-				struct vfs_file *f = current_thread->parent->files->fd[pfd->fd];
+				struct vfs_file *f = fcheck(pfd->fd);
 
 				pfd->revents = f->f_op->poll(f, pt);
 				if (pfd->events & pfd->revents)
@@ -57,9 +70,15 @@ int do_poll(struct pollfd *fds, uint32_t nfds)
 				pfd->revents = 0;
 		}
 
-		if (nr > 0)
+		if (nr > 0 || !timeout || (expires && get_milliseconds(NULL) >= expires))
+		{
+			poll_table_free(pt);
+			break;
+		}
+		if (fatal_signal_pending(current_thread))
 		{
 			poll_table_free(pt);
+			nr = -EINTR;
 			break;
 		}
 
@@ -68,5 +87,7 @@ int do_poll(struct pollfd *fds, uint32_t nfds)
 		poll_table_free(pt);
 	}
 
+	if (expires)
+		del_timer(&current_thread->sleep_timer);
 	return nr;
 }
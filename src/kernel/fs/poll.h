@@ -18,9 +18,18 @@
 #define POLLMSG 0x0400
 #define POLLREMOVE 0x1000
 
+struct vfs_file;
+struct poll_table;
+
+typedef void (*poll_queue_proc)(struct vfs_file *file, struct wait_queue_head *wh, struct poll_table *pt);
+
+// NOTE: MQ 2020-08-08
+// qproc decides what happens with wait queues a file exposes in ->poll (poll and epoll register differently)
+// file's ->poll can be called with NULL poll_table to only query its current events
 struct poll_table
 {
 	struct list_head list;
+	poll_queue_proc qproc;
 };
 
 struct poll_table_entry
@@ -37,8 +46,8 @@ struct pollfd
 	int16_t revents; /* returned events */
 };
 
-int do_poll(struct pollfd *fds, uint32_t nfds);
+int do_poll(struct pollfd *fds, uint32_t nfds, int32_t timeout);
 void poll_wait(struct vfs_file *file, struct wait_queue_head *wh, struct poll_table *pt);
-void poll_wakeup(struct thread *t);
+void poll_wakeup(struct wait_queue_entry *wait);
 
 #endif
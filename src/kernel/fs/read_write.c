@@ -21,7 +21,7 @@ char *vfs_read(const char *path)
 
 ssize_t vfs_fread(int32_t fd, char *buf, size_t count)
 {
-	struct vfs_file *file = current_process->files->fd[fd];
+	struct vfs_file *file = fcheck(fd);
 	if (fd < 0 || !file)
 		return -EBADF;
 
@@ -33,7 +33,7 @@ ssize_t vfs_fread(int32_t fd, char *buf, size_t count)
 
 ssize_t vfs_fwrite(int32_t fd, const char *buf, size_t count)
 {
-	struct vfs_file *file = current_process->files->fd[fd];
+	struct vfs_file *file = fcheck(fd);
 	if (fd < 0 || !file)
 		return -EBADF;
 
@@ -43,7 +43,12 @@ ssize_t vfs_fwrite(int32_t fd, const char *buf, size_t count)
 		ppos = file->f_dentry->d_inode->i_size;
 
 	if (file->f_mode & FMODE_CAN_WRITE)
+	{
+		struct vfs_inode *inode = file->f_dentry->d_inode;
+		if (inode->i_data.ncached)
+			invalidate_inode_pages(inode);
 		return file->f_op->write(file, buf, count, ppos);
+	}
 
 	return -EINVAL;
 }
@@ -68,7 +73,7 @@ loff_t generic_file_llseek(struct vfs_file *file, loff_t offset, int whence)
 
 loff_t vfs_flseek(int32_t fd, loff_t offset, int whence)
 {
-	struct vfs_file *file = current_process->files->fd[fd];
+	struct vfs_file *file = fcheck(fd);
 	if (fd < 0 || !file)
 		return -EBADF;
 
@@ -51,21 +51,12 @@ int unregister_filesystem(struct vfs_file_system_type *fs)
 	return -EINVAL;
 }
 
-int find_unused_fd_slot(int lowerlimit)
-{
-	for (int i = lowerlimit; i < 256; ++i)
-		if (!current_process->files->fd[i])
-			return i;
-
-	return -EINVAL;
-}
-
 struct vfs_inode *init_inode()
 {
 	struct vfs_inode *i = kcalloc(1, sizeof(struct vfs_inode));
 	i->i_blocks = 0;
 	i->i_size = 0;
-	sema_init(&i->i_sem, 1);
+	init_rwsem(&i->i_rwsem);
 
 	return i;
 }
@@ -113,6 +104,7 @@ struct vfs_mount *do_mount(const char *fstype, int flags, const char *path)
 		{
 			// TODO: MQ 2020-10-24 Make sure path is empty folder
 			list_del(&iter->d_sibling);
+			iput(iter->d_inode);
 			kfree(iter);
 		}
 	}
@@ -142,6 +134,7 @@ void vfs_init(struct vfs_file_system_type *fs, char *dev_name)
 	log("VFS: Initializing");
 
 	INIT_LIST_HEAD(&vfsmntlist);
+	inode_cache_init();
 
 	log("VFS: Mount ext2");
 	init_rootfs(fs, dev_name);
@@ -6,7 +6,8 @@
 #include <include/fcntl.h>
 #include <include/list.h>
 #include <include/types.h>
-#include <locking/semaphore.h>
+#include <locking/rwsem.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <system/time.h>
@@ -21,6 +22,13 @@
 #define FMODE_CAN_WRITE 0x40000
 #define OPEN_FMODE(flag) ((flag + 1) & O_ACCMODE)
 
+// inode state
+#define I_DIRTY_SYNC 0x1	 /* metadata which is only needed by fsync (e.g. timestamps) */
+#define I_DIRTY_DATASYNC 0x2 /* metadata which is needed to read data back (size, block map) */
+#define I_DIRTY (I_DIRTY_SYNC | I_DIRTY_DATASYNC)
+#define I_HASHED 0x4
+
+struct files_struct;
 struct vm_area_struct;
 struct vfs_superblock;
 
@@ -29,6 +37,9 @@ struct address_space
 	struct vm_area_struct *i_mmap;
 	struct list_head pages;
 	uint32_t npages;
+	// cached file pages (filemap.c), unlike `pages` which is tmpfs's storage
+	struct list_head page_cache;
+	uint32_t ncached;
 };
 
 struct dirent
@@ -121,6 +132,7 @@ struct vfs_super_operations
 	struct vfs_inode *(*alloc_inode)(struct vfs_superblock *sb);
 	void (*read_inode)(struct vfs_inode *);
 	void (*write_inode)(struct vfs_inode *);
+	void (*destroy_inode)(struct vfs_inode *);
 	void (*write_super)(struct vfs_superblock *);
 };
 
@@ -140,13 +152,19 @@ struct vfs_inode
 	unsigned long i_blksize;
 	uint32_t i_flags;
 	uint32_t i_size;
-	struct semaphore i_sem;
+	struct rw_semaphore i_rwsem;
 	struct pipe *i_pipe;
 	struct address_space i_data;
 	struct vfs_inode_operations *i_op;
 	struct vfs_file_operations *i_fop;
 	struct vfs_superblock *i_sb;
 	void *i_fs_info;
+	// inode cache (inode.c)
+	uint32_t i_state;
+	uint64_t i_dirtied_when;
+	struct list_head i_hash;
+	struct list_head i_lru;
+	struct list_head i_dirty;
 };
 
 struct vfs_inode_operations
@@ -184,6 +202,8 @@ struct vfs_file
 	void *private_data;
 	fmode_t f_mode;
 	loff_t f_pos;
+	// epoll items watching this file
+	struct list_head f_ep_links;
 };
 
 struct vfs_file_operations
@@ -207,7 +227,6 @@ struct nameidata
 
 int register_filesystem(struct vfs_file_system_type *fs);
 int unregister_filesystem(struct vfs_file_system_type *fs);
-int find_unused_fd_slot(int lowerlimit);
 struct vfs_mount *lookup_mnt(struct vfs_dentry *d);
 void vfs_init(struct vfs_file_system_type *fs, char *dev_name);
 struct vfs_inode *init_inode();
@@ -217,7 +236,6 @@ struct vfs_mount *do_mount(const char *fstype, int flags, const char *name);
 // open.c
 struct vfs_dentry *alloc_dentry(struct vfs_dentry *parent, char *name);
 int32_t vfs_open(const char *path, int32_t flags, ...);
-int32_t vfs_close(int32_t fd);
 int vfs_stat(const char *path, struct kstat *stat);
 int vfs_fstat(int32_t fd, struct kstat *stat);
 int vfs_mknod(const char *path, int mode, dev_t dev);
@@ -236,6 +254,39 @@ ssize_t vfs_fwrite(int32_t fd, const char *buf, size_t count);
 loff_t generic_file_llseek(struct vfs_file *file, loff_t offset, int whence);
 loff_t vfs_flseek(int32_t fd, loff_t offset, int whence);
 
+// filemap.c
+struct page *find_get_page(struct vfs_inode *inode, uint32_t index);
+struct page *read_cache_page(struct vfs_file *file, uint32_t index);
+void invalidate_inode_pages(struct vfs_inode *inode);
+int filemap_map_private(struct vfs_file *file, uint32_t addr, uint32_t len, uint32_t pgoff, bool writable);
+
+// file.c
+struct files_struct *alloc_files();
+struct files_struct *dup_files(struct files_struct *old);
+void free_files(struct files_struct *files);
+void close_files(struct files_struct *files);
+void do_close_on_exec(struct files_struct *files);
+struct vfs_file *fcheck(int32_t fd);
+int find_unused_fd_slot(int lowerlimit);
+void put_unused_fd(int32_t fd);
+void fd_install(int32_t fd, struct vfs_file *file);
+void set_close_on_exec(int32_t fd, bool flag);
+bool get_close_on_exec(int32_t fd);
+int fput(struct vfs_file *file);
+int32_t vfs_close(int32_t fd);
+int do_dup2(int32_t oldfd, int32_t newfd);
+int do_close_range(uint32_t fd, uint32_t max_fd, uint32_t flags);
+
+// inode.c
+void inode_cache_init();
+struct vfs_inode *iget(struct vfs_superblock *sb, unsigned long ino);
+void insert_inode_hash(struct vfs_inode *inode);
+void iput(struct vfs_inode *inode);
+void mark_inode_dirty(struct vfs_inode *inode, uint32_t flags);
+void write_inode_now(struct vfs_inode *inode, bool datasync);
+void sync_inodes();
+int vfs_fsync(int32_t fd, bool datasync);
+
 // fcntl.c
 int do_fcntl(int fd, int cmd, unsigned long arg);
 
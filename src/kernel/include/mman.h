@@ -18,6 +18,8 @@
 #define MAP_FIXED 0x10	   /* Interpret addr exactly */
 #define MAP_ANONYMOUS 0x20 /* don't use a file */
 
+#define MREMAP_MAYMOVE 1
+
 struct kmmap_args
 {
 	void *addr;
@@ -2,6 +2,8 @@
 #define INCLUDE_SOCKIOS_H
 
 #define SIOCGIFDNSADDR 0x8900
+#define SIOCGIFSKBSTATS 0x8901 /* get sk_buff pool stats (struct ifskbstats via ifr_data) */
+#define SIOCGIFSTATS 0x8902	   /* get device counters (struct net_device_stats via ifr_data) */
 
 /* Socket configuration controls. */
 #define SIOCGIFNAME 0x8910	  /* get iface name		*/
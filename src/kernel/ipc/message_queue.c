@@ -8,6 +8,7 @@
 #include <memory/vmm.h>
 #include <utils/debug.h>
 #include <utils/hashmap.h>
+#include <utils/math.h>
 #include <utils/string.h>
 
 static const char defaultdir[] = "/dev/mqueue/";
@@ -36,6 +37,33 @@ static char *mq_normalize_path(char *name)
 	}
 }
 
+static uint32_t mq_message_size(struct mq_attr *attr)
+{
+	return ALIGN_UP(sizeof(struct mq_message) + attr->mq_msgsize, sizeof(uint32_t));
+}
+
+static void mq_setup_slab(struct message_queue *mq)
+{
+	uint32_t size = mq_message_size(mq->attr);
+	mq->slab = kcalloc(mq->attr->mq_maxmsg, size);
+
+	for (int32_t i = 0; i < mq->attr->mq_maxmsg; ++i)
+	{
+		struct mq_message *msg = (struct mq_message *)(mq->slab + i * size);
+		list_add_tail(&msg->sibling, &mq->free_messages);
+	}
+}
+
+void mq_init_queue(struct message_queue *mq)
+{
+	INIT_LIST_HEAD(&mq->wait.list);
+	for (int i = 0; i < MQ_PRIO_MAX; ++i)
+		INIT_LIST_HEAD(&mq->messages[i]);
+	INIT_LIST_HEAD(&mq->free_messages);
+	INIT_LIST_HEAD(&mq->senders);
+	INIT_LIST_HEAD(&mq->receivers);
+}
+
 int32_t mq_open(const char *name, int32_t flags, struct mq_attr *attr)
 {
 	char *fname = mq_normalize_path(name);
@@ -43,22 +71,35 @@ int32_t mq_open(const char *name, int32_t flags, struct mq_attr *attr)
 
 	if (ret >= 0)
 	{
-		struct vfs_file *filp = current_process->files->fd[ret];
+		struct vfs_file *filp = fcheck(ret);
 		struct mqueuefs_inode *mqi = filp->f_dentry->d_inode->i_fs_info;
 		struct message_queue *mq = hashmap_get(&mq_map, &mqi->key);
 		assert(mq);
 
+		int32_t err = 0;
 		if (flags & O_CREAT && !mq->attr)
 		{
-			struct mq_attr *mqattr = kcalloc(1, sizeof(struct mq_attr));
-			mqattr->mq_flags = flags;
-			mqattr->mq_maxmsg = attr ? attr->mq_maxmsg : MAX_NUMBER_OF_MQ_MESSAGES;
-			mqattr->mq_msgsize = attr ? attr->mq_msgsize : MAX_MQ_MESSAGE_SIZE;
-
-			mq->attr = mqattr;
+			if (attr && (attr->mq_maxmsg <= 0 || attr->mq_msgsize <= 0))
+				err = -EINVAL;
+			else
+			{
+				struct mq_attr *mqattr = kcalloc(1, sizeof(struct mq_attr));
+				mqattr->mq_flags = flags;
+				mqattr->mq_maxmsg = attr ? attr->mq_maxmsg : MAX_NUMBER_OF_MQ_MESSAGES;
+				mqattr->mq_msgsize = attr ? attr->mq_msgsize : MAX_MQ_MESSAGE_SIZE;
+
+				mq->attr = mqattr;
+				mq_setup_slab(mq);
+			}
 		}
 		else if (attr && (mq->attr->mq_maxmsg != attr->mq_maxmsg || mq->attr->mq_msgsize != attr->mq_msgsize))
-			ret = -EINVAL;
+			err = -EINVAL;
+
+		if (err < 0)
+		{
+			vfs_close(ret);
+			ret = err;
+		}
 	}
 
 	if (fname != name)
@@ -66,11 +107,42 @@ int32_t mq_open(const char *name, int32_t flags, struct mq_attr *attr)
 	return ret;
 }
 
+static struct message_queue *mq_from_fd(int32_t fd, struct vfs_file **filp)
+{
+	struct vfs_file *file = fcheck(fd);
+	if (!file || file->f_op != &mqueuefs_file_operations)
+		return NULL;
+
+	struct message_queue *mq = file->private_data;
+	if (!mq || !mq->attr)
+		return NULL;
+
+	if (filp)
+		*filp = file;
+	return mq;
+}
+
 int32_t mq_close(int32_t fd)
 {
+	// registration is removed when its process closes the queue
+	struct message_queue *mq = mq_from_fd(fd, NULL);
+	if (mq && mq->notify_pid == current_process->pid)
+		mq->notify_pid = 0;
+
 	return vfs_close(fd);
 }
 
+static void mq_wake_all(struct list_head *waiters, int32_t status)
+{
+	struct mq_waiter *iter, *next;
+	list_for_each_entry_safe(iter, next, waiters, wait.sibling)
+	{
+		list_del(&iter->wait.sibling);
+		iter->status = status;
+		update_thread(iter->wait.thread, THREAD_READY);
+	}
+}
+
 int32_t mq_unlink(const char *name)
 {
 	char *fname = mq_normalize_path(name);
@@ -78,35 +150,18 @@ int32_t mq_unlink(const char *name)
 
 	if (ret >= 0)
 	{
-		struct vfs_file *filp = current_process->files->fd[ret];
+		struct vfs_file *filp = fcheck(ret);
 		struct mqueuefs_inode *mqi = filp->f_dentry->d_inode->i_fs_info;
 		struct message_queue *mq = hashmap_get(&mq_map, &mqi->key);
 		assert(mq);
 
-		struct mq_message *miter, *mnext;
-		list_for_each_entry_safe(miter, mnext, &mq->messages, sibling)
-		{
-			list_del(&miter->sibling);
-			kfree(miter);
-		}
-
-		struct mq_sender *siter, *snext;
-		list_for_each_entry_safe(siter, snext, &mq->senders, sibling)
-		{
-			list_del(&siter->sibling);
-			kfree(siter);
-			update_thread(siter->sender, THREAD_READY);
-		}
-
-		struct mq_receiver *riter, *rnext;
-		list_for_each_entry_safe(riter, rnext, &mq->receivers, sibling)
-		{
-			list_del(&riter->sibling);
-			kfree(riter);
-			update_thread(riter->receiver, THREAD_READY);
-		}
-
+		lock_scheduler();
+		mq_wake_all(&mq->senders, -EBADF);
+		mq_wake_all(&mq->receivers, -EBADF);
 		hashmap_remove(&mq_map, &mqi->key);
+		unlock_scheduler();
+
+		kfree(mq->slab);
 		kfree(mq->attr);
 		kfree(mq);
 	}
@@ -116,150 +171,248 @@ int32_t mq_unlink(const char *name)
 	return 0;
 }
 
-static void mq_add_message(struct message_queue *mq, struct mq_message *msg)
+static bool mq_is_nonblock(struct vfs_file *file, struct message_queue *mq)
 {
-	struct mq_message *iter;
-	list_for_each_entry(iter, &mq->messages, sibling)
-	{
-		if (msg->priority > iter->priority)
-			break;
-	}
+	return (file->f_flags | mq->attr->mq_flags) & O_NONBLOCK;
+}
 
-	if (&iter->sibling == &mq->messages)
-		list_add_tail(&msg->sibling, &mq->messages);
-	else
-		list_add(&msg->sibling, iter->sibling.prev);
+// absolute timeout is in CLOCK_REALTIME, it's converted into sleep timer's clock
+static int32_t mq_get_expires(const struct timespec *abs_timeout, uint64_t *expires)
+{
+	*expires = 0;
+	if (!abs_timeout)
+		return 0;
+
+	if (abs_timeout->tv_sec < 0 || abs_timeout->tv_nsec < 0 || abs_timeout->tv_nsec >= 1000000000)
+		return -EINVAL;
 
-	mq->attr->mq_curmsgs += 1;
+	uint64_t now = get_milliseconds_since_epoch();
+	uint64_t deadline = (uint64_t)abs_timeout->tv_sec * 1000 + abs_timeout->tv_nsec / 1000000;
+	if (deadline <= now)
+		return -ETIMEDOUT;
+
+	*expires = get_milliseconds(NULL) + (deadline - now);
+	return 0;
 }
 
-static void mq_add_sender(struct message_queue *mq, struct mq_sender *mqs)
+// scheduler is locked (once) by caller, it's locked again when returning
+static int32_t mq_wait(struct list_head *waiters, struct mq_waiter *waiter, uint64_t expires)
 {
-	struct mq_sender *iter;
-	list_for_each_entry(iter, &mq->senders, sibling)
-	{
-		if (mqs->priority > iter->priority)
-			break;
-	}
+	struct thread *th = current_thread;
+
+	waiter->wait.thread = th;
+	waiter->wait.func = NULL;
+	waiter->msg = NULL;
+	waiter->status = 0;
+	list_add_tail(&waiter->wait.sibling, waiters);
+	if (expires)
+		mod_timer(&th->sleep_timer, expires);
+	update_thread(th, THREAD_WAITING);
+
+	unlock_scheduler();
+	schedule();
+	lock_scheduler();
+
+	if (expires)
+		del_timer(&th->sleep_timer);
+
+	if (waiter->status)
+		return waiter->status < 0 ? waiter->status : 0;
+
+	// still being queued means that timer or signal woke us up
+	list_del(&waiter->wait.sibling);
+	return expires && get_milliseconds(NULL) >= expires ? -ETIMEDOUT : -EINTR;
+}
 
-	if (&iter->sibling == &mq->senders)
-		list_add_tail(&mqs->sibling, &mq->senders);
-	else
-		list_add(&mqs->sibling, iter->sibling.prev);
+static struct mq_message *mq_dequeue(struct message_queue *mq)
+{
+	if (!mq->bitmap)
+		return NULL;
+
+	uint32_t priority = 31 - __builtin_clz(mq->bitmap);
+	struct list_head *head = &mq->messages[priority];
+	struct mq_message *msg = list_first_entry(head, struct mq_message, sibling);
+
+	list_del(&msg->sibling);
+	if (list_empty(head))
+		mq->bitmap &= ~(1 << priority);
+	mq->attr->mq_curmsgs--;
+
+	return msg;
 }
 
-static void mq_add_receiver(struct message_queue *mq, struct mq_receiver *mqr)
+// receivers only wait on empty queue, so blocked receiver can take message without queuing it
+static void mq_deliver(struct message_queue *mq, struct mq_message *msg)
 {
-	struct mq_receiver *iter;
-	list_for_each_entry(iter, &mq->receivers, sibling)
+	struct mq_waiter *receiver = list_first_entry_or_null(&mq->receivers, struct mq_waiter, wait.sibling);
+	if (receiver)
 	{
-		if (mqr->priority > iter->priority)
-			break;
+		list_del(&receiver->wait.sibling);
+		receiver->msg = msg;
+		receiver->status = 1;
+		update_thread(receiver->wait.thread, THREAD_READY);
+		return;
 	}
 
-	if (&iter->sibling == &mq->receivers)
-		list_add_tail(&mqr->sibling, &mq->receivers);
-	else
-		list_add(&mqr->sibling, iter->sibling.prev);
+	list_add_tail(&msg->sibling, &mq->messages[msg->priority]);
+	mq->bitmap |= 1 << msg->priority;
+	mq->attr->mq_curmsgs++;
+
+	// notification is one-shot, process has to register again
+	if (mq->attr->mq_curmsgs == 1 && mq->notify_pid)
+	{
+		pid_t pid = mq->notify_pid;
+		mq->notify_pid = 0;
+		if (mq->notify.sigev_notify == SIGEV_SIGNAL)
+			do_kill(pid, mq->notify.sigev_signo);
+	}
+
+	wake_up(&mq->wait);
 }
 
-int32_t mq_send(int32_t fd, char *user_buf, uint32_t priority, uint32_t msize)
+int32_t mq_send(int32_t fd, char *user_buf, uint32_t priority, uint32_t msize, const struct timespec *abs_timeout)
 {
-	struct vfs_file *file = current_thread->parent->files->fd[fd];
-	struct message_queue *mq = (struct message_queue *)file->private_data;
+	struct vfs_file *file;
+	struct message_queue *mq = mq_from_fd(fd, &file);
 
 	if (!mq || !(file->f_mode & FMODE_CAN_WRITE))
 		return -EBADF;
 	else if (msize > mq->attr->mq_msgsize)
 		return -EMSGSIZE;
+	else if (priority >= MQ_PRIO_MAX)
+		return -EINVAL;
 
-	assert(mq->attr->mq_curmsgs <= mq->attr->mq_maxmsg);
-	if (mq->attr->mq_curmsgs == mq->attr->mq_maxmsg)
+	lock_scheduler();
+
+	int32_t ret = 0;
+	while (list_empty(&mq->free_messages))
 	{
-		if ((mq->attr->mq_flags & O_NONBLOCK) == 0)
+		uint64_t expires;
+		if (mq_is_nonblock(file, mq))
+			ret = -EAGAIN;
+		else if ((ret = mq_get_expires(abs_timeout, &expires)) >= 0)
 		{
-			struct mq_sender *mqs;
-			wait_until_with_setup(list_is_poison(&mqs->sibling) && mq->attr->mq_curmsgs < mq->attr->mq_maxmsg, ({
-									  mqs = kcalloc(1, sizeof(struct mq_sender));
-									  mqs->sender = current_thread;
-									  mqs->priority = priority;
-									  mq_add_sender(mq, mqs);
-								  }),
-								  kfree(mqs));
+			struct mq_waiter waiter;
+			ret = mq_wait(&mq->senders, &waiter, expires);
+		}
+
+		if (ret < 0)
+		{
+			unlock_scheduler();
+			return ret;
 		}
-		else
-			return -EAGAIN;
 	}
-	assert(mq->attr->mq_curmsgs < mq->attr->mq_maxmsg);
 
-	char *kernel_buf = kcalloc(msize, sizeof(char));
-	memcpy(kernel_buf, user_buf, msize);
+	struct mq_message *msg = list_first_entry(&mq->free_messages, struct mq_message, sibling);
+	list_del(&msg->sibling);
 
-	struct mq_message *mqm = kcalloc(1, sizeof(struct mq_message));
-	mqm->buf = kernel_buf;
-	mqm->msize = msize;
-	mqm->priority = priority;
-	mq_add_message(mq, mqm);
+	unlock_scheduler();
 
-	struct mq_receiver *mqr = list_first_entry_or_null(&mq->receivers, struct mq_receiver, sibling);
-	if (mqr)
-	{
-		assert(mq->attr->mq_curmsgs == 1);
-		list_del(&mqr->sibling);
-		update_thread(mqr->receiver, THREAD_READY);
-	}
+	// slot is reserved, copying from userspace (might fault) is done without lock
+	memcpy(msg->buf, user_buf, msize);
+	msg->msize = msize;
+	msg->priority = priority;
 
-	wake_up(&mq->wait);
+	lock_scheduler();
+	mq_deliver(mq, msg);
+	unlock_scheduler();
 
 	return 0;
 }
 
-int32_t mq_receive(int32_t fd, char *user_buf, uint32_t priority, uint32_t msize)
+int32_t mq_receive(int32_t fd, char *user_buf, uint32_t *priority, uint32_t msize, const struct timespec *abs_timeout)
 {
-	struct vfs_file *file = current_thread->parent->files->fd[fd];
-	struct message_queue *mq = (struct message_queue *)file->private_data;
+	struct vfs_file *file;
+	struct message_queue *mq = mq_from_fd(fd, &file);
 
 	if (!mq || !(file->f_mode & FMODE_CAN_READ))
-		return -EINVAL;
+		return -EBADF;
 	else if (msize < mq->attr->mq_msgsize)
 		return -EMSGSIZE;
 
-	assert(0 <= mq->attr->mq_curmsgs && mq->attr->mq_curmsgs <= mq->attr->mq_maxmsg);
-	assert(msize >= mq->attr->mq_msgsize);
-	if (mq->attr->mq_curmsgs == mq->attr->mq_maxmsg)
+	lock_scheduler();
+
+	int32_t ret = 0;
+	struct mq_message *msg;
+	while (!(msg = mq_dequeue(mq)))
 	{
-		struct mq_sender *mqs = list_first_entry_or_null(&mq->senders, struct mq_sender, sibling);
-		if (mqs)
-		{
-			list_del(&mqs->sibling);
-			update_thread(mqs->sender, THREAD_READY);
-		}
+		uint64_t expires;
+		struct mq_waiter waiter;
+		if (mq_is_nonblock(file, mq))
+			ret = -EAGAIN;
+		else if ((ret = mq_get_expires(abs_timeout, &expires)) >= 0 &&
+				 (ret = mq_wait(&mq->receivers, &waiter, expires)) >= 0 &&
+				 waiter.msg)
+			msg = waiter.msg;
+
+		if (ret < 0 || msg)
+			break;
+	}
+
+	unlock_scheduler();
+
+	if (!msg)
+		return ret;
+
+	memcpy(user_buf, msg->buf, msg->msize);
+	if (priority)
+		*priority = msg->priority;
+	ret = msg->msize;
+
+	lock_scheduler();
+
+	list_add(&msg->sibling, &mq->free_messages);
+	struct mq_waiter *sender = list_first_entry_or_null(&mq->senders, struct mq_waiter, wait.sibling);
+	if (sender)
+	{
+		list_del(&sender->wait.sibling);
+		sender->status = 1;
+		update_thread(sender->wait.thread, THREAD_READY);
 	}
-	else if (mq->attr->mq_curmsgs == 0)
+	wake_up(&mq->wait);
+
+	unlock_scheduler();
+
+	return ret;
+}
+
+int32_t mq_notify(int32_t fd, const struct sigevent *sevp)
+{
+	struct message_queue *mq = mq_from_fd(fd, NULL);
+	if (!mq)
+		return -EBADF;
+
+	int32_t ret = 0;
+	lock_scheduler();
+
+	if (!sevp)
 	{
-		if ((mq->attr->mq_flags & O_NONBLOCK) == 0)
-		{
-			struct mq_receiver *mqr;
-			wait_until_with_setup(mq->attr->mq_curmsgs > 0 && list_is_poison(&mqr->sibling), ({
-									  mqr = kcalloc(1, sizeof(struct mq_receiver));
-									  mqr->priority = priority;
-									  mqr->receiver = current_thread;
-									  mq_add_receiver(mq, mqr);
-								  }),
-								  kfree(mqr));
-		}
-		else
-			return -EAGAIN;
+		if (mq->notify_pid == current_process->pid)
+			mq->notify_pid = 0;
+	}
+	else if (mq->notify_pid)
+		ret = -EBUSY;
+	else if ((sevp->sigev_notify == SIGEV_SIGNAL && valid_signal(sevp->sigev_signo) && sevp->sigev_signo > 0) ||
+			 sevp->sigev_notify == SIGEV_NONE)
+	{
+		mq->notify_pid = current_process->pid;
+		mq->notify = *sevp;
 	}
+	else
+		ret = -EINVAL;
 
-	struct mq_message *mqm = list_first_entry_or_null(&mq->messages, struct mq_message, sibling);
-	assert(mqm);
-	list_del(&mqm->sibling);
-	mq->attr->mq_curmsgs--;
-	memcpy(user_buf, mqm->buf, msize);
-	kfree(mqm);
+	unlock_scheduler();
+	return ret;
+}
 
-	return 0;
+bool mq_is_readable(struct message_queue *mq)
+{
+	return mq->bitmap;
+}
+
+bool mq_is_writable(struct message_queue *mq)
+{
+	return !list_empty(&mq->free_messages);
 }
 
 void mq_init()
@@ -6,6 +6,8 @@
 #include <proc/task.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <system/time.h>
+#include <utils/hashmap.h>
 
 #define MAX_NUMBER_OF_MQ_MESSAGES 32
 #define MAX_MQ_MESSAGE_SIZE 512
@@ -19,35 +21,44 @@ struct mq_attr
                                        (ignored for mq_open()) */
 };
 
-struct mq_sender
-{
-	struct thread *sender;
-	struct list_head sibling;
-	uint32_t priority;
-};
+// NOTE: MQ 2020-08-20
+// Queue owns a slab of mq_maxmsg messages (sized from mq_attr when it's created), send/receive never allocate
+// queued messages are kept in one list per priority, bitmap has a bit for every non-empty list -> the highest is found by bsr
+// a message sent while a receiver is blocked is handed to it directly without being queued
+#define MQ_PRIO_MAX 32
 
-struct mq_receiver
+struct mq_message
 {
-	struct thread *receiver;
 	uint32_t priority;
+	uint32_t msize;
 	struct list_head sibling;
+	char buf[];
 };
 
-struct mq_message
+// blocked sender or receiver, it lives on waiter's stack
+// wait entry is first so that kreaper recognizes it on the stack of a killed waiter
+struct mq_waiter
 {
-	char *buf;
-	uint32_t priority;
-	uint32_t msize;
-	struct list_head sibling;
+	struct wait_queue_entry wait;
+	// message which is handed to receiver
+	struct mq_message *msg;
+	// 1 if the other side has woken it up, < 0 if queue is gone
+	int32_t status;
 };
 
 struct message_queue
 {
 	struct wait_queue_head wait;
-	struct list_head messages;
+	struct list_head messages[MQ_PRIO_MAX];
+	uint32_t bitmap;
+	char *slab;
+	struct list_head free_messages;
 	struct list_head senders;
 	struct list_head receivers;
 	struct mq_attr *attr;
+	// process which is signaled when a message arrives at empty queue (0 if nobody is registered)
+	pid_t notify_pid;
+	struct sigevent notify;
 };
 
 extern struct hashmap mq_map;
@@ -55,7 +66,11 @@ void mq_init();
 int32_t mq_open(const char *name, int32_t flags, struct mq_attr *attr);
 int32_t mq_close(int32_t fd);
 int32_t mq_unlink(const char *name);
-int32_t mq_send(int32_t fd, char *buf, uint32_t priorty, uint32_t msize);
-int32_t mq_receive(int32_t fd, char *buf, uint32_t priority, uint32_t msize);
+int32_t mq_send(int32_t fd, char *buf, uint32_t priority, uint32_t msize, const struct timespec *abs_timeout);
+int32_t mq_receive(int32_t fd, char *buf, uint32_t *priority, uint32_t msize, const struct timespec *abs_timeout);
+int32_t mq_notify(int32_t fd, const struct sigevent *sevp);
+void mq_init_queue(struct message_queue *mq);
+bool mq_is_readable(struct message_queue *mq);
+bool mq_is_writable(struct message_queue *mq);
 
 #endif
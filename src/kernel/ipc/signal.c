@@ -4,7 +4,6 @@
 #include <include/errno.h>
 #include <proc/task.h>
 #include <utils/debug.h>
-#include <utils/hashmap.h>
 #include <utils/string.h>
 
 extern void return_usermode(struct interrupt_registers *);
@@ -42,6 +41,21 @@ bool sig_ignored(struct thread *th, int sig)
 	return handler == SIG_IGN || (handler == SIG_DFL && sig_kernel_ignore(sig));
 }
 
+// NOTE: MQ 2020-08-19
+// pending signal whose default action kills the process, blocking waits check it and give up (-EINTR)
+// so the thread releases what it holds and exits when it returns to userspace
+bool fatal_signal_pending(struct thread *th)
+{
+	sigset_t mask = th->pending & ~th->blocked;
+
+	for (int signum = 1; mask; signum++, mask >>= 1)
+	{
+		if (mask & 1 && sig_fatal(th->parent, signum))
+			return true;
+	}
+	return false;
+}
+
 int do_sigprocmask(int how, const sigset_t *set, sigset_t *oldset)
 {
 	if (oldset)
@@ -92,89 +106,128 @@ int do_sigsuspend(const sigset_t *set)
 	return 0;
 }
 
-int do_kill(pid_t pid, int32_t signum)
+static void send_signal(struct process *proc, int32_t signum)
 {
-	log("Signal: Kill with pid=%d signum=%d", pid, signum);
-	if (!valid_signal(signum) || signum < 0)
-		return -EINVAL;
+	struct thread *th = proc->thread;
 
+	// null signal only checks that target exists
 	if (!signum)
-		return 0;
+		return;
 
-	if (pid > 0)
+	if (signum == SIGCONT)
 	{
-		struct process *proc = find_process_by_pid(pid);
-		struct thread *th = proc->thread;
-
-		if (signum == SIGCONT)
-		{
-			current_process->flags |= SIGNAL_CONTINUED;
-			current_process->flags &= ~SIGNAL_STOPED;
-			sigdelsetmask(&current_thread->pending, SIG_KERNEL_STOP_MASK);
+		proc->flags |= SIGNAL_CONTINUED;
+		proc->flags &= ~SIGNAL_STOPED;
+		sigdelsetmask(&th->pending, SIG_KERNEL_STOP_MASK);
 
-			if (th != current_thread)
-				update_thread(th, THREAD_READY);
+		if (th != current_thread)
+			update_thread(th, THREAD_READY);
 
-			do_kill(current_process->parent->pid, SIGCHLD);
-			wake_up(&current_process->parent->wait_chld);
-		}
-		else if (sig_kernel_stop(signum))
-		{
-			current_process->flags |= SIGNAL_STOPED;
-			current_process->flags &= ~SIGNAL_CONTINUED;
-			sigdelset(&current_thread->pending, SIGCONT);
-
-			update_thread(th, THREAD_WAITING);
+		do_kill(proc->parent->pid, SIGCHLD);
+		wake_up(&proc->parent->wait_chld);
+	}
+	else if (sig_kernel_stop(signum))
+	{
+		proc->flags |= SIGNAL_STOPED;
+		proc->flags &= ~SIGNAL_CONTINUED;
+		sigdelset(&th->pending, SIGCONT);
 
-			do_kill(current_process->parent->pid, SIGCHLD);
-			wake_up(&current_process->parent->wait_chld);
+		update_thread(th, THREAD_WAITING);
 
-			if (th == current_thread)
-				schedule();
-		}
-		else if (!sig_ignored(th, signum))
-		{
-			th->pending |= sigmask(signum);
+		do_kill(proc->parent->pid, SIGCHLD);
+		wake_up(&proc->parent->wait_chld);
 
-			if (signum == SIGKILL && th != current_thread)
-				update_thread(th, THREAD_READY);
-		}
+		if (th == current_thread)
+			schedule();
 	}
-	else if (pid == 0)
+	else if (!sig_ignored(th, signum))
 	{
-		struct process *proc;
-		for_each_process(proc)
-		{
-			if (proc->gid == current_process->gid)
-				do_kill(proc->gid, signum);
-		}
+		th->pending |= sigmask(signum);
+
+		if (signum == SIGKILL && th != current_thread)
+			update_thread(th, THREAD_READY);
 	}
-	else if (pid == -1)
+}
+
+// NOTE: MQ 2020-08-22
+// members are signaled with scheduler locked (lists can't change under us), the calling process is signaled
+// after unlocking because stopping itself schedules away
+static int kill_pgrp(pid_t pgrp, int32_t signum)
+{
+	bool self = false;
+	int ret = -ESRCH;
+
+	lock_scheduler();
+	struct pid *pid = find_pid(pgrp);
+	if (pid)
 	{
 		struct process *proc;
-		for_each_process(proc)
+		for_each_pid_task(proc, pid, PIDTYPE_PGID)
 		{
-			// TODO: MQ 2020-08-20 Make sure calling process has permission to send signals
-			if (proc->pid > 1)
-				do_kill(proc->gid, signum);
+			ret = 0;
+			if (proc == current_process)
+				self = true;
+			else
+				send_signal(proc, signum);
 		}
 	}
-	else
+	unlock_scheduler();
+
+	if (self)
+		send_signal(current_process, signum);
+	return ret;
+}
+
+static int kill_all(int32_t signum)
+{
+	bool self = false;
+
+	lock_scheduler();
+	struct process *proc;
+	for_each_process(proc)
 	{
-		struct process *proc;
-		for_each_process(proc)
-		{
-			if (proc->gid == -pid)
-				do_kill(proc->gid, signum);
-		}
+		// TODO: MQ 2020-08-20 Make sure calling process has permission to send signals
+		if (proc->pid <= INIT_PID)
+			continue;
+		if (proc == current_process)
+			self = true;
+		else
+			send_signal(proc, signum);
 	}
+	unlock_scheduler();
 
+	if (self)
+		send_signal(current_process, signum);
 	return 0;
 }
 
+int do_kill(pid_t pid, int32_t signum)
+{
+	log("Signal: Kill with pid=%d signum=%d", pid, signum);
+	if (!valid_signal(signum) || signum < 0)
+		return -EINVAL;
+
+	if (pid > 0)
+	{
+		struct process *proc = find_process_by_pid(pid);
+		if (!proc)
+			return -ESRCH;
+
+		send_signal(proc, signum);
+		return 0;
+	}
+	else if (pid == 0)
+		return kill_pgrp(current_process->gid, signum);
+	else if (pid == -1)
+		return kill_all(signum);
+	else
+		return kill_pgrp(-pid, signum);
+}
+
 void signal_handler(struct interrupt_registers *regs)
 {
-	if (!current_thread || !current_thread->pending || current_thread->signaling ||
+	if (!current_thread || !current_thread->pending ||
+		(current_thread->signaling && !fatal_signal_pending(current_thread)) ||
 		((uint32_t)regs + sizeof(struct interrupt_registers) != current_thread->kernel_stack))
 		return;
 
@@ -209,9 +262,13 @@ void handle_signal(struct interrupt_registers *regs, sigset_t restored_sig)
 	if (sig_default_action(current_process, signum))
 	{
 		assert(sig_fatal(current_process, signum));
-		current_process->caused_signal = signum;
-		current_process->flags |= SIGNAL_TERMINATED;
-		current_process->flags &= ~(SIGNAL_CONTINUED | SIGNAL_STOPED);
+		// zapped thread, process's status belongs to the thread which is taking it down
+		if (!(current_process->flags & SIGNAL_GROUP_EXIT))
+		{
+			current_process->caused_signal = signum;
+			current_process->flags |= SIGNAL_TERMINATED;
+			current_process->flags &= ~(SIGNAL_CONTINUED | SIGNAL_STOPED);
+		}
 		current_thread->signaling = false;
 		sigemptyset(&current_thread->pending);
 		do_exit(signum);
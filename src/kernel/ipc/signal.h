@@ -97,6 +97,26 @@ typedef void (*__sighandler_t)(int);
 #define sig_kernel_stop(sig) \
 	(((sig) < SIGRTMIN) && siginmask(sig, SIG_KERNEL_STOP_MASK))
 
+// NOTE: MQ 2020-08-20 Used by mq_notify, SIGEV_THREAD is not supported
+#define SIGEV_SIGNAL 0
+#define SIGEV_NONE 1
+#define SIGEV_THREAD 2
+
+union sigval
+{
+	int sival_int;
+	void *sival_ptr;
+};
+
+struct sigevent
+{
+	int sigev_notify;
+	int sigev_signo;
+	union sigval sigev_value;
+	void (*sigev_notify_function)(union sigval);
+	void *sigev_notify_attributes;
+};
+
 #define sig_user_defined(p, signr)                      \
 	(((p)->sighand[(signr)-1].sa_handler != SIG_DFL) && \
 	 ((p)->sighand[(signr)-1].sa_handler != SIG_IGN))
@@ -177,6 +197,7 @@ int do_sigprocmask(int how, const sigset_t *set, sigset_t *oldset);
 int do_sigaction(int signum, const struct sigaction *action, struct sigaction *old_action);
 int do_sigsuspend(const sigset_t *set);
 int do_kill(pid_t pid, int32_t signum);
+bool fatal_signal_pending(struct thread *th);
 bool sig_ignored(struct thread *th, int sig);
 void signal_handler(struct interrupt_registers *regs);
 void handle_signal(struct interrupt_registers *regs, sigset_t restored_sig);
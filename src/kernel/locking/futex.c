@@ -0,0 +1,187 @@
+#include "futex.h"
+
+#include <include/errno.h>
+#include <include/limits.h>
+#include <memory/kernel_info.h>
+#include <proc/task.h>
+#include <system/time.h>
+#include <utils/debug.h>
+
+// NOTE: MQ 2020-08-19
+// futex is a user space word, kernel only keeps threads which sleep on it
+// waiters are hashed by (mm, user address) into buckets, a bucket is shared by unrelated futexes so every waiter is matched by its key
+// value check and queuing happen with scheduler lock held -> waker, which changes the value first, can't miss a waiter
+static struct list_head futex_queues[FUTEX_HASH_SIZE];
+
+static struct list_head *futex_hash(struct mm_struct *mm, uint32_t uaddr)
+{
+	uint32_t key = ((uint32_t)mm >> 4) ^ (uaddr >> 2);
+	return &futex_queues[(key * 0x9E3779B9) >> (32 - FUTEX_HASH_BITS)];
+}
+
+static bool futex_match(struct thread *th, struct mm_struct *mm, uint32_t uaddr)
+{
+	return th->parent->mm == mm && th->futex_key == uaddr;
+}
+
+static int32_t futex_check_address(uint32_t *uaddr)
+{
+	if (!uaddr || (uint32_t)uaddr & 0x3)
+		return -EINVAL;
+	if ((uint32_t)uaddr >= KERNEL_HIGHER_HALF)
+		return -EFAULT;
+	return 0;
+}
+
+void futex_init()
+{
+	log("Futex: Initializing");
+	for (int i = 0; i < FUTEX_HASH_SIZE; ++i)
+		INIT_LIST_HEAD(&futex_queues[i]);
+}
+
+void futex_unqueue(struct thread *th)
+{
+	if (!th->futex_key)
+		return;
+
+	list_del(&th->futex_sibling);
+	th->futex_key = 0;
+}
+
+static int32_t futex_wait(uint32_t *uaddr, uint32_t val, const struct timespec *timeout)
+{
+	struct thread *th = current_thread;
+	uint64_t expires = 0;
+
+	if (timeout)
+	{
+		if (timeout->tv_sec < 0 || timeout->tv_nsec < 0 || timeout->tv_nsec >= 1000000000)
+			return -EINVAL;
+		expires = get_milliseconds(NULL) + timeout->tv_sec * 1000 + timeout->tv_nsec / 1000000;
+	}
+
+	lock_scheduler();
+
+	if (*uaddr != val)
+	{
+		unlock_scheduler();
+		return -EAGAIN;
+	}
+
+	th->futex_key = (uint32_t)uaddr;
+	list_add_tail(&th->futex_sibling, futex_hash(current_process->mm, (uint32_t)uaddr));
+	if (expires)
+		mod_timer(&th->sleep_timer, expires);
+	update_thread(th, THREAD_WAITING);
+
+	unlock_scheduler();
+
+	schedule();
+
+	lock_scheduler();
+
+	// waker dequeues us, still being queued means that timer or signal woke us up
+	int32_t ret = 0;
+	if (th->futex_key)
+	{
+		futex_unqueue(th);
+		ret = expires && get_milliseconds(NULL) >= expires ? -ETIMEDOUT : -EINTR;
+	}
+	if (expires)
+		del_timer(&th->sleep_timer);
+
+	unlock_scheduler();
+
+	return ret;
+}
+
+int32_t futex_wake(uint32_t *uaddr, int32_t nr_wake)
+{
+	struct mm_struct *mm = current_process->mm;
+	struct list_head *head = futex_hash(mm, (uint32_t)uaddr);
+	int32_t nr = 0;
+
+	lock_scheduler();
+
+	struct thread *iter, *next;
+	list_for_each_entry_safe(iter, next, head, futex_sibling)
+	{
+		if (nr >= nr_wake)
+			break;
+		if (!futex_match(iter, mm, (uint32_t)uaddr))
+			continue;
+
+		futex_unqueue(iter);
+		update_thread(iter, THREAD_READY);
+		nr++;
+	}
+
+	unlock_scheduler();
+
+	return nr;
+}
+
+// wakes up to `nr_wake` waiters of uaddr, up to `nr_requeue` of the rest are moved to uaddr2 without waking them (no thundering herd on broadcast)
+static int32_t futex_requeue(uint32_t *uaddr, int32_t nr_wake, int32_t nr_requeue, uint32_t *uaddr2)
+{
+	struct mm_struct *mm = current_process->mm;
+	struct list_head *head = futex_hash(mm, (uint32_t)uaddr);
+	struct list_head *head2 = futex_hash(mm, (uint32_t)uaddr2);
+	int32_t nr = 0, nr_moved = 0;
+
+	lock_scheduler();
+
+	struct thread *iter, *next;
+	list_for_each_entry_safe(iter, next, head, futex_sibling)
+	{
+		if (!futex_match(iter, mm, (uint32_t)uaddr))
+			continue;
+
+		if (nr < nr_wake)
+		{
+			futex_unqueue(iter);
+			update_thread(iter, THREAD_READY);
+			nr++;
+		}
+		else if (nr_moved < nr_requeue)
+		{
+			iter->futex_key = (uint32_t)uaddr2;
+			if (head != head2)
+			{
+				list_del(&iter->futex_sibling);
+				list_add_tail(&iter->futex_sibling, head2);
+			}
+			nr_moved++;
+		}
+		else
+			break;
+	}
+
+	unlock_scheduler();
+
+	return nr + nr_moved;
+}
+
+int32_t do_futex(uint32_t *uaddr, int32_t op, uint32_t val, uint32_t val2, uint32_t *uaddr2)
+{
+	int32_t ret = futex_check_address(uaddr);
+	if (ret < 0)
+		return ret;
+
+	// every futex is private to its process (address space is the key)
+	switch (op & FUTEX_CMD_MASK)
+	{
+	case FUTEX_WAIT:
+		return futex_wait(uaddr, val, (const struct timespec *)val2);
+	case FUTEX_WAKE:
+		return futex_wake(uaddr, val);
+	case FUTEX_REQUEUE:
+		ret = futex_check_address(uaddr2);
+		if (ret < 0)
+			return ret;
+		return futex_requeue(uaddr, val, val2, uaddr2);
+	default:
+		return -ENOSYS;
+	}
+}
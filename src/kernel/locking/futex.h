@@ -0,0 +1,22 @@
+#ifndef LOCKING_FUTEX_H
+#define LOCKING_FUTEX_H
+
+#include <stdint.h>
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+#define FUTEX_REQUEUE 3
+#define FUTEX_PRIVATE_FLAG 128
+#define FUTEX_CMD_MASK ~FUTEX_PRIVATE_FLAG
+
+#define FUTEX_HASH_BITS 8
+#define FUTEX_HASH_SIZE (1 << FUTEX_HASH_BITS)
+
+struct thread;
+
+void futex_init();
+int32_t do_futex(uint32_t *uaddr, int32_t op, uint32_t val, uint32_t val2, uint32_t *uaddr2);
+int32_t futex_wake(uint32_t *uaddr, int32_t nr_wake);
+void futex_unqueue(struct thread *th);
+
+#endif
@@ -0,0 +1,53 @@
+#include "lockstat.h"
+
+#include <proc/task.h>
+#include <utils/vsprintf.h>
+
+static struct lock_class *lock_classes;
+
+void lock_class_register(struct lock_class *class)
+{
+	lock_scheduler();
+
+	if (!class->registered)
+	{
+		class->next = lock_classes;
+		lock_classes = class;
+		class->registered = true;
+	}
+
+	unlock_scheduler();
+}
+
+void lock_stat_contended(struct lock_class *class, uint64_t wait_cycles)
+{
+	if (!class)
+		return;
+
+	lock_scheduler();
+
+	class->contended++;
+	class->wait_cycles += wait_cycles;
+	if (wait_cycles > class->max_wait_cycles)
+		class->max_wait_cycles = wait_cycles;
+
+	unlock_scheduler();
+}
+
+int lock_stats_show(char *buf, size_t size)
+{
+	int len = snprintf(buf, size, "%-24s %10s %10s %10s %10s\n", "CLASS", "ACQUIRED", "CONTENDED", "AVG", "MAX");
+
+	lock_scheduler();
+
+	for (struct lock_class *iter = lock_classes; iter && len < size; iter = iter->next)
+	{
+		uint32_t avg = iter->contended ? iter->wait_cycles / iter->contended : 0;
+		len += snprintf(buf + len, size - len, "%-24s %10u %10u %10u %10u\n",
+						iter->name, atomic_read(&iter->acquired), iter->contended, avg, iter->max_wait_cycles);
+	}
+
+	unlock_scheduler();
+
+	return len < size ? len : size;
+}
@@ -0,0 +1,45 @@
+#ifndef LOCKING_LOCKSTAT_H
+#define LOCKING_LOCKSTAT_H
+
+#include <include/atomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// NOTE: MQ 2020-08-23
+// Locks initialized at the same place (e.g. every pipe's mutex) share one class, stats are kept per class
+// wait time is in tsc cycles like irq stats, it's measured from queuing until the lock is handed over
+struct lock_class
+{
+	const char *name;
+	bool registered;
+	atomic_t acquired;
+	uint32_t contended;
+	uint64_t wait_cycles;
+	uint32_t max_wait_cycles;
+	struct lock_class *next;
+};
+
+#define DEFINE_LOCK_CLASS(cname, lname) \
+	struct lock_class cname = {         \
+		.name = lname,                  \
+	}
+
+// file scope only, compound literal is static there
+#define LOCK_CLASS(lname) (&(struct lock_class){.name = lname})
+
+void lock_class_register(struct lock_class *class);
+void lock_stat_contended(struct lock_class *class, uint64_t wait_cycles);
+int lock_stats_show(char *buf, size_t size);
+
+static inline void lock_stat_acquired(struct lock_class *class)
+{
+	if (!class)
+		return;
+
+	if (!class->registered)
+		lock_class_register(class);
+	atomic_inc(&class->acquired);
+}
+
+#endif
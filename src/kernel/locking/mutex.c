@@ -0,0 +1,62 @@
+#include "mutex.h"
+
+#include <cpu/hal.h>
+#include <proc/task.h>
+#include <utils/debug.h>
+
+#include "waiter.h"
+
+void __mutex_lock_slowpath(struct mutex *lock)
+{
+	struct lock_waiter waiter = {
+		.thread = current_thread,
+	};
+	uint64_t start = rdtsc();
+
+	lock_scheduler();
+	spin_lock(&lock->wait_lock);
+
+	// owner can release it (fast path) until waiters flag is set
+	uint32_t owner;
+	while ((owner = lock->owner))
+	{
+		if (cmpxchg(&lock->owner, owner, owner | MUTEX_FLAG_WAITERS) == owner)
+			break;
+	}
+
+	if (!owner && !cmpxchg(&lock->owner, 0, (uint32_t)current_thread))
+	{
+		spin_unlock(&lock->wait_lock);
+		unlock_scheduler();
+		return;
+	}
+
+	assert((owner & ~MUTEX_FLAG_MASK) != (uint32_t)current_thread);
+	list_add_tail(&waiter.sibling, &lock->wait_list);
+	spin_unlock(&lock->wait_lock);
+
+	// unlock makes us the owner before waking us up
+	lock_waiter_sleep(&waiter);
+
+	unlock_scheduler();
+	lock_stat_contended(lock->class, rdtsc() - start);
+}
+
+void __mutex_unlock_slowpath(struct mutex *lock)
+{
+	lock_scheduler();
+	spin_lock(&lock->wait_lock);
+
+	assert((lock->owner & ~MUTEX_FLAG_MASK) == (uint32_t)current_thread);
+	if (list_empty(&lock->wait_list))
+		lock->owner = 0;
+	else
+	{
+		struct lock_waiter *waiter = list_first_entry(&lock->wait_list, struct lock_waiter, sibling);
+		lock_waiter_grant(waiter);
+		lock->owner = (uint32_t)waiter->thread | (list_empty(&lock->wait_list) ? 0 : MUTEX_FLAG_WAITERS);
+	}
+
+	spin_unlock(&lock->wait_lock);
+	unlock_scheduler();
+}
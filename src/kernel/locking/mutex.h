@@ -0,0 +1,79 @@
+#ifndef LOCKING_MUTEX_H
+#define LOCKING_MUTEX_H
+
+#include <include/list.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lockstat.h"
+#include "spinlock.h"
+
+// owner is aligned thread pointer, lowest bit tells unlock to hand the mutex over to a waiter
+#define MUTEX_FLAG_WAITERS 0x1
+#define MUTEX_FLAG_MASK 0x3
+
+// NOTE: MQ 2020-08-23
+// Uncontended lock/unlock is a single cmpxchg of owner, scheduler is only locked when someone has to sleep
+// kernel runs on one cpu so owner is never running while we are -> waiter sleeps right away instead of spinning
+struct mutex
+{
+	volatile uint32_t owner;
+	spinlock_t wait_lock;
+	struct list_head wait_list;
+	struct lock_class *class;
+};
+
+#define __MUTEX_INITIALIZER(name, lclass)              \
+	{                                                  \
+		.owner = 0,                                    \
+		.wait_lock = 0,                                \
+		.wait_list = LIST_HEAD_INIT((name).wait_list), \
+		.class = lclass,                               \
+	}
+
+#define DEFINE_MUTEX(name) \
+	struct mutex name = __MUTEX_INITIALIZER(name, LOCK_CLASS(#name))
+
+static inline void __mutex_init(struct mutex *lock, struct lock_class *class)
+{
+	*lock = (struct mutex)__MUTEX_INITIALIZER(*lock, class);
+}
+
+#define mutex_init(lock) ({                         \
+	static DEFINE_LOCK_CLASS(__mutex_class, #lock); \
+	__mutex_init(lock, &__mutex_class);             \
+})
+
+extern volatile struct thread *current_thread;
+
+void __mutex_lock_slowpath(struct mutex *lock);
+void __mutex_unlock_slowpath(struct mutex *lock);
+
+static inline void mutex_lock(struct mutex *lock)
+{
+	if (cmpxchg(&lock->owner, 0, (uint32_t)current_thread))
+		__mutex_lock_slowpath(lock);
+	lock_stat_acquired(lock->class);
+}
+
+static inline bool mutex_trylock(struct mutex *lock)
+{
+	if (cmpxchg(&lock->owner, 0, (uint32_t)current_thread))
+		return false;
+
+	lock_stat_acquired(lock->class);
+	return true;
+}
+
+static inline void mutex_unlock(struct mutex *lock)
+{
+	if (cmpxchg(&lock->owner, (uint32_t)current_thread, 0) != (uint32_t)current_thread)
+		__mutex_unlock_slowpath(lock);
+}
+
+static inline bool mutex_is_locked(struct mutex *lock)
+{
+	return lock->owner != 0;
+}
+
+#endif
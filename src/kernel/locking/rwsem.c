@@ -0,0 +1,95 @@
+#include "rwsem.h"
+
+#include <cpu/hal.h>
+#include <proc/task.h>
+#include <utils/debug.h>
+
+#include "waiter.h"
+
+// scheduler and sem->lock are held by caller
+static void rwsem_wake(struct rw_semaphore *sem)
+{
+	struct lock_waiter *waiter, *next;
+	list_for_each_entry_safe(waiter, next, &sem->wait_list, sibling)
+	{
+		if (waiter->write)
+		{
+			if (!sem->count)
+			{
+				sem->count = RWSEM_WRITER_LOCKED;
+				lock_waiter_grant(waiter);
+			}
+			break;
+		}
+
+		sem->count++;
+		lock_waiter_grant(waiter);
+	}
+}
+
+static void rwsem_down(struct rw_semaphore *sem, bool write)
+{
+	lock_scheduler();
+	spin_lock(&sem->lock);
+
+	bool available = write ? !sem->count : sem->count >= 0;
+	if (available && list_empty(&sem->wait_list))
+	{
+		sem->count = write ? RWSEM_WRITER_LOCKED : sem->count + 1;
+		spin_unlock(&sem->lock);
+		unlock_scheduler();
+		lock_stat_acquired(sem->class);
+		return;
+	}
+
+	struct lock_waiter waiter = {
+		.thread = current_thread,
+		.write = write,
+	};
+	uint64_t start = rdtsc();
+	list_add_tail(&waiter.sibling, &sem->wait_list);
+	spin_unlock(&sem->lock);
+
+	// releaser accounts us in sem->count before waking us up
+	lock_waiter_sleep(&waiter);
+
+	unlock_scheduler();
+	lock_stat_acquired(sem->class);
+	lock_stat_contended(sem->class, rdtsc() - start);
+}
+
+void down_read(struct rw_semaphore *sem)
+{
+	rwsem_down(sem, false);
+}
+
+void down_write(struct rw_semaphore *sem)
+{
+	rwsem_down(sem, true);
+}
+
+void up_read(struct rw_semaphore *sem)
+{
+	lock_scheduler();
+	spin_lock(&sem->lock);
+
+	assert(sem->count > 0);
+	if (!--sem->count)
+		rwsem_wake(sem);
+
+	spin_unlock(&sem->lock);
+	unlock_scheduler();
+}
+
+void up_write(struct rw_semaphore *sem)
+{
+	lock_scheduler();
+	spin_lock(&sem->lock);
+
+	assert(sem->count == RWSEM_WRITER_LOCKED);
+	sem->count = 0;
+	rwsem_wake(sem);
+
+	spin_unlock(&sem->lock);
+	unlock_scheduler();
+}
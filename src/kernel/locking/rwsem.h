@@ -0,0 +1,50 @@
+#ifndef LOCKING_RWSEM_H
+#define LOCKING_RWSEM_H
+
+#include <include/list.h>
+#include <stdint.h>
+
+#include "lockstat.h"
+#include "spinlock.h"
+
+#define RWSEM_WRITER_LOCKED -1
+
+// NOTE: MQ 2020-08-23
+// count > 0 is number of readers, writer sets it to RWSEM_WRITER_LOCKED
+// new comers queue behind any waiter (fifo) -> a stream of readers can't starve a writer
+// releaser wakes the first writer or every reader in front of the next writer
+struct rw_semaphore
+{
+	spinlock_t lock;
+	int32_t count;
+	struct list_head wait_list;
+	struct lock_class *class;
+};
+
+#define __RWSEM_INITIALIZER(name, lclass)              \
+	{                                                  \
+		.lock = 0,                                     \
+		.count = 0,                                    \
+		.wait_list = LIST_HEAD_INIT((name).wait_list), \
+		.class = lclass,                               \
+	}
+
+#define DECLARE_RWSEM(name) \
+	struct rw_semaphore name = __RWSEM_INITIALIZER(name, LOCK_CLASS(#name))
+
+static inline void __init_rwsem(struct rw_semaphore *sem, struct lock_class *class)
+{
+	*sem = (struct rw_semaphore)__RWSEM_INITIALIZER(*sem, class);
+}
+
+#define init_rwsem(sem) ({                         \
+	static DEFINE_LOCK_CLASS(__rwsem_class, #sem); \
+	__init_rwsem(sem, &__rwsem_class);             \
+})
+
+void down_read(struct rw_semaphore *sem);
+void up_read(struct rw_semaphore *sem);
+void down_write(struct rw_semaphore *sem);
+void up_write(struct rw_semaphore *sem);
+
+#endif
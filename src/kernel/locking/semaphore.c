@@ -1,54 +1,52 @@
 #include "semaphore.h"
 
-#include <memory/vmm.h>
+#include <cpu/hal.h>
 #include <proc/task.h>
 
-struct semaphore_waiter
-{
-	struct list_head sibling;
-	struct thread *task;
-};
+#include "waiter.h"
 
 void acquire_semaphore(struct semaphore *sem)
 {
-	// TODO: MQ 2020-07-20 should we use lock/unlock_scheduler instead?
-	disable_interrupts();
+	lock_scheduler();
 	spin_lock(&sem->lock);
+
 	if (sem->count > 0)
 	{
 		sem->count--;
 		spin_unlock(&sem->lock);
-		enable_interrupts();
+		unlock_scheduler();
+		lock_stat_acquired(sem->class);
+		return;
 	}
-	else
-	{
-		struct semaphore_waiter *waiter = kcalloc(1, sizeof(struct semaphore_waiter));
-		waiter->task = current_thread;
 
-		list_add_tail(&waiter->sibling, &sem->wait_list);
-		update_thread(current_thread, THREAD_WAITING);
-		spin_unlock(&sem->lock);
-		schedule();
-	}
+	struct lock_waiter waiter = {
+		.thread = current_thread,
+	};
+	uint64_t start = rdtsc();
+	list_add_tail(&waiter.sibling, &sem->wait_list);
+	spin_unlock(&sem->lock);
+
+	// releaser passes its count to us instead of increasing sem->count
+	lock_waiter_sleep(&waiter);
+
+	unlock_scheduler();
+	lock_stat_acquired(sem->class);
+	lock_stat_contended(sem->class, rdtsc() - start);
 }
 
 void release_semaphore(struct semaphore *sem)
 {
-	disable_interrupts();
+	lock_scheduler();
 	spin_lock(&sem->lock);
+
 	if (list_empty(&sem->wait_list))
 	{
 		if (sem->count < sem->capacity)
 			sem->count++;
 	}
 	else
-	{
-		struct semaphore_waiter *waiter = list_first_entry(&sem->wait_list, struct semaphore_waiter, sibling);
-
-		list_del(&waiter->sibling);
-		update_thread(waiter->task, THREAD_READY);
-	}
+		lock_waiter_grant(list_first_entry(&sem->wait_list, struct lock_waiter, sibling));
 
 	spin_unlock(&sem->lock);
-	enable_interrupts();
+	unlock_scheduler();
 }
@@ -4,6 +4,7 @@
 #include <include/list.h>
 #include <stdint.h>
 
+#include "lockstat.h"
 #include "spinlock.h"
 
 struct semaphore
@@ -12,24 +13,31 @@ struct semaphore
 	uint32_t count;
 	uint32_t capacity;
 	struct list_head wait_list;
+	struct lock_class *class;
 };
 
-#define __SEMAPHORE_INITIALIZER(name, n)               \
+#define __SEMAPHORE_INITIALIZER(name, n, lclass)       \
 	{                                                  \
 		.lock = 0,                                     \
 		.count = n,                                    \
 		.capacity = n,                                 \
 		.wait_list = LIST_HEAD_INIT((name).wait_list), \
+		.class = lclass,                               \
 	}
 
 #define DEFINE_SEMAPHORE(name) \
-	struct semaphore name = __SEMAPHORE_INITIALIZER(name, 1)
+	struct semaphore name = __SEMAPHORE_INITIALIZER(name, 1, LOCK_CLASS(#name))
 
-static inline void sema_init(struct semaphore *sem, int val)
+static inline void __sema_init(struct semaphore *sem, int val, struct lock_class *class)
 {
-	*sem = (struct semaphore)__SEMAPHORE_INITIALIZER(*sem, val);
+	*sem = (struct semaphore)__SEMAPHORE_INITIALIZER(*sem, val, class);
 }
 
+#define sema_init(sem, val) ({                   \
+	static DEFINE_LOCK_CLASS(__sem_class, #sem); \
+	__sema_init(sem, val, &__sem_class);         \
+})
+
 void acquire_semaphore(struct semaphore *sem);
 void release_semaphore(struct semaphore *sem);
 
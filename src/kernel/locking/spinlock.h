@@ -1,6 +1,8 @@
 #ifndef LOCKING_SPINLOCK_H
 #define LOCKING_SPINLOCK_H
 
+#include <stdint.h>
+
 #define barrier() asm volatile("" \
 							   :  \
 							   :  \
@@ -22,6 +24,18 @@ static inline unsigned short xchg_8(void *ptr, unsigned char x)
 	return x;
 }
 
+// returns value of *ptr before the exchange, it's only stored if that value is old
+static inline uint32_t cmpxchg(volatile uint32_t *ptr, uint32_t old, uint32_t new)
+{
+	uint32_t prev;
+	__asm__ __volatile__("lock; cmpxchgl %2,%1"
+						 : "=a"(prev), "+m"(*ptr)
+						 : "r"(new), "0"(old)
+						 : "memory");
+
+	return prev;
+}
+
 #define SPINLOCK_UNLOCKED 0
 #define SPINLOCK_LOCK 1
 
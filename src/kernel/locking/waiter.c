@@ -0,0 +1,24 @@
+#include "waiter.h"
+
+#include <proc/task.h>
+
+// scheduler is locked (once) by caller, it's locked again when returning
+// signal, timer or zap_other_threads can wake the thread up, lock is not taken until it's granted
+void lock_waiter_sleep(struct lock_waiter *waiter)
+{
+	while (!waiter->granted)
+	{
+		update_thread(current_thread, THREAD_WAITING);
+		unlock_scheduler();
+		schedule();
+		lock_scheduler();
+	}
+}
+
+// scheduler is locked by caller
+void lock_waiter_grant(struct lock_waiter *waiter)
+{
+	list_del(&waiter->sibling);
+	waiter->granted = true;
+	update_thread(waiter->thread, THREAD_READY);
+}
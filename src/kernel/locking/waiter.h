@@ -0,0 +1,25 @@
+#ifndef LOCKING_WAITER_H
+#define LOCKING_WAITER_H
+
+#include <include/list.h>
+#include <stdbool.h>
+
+struct thread;
+
+// NOTE: MQ 2020-08-23
+// Waiter lives on the sleeping thread's stack, releaser hands the lock over (granted) and dequeues it
+// -> nothing is allocated for contended acquire, a woken thread doesn't race new comers for the lock
+// sleeping is not interruptible, even a killed thread stays queued until it's granted, holders unwind and release
+// -> waiter is always dequeued by the releaser before its stack goes away
+struct lock_waiter
+{
+	struct list_head sibling;
+	struct thread *thread;
+	bool write;
+	bool granted;
+};
+
+void lock_waiter_sleep(struct lock_waiter *waiter);
+void lock_waiter_grant(struct lock_waiter *waiter);
+
+#endif
@@ -9,6 +9,8 @@
 #include "cpu/idt.h"
 #include "cpu/pit.h"
 #include "cpu/rtc.h"
+#include "cpu/softirq.h"
+#include "cpu/sysenter.h"
 #include "cpu/tss.h"
 #include "devices/ata.h"
 #include "devices/char/memory.h"
@@ -19,6 +21,7 @@
 #include "fs/ext2/ext2.h"
 #include "fs/vfs.h"
 #include "ipc/message_queue.h"
+#include "locking/futex.h"
 #include "memory/pmm.h"
 #include "memory/vmm.h"
 #include "multiboot2.h"
@@ -29,6 +32,7 @@
 #include "net/net.h"
 #include "net/tcp.h"
 #include "proc/task.h"
+#include "proc/vdso.h"
 #include "system/framebuffer.h"
 #include "system/sysapi.h"
 #include "system/time.h"
@@ -50,6 +54,7 @@ void setup_window_server(struct Elf32_Layout *elf_layout)
 	struct framebuffer *fb = get_framebuffer();
 	uint32_t screen_size = fb->height * fb->pitch;
 	struct vm_area_struct *area = get_unmapped_area(0, screen_size);
+	assert(area);
 	uint32_t blocks = (area->vm_end - area->vm_start) / PMM_FRAME_SIZE;
 	for (uint32_t iblock = 0; iblock < blocks; ++iblock)
 		vmm_map_address(
@@ -79,6 +84,9 @@ void kernel_init()
 	unlock_scheduler();
 
 	timer_init();
+	softirq_init();
+	debug_start_drainer();
+	reaper_init();
 
 	// setup random's seed
 	srand(get_seconds(NULL));
@@ -97,9 +105,11 @@ void kernel_init()
 
 	// init ipc message queue
 	mq_init();
+	futex_init();
 
 	// register system apis
 	syscall_init();
+	vdso_init();
 
 	process_load("window server", "/bin/window_server", THREAD_SYSTEM_POLICY, 0, setup_window_server);
 
@@ -153,9 +163,13 @@ int kernel_main(uint32_t addr, uint32_t magic)
 	// register irq and handlers
 	idt_init();
 
+	// fast system call entry
+	sysenter_init();
+
 	// physical memory and paging
 	pmm_init(multiboot_meminfo, multiboot_mmap);
 	vmm_init();
+	vmalloc_init();
 
 	exception_init();
 
@@ -2,7 +2,7 @@
 
 #include "vmm.h"
 
-#define PKMAP_BASE 0xE0000000
+#define PKMAP_BASE 0xE8000000
 #define LAST_PKMAP 1024
 
 uint32_t pkmap[LAST_PKMAP];
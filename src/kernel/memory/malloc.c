@@ -7,8 +7,8 @@
 #include "vmm.h"
 
 #define BLOCK_MAGIC 0x464E
-
-extern uint32_t heap_current;
+// NOTE: MQ 2020-08-18 Page sized and larger objects come from vmalloc, they are page aligned and their frames are given back on kfree
+#define KMALLOC_MAX_SIZE PMM_FRAME_SIZE
 
 struct block_meta
 {
@@ -75,6 +75,9 @@ void *kmalloc(size_t size)
 	if (size <= 0)
 		return NULL;
 
+	if (size >= KMALLOC_MAX_SIZE)
+		return vmalloc(size);
+
 	struct block_meta *block;
 
 	size = ALIGN_UP(size, 4);
@@ -123,46 +126,17 @@ void kfree(void *ptr)
 	if (!ptr)
 		return;
 
+	if (is_vmalloc_addr(ptr))
+	{
+		vfree(ptr);
+		return;
+	}
+
 	struct block_meta *block = get_block_ptr(ptr);
 	assert_kblock_valid(block);
 	block->free = true;
 }
 
-// NOTE: MQ 2019-11-24
-// next object in heap space can be any number
-// align heap so the next object's addr will be started at size * n
-// ------------------- 0xE0000000
-// |                 |
-// |                 |
-// |                 | new object address m = (size * n)
-// ------------------- m - sizeof(struct block_meta)
-// |                 | empty object (>= 1)
-// ------------------- padding - sizeof(struct block_meta)
-void *kalign_heap(size_t size)
-{
-	uint32_t heap_addr = (uint32_t)sbrk(0);
-
-	if (heap_addr % size == 0)
-		return NULL;
-
-	uint32_t padding_size = div_ceil(heap_addr, size) * size - heap_addr;
-	uint32_t required_size = sizeof(struct block_meta) * 2;
-
-	while (padding_size <= KERNEL_HEAP_TOP)
-	{
-		if (padding_size > required_size)
-		{
-			struct block_meta *last = kblocklist;
-			while (!last->next)
-				last = last->next;
-			struct block_meta *block = request_space(last, padding_size - required_size);
-			return block + 1;
-		}
-		padding_size += size;
-	}
-	return NULL;
-}
-
 void *krealloc(void *ptr, size_t size)
 {
 	if (!ptr && size == 0)
@@ -173,7 +147,8 @@ void *krealloc(void *ptr, size_t size)
 	else if (!ptr)
 		return kcalloc(size, sizeof(char));
 
+	size_t old_size = is_vmalloc_addr(ptr) ? vmalloc_size(ptr) : get_block_ptr(ptr)->size;
 	void *newptr = kcalloc(size, sizeof(char));
-	memcpy(newptr, ptr, size);
+	memcpy(newptr, ptr, min(old_size, size));
 	return newptr;
 }
@@ -1,6 +1,9 @@
 #include <fs/vfs.h>
+#include <include/errno.h>
+#include <include/mman.h>
 #include <memory/vmm.h>
 #include <proc/task.h>
+#include <proc/vdso.h>
 #include <utils/debug.h>
 #include <utils/math.h>
 #include <utils/string.h>
@@ -9,175 +12,591 @@
 
 // TODO: MQ 2020-01-25 Add support for release block when there is no reference to frame block
 
-struct vm_area_struct *get_unmapped_area(uint32_t addr, uint32_t len)
+static struct vm_area_struct *vma_prev(struct vm_area_struct *vma)
 {
-	struct mm_struct *mm = current_process->mm;
-	struct vm_area_struct *vma = kcalloc(1, sizeof(struct vm_area_struct));
+	return vma->vm_sibling.prev == &vma->vm_mm->mmap ? NULL : list_prev_entry(vma, vm_sibling);
+}
+
+static struct vm_area_struct *vma_next(struct vm_area_struct *vma)
+{
+	return list_is_last(&vma->vm_sibling, &vma->vm_mm->mmap) ? NULL : list_next_entry(vma, vm_sibling);
+}
+
+static uint32_t vma_gap(struct vm_area_struct *vma)
+{
+	struct vm_area_struct *prev = vma_prev(vma);
+	return vma->vm_start - (prev ? prev->vm_end : 0);
+}
+
+static void vma_augment(struct rb_node *node)
+{
+	struct vm_area_struct *vma = rb_entry(node, struct vm_area_struct, vm_rb);
+	uint32_t gap = vma_gap(vma);
+
+	if (node->rb_left)
+		gap = max(gap, rb_entry(node->rb_left, struct vm_area_struct, vm_rb)->rb_subtree_gap);
+	if (node->rb_right)
+		gap = max(gap, rb_entry(node->rb_right, struct vm_area_struct, vm_rb)->rb_subtree_gap);
+
+	vma->rb_subtree_gap = gap;
+}
+
+// an area's gap depends on its previous area, the next area has to be re-augmented when one is added, removed or resized
+static void vma_gap_update_next(struct vm_area_struct *vma)
+{
+	struct vm_area_struct *next = vma_next(vma);
+	if (next)
+		rb_augment_propagate(&next->vm_rb, vma_augment);
+}
+
+void vma_link(struct mm_struct *mm, struct vm_area_struct *vma)
+{
+	struct rb_node **link = &mm->mm_rb.rb_node, *parent = NULL;
+	struct vm_area_struct *prev = NULL;
+
+	while (*link)
+	{
+		struct vm_area_struct *iter = rb_entry(*link, struct vm_area_struct, vm_rb);
+		parent = *link;
+		if (vma->vm_start < iter->vm_start)
+			link = &parent->rb_left;
+		else
+		{
+			prev = iter;
+			link = &parent->rb_right;
+		}
+	}
+
 	vma->vm_mm = mm;
+	list_add(&vma->vm_sibling, prev ? &prev->vm_sibling : &mm->mmap);
+	rb_link_node(&vma->vm_rb, parent, link);
+	rb_insert_color(&vma->vm_rb, &mm->mm_rb, vma_augment);
+	vma_gap_update_next(vma);
+	mm->map_count++;
+}
 
-	if (!addr || addr < mm->end_brk)
-		addr = max(mm->free_area_cache, mm->end_brk);
-	assert(addr == PAGE_ALIGN(addr));
-	len = PAGE_ALIGN(len);
+void vma_unlink(struct mm_struct *mm, struct vm_area_struct *vma)
+{
+	struct vm_area_struct *next = vma_next(vma);
 
-	uint32_t found_addr = addr;
-	if (list_empty(&mm->mmap))
-		list_add(&vma->vm_sibling, &mm->mmap);
-	else
+	list_del(&vma->vm_sibling);
+	rb_erase(&vma->vm_rb, &mm->mm_rb, vma_augment);
+	if (next)
+		rb_augment_propagate(&next->vm_rb, vma_augment);
+
+	if (mm->mmap_cache == vma)
+		mm->mmap_cache = NULL;
+	mm->map_count--;
+}
+
+// caller makes sure that the new range doesn't overlap neighbours, so area's position in tree is unchanged
+static void vma_adjust(struct vm_area_struct *vma, uint32_t start, uint32_t end)
+{
+	vma->vm_start = start;
+	vma->vm_end = end;
+	rb_augment_propagate(&vma->vm_rb, vma_augment);
+	vma_gap_update_next(vma);
+}
+
+// [vm_start, addr) stays in vma, returns the new area [addr, vm_end)
+static struct vm_area_struct *split_vma(struct mm_struct *mm, struct vm_area_struct *vma, uint32_t addr)
+{
+	struct vm_area_struct *new = kcalloc(1, sizeof(struct vm_area_struct));
+	new->vm_start = addr;
+	new->vm_end = vma->vm_end;
+	new->vm_flags = vma->vm_flags;
+	new->vm_file = vma->vm_file;
+
+	vma_adjust(vma, vma->vm_start, addr);
+	vma_link(mm, new);
+	return new;
+}
+
+// NOTE: MQ 2020-08-17
+// Only anonymous areas are merged, heap is never merged because do_brk resizes it by its end, vdso belongs to every process
+static bool vma_can_merge(struct vm_area_struct *prev, struct vm_area_struct *next)
+{
+	struct mm_struct *mm = prev->vm_mm;
+
+	return prev->vm_end == next->vm_start &&
+		   prev->vm_flags == next->vm_flags &&
+		   !prev->vm_file && !next->vm_file &&
+		   prev->vm_start != mm->start_brk && next->vm_start != mm->start_brk &&
+		   next->vm_end <= VDSO_BASE;
+}
+
+static void vma_join(struct mm_struct *mm, struct vm_area_struct *prev, struct vm_area_struct *next)
+{
+	uint32_t end = next->vm_end;
+
+	vma_unlink(mm, next);
+	kfree(next);
+	vma_adjust(prev, prev->vm_start, end);
+}
+
+// the first area which ends above addr (addr is either inside or in the gap before it)
+static struct vm_area_struct *find_vma_above(struct mm_struct *mm, uint32_t addr)
+{
+	struct vm_area_struct *vma = mm->mmap_cache;
+	if (vma && vma->vm_start <= addr && addr < vma->vm_end)
+		return vma;
+
+	struct vm_area_struct *found = NULL;
+	struct rb_node *node = mm->mm_rb.rb_node;
+	while (node)
 	{
-		struct vm_area_struct *iter = NULL;
-		list_for_each_entry(iter, &mm->mmap, vm_sibling)
+		struct vm_area_struct *iter = rb_entry(node, struct vm_area_struct, vm_rb);
+		if (iter->vm_end > addr)
 		{
-			struct vm_area_struct *next = list_next_entry(iter, vm_sibling);
-			bool is_last_entry = list_is_last(&iter->vm_sibling, &mm->mmap);
+			found = iter;
+			if (iter->vm_start <= addr)
+				break;
+			node = node->rb_left;
+		}
+		else
+			node = node->rb_right;
+	}
 
-			if (addr + len <= iter->vm_start)
+	if (found && found->vm_start <= addr)
+		mm->mmap_cache = found;
+	return found;
+}
+
+struct vm_area_struct *find_vma(struct mm_struct *mm, uint32_t addr)
+{
+	struct vm_area_struct *vma = find_vma_above(mm, addr);
+	return vma && vma->vm_start <= addr ? vma : NULL;
+}
+
+// NOTE: MQ 2020-08-17
+// The lowest free range [start, start + len) with start >= low, returns 0 if there is none
+// subtrees whose largest gap is smaller than len are skipped, gaps ending below low + len as well
+static uint32_t unmapped_area(struct mm_struct *mm, uint32_t low, uint32_t len)
+{
+	uint32_t high = VDSO_BASE;
+	uint32_t low_limit = low + len;
+	if (low_limit < low || low_limit > high)
+		return 0;
+
+	struct vm_area_struct *vma = find_vma_above(mm, low);
+	if (!vma || low_limit <= vma->vm_start)
+		return low;
+
+	vma = rb_entry(mm->mm_rb.rb_node, struct vm_area_struct, vm_rb);
+	if (vma->rb_subtree_gap < len)
+		goto check_highest;
+
+	uint32_t gap_start, gap_end;
+	while (true)
+	{
+		gap_end = vma->vm_start;
+		if (gap_end >= low_limit && vma->vm_rb.rb_left)
+		{
+			struct vm_area_struct *left = rb_entry(vma->vm_rb.rb_left, struct vm_area_struct, vm_rb);
+			if (left->rb_subtree_gap >= len)
 			{
-				list_add(&iter->vm_sibling, &mm->mmap);
-				break;
+				vma = left;
+				continue;
 			}
-			else if (addr >= iter->vm_end &&
-					 (is_last_entry ||
-					  (!is_last_entry && addr + len <= next->vm_start)))
+		}
+
+		struct vm_area_struct *prev = vma_prev(vma);
+		gap_start = prev ? prev->vm_end : 0;
+	check_current:
+		if (gap_end >= low_limit && gap_end - max(gap_start, low) >= len)
+			return max(gap_start, low);
+
+		if (vma->vm_rb.rb_right)
+		{
+			struct vm_area_struct *right = rb_entry(vma->vm_rb.rb_right, struct vm_area_struct, vm_rb);
+			if (right->rb_subtree_gap >= len)
 			{
-				list_add(&vma->vm_sibling, &iter->vm_sibling);
-				break;
+				vma = right;
+				continue;
 			}
-			else if (!is_last_entry &&
-					 (iter->vm_end <= addr && addr < next->vm_start) && next->vm_start - iter->vm_end >= len)
+		}
+
+		// go up until coming from a left child, its parent's gap hasn't been checked yet
+		while (true)
+		{
+			struct rb_node *node = &vma->vm_rb;
+			if (!node->rb_parent)
+				goto check_highest;
+
+			vma = rb_entry(node->rb_parent, struct vm_area_struct, vm_rb);
+			if (node == vma->vm_rb.rb_left)
 			{
-				list_add(&vma->vm_sibling, &iter->vm_sibling);
-				found_addr = next->vm_start - len;
-				break;
+				gap_start = vma_prev(vma)->vm_end;
+				gap_end = vma->vm_start;
+				goto check_current;
 			}
 		}
 	}
 
-	if (found_addr)
-	{
-		vma->vm_start = found_addr;
-		vma->vm_end = found_addr + len;
-		mm->free_area_cache = vma->vm_end;
-	}
+check_highest:
+	vma = list_last_entry(&mm->mmap, struct vm_area_struct, vm_sibling);
+	gap_start = max(vma->vm_end, low);
+	if (gap_start + len < gap_start || gap_start + len > high)
+		return 0;
+	return gap_start;
+}
+
+struct vm_area_struct *get_unmapped_area(uint32_t addr, uint32_t len)
+{
+	struct mm_struct *mm = current_process->mm;
+
+	if (!addr || addr < mm->end_brk)
+		addr = max(mm->free_area_cache, mm->end_brk);
+	assert(addr == PAGE_ALIGN(addr));
+	len = PAGE_ALIGN(len);
+
+	uint32_t start = unmapped_area(mm, addr, len);
+	if (!start)
+		return NULL;
+
+	struct vm_area_struct *vma = kcalloc(1, sizeof(struct vm_area_struct));
+	vma->vm_start = start;
+	vma->vm_end = start + len;
+	vma_link(mm, vma);
+	mm->free_area_cache = vma->vm_end;
 
 	return vma;
 }
 
-static struct vm_area_struct *find_vma(struct mm_struct *mm, uint32_t addr)
+static int expand_area(struct vm_area_struct *vma, uint32_t address)
+{
+	address = PAGE_ALIGN(address);
+	if (address <= vma->vm_end)
+		return 0;
+
+	struct vm_area_struct *next = vma_next(vma);
+	if (next && address > next->vm_start)
+		return -ENOMEM;
+
+	vma_adjust(vma, vma->vm_start, address);
+	return 0;
+}
+
+// same rule as change_protection, PROT_NONE page is present for kernel only
+static uint32_t vma_page_flags(struct vm_area_struct *vma)
 {
-	struct vm_area_struct *iter = NULL;
-	list_for_each_entry(iter, &mm->mmap, vm_sibling)
+	uint32_t flags = I86_PTE_PRESENT;
+	if (vma->vm_flags & (VM_READ | VM_WRITE | VM_EXEC))
+		flags |= I86_PTE_USER;
+	if (vma->vm_flags & VM_WRITE)
+		flags |= I86_PTE_WRITABLE;
+	return flags;
+}
+
+static void map_anonymous_range(struct vm_area_struct *vma, uint32_t start, uint32_t end)
+{
+	uint32_t flags = vma_page_flags(vma);
+
+	for (uint32_t vaddr = start; vaddr < end; vaddr += PMM_FRAME_SIZE)
 	{
-		if (iter->vm_start <= addr && addr < iter->vm_end)
-			return iter;
+		uint32_t paddr = (uint32_t)pmm_alloc_block();
+		vmm_map_address(current_process->pdir, vaddr, paddr, flags);
 	}
-
-	return NULL;
 }
 
-static int expand_area(struct vm_area_struct *vma, uint32_t address, bool fixed)
+// NOTE: MQ 2020-08-17 Areas partly covered by [addr, addr + len) are split, vdso pages don't belong to the process
+int do_munmap(struct mm_struct *mm, uint32_t addr, size_t len)
 {
-	address = PAGE_ALIGN(address);
-	if (address <= vma->vm_end)
+	uint32_t end = PAGE_ALIGN(addr + len);
+	if (addr % PMM_FRAME_SIZE || end < addr || end > VDSO_BASE)
+		return -EINVAL;
+
+	struct vm_area_struct *vma = find_vma_above(mm, addr);
+	if (!vma || vma->vm_start >= end)
 		return 0;
 
-	if (list_is_last(&vma->vm_sibling, &current_process->mm->mmap))
-		vma->vm_end = address;
-	else
+	if (vma->vm_start < addr)
+		vma = split_vma(mm, vma, addr);
+
+	while (vma && vma->vm_start < end)
 	{
-		struct vm_area_struct *next = list_next_entry(vma, vm_sibling);
-		if (address <= next->vm_start)
-			vma->vm_end = address;
+		if (vma->vm_end > end)
+			split_vma(mm, vma, end);
+
+		struct vm_area_struct *next = vma_next(vma);
+		if (vma->vm_file)
+			vmm_unmap_range(current_process->pdir, vma->vm_start, vma->vm_end);
 		else
+			vmm_release_range(current_process->pdir, vma->vm_start, vma->vm_end);
+
+		vma_unlink(mm, vma);
+		kfree(vma);
+		vma = next;
+	}
+
+	mm->free_area_cache = min(mm->free_area_cache, addr);
+	return 0;
+}
+
+// page cache's frame is shared, process gets its own copy before the page becomes writable
+static void change_protection(uint32_t start, uint32_t end, uint32_t prot)
+{
+	char *buf = NULL;
+
+	for (uint32_t vaddr = start; vaddr < end; vaddr += PMM_FRAME_SIZE)
+	{
+		if (!vmm_is_mapped(vaddr))
+			continue;
+
+		uint32_t pte = vmm_get_physical_address(vaddr, true);
+		uint32_t paddr = pte & I86_PTE_FRAME;
+		bool private = pte & (I86_PTE_WRITABLE | I86_PTE_PRIVATE);
+
+		if ((prot & PROT_WRITE) && !private)
 		{
-			assert(!fixed);
-			list_del(&vma->vm_sibling);
-			struct vm_area_struct *vma_expand = get_unmapped_area(0, address - vma->vm_start);
-			memcpy(vma, vma_expand, sizeof(struct vm_area_struct));
-			kfree(vma_expand);
+			if (!buf)
+				buf = kmalloc(PMM_FRAME_SIZE);
+			memcpy(buf, (char *)vaddr, PMM_FRAME_SIZE);
+			paddr = (uint32_t)pmm_alloc_block();
+			vmm_map_address(current_process->pdir, vaddr, paddr, I86_PTE_PRESENT | I86_PTE_WRITABLE);
+			memcpy((char *)vaddr, buf, PMM_FRAME_SIZE);
+			private = true;
 		}
+
+		// PROT_NONE page stays present for kernel, user access faults
+		uint32_t flags = I86_PTE_PRESENT;
+		if (prot)
+			flags |= I86_PTE_USER;
+		if (prot & PROT_WRITE)
+			flags |= I86_PTE_WRITABLE;
+		if (private)
+			flags |= I86_PTE_PRIVATE;
+		vmm_map_address(current_process->pdir, vaddr, paddr, flags);
 	}
-	return 0;
+
+	kfree(buf);
 }
 
-// NOTE: MQ 2020-01-25 We only support unmap in one area
-int do_munmap(struct mm_struct *mm, uint32_t addr, size_t len)
+int do_mprotect(struct mm_struct *mm, uint32_t addr, size_t len, uint32_t prot)
 {
-	struct vm_area_struct *vma = find_vma(mm, addr);
-	if (!vma || vma->vm_start < addr)
+	uint32_t end = PAGE_ALIGN(addr + len);
+	if (addr % PMM_FRAME_SIZE || end < addr || end > VDSO_BASE)
+		return -EINVAL;
+	if (addr == end)
 		return 0;
 
-	len = PAGE_ALIGN(len);
-	if (vma->vm_end - vma->vm_start >= len)
-		vma->vm_end = addr;
-	else
-		list_del(&vma->vm_sibling);
+	prot &= VM_READ | VM_WRITE | VM_EXEC;
+
+	// the whole range has to be mapped without holes
+	struct vm_area_struct *vma = find_vma(mm, addr);
+	if (!vma)
+		return -ENOMEM;
+	for (struct vm_area_struct *iter = vma; iter->vm_end < end;)
+	{
+		struct vm_area_struct *next = vma_next(iter);
+		if (!next || next->vm_start != iter->vm_end)
+			return -ENOMEM;
+		iter = next;
+	}
+
+	if (vma->vm_start < addr)
+		vma = split_vma(mm, vma, addr);
+
+	struct vm_area_struct *first = vma;
+	for (; vma && vma->vm_start < end; vma = vma_next(vma))
+	{
+		if (vma->vm_end > end)
+			split_vma(mm, vma, end);
+
+		vma->vm_flags = (vma->vm_flags & ~(VM_READ | VM_WRITE | VM_EXEC)) | prot;
+		change_protection(vma->vm_start, vma->vm_end, prot);
+	}
+
+	// neighbours with the same protection are joined back
+	struct vm_area_struct *iter = vma_prev(first) ? vma_prev(first) : first;
+	while (iter && iter->vm_start < end)
+	{
+		struct vm_area_struct *next = vma_next(iter);
+		if (next && vma_can_merge(iter, next))
+			vma_join(mm, iter, next);
+		else
+			iter = next;
+	}
 
 	return 0;
 }
 
+static void move_page_range(uint32_t old_addr, uint32_t new_addr, uint32_t len)
+{
+	for (uint32_t offset = 0; offset < len; offset += PMM_FRAME_SIZE)
+	{
+		if (!vmm_is_mapped(old_addr + offset))
+			continue;
+
+		uint32_t pte = vmm_get_physical_address(old_addr + offset, true);
+		vmm_map_address(current_process->pdir, new_addr + offset, pte & I86_PTE_FRAME, pte & ~I86_PTE_FRAME);
+		vmm_unmap_address(current_process->pdir, old_addr + offset);
+	}
+}
+
+// NOTE: MQ 2020-08-17
+// Shrinking unmaps the tail, growing is done in place when the gap after area allows, otherwise pages are moved (MREMAP_MAYMOVE)
+// file areas are mapped once when they are created, so only anonymous ones can grow
+int32_t do_mremap(struct mm_struct *mm, uint32_t addr, size_t old_len, size_t new_len, uint32_t flags)
+{
+	old_len = PAGE_ALIGN(old_len);
+	new_len = PAGE_ALIGN(new_len);
+	if (addr % PMM_FRAME_SIZE || !new_len || addr + old_len < addr || addr + old_len > VDSO_BASE)
+		return -EINVAL;
+
+	struct vm_area_struct *vma = find_vma(mm, addr);
+	if (!vma || addr + old_len > vma->vm_end)
+		return -EFAULT;
+
+	if (new_len <= old_len)
+	{
+		int ret = do_munmap(mm, addr + new_len, old_len - new_len);
+		return ret < 0 ? ret : (int32_t)addr;
+	}
+
+	if (vma->vm_file)
+		return -EINVAL;
+
+	uint32_t old_end = addr + old_len;
+	uint32_t new_end = addr + new_len;
+	struct vm_area_struct *next = vma_next(vma);
+	if (old_end == vma->vm_end && new_end > addr && new_end <= VDSO_BASE &&
+		(!next || new_end <= next->vm_start))
+	{
+		vma_adjust(vma, vma->vm_start, new_end);
+		map_anonymous_range(vma, old_end, new_end);
+		return addr;
+	}
+
+	if (!(flags & MREMAP_MAYMOVE))
+		return -ENOMEM;
+
+	struct vm_area_struct *new_vma = get_unmapped_area(0, new_len);
+	if (!new_vma)
+		return -ENOMEM;
+
+	new_vma->vm_flags = vma->vm_flags;
+	move_page_range(addr, new_vma->vm_start, old_len);
+	map_anonymous_range(new_vma, new_vma->vm_start + old_len, new_vma->vm_end);
+	do_munmap(mm, addr, old_len);
+
+	return new_vma->vm_start;
+}
+
 int32_t do_mmap(uint32_t addr,
 				size_t len, uint32_t prot,
-				uint32_t flag, int32_t fd, __unused off_t off)
+				uint32_t flag, int32_t fd, off_t off)
 {
-	struct vfs_file *file = fd >= 0 ? current_process->files->fd[fd] : NULL;
+	struct vfs_file *file = fd >= 0 ? fcheck(fd) : NULL;
 	uint32_t aligned_addr = ALIGN_DOWN(addr, PMM_FRAME_SIZE);
 	struct vm_area_struct *vma = find_vma(current_process->mm, aligned_addr);
 
+	if (file && (flag & MAP_PRIVATE) && off % PMM_FRAME_SIZE)
+		return -EINVAL;
+
 	if (!vma)
+	{
 		vma = get_unmapped_area(aligned_addr, len);
+		if (!vma)
+			return -ENOMEM;
+		vma->vm_flags = (prot & (VM_READ | VM_WRITE | VM_EXEC)) | (flag & MAP_SHARED ? VM_SHARED : 0);
+		// hint is only a hint, area is placed somewhere else when it's taken
+		if (vma->vm_start != aligned_addr)
+			addr = 0;
+	}
 	else if (vma->vm_end < addr + len)
-		expand_area(vma, addr + len, true);
+	{
+		int ret = expand_area(vma, addr + len);
+		if (ret < 0)
+			return ret;
+	}
 
-	if (file)
+	if (file && (flag & MAP_PRIVATE))
+	{
+		// MAP_FIXED can map a part of an existing area (runtime linker maps library's data over its text)
+		uint32_t start = addr ? aligned_addr : vma->vm_start;
+		uint32_t end = PAGE_ALIGN((addr ? addr : vma->vm_start) + len);
+		int ret = filemap_map_private(file, start, end - start, off / PMM_FRAME_SIZE, prot & PROT_WRITE);
+		if (ret < 0)
+			return ret;
+		vma->vm_file = file;
+	}
+	else if (file)
 	{
 		file->f_op->mmap(file, vma);
 		vma->vm_file = file;
 	}
 	else
-		for (uint32_t vaddr = vma->vm_start; vaddr < vma->vm_end; vaddr += PMM_FRAME_SIZE)
-		{
-			uint32_t paddr = (uint32_t)pmm_alloc_block();
-			vmm_map_address(current_process->pdir, vaddr, paddr, I86_PTE_PRESENT | I86_PTE_WRITABLE | I86_PTE_USER);
-		}
+		map_anonymous_range(vma, vma->vm_start, vma->vm_end);
 
 	return addr ? addr : vma->vm_start;
 }
 
+// NOTE: MQ 2020-08-15
+// Anonymous areas are mapped eagerly except elf's bss, a missing page in them is zero-filled on first touch
+// with the area's protection, touching PROT_NONE area or writing into read-only one is a real fault
+int handle_mm_fault(uint32_t address, bool write)
+{
+	if (!current_process || !current_process->mm || address >= KERNEL_HIGHER_HALF)
+		return -EFAULT;
+
+	struct vm_area_struct *vma = find_vma(current_process->mm, address);
+	if (!vma || vma->vm_file || vmm_is_mapped(address))
+		return -EFAULT;
+	if (!(vma->vm_flags & (VM_READ | VM_WRITE | VM_EXEC)) || (write && !(vma->vm_flags & VM_WRITE)))
+		return -EACCES;
+
+	// zero-filling goes through a kernel-writable mapping, then the page gets the area's protection
+	uint32_t vaddr = ALIGN_DOWN(address, PMM_FRAME_SIZE);
+	uint32_t paddr = (uint32_t)pmm_alloc_block();
+	vmm_map_address(current_process->pdir, vaddr, paddr, I86_PTE_PRESENT | I86_PTE_WRITABLE);
+	memset((char *)vaddr, 0, PMM_FRAME_SIZE);
+	vmm_map_address(current_process->pdir, vaddr, paddr, vma_page_flags(vma));
+
+	return 0;
+}
+
 // FIXME: MQ 2019-01-16 Currently, we assume that start_brk is not changed
-uint32_t do_brk(uint32_t addr, size_t len)
+int32_t do_brk(uint32_t addr, size_t len)
 {
 	struct mm_struct *mm = current_process->mm;
 	struct vm_area_struct *vma = find_vma(mm, addr);
 	uint32_t new_brk = PAGE_ALIGN(addr + len);
 	mm->brk = new_brk;
 
-	if (!vma || vma->vm_end >= new_brk)
+	if (!vma)
 		return 0;
 
-	struct vm_area_struct *new_vma = kcalloc(1, sizeof(struct vm_area_struct));
-	memcpy(new_vma, vma, sizeof(struct vm_area_struct));
-	if (new_brk > mm->brk)
-		expand_area(new_vma, new_brk, true);
-	else
-		new_vma->vm_end = new_brk;
+	// NOTE: MQ 2020-08-09 When the break shrinks, pages above it are given back (the initial heap area is always kept)
+	if (new_brk <= vma->vm_end)
+	{
+		uint32_t end = max(new_brk, vma->vm_start + UHEAP_SIZE);
+		if (!vma->vm_file && end < vma->vm_end)
+		{
+			vmm_release_range(current_process->pdir, end, vma->vm_end);
+			vma_adjust(vma, vma->vm_start, end);
+		}
+		return 0;
+	}
+
+	uint32_t old_end = vma->vm_end;
+	int ret = expand_area(vma, new_brk);
+	if (ret < 0)
+	{
+		mm->brk = old_end;
+		return ret;
+	}
 
 	if (vma->vm_file)
-		vma->vm_file->f_op->mmap(vma->vm_file, new_vma);
+		vma->vm_file->f_op->mmap(vma->vm_file, vma);
 	else
 	{
-		if (new_vma->vm_end > vma->vm_end)
-		{
-			uint32_t nframes = (new_vma->vm_end - vma->vm_end) / PMM_FRAME_SIZE;
-			uint32_t paddr = (uint32_t)pmm_alloc_blocks(nframes);
-			for (uint32_t vaddr = vma->vm_end; vaddr < new_vma->vm_end; vaddr += PMM_FRAME_SIZE, paddr += PMM_FRAME_SIZE)
-				vmm_map_address(current_process->pdir, vaddr, paddr, I86_PTE_PRESENT | I86_PTE_WRITABLE | I86_PTE_USER);
-		}
-		else if (new_vma->vm_end < vma->vm_end)
-			for (uint32_t addr = new_vma->vm_end; addr < vma->vm_end; addr += PMM_FRAME_SIZE)
-				vmm_unmap_address(current_process->pdir, addr);
+		uint32_t nframes = (vma->vm_end - old_end) / PMM_FRAME_SIZE;
+		uint32_t paddr = (uint32_t)pmm_alloc_blocks(nframes);
+		uint32_t flags = vma_page_flags(vma);
+		for (uint32_t vaddr = old_end; vaddr < vma->vm_end; vaddr += PMM_FRAME_SIZE, paddr += PMM_FRAME_SIZE)
+			vmm_map_address(current_process->pdir, vaddr, paddr, flags);
 	}
-	memcpy(vma, new_vma, sizeof(struct vm_area_struct));
 
 	return 0;
 }
@@ -1,4 +1,5 @@
 #include <include/errno.h>
+#include <utils/debug.h>
 #include <utils/math.h>
 #include <utils/string.h>
 
@@ -13,6 +14,7 @@ void *sbrk(size_t n)
 		return (char *)kernel_heap_current;
 
 	char *heap_base = (char *)kernel_heap_current;
+	assert(kernel_heap_current + n <= KERNEL_HEAP_TOP, "Kernel heap runs into vmalloc area");
 
 	if (n <= kernel_remaining_from_last_used)
 		kernel_remaining_from_last_used -= n;
@@ -0,0 +1,267 @@
+#include <utils/debug.h>
+#include <utils/math.h>
+#include <utils/rbtree.h>
+#include <utils/string.h>
+
+#include "vmm.h"
+
+// NOTE: MQ 2020-08-18
+// vmalloc hands out page-granular kernel ranges in [VMALLOC_START, VMALLOC_END), frames don't have to be contiguous
+// every range is followed by an unmapped guard page -> overrunning a buffer faults instead of corrupting its neighbour
+// free ranges are kept in rbtree by address and each node caches the largest free range in its subtree (lowest fit in O(log n))
+
+struct vmap_free
+{
+	uint32_t start, end;
+	uint32_t subtree_max;
+	struct rb_node rb;
+};
+
+struct vm_struct
+{
+	uint32_t addr;
+	// without guard page
+	uint32_t size;
+	// frames belong to area (vmalloc) or only virtual range is reserved (get_vm_area)
+	bool own_pages;
+	struct rb_node rb;
+};
+
+static struct rb_root free_root;
+static struct rb_root busy_root;
+
+static void vmap_free_augment(struct rb_node *node)
+{
+	struct vmap_free *va = rb_entry(node, struct vmap_free, rb);
+	uint32_t max_size = va->end - va->start;
+
+	if (node->rb_left)
+		max_size = max(max_size, rb_entry(node->rb_left, struct vmap_free, rb)->subtree_max);
+	if (node->rb_right)
+		max_size = max(max_size, rb_entry(node->rb_right, struct vmap_free, rb)->subtree_max);
+
+	va->subtree_max = max_size;
+}
+
+static void insert_free_range(uint32_t start, uint32_t end)
+{
+	struct vmap_free *va = kcalloc(1, sizeof(struct vmap_free));
+	va->start = start;
+	va->end = end;
+
+	struct rb_node **link = &free_root.rb_node, *parent = NULL;
+	while (*link)
+	{
+		parent = *link;
+		if (start < rb_entry(parent, struct vmap_free, rb)->start)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+
+	rb_link_node(&va->rb, parent, link);
+	rb_insert_color(&va->rb, &free_root, vmap_free_augment);
+}
+
+static struct vmap_free *find_lowest_fit(uint32_t size)
+{
+	struct rb_node *node = free_root.rb_node;
+	if (!node || rb_entry(node, struct vmap_free, rb)->subtree_max < size)
+		return NULL;
+
+	while (node)
+	{
+		struct vmap_free *va = rb_entry(node, struct vmap_free, rb);
+
+		if (node->rb_left && rb_entry(node->rb_left, struct vmap_free, rb)->subtree_max >= size)
+			node = node->rb_left;
+		else if (va->end - va->start >= size)
+			return va;
+		else
+			node = node->rb_right;
+	}
+
+	return NULL;
+}
+
+static uint32_t alloc_vmap_range(uint32_t size)
+{
+	struct vmap_free *va = find_lowest_fit(size);
+	if (!va)
+		return 0;
+
+	uint32_t addr = va->start;
+	va->start += size;
+	if (va->start == va->end)
+	{
+		rb_erase(&va->rb, &free_root, vmap_free_augment);
+		kfree(va);
+	}
+	else
+		rb_augment_propagate(&va->rb, vmap_free_augment);
+
+	return addr;
+}
+
+// freed range is coalesced with its free neighbours
+static void free_vmap_range(uint32_t addr, uint32_t size)
+{
+	struct vmap_free *prev = NULL, *next = NULL;
+	struct rb_node *node = free_root.rb_node;
+	while (node)
+	{
+		struct vmap_free *va = rb_entry(node, struct vmap_free, rb);
+		if (addr < va->start)
+		{
+			next = va;
+			node = node->rb_left;
+		}
+		else
+		{
+			prev = va;
+			node = node->rb_right;
+		}
+	}
+
+	uint32_t end = addr + size;
+	if (prev && prev->end == addr)
+	{
+		prev->end = end;
+		if (next && next->start == end)
+		{
+			prev->end = next->end;
+			rb_erase(&next->rb, &free_root, vmap_free_augment);
+			kfree(next);
+		}
+		rb_augment_propagate(&prev->rb, vmap_free_augment);
+	}
+	else if (next && next->start == end)
+	{
+		next->start = addr;
+		rb_augment_propagate(&next->rb, vmap_free_augment);
+	}
+	else
+		insert_free_range(addr, end);
+}
+
+static void insert_vm_area(struct vm_struct *area)
+{
+	struct rb_node **link = &busy_root.rb_node, *parent = NULL;
+	while (*link)
+	{
+		parent = *link;
+		if (area->addr < rb_entry(parent, struct vm_struct, rb)->addr)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+
+	rb_link_node(&area->rb, parent, link);
+	rb_insert_color(&area->rb, &busy_root, NULL);
+}
+
+static struct vm_struct *find_vm_area(const void *addr)
+{
+	struct rb_node *node = busy_root.rb_node;
+	while (node)
+	{
+		struct vm_struct *area = rb_entry(node, struct vm_struct, rb);
+		if ((uint32_t)addr < area->addr)
+			node = node->rb_left;
+		else if ((uint32_t)addr > area->addr)
+			node = node->rb_right;
+		else
+			return area;
+	}
+	return NULL;
+}
+
+void vmalloc_init()
+{
+	log("VMALLOC: Initializing");
+	insert_free_range(VMALLOC_START, VMALLOC_END);
+}
+
+void *get_vm_area(size_t size)
+{
+	size = PAGE_ALIGN(size);
+	if (!size)
+		return NULL;
+
+	uint32_t addr = alloc_vmap_range(size + PMM_FRAME_SIZE);
+	if (!addr)
+	{
+		err("VMALLOC: Out of virtual space for %d bytes", size);
+		return NULL;
+	}
+
+	struct vm_struct *area = kcalloc(1, sizeof(struct vm_struct));
+	area->addr = addr;
+	area->size = size;
+	insert_vm_area(area);
+
+	return (void *)addr;
+}
+
+static void vunmap(const void *addr, bool free_pages)
+{
+	if (!addr)
+		return;
+
+	struct vm_struct *area = find_vm_area(addr);
+	assert(area, "VMALLOC: 0x%x is not allocated", addr);
+
+	for (uint32_t vaddr = area->addr; vaddr < area->addr + area->size; vaddr += PMM_FRAME_SIZE)
+	{
+		if (!vmm_is_mapped(vaddr))
+			continue;
+
+		if (free_pages && area->own_pages)
+			pmm_free_block((void *)vmm_get_physical_address(vaddr, false));
+		vmm_unmap_address(vmm_get_directory(), vaddr);
+	}
+
+	rb_erase(&area->rb, &busy_root, NULL);
+	free_vmap_range(area->addr, area->size + PMM_FRAME_SIZE);
+	kfree(area);
+}
+
+// pages mapped into reserved range by caller are only unmapped
+void free_vm_area(const void *addr)
+{
+	vunmap(addr, false);
+}
+
+void *vmalloc(size_t size)
+{
+	char *addr = get_vm_area(size);
+	if (!addr)
+		return NULL;
+
+	struct vm_struct *area = find_vm_area(addr);
+	area->own_pages = true;
+	for (uint32_t vaddr = area->addr; vaddr < area->addr + area->size; vaddr += PMM_FRAME_SIZE)
+	{
+		uint32_t paddr = (uint32_t)pmm_alloc_block();
+		if (!paddr)
+		{
+			vfree(addr);
+			return NULL;
+		}
+		vmm_map_address(vmm_get_directory(), vaddr, paddr, I86_PTE_PRESENT | I86_PTE_WRITABLE);
+	}
+
+	memset(addr, 0, area->size);
+	return addr;
+}
+
+void vfree(const void *addr)
+{
+	vunmap(addr, true);
+}
+
+size_t vmalloc_size(const void *addr)
+{
+	struct vm_struct *area = find_vm_area(addr);
+	return area ? area->size : 0;
+}
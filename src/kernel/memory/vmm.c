@@ -1,5 +1,6 @@
 #include "vmm.h"
 
+#include <proc/vdso.h>
 #include <utils/debug.h>
 #include <utils/string.h>
 
@@ -38,14 +39,16 @@ void vmm_flush_tlb_entry(uint32_t addr)
   |                         |
   | Device drivers          |
   |                         |
+  |-------------------------| 0xE8400000
+  | PKMAP (highmem.c)       |
   |-------------------------| 0xE8000000
-  | VMALLOC                 |
+  | VMALLOC (guard pages)   |
   |-------------------------| 0xE0000000
   |                         |
   |                         |
   | Kernel heap             |
   |                         |
-  |_________________________| 0xC8000000
+  |_________________________| 0xD0000000
   |                         | 
   | Kernel itself           |
   |_________________________| 0xC0000000
@@ -166,13 +169,20 @@ uint32_t vmm_get_physical_address(uint32_t vaddr, bool is_page)
 		return (paddr & ~0xfff) | (vaddr & 0xfff);
 }
 
+// check page is present in current address space without touching a missing page table
+bool vmm_is_mapped(uint32_t vaddr)
+{
+	uint32_t *dir = (uint32_t *)PAGE_DIRECTORY_BASE;
+	if (!is_page_enabled(dir[get_page_directory_index(vaddr)]))
+		return false;
+
+	return is_page_enabled(vmm_get_physical_address(vaddr, true));
+}
+
 struct pdirectory *vmm_create_address_space(struct pdirectory *current)
 {
-	char *aligned_object = kalign_heap(PMM_FRAME_SIZE);
 	// NOTE: MQ 2019-11-24 page directory, page table have to be aligned by 4096
-	struct pdirectory *va_dir = kcalloc(1, sizeof(struct pdirectory));
-	if (aligned_object)
-		kfree(aligned_object);
+	struct pdirectory *va_dir = vmalloc(sizeof(struct pdirectory));
 
 	for (int i = 768; i < 1023; ++i)
 		va_dir->m_entries[i] = vmm_get_physical_address(PAGE_TABLE_BASE + i * PMM_FRAME_SIZE, true);
@@ -210,8 +220,9 @@ void vmm_map_address(struct pdirectory *va_dir, uint32_t virt, uint32_t phys, ui
 	if (virt != PAGE_ALIGN(virt))
 		dlog("0x%x is not page aligned", virt);
 
+	// page table is shared by other pages, so read-only is only enforced in page's entry
 	if (!is_page_enabled(va_dir->m_entries[get_page_directory_index(virt)]))
-		vmm_create_page_table(va_dir, virt, flags);
+		vmm_create_page_table(va_dir, virt, flags | I86_PDE_WRITABLE);
 
 	uint32_t *table = (uint32_t *)((char *)PAGE_TABLE_BASE + get_page_directory_index(virt) * PMM_FRAME_SIZE);
 	uint32_t tindex = get_page_table_entry_index(virt);
@@ -260,48 +271,94 @@ void vmm_unmap_range(struct pdirectory *va_dir, uint32_t vm_start, uint32_t vm_e
 		vmm_unmap_address(va_dir, addr);
 }
 
+// NOTE: MQ 2020-08-09 Unlike vmm_unmap_range, frames are given back to pmm (only use it for private anonymous pages)
+// read-only frames which are not marked as private come from page cache and are only unmapped
+void vmm_release_range(struct pdirectory *va_dir, uint32_t vm_start, uint32_t vm_end)
+{
+	assert(PAGE_ALIGN(vm_start) == vm_start);
+	assert(PAGE_ALIGN(vm_end) == vm_end);
+
+	for (uint32_t addr = vm_start; addr < vm_end; addr += PMM_FRAME_SIZE)
+	{
+		if (!is_page_enabled(va_dir->m_entries[get_page_directory_index(addr)]))
+			continue;
+
+		struct ptable *pt = (struct ptable *)(PAGE_TABLE_BASE + get_page_directory_index(addr) * PMM_FRAME_SIZE);
+		uint32_t pte = get_page_table_entry_index(addr);
+		uint32_t paddr = pt->m_entries[pte];
+		if (!is_page_enabled(paddr))
+			continue;
+
+		pt->m_entries[pte] = 0;
+		vmm_flush_tlb_entry(addr);
+		if (paddr & (I86_PTE_WRITABLE | I86_PTE_PRIVATE))
+			pmm_free_block((void *)(paddr & ~0xfff));
+	}
+}
+
 struct pdirectory *vmm_fork(struct pdirectory *va_dir)
 {
 	struct pdirectory *forked_dir = vmm_create_address_space(va_dir);
-	char *aligned_object = kalign_heap(PMM_FRAME_SIZE);
-	uint32_t heap_current = (uint32_t)sbrk(0);
+	// NOTE: MQ 2020-08-18 Frames are copied through a reserved window in vmalloc area (forked page table, source and destination page)
+	char *window = get_vm_area(3 * PMM_FRAME_SIZE);
+	struct ptable *forked_pt = (struct ptable *)window;
+	char *pte = window + PMM_FRAME_SIZE;
+	char *forked_pte = pte + PMM_FRAME_SIZE;
 
-	// NOTE: MQ 2019-12-15 Any heap changes via malloc is forbidden
 	for (int ipd = 0; ipd < 768; ++ipd)
 		if (is_page_enabled(va_dir->m_entries[ipd]))
 		{
-			struct ptable *forked_pt = (struct ptable *)heap_current;
 			uint32_t forked_pt_paddr = (uint32_t)pmm_alloc_block();
-			vmm_map_address(va_dir, (uint32_t)forked_pt, forked_pt_paddr, I86_PTE_PRESENT | I86_PTE_WRITABLE | I86_PTE_USER);
+			vmm_map_address(va_dir, (uint32_t)forked_pt, forked_pt_paddr, I86_PTE_PRESENT | I86_PTE_WRITABLE);
 			memset(forked_pt, 0, sizeof(struct ptable));
 
-			heap_current += sizeof(struct ptable);
 			struct ptable *pt = (struct ptable *)(PAGE_TABLE_BASE + ipd * PMM_FRAME_SIZE);
 			for (int ipt = 0; ipt < PAGES_PER_TABLE; ++ipt)
 			{
 				if (is_page_enabled(pt->m_entries[ipt]))
 				{
-					char *pte = (char *)heap_current;
-					char *forked_pte = pte + PMM_FRAME_SIZE;
-					heap_current = (uint32_t)(forked_pte + PMM_FRAME_SIZE);
+					// vdso text and data pages are shared by every process
+					// read-only pages below vdso come from page cache (elf text), share them as well
+					// unless mprotect has made process's own page read-only
+					uint32_t vaddr = ipd * PAGES_PER_TABLE * PMM_FRAME_SIZE + ipt * PMM_FRAME_SIZE;
+					if (vdso_is_shared_page(vaddr) ||
+						(vaddr < VDSO_BASE && !(pt->m_entries[ipt] & (I86_PTE_WRITABLE | I86_PTE_PRIVATE))))
+					{
+						forked_pt->m_entries[ipt] = pt->m_entries[ipt];
+						continue;
+					}
+
 					uint32_t forked_pte_paddr = (uint32_t)pmm_alloc_block();
 
-					vmm_map_address(va_dir, (uint32_t)pte, pt->m_entries[ipt], I86_PTE_PRESENT | I86_PTE_WRITABLE | I86_PTE_USER);
-					vmm_map_address(va_dir, (uint32_t)forked_pte, forked_pte_paddr, I86_PTE_PRESENT | I86_PTE_WRITABLE | I86_PTE_USER);
+					vmm_map_address(va_dir, (uint32_t)pte, pt->m_entries[ipt] & ~0xfff, I86_PTE_PRESENT | I86_PTE_WRITABLE);
+					vmm_map_address(va_dir, (uint32_t)forked_pte, forked_pte_paddr, I86_PTE_PRESENT | I86_PTE_WRITABLE);
 
 					memcpy(forked_pte, pte, PMM_FRAME_SIZE);
 
-					vmm_unmap_address(va_dir, (uint32_t)pte);
-					vmm_unmap_address(va_dir, (uint32_t)forked_pte);
-
-					forked_pt->m_entries[ipt] = forked_pte_paddr | I86_PTE_PRESENT | I86_PTE_WRITABLE | I86_PTE_USER;
+					// copy keeps page's protection (mprotect)
+					forked_pt->m_entries[ipt] = forked_pte_paddr | (pt->m_entries[ipt] & 0xfff);
 				}
 			}
-			vmm_unmap_address(va_dir, (uint32_t)forked_pt);
 			forked_dir->m_entries[ipd] = forked_pt_paddr | I86_PDE_PRESENT | I86_PDE_WRITABLE | I86_PDE_USER;
 		}
 
-	if (aligned_object)
-		kfree(aligned_object);
+	free_vm_area(window);
 	return forked_dir;
 }
+
+// NOTE: MQ 2020-08-20
+// user pages are given back by exit_mm, only page tables of user space and the directory itself are left
+// kernel page tables (768 -> 1022) are shared by every address space and 1023 is the directory (recursive)
+uint32_t vmm_destroy_address_space(struct pdirectory *va_dir)
+{
+	uint32_t frames = 0;
+	for (int ipd = 0; ipd < 768; ++ipd)
+		if (is_page_enabled(va_dir->m_entries[ipd]))
+		{
+			pmm_free_block((void *)(va_dir->m_entries[ipd] & ~0xfff));
+			frames++;
+		}
+
+	vfree(va_dir);
+	return frames + 1;
+}
@@ -8,8 +8,10 @@
 #include "kernel_info.h"
 #include "pmm.h"
 
-#define KERNEL_HEAP_TOP 0xF0000000
+#define KERNEL_HEAP_TOP 0xE0000000
 #define KERNEL_HEAP_BOTTOM 0xD0000000
+#define VMALLOC_START 0xE0000000
+#define VMALLOC_END 0xE8000000
 #define USER_HEAP_TOP 0x40000000
 
 struct vm_area_struct;
@@ -29,6 +31,7 @@ enum PAGE_PTE_FLAGS
 	I86_PTE_PAT = 0x80,			   //0000000000000000000000010000000
 	I86_PTE_CPU_GLOBAL = 0x100,	   //0000000000000000000000100000000
 	I86_PTE_LV4_GLOBAL = 0x200,	   //0000000000000000000001000000000
+	I86_PTE_PRIVATE = 0x400,	   //0000000000000000000010000000000 (available to os, read-only frame is owned by the process)
 	I86_PTE_FRAME = 0x7FFFF000	   //1111111111111111111000000000000
 };
 
@@ -62,6 +65,7 @@ struct page
 	uint32_t frame;
 	struct list_head sibling;
 	uint32_t virtual;
+	uint32_t index;	 // in file, for page cache
 };
 
 struct pages
@@ -86,10 +90,13 @@ struct pdirectory *vmm_get_directory();
 void vmm_map_address(struct pdirectory *dir, uint32_t virt, uint32_t phys, uint32_t flags);
 void vmm_unmap_address(struct pdirectory *va_dir, uint32_t virt);
 void vmm_unmap_range(struct pdirectory *va_dir, uint32_t vm_start, uint32_t vm_end);
+void vmm_release_range(struct pdirectory *va_dir, uint32_t vm_start, uint32_t vm_end);
 void *create_kernel_stack(int32_t blocks);
 struct pdirectory *vmm_create_address_space(struct pdirectory *dir);
 uint32_t vmm_get_physical_address(uint32_t vaddr, bool is_page);
+bool vmm_is_mapped(uint32_t vaddr);
 struct pdirectory *vmm_fork(struct pdirectory *va_dir);
+uint32_t vmm_destroy_address_space(struct pdirectory *va_dir);
 
 // malloc.c
 void *sbrk(size_t n);
@@ -97,15 +104,33 @@ void *kmalloc(size_t n);
 void *kcalloc(size_t n, size_t size);
 void *krealloc(void *ptr, size_t size);
 void kfree(void *ptr);
-void *kalign_heap(size_t size);
+
+// vmalloc.c
+void vmalloc_init();
+void *vmalloc(size_t size);
+void vfree(const void *addr);
+void *get_vm_area(size_t size);
+void free_vm_area(const void *addr);
+size_t vmalloc_size(const void *addr);
+
+static inline bool is_vmalloc_addr(const void *addr)
+{
+	return VMALLOC_START <= (uint32_t)addr && (uint32_t)addr < VMALLOC_END;
+}
 
 // mmap.c
 struct vm_area_struct *get_unmapped_area(uint32_t addr, uint32_t len);
+struct vm_area_struct *find_vma(struct mm_struct *mm, uint32_t addr);
+int handle_mm_fault(uint32_t address, bool write);
 int32_t do_mmap(uint32_t addr,
 				size_t len, uint32_t prot,
 				uint32_t flag, int32_t fd, off_t off);
 int do_munmap(struct mm_struct *mm, uint32_t addr, size_t len);
-uint32_t do_brk(uint32_t addr, size_t len);
+int do_mprotect(struct mm_struct *mm, uint32_t addr, size_t len, uint32_t prot);
+int32_t do_mremap(struct mm_struct *mm, uint32_t addr, size_t old_len, size_t new_len, uint32_t flags);
+void vma_link(struct mm_struct *mm, struct vm_area_struct *vma);
+void vma_unlink(struct mm_struct *mm, struct vm_area_struct *vma);
+int32_t do_brk(uint32_t addr, size_t len);
 
 // highmem.c
 void kmap(struct page *p);
@@ -23,13 +23,16 @@ int packet_sendmsg(struct socket *sock, void *msg, size_t msg_len)
 		return -ESHUTDOWN;
 
 	struct packet_sock *psk = pkt_sk(sock->sk);
+	int ret = netif_tx_wait(psk->sk.dev);
+	if (ret < 0)
+		return ret;
+
 	struct sk_buff *skb = skb_alloc(sizeof(struct ethernet_packet), msg_len);
 	skb->sk = sock->sk;
 	skb->dev = psk->sk.dev;
 
-	// increase tail -> copy msg into data-tail
-	skb_put(skb, msg_len);
-	memcpy(skb->data, msg, msg_len);
+	// increase tail -> copy msg into data-tail (and fragments if msg is too large)
+	skb_put_data(skb, msg, msg_len);
 
 	if (sock->type != SOCK_RAW)
 	{
@@ -41,8 +44,9 @@ int packet_sendmsg(struct socket *sock, void *msg, size_t msg_len)
 	else
 		skb->mac.eh = (struct ethernet_packet *)skb->data;
 
-	ethernet_sendmsg(skb);
-	return 0;
+	ret = ethernet_sendmsg(skb);
+	skb_free(skb);
+	return ret < 0 ? ret : 0;
 }
 
 int packet_recvmsg(struct socket *sock, void *msg, size_t msg_len)
@@ -58,6 +62,8 @@ int packet_recvmsg(struct socket *sock, void *msg, size_t msg_len)
 		skb = list_first_entry_or_null(&sk->rx_queue, struct sk_buff, sibling);
 		if (!skb)
 		{
+			if (fatal_signal_pending(current_thread))
+				return -EINTR;
 			update_thread(sk->owner_thread, THREAD_WAITING);
 			schedule();
 		}
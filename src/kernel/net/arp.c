@@ -3,9 +3,9 @@
 #include <include/errno.h>
 #include <include/if_ether.h>
 #include <memory/vmm.h>
+#include <net/ethernet.h>
 #include <net/net.h>
 #include <net/sk_buff.h>
-#include <system/sysapi.h>
 #include <utils/string.h>
 
 int arp_validate_packet(struct arp_packet *ap)
@@ -16,9 +16,8 @@ int arp_validate_packet(struct arp_packet *ap)
 	return 0;
 }
 
-struct arp_packet *arp_create_packet(uint8_t *source_mac, uint32_t source_ip, uint8_t *dest_mac, uint32_t dest_ip, uint16_t op)
+void arp_build_header(struct arp_packet *ap, uint8_t *source_mac, uint32_t source_ip, uint8_t *dest_mac, uint32_t dest_ip, uint16_t op)
 {
-	struct arp_packet *ap = kcalloc(1, sizeof(struct arp_packet));
 	ap->htype = htons(ARP_ETHERNET);
 	ap->ptype = htons(ETH_P_IP);
 	ap->hlen = 6;
@@ -28,8 +27,6 @@ struct arp_packet *arp_create_packet(uint8_t *source_mac, uint32_t source_ip, ui
 	ap->spa = htonl(source_ip);
 	memcpy(ap->tha, dest_mac, 6);
 	ap->tpa = htonl(dest_ip);
-
-	return ap;
 }
 
 int arp_rcv(struct sk_buff *skb)
@@ -46,23 +43,26 @@ int arp_rcv(struct sk_buff *skb)
 	return 0;
 }
 
-int arp_send(uint8_t *source_mac, uint32_t source_ip, uint8_t *dest_mac, uint32_t dest_ip, uint16_t type)
+// NOTE: MQ 2020-08-07
+// build arp frame directly into sk_buff, dest_mac is NULL -> broadcast (who-has, gratuitous arp)
+int arp_send(struct net_device *dev, uint16_t op, uint32_t source_ip, uint8_t *dest_mac, uint32_t dest_ip)
 {
-	uint32_t sockfd = sys_socket(PF_PACKET, SOCK_DGRAM, ETH_P_ARP);
-	struct socket *sock = sockfd_lookup(sockfd);
-	struct net_device *dev = sock->sk->dev;
-
 	if (dev->state & NETDEV_STATE_OFF)
 		return -EBUSY;
 
-	struct sockaddr_ll addr_remote;
-	addr_remote.sll_protocol = ETH_P_ARP;
-	addr_remote.sll_pkttype = PACKET_BROADCAST;
-	memcpy(addr_remote.sll_addr, dest_mac, 6);
-	sock->ops->connect(sock, (struct sockaddr *)&addr_remote, sizeof(struct sockaddr_ll));
+	struct sk_buff *skb = skb_alloc(sizeof(struct ethernet_packet), sizeof(struct arp_packet));
+	skb->dev = dev;
 
-	struct arp_packet *sarp = arp_create_packet(source_mac, source_ip, dest_mac, dest_ip, type);
-	sock->ops->sendmsg(sock, sarp, sizeof(struct arp_packet));
-	sock->ops->shutdown(sock);
-	return 0;
+	skb->nh.arph = (struct arp_packet *)skb->data;
+	skb_put(skb, sizeof(struct arp_packet));
+	// target hardware address of a request is what we are asking for
+	arp_build_header(skb->nh.arph, dev->dev_addr, source_ip, op == ARP_REQUEST ? dev->zero_addr : dest_mac, dest_ip, op);
+
+	skb_push(skb, sizeof(struct ethernet_packet));
+	skb->mac.eh = (struct ethernet_packet *)skb->data;
+	ethernet_build_header(skb->mac.eh, ETH_P_ARP, dev->dev_addr, dest_mac ? dest_mac : dev->broadcast_addr);
+
+	int ret = dev_queue_xmit(skb);
+	skb_free(skb);
+	return ret;
 }
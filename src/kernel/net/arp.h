@@ -9,6 +9,7 @@
 #define ARP_REPLY 0x0002
 
 struct sk_buff;
+struct net_device;
 
 struct __attribute__((packed)) arp_packet
 {
@@ -22,8 +23,8 @@ struct __attribute__((packed)) arp_packet
 	uint32_t tpa;
 };
 
-struct arp_packet *arp_create_packet(uint8_t *source_mac, uint32_t source_ip, uint8_t *dest_mac, uint32_t dest_ip, uint16_t op);
+void arp_build_header(struct arp_packet *ap, uint8_t *source_mac, uint32_t source_ip, uint8_t *dest_mac, uint32_t dest_ip, uint16_t op);
 int arp_rcv(struct sk_buff *skb);
-int arp_send(uint8_t *source_mac, uint32_t source_ip, uint8_t *dest_mac, uint32_t dest_ip, uint16_t type);
+int arp_send(struct net_device *dev, uint16_t op, uint32_t source_ip, uint8_t *dest_mac, uint32_t dest_ip);
 
 #endif
@@ -3,58 +3,155 @@
 #include <cpu/hal.h>
 #include <cpu/pic.h>
 #include <devices/pci.h>
+#include <include/errno.h>
 #include <include/if_ether.h>
 #include <memory/vmm.h>
 #include <net/net.h>
+#include <net/sk_buff.h>
 #include <proc/task.h>
 #include <utils/debug.h>
 #include <utils/string.h>
 
 static char rx_buffer[RX_PADDING_BUFFER_SIZE] __attribute__((aligned(4)));
 // NOTE: MQ 2020-04-10 The maximum ethernet transmitted packet's size is 1792 -> one page
-static char tx_buffer[4][PMM_FRAME_SIZE] __attribute__((aligned(4)));
-static uint8_t tx_counter = 0;
+static char tx_buffer[NUM_TX_DESC][PMM_FRAME_SIZE] __attribute__((aligned(4)));
+// NOTE: MQ 2020-08-03
+// cur_tx is the next descriptor to fill, dirty_tx is the oldest descriptor not yet completed
+// both only increase, (cur_tx - dirty_tx) is number of in-flight frames
+static uint32_t cur_tx = 0;
+static uint32_t dirty_tx = 0;
+static uint32_t tx_len[NUM_TX_DESC];
 static uint8_t broadcast_mac_addr[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
 static struct net_device *rtl_netdev;
 
-void rtl8139_send_packet(void *payload, uint32_t size)
+static void rtl8139_fill_tx(struct sk_buff *skb)
 {
-	memcpy(tx_buffer[tx_counter], payload, size);
+	uint32_t entry = cur_tx % NUM_TX_DESC;
+	uint32_t len = skb->len;
 
-	outportl(rtl_netdev->base_addr + 0x20 + tx_counter * 4, vmm_get_physical_address((uint32_t)&tx_buffer[tx_counter], false));
-	outportl(rtl_netdev->base_addr + 0x10 + tx_counter * 4, size);
+	// linear part + fragments are gathered into the descriptor's buffer
+	skb_copy_bits(skb, 0, tx_buffer[entry], len);
+	if (len < ETH_ZLEN)
+	{
+		memset(tx_buffer[entry] + len, 0, ETH_ZLEN - len);
+		len = ETH_ZLEN;
+	}
+
+	outportl(rtl_netdev->base_addr + RTL8139_TxAddr0 + entry * 4, vmm_get_physical_address((uint32_t)&tx_buffer[entry], false));
+	outportl(rtl_netdev->base_addr + RTL8139_TxStatus0 + entry * 4, len);
+
+	tx_len[entry] = skb->len;
+	cur_tx++;
+}
+
+int rtl8139_xmit(struct net_device *dev, struct sk_buff *skb)
+{
+	if (skb->len > PMM_FRAME_SIZE)
+	{
+		err("rtl8139 tx packet is too large %d", skb->len);
+		return -EMSGSIZE;
+	}
+
+	int ret = 0;
+	uint32_t flags = irq_save();
+
+	// frames in tx_queue have to go first to keep the order
+	if (list_empty(&dev->tx_queue) && cur_tx - dirty_tx < NUM_TX_DESC)
+		rtl8139_fill_tx(skb);
+	else if (!netif_queue_stopped(dev))
+	{
+		// caller still owns skb -> keep our own reference until a descriptor is available
+		struct sk_buff *skb_new = skb_clone(skb);
+		list_add_tail(&skb_new->sibling, &dev->tx_queue);
+		dev->tx_queue_len++;
+		dev->stats.tx_busy++;
+	}
+	else
+		ret = -ENOBUFS;
+
+	irq_restore(flags);
+	return ret;
+}
+
+static void rtl8139_tx_complete(struct net_device *dev)
+{
+	uint32_t flags = irq_save();
+
+	while (dirty_tx != cur_tx)
+	{
+		uint32_t entry = dirty_tx % NUM_TX_DESC;
+		uint32_t status = inportl(dev->base_addr + RTL8139_TxStatus0 + entry * 4);
+
+		if (!(status & (RTL8139_TxStatOK | RTL8139_TxUnderrun | RTL8139_TxAborted)))
+			break;
+
+		if (status & (RTL8139_TxOutOfWindow | RTL8139_TxAborted))
+			dev->stats.tx_errors++;
+		else
+		{
+			dev->stats.tx_packets++;
+			dev->stats.tx_bytes += tx_len[entry];
+		}
+		dirty_tx++;
+	}
+
+	while (!list_empty(&dev->tx_queue) && cur_tx - dirty_tx < NUM_TX_DESC)
+	{
+		struct sk_buff *skb = list_first_entry(&dev->tx_queue, struct sk_buff, sibling);
+		list_del(&skb->sibling);
+		dev->tx_queue_len--;
 
-	tx_counter = tx_counter >= 3 ? 0 : tx_counter + 1;
+		rtl8139_fill_tx(skb);
+		skb_free(skb);
+	}
+
+	irq_restore(flags);
+	netif_wake_queue(dev);
 }
 
-void rtl8139_receive_packet(struct interrupt_registers *regs)
+static int rtl8139_rx(struct net_device *dev, int budget)
 {
-	while ((inportb(rtl_netdev->base_addr + RTL8139_ChipCmd) & RTL8139_RxBufEmpty) == 0)
+	int received = 0;
+
+	while (received < budget && (inportb(dev->base_addr + RTL8139_ChipCmd) & RTL8139_RxBufEmpty) == 0)
 	{
-		uint16_t rx_buf_ptr = inportw(rtl_netdev->base_addr + RTL8139_RxBufPtr) + 0x10;
+		uint16_t rx_buf_ptr = inportw(dev->base_addr + RTL8139_RxBufPtr) + 0x10;
 		uint32_t rx_read_ptr = (uint32_t)rx_buffer + rx_buf_ptr;
 		struct rtl8139_rx_header *rx_header = (struct rtl8139_rx_header *)rx_read_ptr;
 
 		rx_buf_ptr = (rx_buf_ptr + rx_header->size + sizeof(struct rtl8139_rx_header) + 3) & RX_BUF_PTR_MASK;
 
-		if (rx_header->status & (RX_PACKET_HEADER_FAE | RX_PACKET_HEADER_CRC | RX_PACKET_HEADER_RUNT | RX_PACKET_HEADER_LONG))
+		if (rx_header->status & (RX_PACKET_HEADER_FAE | RX_PACKET_HEADER_CRC | RX_PACKET_HEADER_RUNT | RX_PACKET_HEADER_LONG) ||
+			rx_header->size > RX_PACKET_MAX_SIZE)
 		{
 			err("rtl8139 rx packet header error 0x%x", rx_header->status);
+			dev->stats.rx_errors++;
 		}
 		else
 		{
 			uint8_t *buf = (uint8_t *)(rx_read_ptr + sizeof(struct rtl8139_rx_header));
-			uint8_t *payload = kcalloc(1, rx_header->size);
+			push_rx_queue(buf, rx_header->size);
 
-			memcpy(payload, buf, rx_header->size);
-			push_rx_queue(payload, rx_header->size);
-			kfree(payload);
+			dev->stats.rx_packets++;
+			dev->stats.rx_bytes += rx_header->size;
 		}
-		outportw(rtl_netdev->base_addr + RTL8139_RxBufPtr, rx_buf_ptr - 0x10);
+		outportw(dev->base_addr + RTL8139_RxBufPtr, rx_buf_ptr - 0x10);
+		received++;
 	}
 
-	irq_ack(regs->int_no);
-	net_switch();
+	return received;
+}
+
+// NOTE: MQ 2020-08-03 run in net thread, device interrupts are masked until we have drained rx ring below budget
+int rtl8139_poll(struct net_device *dev, int budget)
+{
+	rtl8139_tx_complete(dev);
+
+	int received = rtl8139_rx(dev, budget);
+	if (received < budget)
+		outportw(dev->base_addr + RTL8139_IntrMask, RTL8139_IntrDefault);
+
+	return received;
 }
 
 int32_t rtl8139_irq_handler(struct interrupt_registers *regs)
@@ -62,15 +159,27 @@ int32_t rtl8139_irq_handler(struct interrupt_registers *regs)
 	uint16_t status = inportw(rtl_netdev->base_addr + RTL8139_IntrStatus);
 
 	if (!status)
-		return status;
+		return IRQ_HANDLER_CONTINUE;
 
 	outportw(rtl_netdev->base_addr + RTL8139_IntrStatus, status);
+	rtl_netdev->stats.irqs++;
+
+	if (status & (RTL8139_RxOverflow | RTL8139_RxFIFOOver))
+		rtl_netdev->stats.rx_over_errors++;
+	if (status & RTL8139_RxOverflow)
+	{
+		rtl_netdev->stats.rx_missed_errors += inportl(rtl_netdev->base_addr + RTL8139_RxMissed);
+		outportl(rtl_netdev->base_addr + RTL8139_RxMissed, 0);
+	}
 
-	if (status & TOK)
-		irq_ack(regs->int_no);
-	if (status & ROK)
-		rtl8139_receive_packet(regs);
+	// mask rx/tx interrupts, frames are picked up by net thread with budget
+	if (status & RTL8139_IntrPoll)
+	{
+		outportw(rtl_netdev->base_addr + RTL8139_IntrMask, RTL8139_IntrDefault & ~RTL8139_IntrPoll);
+		napi_schedule(rtl_netdev);
+	}
 
+	irq_ack(regs->int_no);
 	return IRQ_HANDLER_CONTINUE;
 }
 
@@ -106,15 +215,7 @@ void rtl8139_init()
 	outportl(ioaddr + RTL8139_RxBuf, vmm_get_physical_address((uint32_t)rx_buffer, false));	 // send uint32_t memory location to RBSTART (0x30)
 
 	// Set IMR + ISR
-	outportw(ioaddr + RTL8139_IntrMask, RTL8139_PCIErr |				  /* PCI error */
-											RTL8139_PCSTimeout |		  /* PCS timeout */
-											RTL8139_RxFIFOOver |		  /* Rx FIFO over */
-											RTL8139_RxUnderrun |		  /* Rx underrun */
-											RTL8139_RxOverflow |		  /* Rx overflow */
-											RTL8139_TxErr |				  /* Tx error */
-											RTL8139_TxOK |				  /* Tx okay */
-											RTL8139_RxErr |				  /* Rx error */
-											RTL8139_RxOK /* Rx okay */);  // Sets the TOK and ROK bits high
+	outportw(ioaddr + RTL8139_IntrMask, RTL8139_IntrDefault);
 
 	// Configuring receive buffer (RCR)
 	outportl(ioaddr + RTL8139_RxConfig, RTL8139_AcceptBroadcast |
@@ -135,6 +236,8 @@ void rtl8139_init()
 	memcpy(rtl_netdev->dev_addr, mac_addr, 6);
 	memcpy(rtl_netdev->broadcast_addr, broadcast_mac_addr, 6);
 	memset(rtl_netdev->zero_addr, 0, 6);
+	rtl_netdev->xmit = rtl8139_xmit;
+	rtl_netdev->poll = rtl8139_poll;
 
 	register_net_device(rtl_netdev);
 
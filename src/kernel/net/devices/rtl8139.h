@@ -1,6 +1,7 @@
 #ifndef NET_RTL8139_H
 #define NET_RTL8139_H
 
+#include <include/if_ether.h>
 #include <stdint.h>
 
 #define RTL8139_VENDOR_ID 0x10EC
@@ -61,6 +62,16 @@ enum RTL8139_IntrStatusBits
 	RTL8139_RxAckBits = RTL8139_RxFIFOOver | RTL8139_RxOverflow | RTL8139_RxOK,
 };
 
+enum RTL8139_TxStatusBits
+{
+	RTL8139_TxHostOwns = 0x2000,
+	RTL8139_TxUnderrun = 0x4000,
+	RTL8139_TxStatOK = 0x8000,
+	RTL8139_TxOutOfWindow = 0x20000000,
+	RTL8139_TxAborted = 0x40000000,
+	RTL8139_TxCarrierLost = 0x80000000,
+};
+
 enum RTL8139_rx_mode_bits
 {
 	RTL8139_AcceptErr = 0x20,
@@ -94,10 +105,16 @@ enum RTL8139_RxConfigBits
 #define ROK 0x01
 #define TOK 0x04
 
+#define NUM_TX_DESC 4
+#define RTL8139_IntrDefault (RTL8139_PCIErr | RTL8139_PCSTimeout | RTL8139_RxFIFOOver | RTL8139_RxUnderrun | RTL8139_RxOverflow | \
+							 RTL8139_TxErr | RTL8139_TxOK | RTL8139_RxErr | RTL8139_RxOK)
+#define RTL8139_IntrPoll (RTL8139_RxAckBits | RTL8139_RxErr | RTL8139_TxOK | RTL8139_TxErr)
+
 #define RX_BUFFER_SIZE 8096
 #define RX_PADDING_BUFFER_SIZE (8096 + 16 + 1500)
 
 #define RX_BUF_PTR_MASK 0xfffffffc
+#define RX_PACKET_MAX_SIZE (ETH_FRAME_LEN + 4)
 #define RX_PACKET_HEADER_MAR 0x8000
 #define RX_PACKET_HEADER_PAM 0x4000
 #define RX_PACKET_HEADER_BAR 0x2000
@@ -115,6 +132,5 @@ struct __attribute__((packed)) rtl8139_rx_header
 };
 
 void rtl8139_init();
-void rtl8139_send_packet(void *payload, uint32_t size);
 
 #endif
@@ -0,0 +1,338 @@
+#include "virtio_net.h"
+
+#include <cpu/hal.h>
+#include <cpu/idt.h>
+#include <cpu/pic.h>
+#include <devices/pci.h>
+#include <devices/virtio.h>
+#include <include/errno.h>
+#include <include/if_ether.h>
+#include <memory/vmm.h>
+#include <net/net.h>
+#include <net/sk_buff.h>
+#include <utils/debug.h>
+#include <utils/string.h>
+
+// NOTE: MQ 2020-08-05 vrings have to be physically contiguous -> kernel image (bss) is the simplest place
+static uint8_t rx_vring[VRING_SIZE(VIRTQ_MAX_SIZE)] __attribute__((aligned(VIRTIO_PCI_VRING_ALIGN)));
+static uint8_t tx_vring[VRING_SIZE(VIRTQ_MAX_SIZE)] __attribute__((aligned(VIRTIO_PCI_VRING_ALIGN)));
+// tx header of a frame is indexed by its head descriptor (unique while the frame is in-flight)
+static struct virtio_net_hdr tx_hdr[VIRTQ_MAX_SIZE];
+
+static struct virtqueue rvq, svq;
+static uint32_t vnet_features;
+static uint32_t vnet_hdr_len;
+static uint32_t rx_posted;
+static uint8_t broadcast_mac_addr[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+static struct net_device *vnet_netdev;
+
+static bool virtio_net_has_feature(uint32_t feature)
+{
+	return vnet_features & (1 << feature);
+}
+
+// NOTE: MQ 2020-08-05
+// received frame starts with virtio_net_hdr in the same buffer
+// without mergeable buffers, legacy devices expect the header in its own descriptor
+static void virtio_net_refill_rx(struct net_device *dev)
+{
+	bool added = false;
+
+	while (rx_posted < VIRTIO_NET_RX_BUFFERS && rvq.num_free)
+	{
+		struct sk_buff *skb = netdev_alloc_skb(dev, SKB_POOL_BUFFER_SIZE - sizeof(struct skb_shared_info));
+		uint32_t size = skb->end - skb->head;
+
+		struct virtq_sg sg[2];
+		uint32_t in = 0;
+		if (virtio_net_has_feature(VIRTIO_NET_F_MRG_RXBUF))
+			sg[in++] = (struct virtq_sg){.addr = skb->head, .len = size};
+		else
+		{
+			sg[in++] = (struct virtq_sg){.addr = skb->head, .len = vnet_hdr_len};
+			sg[in++] = (struct virtq_sg){.addr = skb->head + vnet_hdr_len, .len = size - vnet_hdr_len};
+		}
+
+		if (virtqueue_add_buf(&rvq, sg, 0, in, skb) < 0)
+		{
+			skb_free(skb);
+			break;
+		}
+		rx_posted++;
+		added = true;
+	}
+
+	if (added)
+		virtqueue_kick(&rvq);
+}
+
+// returns 0 if there is no used buffer, -EPROTO if frame is broken, 1 otherwise
+static int virtio_net_get_rx(struct net_device *dev, struct sk_buff **pskb)
+{
+	uint32_t len;
+	struct sk_buff *skb = virtqueue_get_buf(&rvq, &len);
+	if (!skb)
+		return 0;
+	rx_posted--;
+
+	struct virtio_net_hdr *hdr = (struct virtio_net_hdr *)skb->head;
+	skb->dev = dev;
+	skb->data = skb->head + vnet_hdr_len;
+	skb->tail = skb->head + len;
+	skb->len = len - vnet_hdr_len;
+
+	if (hdr->flags & VIRTIO_NET_HDR_F_DATA_VALID)
+		skb->ip_summed = CHECKSUM_UNNECESSARY;
+	else if (hdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM)
+		skb->ip_summed = CHECKSUM_PARTIAL;
+
+	// frame is spread across multiple buffers -> chain them as fragments
+	uint16_t num_buffers = virtio_net_has_feature(VIRTIO_NET_F_MRG_RXBUF) ? hdr->num_buffers : 1;
+	struct sk_buff **pprev = &skb_shinfo(skb)->frag_list;
+	for (uint16_t i = 1; i < num_buffers; ++i)
+	{
+		struct sk_buff *frag = virtqueue_get_buf(&rvq, &len);
+		if (!frag)
+		{
+			dev->stats.rx_errors++;
+			skb_free(skb);
+			return -EPROTO;
+		}
+		rx_posted--;
+
+		frag->tail = frag->data + len;
+		frag->len = len;
+		skb->data_len += len;
+		skb->len += len;
+		*pprev = frag;
+		pprev = &frag->next;
+	}
+
+	*pskb = skb;
+	return 1;
+}
+
+static int virtio_net_rx(struct net_device *dev, int budget)
+{
+	int received = 0;
+
+	while (received < budget)
+	{
+		struct sk_buff *skb;
+		int ret = virtio_net_get_rx(dev, &skb);
+		if (!ret)
+			break;
+
+		received++;
+		if (ret < 0)
+			continue;
+
+		// protocol handlers access headers directly -> they have to be linear
+		skb = skb_linearize(skb);
+		dev->stats.rx_packets++;
+		dev->stats.rx_bytes += skb->len;
+		netif_receive_skb(skb);
+	}
+
+	virtio_net_refill_rx(dev);
+	return received;
+}
+
+static int virtio_net_add_tx(struct net_device *dev, struct sk_buff *skb)
+{
+	struct virtq_sg sg[VIRTIO_NET_MAX_SG];
+	uint32_t out = 0;
+
+	struct virtio_net_hdr *hdr = &tx_hdr[svq.free_head];
+	memset(hdr, 0, sizeof(struct virtio_net_hdr));
+	hdr->gso_type = VIRTIO_NET_HDR_GSO_NONE;
+	if (skb->ip_summed == CHECKSUM_PARTIAL)
+	{
+		hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+		hdr->csum_start = skb->h.raw - skb->data;
+		hdr->csum_offset = skb->csum_offset;
+	}
+
+	sg[out++] = (struct virtq_sg){.addr = hdr, .len = vnet_hdr_len};
+	sg[out++] = (struct virtq_sg){.addr = skb->data, .len = skb_headlen(skb)};
+	for (struct sk_buff *frag = skb_shinfo(skb)->frag_list; frag; frag = frag->next)
+	{
+		if (out == VIRTIO_NET_MAX_SG)
+			return -EMSGSIZE;
+		sg[out++] = (struct virtq_sg){.addr = frag->data, .len = frag->len};
+	}
+
+	return virtqueue_add_buf(&svq, sg, out, 0, skb);
+}
+
+// NOTE: MQ 2020-08-05 zero-copy, device reads skb's buffers directly, we keep a clone until it is done
+int virtio_net_xmit(struct net_device *dev, struct sk_buff *skb)
+{
+	if (skb->len > ETH_FRAME_LEN)
+	{
+		err("virtio-net tx packet is too large %d", skb->len);
+		return -EMSGSIZE;
+	}
+
+	int ret = 0;
+	uint32_t flags = irq_save();
+	struct sk_buff *skb_new = skb_clone(skb);
+
+	// frames in tx_queue have to go first to keep the order
+	if (list_empty(&dev->tx_queue) && virtio_net_add_tx(dev, skb_new) == 0)
+		virtqueue_kick(&svq);
+	else if (!netif_queue_stopped(dev))
+	{
+		list_add_tail(&skb_new->sibling, &dev->tx_queue);
+		dev->tx_queue_len++;
+		dev->stats.tx_busy++;
+	}
+	else
+	{
+		skb_free(skb_new);
+		ret = -ENOBUFS;
+	}
+
+	irq_restore(flags);
+	return ret;
+}
+
+static void virtio_net_tx_complete(struct net_device *dev)
+{
+	uint32_t flags = irq_save();
+
+	struct sk_buff *skb;
+	while ((skb = virtqueue_get_buf(&svq, NULL)))
+	{
+		dev->stats.tx_packets++;
+		dev->stats.tx_bytes += skb->len;
+		skb_free(skb);
+	}
+
+	bool added = false;
+	while (!list_empty(&dev->tx_queue))
+	{
+		skb = list_first_entry(&dev->tx_queue, struct sk_buff, sibling);
+		if (virtio_net_add_tx(dev, skb) < 0)
+			break;
+
+		list_del(&skb->sibling);
+		INIT_LIST_HEAD(&skb->sibling);
+		dev->tx_queue_len--;
+		added = true;
+	}
+	if (added)
+		virtqueue_kick(&svq);
+
+	irq_restore(flags);
+	netif_wake_queue(dev);
+}
+
+// NOTE: MQ 2020-08-05 run in net thread, queue interrupts are suppressed until both queues are drained
+int virtio_net_poll(struct net_device *dev, int budget)
+{
+	virtio_net_tx_complete(dev);
+
+	int received = virtio_net_rx(dev, budget);
+	if (received < budget)
+	{
+		// device might have used buffers between the last check and enabling interrupts
+		bool rx_done = virtqueue_enable_cb(&rvq);
+		bool tx_done = virtqueue_enable_cb(&svq);
+		if (!rx_done || !tx_done)
+		{
+			virtqueue_disable_cb(&rvq);
+			virtqueue_disable_cb(&svq);
+			return budget;
+		}
+	}
+
+	return received;
+}
+
+int32_t virtio_net_irq_handler(struct interrupt_registers *regs)
+{
+	uint8_t isr = virtio_read_isr(vnet_netdev->base_addr);
+	if (!isr)
+		return IRQ_HANDLER_CONTINUE;
+
+	vnet_netdev->stats.irqs++;
+	if (isr & VIRTIO_PCI_ISR_QUEUE)
+	{
+		virtqueue_disable_cb(&rvq);
+		virtqueue_disable_cb(&svq);
+		napi_schedule(vnet_netdev);
+	}
+
+	irq_ack(regs->int_no);
+	return IRQ_HANDLER_CONTINUE;
+}
+
+int virtio_net_init()
+{
+	struct pci_device *dev = get_pci_device(VIRTIO_VENDOR_ID, VIRTIO_NET_DEVICE_ID);
+	if (!dev)
+		return -ENODEV;
+
+	log("Virtio-net: Initializing");
+	uint32_t ioaddr = dev->bar0 & 0xFFFFFFFC;
+
+	// Enable bus master
+	uint32_t command_reg = pci_read_field(dev->address, PCI_COMMAND);
+	if (!(command_reg & PCI_COMMAND_REG_BUS_MASTER))
+	{
+		command_reg |= PCI_COMMAND_REG_BUS_MASTER;
+		pci_write_field(dev->address, PCI_COMMAND, command_reg);
+	}
+
+	// Reset -> acknowledge -> driver
+	virtio_set_status(ioaddr, 0);
+	virtio_set_status(ioaddr, VIRTIO_CONFIG_S_ACKNOWLEDGE);
+	virtio_set_status(ioaddr, VIRTIO_CONFIG_S_ACKNOWLEDGE | VIRTIO_CONFIG_S_DRIVER);
+
+	uint32_t supported_features = (1 << VIRTIO_NET_F_CSUM) | (1 << VIRTIO_NET_F_GUEST_CSUM) |
+								  (1 << VIRTIO_NET_F_MAC) | (1 << VIRTIO_NET_F_MRG_RXBUF);
+	vnet_features = virtio_get_features(ioaddr) & supported_features;
+	virtio_set_features(ioaddr, vnet_features);
+	vnet_hdr_len = virtio_net_has_feature(VIRTIO_NET_F_MRG_RXBUF) ? sizeof(struct virtio_net_hdr) : offsetof(struct virtio_net_hdr, num_buffers);
+
+	if (virtqueue_setup(&rvq, ioaddr, VIRTIO_NET_RX_QUEUE, rx_vring) < 0 ||
+		virtqueue_setup(&svq, ioaddr, VIRTIO_NET_TX_QUEUE, tx_vring) < 0)
+	{
+		virtio_set_status(ioaddr, VIRTIO_CONFIG_S_FAILED);
+		return -EINVAL;
+	}
+
+	uint8_t mac_addr[6] = {0x52, 0x54, 0x00, 0x12, 0x34, 0x56};
+	if (virtio_net_has_feature(VIRTIO_NET_F_MAC))
+		for (int i = 0; i < 6; ++i)
+			mac_addr[i] = inportb(ioaddr + VIRTIO_PCI_CONFIG + i);
+
+	uint8_t interrupt_line = pci_get_interrupt_line(dev->address);
+
+	vnet_netdev = kcalloc(1, sizeof(struct net_device));
+	vnet_netdev->state = NETDEV_STATE_UP;
+	vnet_netdev->base_addr = ioaddr;
+	vnet_netdev->irq = interrupt_line;
+	memcpy(vnet_netdev->name, "virtio-net", 10);
+	memcpy(vnet_netdev->dev_addr, mac_addr, 6);
+	memcpy(vnet_netdev->broadcast_addr, broadcast_mac_addr, 6);
+	memset(vnet_netdev->zero_addr, 0, 6);
+	vnet_netdev->mtu = ETH_DATA_LEN;
+	if (virtio_net_has_feature(VIRTIO_NET_F_CSUM))
+		vnet_netdev->features |= NETIF_F_HW_CSUM;
+	if (virtio_net_has_feature(VIRTIO_NET_F_GUEST_CSUM))
+		vnet_netdev->features |= NETIF_F_RXCSUM;
+	vnet_netdev->xmit = virtio_net_xmit;
+	vnet_netdev->poll = virtio_net_poll;
+
+	register_net_device(vnet_netdev);
+	virtio_net_refill_rx(vnet_netdev);
+
+	register_interrupt_handler(32 + interrupt_line, virtio_net_irq_handler);
+	pic_clear_mask(interrupt_line);
+
+	virtio_set_status(ioaddr, VIRTIO_CONFIG_S_ACKNOWLEDGE | VIRTIO_CONFIG_S_DRIVER | VIRTIO_CONFIG_S_DRIVER_OK);
+	log("Virtio-net: Done, features 0x%x", vnet_features);
+	return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef NET_VIRTIO_NET_H
+#define NET_VIRTIO_NET_H
+
+#include <stdint.h>
+
+#define VIRTIO_NET_DEVICE_ID 0x1000
+
+// feature bits
+#define VIRTIO_NET_F_CSUM 0		  /* Host handles pkts w/ partial csum */
+#define VIRTIO_NET_F_GUEST_CSUM 1 /* Guest handles pkts w/ partial csum */
+#define VIRTIO_NET_F_MAC 5		  /* Host has given MAC address. */
+#define VIRTIO_NET_F_MRG_RXBUF 15 /* Host can merge receive buffers. */
+#define VIRTIO_NET_F_STATUS 16	  /* virtio_net_config.status available */
+
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM 1 /* Use csum_start, csum_offset */
+#define VIRTIO_NET_HDR_F_DATA_VALID 2 /* Csum is valid */
+
+#define VIRTIO_NET_HDR_GSO_NONE 0
+
+#define VIRTIO_NET_RX_QUEUE 0
+#define VIRTIO_NET_TX_QUEUE 1
+
+// rx buffers posted to device, the rest of rx pool is left for frames being processed by the stack
+#define VIRTIO_NET_RX_BUFFERS 32
+#define VIRTIO_NET_MAX_SG 8
+
+struct __attribute__((packed)) virtio_net_hdr
+{
+	uint8_t flags;
+	uint8_t gso_type;
+	uint16_t hdr_len;
+	uint16_t gso_size;
+	uint16_t csum_start;
+	uint16_t csum_offset;
+	// only exists with VIRTIO_NET_F_MRG_RXBUF
+	uint16_t num_buffers;
+};
+
+int virtio_net_init();
+
+#endif
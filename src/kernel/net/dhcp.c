@@ -50,7 +50,7 @@ struct sk_buff *dhcp_create_skbuff(uint8_t op, uint32_t source_ip, uint32_t dest
 	skb_push(skb, sizeof(struct udp_packet));
 	skb->h.udph = (struct udp_packet *)skb->data;
 	uint16_t udp_packet_size = sizeof(struct udp_packet) + dhcp_packet_size;
-	udp_build_header(skb->h.udph, udp_packet_size, source_ip, 68, dest_ip, 67);
+	udp_build_header(skb, udp_packet_size, source_ip, 68, dest_ip, 67);
 
 	skb_push(skb, sizeof(struct ip4_packet));
 	skb->nh.iph = (struct ip4_packet *)skb->data;
@@ -272,6 +272,7 @@ int dhcp_setup()
 	skb = dhcp_create_skbuff(DHCP_REQUEST, 0, 0xffffffff, dhcp_xip, 0, options, dhcp_discovery_option_len);
 	kfree(options);
 	sock->ops->sendmsg(sock, skb->mac.eh, DHCP_SIZE(dhcp_discovery_option_len));
+	skb_free(skb);
 
 	// DHCP Offer
 	struct dhcp_packet *dhcp_offer;
@@ -302,6 +303,7 @@ int dhcp_setup()
 			skb = dhcp_create_skbuff(DHCP_REQUEST, 0, 0xffffffff, dhcp_xip, 0, options, dhcp_discovery_option_len);
 			kfree(options);
 			sock->ops->sendmsg(sock, skb->mac.eh, DHCP_SIZE(dhcp_discovery_option_len));
+			skb_free(skb);
 		}
 	}
 	log("DHCP: Offer");
@@ -312,6 +314,7 @@ int dhcp_setup()
 	dhcp_create_request_options(&options, &dhcp_request_option_len, ntohl(dhcp_offer->yiaddr), ntohl(dhcp_offer->siaddr));
 	skb = dhcp_create_skbuff(DHCP_REQUEST, 0, 0xffffffff, dhcp_xip, 0, options, dhcp_request_option_len);
 	sock->ops->sendmsg(sock, skb->mac.eh, DHCP_SIZE(dhcp_request_option_len));
+	skb_free(skb);
 	kfree(options);
 
 	// DHCP Ack
@@ -334,7 +337,7 @@ int dhcp_setup()
 
 	// ARP Announcement
 	log("DHCP: ARP Announcement");
-	arp_send(dev->dev_addr, local_ip, dev->zero_addr, local_ip, ARP_REQUEST);
+	arp_send(dev, ARP_REQUEST, local_ip, NULL, local_ip);
 
 	dev->local_ip = local_ip;
 	dev->subnet_mask = subnet_mask;
@@ -346,9 +349,10 @@ int dhcp_setup()
 
 	// ARP Probe
 	log("DHCP: ARP for router");
-	uint8_t *router_mac = lookup_mac_addr_from_ip(router_ip);
+	ret = neigh_resolve(dev, router_ip, dev->router_addr);
+	if (ret < 0)
+		err("DHCP: Cannot resolve router's mac address");
 
-	memcpy(dev->router_addr, router_mac, 6);
 	dev->state = NETDEV_STATE_CONNECTED;
 
 	kfree(received_eh);
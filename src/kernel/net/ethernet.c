@@ -2,7 +2,6 @@
 
 #include <include/if_ether.h>
 #include <memory/vmm.h>
-#include <net/devices/rtl8139.h>
 #include <net/net.h>
 #include <net/sk_buff.h>
 #include <proc/task.h>
@@ -15,9 +14,9 @@ void ethernet_build_header(struct ethernet_packet *packet, uint16_t protocal, ui
 	memcpy(packet->source_mac, source_mac, 6);
 }
 
-void ethernet_sendmsg(struct sk_buff *skb)
+int ethernet_sendmsg(struct sk_buff *skb)
 {
-	rtl8139_send_packet(skb->mac.eh, skb->len);
+	return dev_queue_xmit(skb);
 }
 
 int ethernet_rcv(struct sk_buff *skb)
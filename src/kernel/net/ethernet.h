@@ -14,7 +14,7 @@ struct __attribute__((packed)) ethernet_packet
 };
 
 void ethernet_build_header(struct ethernet_packet *packet, uint16_t protocal, uint8_t *source_mac, uint8_t *dest_mac);
-void ethernet_sendmsg(struct sk_buff *skb);
+int ethernet_sendmsg(struct sk_buff *skb);
 int ethernet_rcv(struct sk_buff *skb);
 
 #endif
@@ -13,18 +13,13 @@
 
 int ip4_validate_header(struct ip4_packet *ip, uint8_t protocal)
 {
-	int ret = 0;
-	uint16_t received_checksum = ip->header_checksum;
-
-	ip->header_checksum = 0;
 	uint16_t packet_checksum = singular_checksum(ip, sizeof(struct ip4_packet));
 
 	// TODO: MQ 2020-06-10 Support 5 < ihl <=15 (max)
-	if (ip->version != 4 || ip->ihl != 5 || ip->protocal != protocal || received_checksum != packet_checksum)
-		ret = -EPROTO;
+	if (ip->version != 4 || ip->ihl != 5 || ip->protocal != protocal || packet_checksum)
+		return -EPROTO;
 
-	ip->header_checksum = received_checksum;
-	return ret;
+	return 0;
 }
 
 struct ip4_packet *ip4_build_header(struct ip4_packet *packet, uint16_t packet_size, uint8_t protocal, uint32_t source_ip, uint32_t dest_ip, uint32_t identification)
@@ -45,17 +40,16 @@ struct ip4_packet *ip4_build_header(struct ip4_packet *packet, uint16_t packet_s
 	return packet;
 }
 
-void ip4_sendmsg(struct socket *sock, struct sk_buff *skb)
+int ip4_sendmsg(struct socket *sock, struct sk_buff *skb)
 {
 	struct inet_sock *isk = inet_sk(sock->sk);
-	// NOTE: MQ 2020-05-21 We don't need to perform routing, only support one router
 	skb->dev = isk->sk.dev;
 
+	// destination mac is filled by neighbour when it is resolved
 	skb_push(skb, sizeof(struct ethernet_packet));
 	skb->mac.eh = (struct ethernet_packet *)skb->data;
-	uint8_t *dest_mac = lookup_mac_addr_for_ethernet(skb->dev, isk->dsin.sin_addr);
-	ethernet_build_header(skb->mac.eh, ETH_P_IP, skb->dev->dev_addr, dest_mac);
-	ethernet_sendmsg(skb);
+	ethernet_build_header(skb->mac.eh, ETH_P_IP, skb->dev->dev_addr, skb->dev->zero_addr);
+	return neigh_output(skb, isk->dsin.sin_addr);
 }
 
 // Check ip header valid, adjust skb *data
@@ -37,7 +37,7 @@ struct __attribute__((packed)) ip4_packet
 };
 
 struct ip4_packet *ip4_build_header(struct ip4_packet *packet, uint16_t packet_size, uint8_t protocal, uint32_t source_ip, uint32_t dest_ip, uint32_t identification);
-void ip4_sendmsg(struct socket *sock, struct sk_buff *skb);
+int ip4_sendmsg(struct socket *sock, struct sk_buff *skb);
 int ip4_rcv(struct sk_buff *skb);
 int ip4_validate_header(struct ip4_packet *ip, uint8_t protocal);
 
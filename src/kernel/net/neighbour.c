@@ -1,104 +1,295 @@
 #include "neighbour.h"
 
+#include <cpu/hal.h>
+#include <include/errno.h>
 #include <include/if_ether.h>
 #include <memory/vmm.h>
 #include <net/arp.h>
+#include <net/ethernet.h>
 #include <net/net.h>
-#include <system/sysapi.h>
+#include <net/sk_buff.h>
+#include <proc/task.h>
+#include <system/time.h>
 #include <utils/string.h>
 
-struct list_head lneighbour;
+#define INADDR_BROADCAST 0xFFFFFFFF
 
-uint8_t *get_mac_addr_from_ip(uint32_t ip)
+// NOTE: MQ 2020-08-07
+// table is touched by senders, net thread and timer interrupt -> every access is done with interrupts disabled
+static struct list_head neigh_hash_table[NEIGH_HASH_SIZE];
+static struct wait_queue_head neigh_wait;
+
+static void neigh_timer_handler(struct timer_list *timer);
+
+static uint32_t neigh_hash(uint32_t ip)
+{
+	// hosts in the same subnet only differ in low bits -> multiplicative hashing spreads them over buckets
+	return (ip * 0x9E370001UL) >> (32 - NEIGH_HASH_SHIFT);
+}
+
+static struct neighbour *neigh_lookup(struct net_device *dev, uint32_t ip)
 {
 	struct neighbour *nb;
-	list_for_each_entry(nb, &lneighbour, sibling)
+	list_for_each_entry(nb, &neigh_hash_table[neigh_hash(ip)], sibling)
 	{
-		if (nb->ip == ip && nb->nud_state & NUD_REACHABLE)
-			return nb->dev->dev_addr;
+		if (nb->ip == ip && nb->dev == dev)
+			return nb;
 	}
 	return NULL;
 }
 
-uint8_t *lookup_mac_addr_from_ip(uint32_t ip)
+static struct neighbour *neigh_create(struct net_device *dev, uint32_t ip)
 {
-	uint8_t *maddr = get_mac_addr_from_ip(ip);
+	struct neighbour *nb = kcalloc(1, sizeof(struct neighbour));
+	nb->dev = dev;
+	nb->ip = ip;
+	nb->nud_state = NUD_NONE;
+	INIT_LIST_HEAD(&nb->arp_queue);
+	nb->timer = (struct timer_list)TIMER_INITIALIZER(neigh_timer_handler, UINT32_MAX);
+	INIT_LIST_HEAD(&nb->timer.sibling);
 
-	if (maddr)
-		return maddr;
+	list_add_tail(&nb->sibling, &neigh_hash_table[neigh_hash(ip)]);
+	return nb;
+}
 
-	uint32_t sockfd = sys_socket(PF_PACKET, SOCK_DGRAM, ETH_P_ARP);
-	struct socket *sock = sockfd_lookup(sockfd);
-	struct net_device *dev = sock->sk->dev;
+static void neigh_del_timer(struct neighbour *nb)
+{
+	if (is_actived_timer(&nb->timer))
+		del_timer(&nb->timer);
+}
+
+static void neigh_mod_timer(struct neighbour *nb, uint64_t expires)
+{
+	neigh_del_timer(nb);
+	nb->timer.expires = expires;
+	add_timer(&nb->timer);
+}
+
+static void neigh_purge_queue(struct neighbour *nb)
+{
+	struct sk_buff *skb, *next;
+	list_for_each_entry_safe(skb, next, &nb->arp_queue, sibling)
+	{
+		list_del(&skb->sibling);
+		skb_free(skb);
+		nb->dev->stats.tx_dropped++;
+	}
+	nb->arp_queue_len = 0;
+}
 
-	if (dev->state & NETDEV_STATE_OFF)
-		return NULL;
+static void neigh_destroy(struct neighbour *nb)
+{
+	neigh_del_timer(nb);
+	neigh_purge_queue(nb);
+	list_del(&nb->sibling);
+	kfree(nb);
+}
 
-	struct sockaddr_ll addr_remote;
-	addr_remote.sll_protocol = ETH_P_ARP;
-	addr_remote.sll_pkttype = PACKET_BROADCAST;
-	memcpy(addr_remote.sll_addr, dev->broadcast_addr, 6);
-	sock->ops->connect(sock, (struct sockaddr *)&addr_remote, sizeof(struct sockaddr_ll));
+// broadcast who-has while resolving, unicast to the cached address when probing it
+static void neigh_solicit(struct neighbour *nb)
+{
+	struct net_device *dev = nb->dev;
+	arp_send(dev, ARP_REQUEST, dev->local_ip, nb->nud_state == NUD_PROBE ? nb->ha : NULL, nb->ip);
+	nb->probes++;
+}
 
-	struct arp_packet *sarp = arp_create_packet(dev->dev_addr, dev->local_ip, dev->broadcast_addr, ip, ARP_REQUEST);
-	sock->ops->sendmsg(sock, sarp, sizeof(struct arp_packet));
+static void neigh_timer_handler(struct timer_list *timer)
+{
+	struct neighbour *nb = from_timer(nb, timer, timer);
+	uint64_t now = get_milliseconds(NULL);
 
-	struct arp_packet *rarp = kcalloc(1, sizeof(struct arp_packet));
-	while (true)
+	neigh_del_timer(nb);
+	switch (nb->nud_state)
 	{
-		sock->ops->recvmsg(sock, rarp, sizeof(struct arp_packet));
-		if (rarp->oper == htons(ARP_REPLY) && rarp->spa == htonl(ip))
-			break;
+	case NUD_REACHABLE:
+		// address is still used but has to be confirmed before the next time it is relied on
+		nb->nud_state = NUD_STALE;
+		neigh_mod_timer(nb, now + NEIGH_GC_STALE_TIME);
+		break;
+
+	case NUD_STALE:
+	case NUD_FAILED:
+		neigh_destroy(nb);
+		break;
+
+	case NUD_DELAY:
+		nb->nud_state = NUD_PROBE;
+		nb->probes = 0;
+		// fall through
+	case NUD_INCOMPLETE:
+	case NUD_PROBE:
+		if (nb->probes < NEIGH_MAX_PROBES)
+		{
+			neigh_solicit(nb);
+			neigh_mod_timer(nb, now + NEIGH_RETRANS_TIME);
+		}
+		else
+		{
+			nb->nud_state = NUD_FAILED;
+			neigh_purge_queue(nb);
+			neigh_mod_timer(nb, now + NEIGH_GC_FAILED_TIME);
+			wake_up(&neigh_wait);
+		}
+		break;
 	}
-	sock->ops->shutdown(sock);
-	struct neighbour *nb = kcalloc(1, sizeof(struct neighbour));
-	nb->dev = dev;
-	nb->nud_state = NUD_REACHABLE;
-	nb->ip = rarp->spa;
-	memcpy(nb->ha, rarp->sha, 6);
-	list_add_tail(&nb->sibling, &lneighbour);
+}
 
-	kfree(rarp);
-	return nb->ha;
+// entry is about to be used, kick off resolution or confirmation if needed
+static void neigh_event_send(struct neighbour *nb)
+{
+	uint64_t now = get_milliseconds(NULL);
+
+	if (nb->nud_state == NUD_NONE || nb->nud_state == NUD_FAILED)
+	{
+		nb->nud_state = NUD_INCOMPLETE;
+		nb->probes = 0;
+		neigh_solicit(nb);
+		neigh_mod_timer(nb, now + NEIGH_RETRANS_TIME);
+	}
+	else if (nb->nud_state == NUD_STALE)
+	{
+		// give upper layer a chance to confirm before probing
+		nb->nud_state = NUD_DELAY;
+		neigh_mod_timer(nb, now + NEIGH_DELAY_FIRST_PROBE_TIME);
+	}
 }
 
-uint8_t *lookup_mac_addr_for_ethernet(struct net_device *dev, uint32_t ip)
+uint32_t neigh_next_hop(struct net_device *dev, uint32_t ip)
 {
-	if ((dev->subnet_mask & ip) == (dev->local_ip && dev->subnet_mask))
-		return lookup_mac_addr_from_ip(ip);
+	// NOTE: MQ 2020-05-21 We don't need to perform routing, only support one router
+	if ((ip & dev->subnet_mask) == (dev->local_ip & dev->subnet_mask))
+		return ip;
 	else
-		return dev->router_addr;
+		return dev->router_ip;
 }
 
-void neighbour_update_mapping(uint8_t *mac_address, uint32_t ip)
+// NOTE: MQ 2020-08-07
+// ethernet header is already built, fill its destination and transmit
+// if hardware address is not known yet, a clone waits in neighbour's queue and is flushed on arp reply
+int neigh_output(struct sk_buff *skb, uint32_t ip)
 {
-	struct neighbour *nb_iter, *prev_nb;
-	list_for_each_entry(nb_iter, &lneighbour, sibling)
+	struct net_device *dev = skb->dev;
+	if (ip == INADDR_BROADCAST)
 	{
-		if (prev_nb)
-		{
-			list_del(&prev_nb->sibling);
-			kfree(prev_nb);
-			prev_nb = NULL;
-		}
-		if ((nb_iter->ip == ip || memcmp(nb_iter->ha, mac_address, 6) == 0) && nb_iter->nud_state & NUD_REACHABLE)
-			prev_nb = nb_iter;
+		memcpy(skb->mac.eh->dest_mac, dev->broadcast_addr, 6);
+		return dev_queue_xmit(skb);
 	}
-	if (prev_nb)
+
+	uint32_t next_hop = neigh_next_hop(dev, ip);
+	uint32_t flags = irq_save();
+
+	struct neighbour *nb = neigh_lookup(dev, next_hop);
+	if (!nb)
+		nb = neigh_create(dev, next_hop);
+	neigh_event_send(nb);
+
+	if (nb->nud_state & NUD_VALID)
 	{
-		list_del(&prev_nb->sibling);
-		kfree(prev_nb);
+		memcpy(skb->mac.eh->dest_mac, nb->ha, 6);
+		irq_restore(flags);
+		return dev_queue_xmit(skb);
 	}
 
-	struct neighbour *nb = kcalloc(1, sizeof(struct neighbour));
-	nb->ip = ip;
-	memcpy(nb->ha, mac_address, 6);
-	nb->dev = get_current_net_device();
-	nb->nud_state = NUD_REACHABLE;
-	list_add_tail(&nb->sibling, &lneighbour);
+	if (nb->arp_queue_len >= NEIGH_QUEUE_LEN)
+	{
+		struct sk_buff *oldest = list_first_entry(&nb->arp_queue, struct sk_buff, sibling);
+		list_del(&oldest->sibling);
+		skb_free(oldest);
+		nb->arp_queue_len--;
+		dev->stats.tx_dropped++;
+	}
+	list_add_tail(&skb_clone(skb)->sibling, &nb->arp_queue);
+	nb->arp_queue_len++;
+
+	irq_restore(flags);
+	return 0;
+}
+
+// -EAGAIN while resolution is in progress
+static int neigh_read_ha(struct net_device *dev, uint32_t ip, uint8_t *ha)
+{
+	int ret = -EHOSTUNREACH;
+	uint32_t flags = irq_save();
+
+	struct neighbour *nb = neigh_lookup(dev, ip);
+	if (nb && nb->nud_state & NUD_VALID)
+	{
+		memcpy(ha, nb->ha, 6);
+		ret = 0;
+	}
+	else if (nb && nb->nud_state == NUD_INCOMPLETE)
+		ret = -EAGAIN;
+
+	irq_restore(flags);
+	return ret;
+}
+
+// block until hardware address of ip (or its router) is known, must not be called from net thread
+int neigh_resolve(struct net_device *dev, uint32_t ip, uint8_t *ha)
+{
+	uint32_t next_hop = neigh_next_hop(dev, ip);
+	uint32_t flags = irq_save();
+
+	struct neighbour *nb = neigh_lookup(dev, next_hop);
+	if (!nb)
+		nb = neigh_create(dev, next_hop);
+	neigh_event_send(nb);
+
+	irq_restore(flags);
+
+	int ret;
+	int err = wait_event(&neigh_wait, (ret = neigh_read_ha(dev, next_hop, ha)) != -EAGAIN);
+	return err < 0 ? err : ret;
+}
+
+// NOTE: MQ 2020-08-07
+// called from net thread when arp tells us ip is at ha
+// state is REACHABLE for replies to our requests and STALE for what we overhear (requests, gratuitous arp)
+void neigh_update(struct net_device *dev, uint32_t ip, uint8_t *ha, uint8_t state, bool create)
+{
+	uint64_t now = get_milliseconds(NULL);
+	uint32_t flags = irq_save();
+
+	struct neighbour *nb = neigh_lookup(dev, ip);
+	if (!nb && !create)
+	{
+		irq_restore(flags);
+		return;
+	}
+	if (!nb)
+		nb = neigh_create(dev, ip);
+
+	// overheard packet with the same address doesn't downgrade a confirmed entry
+	if (state == NUD_STALE && nb->nud_state & NUD_VALID && memcmp(nb->ha, ha, 6) == 0)
+	{
+		irq_restore(flags);
+		return;
+	}
+
+	memcpy(nb->ha, ha, 6);
+	nb->nud_state = state;
+	nb->probes = 0;
+	if (state == NUD_REACHABLE)
+		nb->confirmed = now;
+	neigh_mod_timer(nb, now + (state == NUD_REACHABLE ? NEIGH_REACHABLE_TIME : NEIGH_GC_STALE_TIME));
+
+	struct sk_buff *skb, *next;
+	list_for_each_entry_safe(skb, next, &nb->arp_queue, sibling)
+	{
+		list_del(&skb->sibling);
+		memcpy(skb->mac.eh->dest_mac, nb->ha, 6);
+		dev_queue_xmit(skb);
+		skb_free(skb);
+	}
+	nb->arp_queue_len = 0;
+
+	wake_up(&neigh_wait);
+	irq_restore(flags);
 }
 
-void neighbour_init()
+void neigh_init()
 {
-	INIT_LIST_HEAD(&lneighbour);
+	for (int i = 0; i < NEIGH_HASH_SIZE; ++i)
+		INIT_LIST_HEAD(&neigh_hash_table[i]);
+	INIT_LIST_HEAD(&neigh_wait.list);
 }
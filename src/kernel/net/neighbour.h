@@ -3,7 +3,9 @@
 
 #include <include/list.h>
 #include <stdint.h>
+#include <system/timer.h>
 
+#define NUD_NONE 0x00
 #define NUD_INCOMPLETE 0x01
 #define NUD_REACHABLE 0x02
 #define NUD_STALE 0x04
@@ -11,18 +13,47 @@
 #define NUD_PROBE 0x10
 #define NUD_FAILED 0x20
 
+// hardware address is known (might need to be confirmed)
+#define NUD_VALID (NUD_REACHABLE | NUD_STALE | NUD_DELAY | NUD_PROBE)
+
+#define NEIGH_HASH_SHIFT 5
+#define NEIGH_HASH_SIZE (1 << NEIGH_HASH_SHIFT)
+
+// milliseconds
+#define NEIGH_REACHABLE_TIME 30000
+#define NEIGH_DELAY_FIRST_PROBE_TIME 5000
+#define NEIGH_RETRANS_TIME 1000
+#define NEIGH_GC_STALE_TIME 60000
+#define NEIGH_GC_FAILED_TIME 3000
+
+#define NEIGH_MAX_PROBES 3
+// packets waiting for resolution, the oldest one is dropped when queue is full
+#define NEIGH_QUEUE_LEN 8
+
+struct sk_buff;
+
+// NOTE: MQ 2020-08-07
+// REACHABLE --(timeout)--> STALE --(used)--> DELAY --(timeout)--> PROBE --(no reply)--> FAILED
+// NONE --(used)--> INCOMPLETE --(reply)--> REACHABLE, any arp from ip refreshes it
 struct neighbour
 {
 	uint8_t ha[6];
+	// host byte order
 	uint32_t ip;
 	uint8_t nud_state;
+	uint8_t probes;
+	uint64_t confirmed;
 	struct net_device *dev;
 	struct list_head sibling;
+	struct list_head arp_queue;
+	uint32_t arp_queue_len;
+	struct timer_list timer;
 };
 
-void neighbour_init();
-uint8_t *lookup_mac_addr_from_ip(uint32_t ip);
-uint8_t *lookup_mac_addr_for_ethernet(struct net_device *dev, uint32_t ip);
-void neighbour_update_mapping(uint8_t *mac_address, uint32_t ip);
+void neigh_init();
+uint32_t neigh_next_hop(struct net_device *dev, uint32_t ip);
+int neigh_output(struct sk_buff *skb, uint32_t ip);
+int neigh_resolve(struct net_device *dev, uint32_t ip, uint8_t *ha);
+void neigh_update(struct net_device *dev, uint32_t ip, uint8_t *ha, uint8_t state, bool create);
 
 #endif
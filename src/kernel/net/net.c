@@ -1,4 +1,5 @@
 #include "net.h"
+#include <cpu/softirq.h>
 
 #include <fs/sockfs/sockfs.h>
 #include <fs/vfs.h>
@@ -30,10 +31,17 @@ struct net_device *current_netdev;
 // -> size might be bigger than its actual size
 void push_rx_queue(uint8_t *data, uint32_t size)
 {
-	struct sk_buff *skb = skb_alloc(0, size);
+	struct sk_buff *skb = netdev_alloc_skb(current_netdev, size);
 
+	skb->dev = current_netdev;
 	skb_put(skb, size);
 	memcpy(skb->data, data, size);
+	netif_receive_skb(skb);
+}
+
+// hand over a received frame to net thread, called from device's poll
+void netif_receive_skb(struct sk_buff *skb)
+{
 	list_add_tail(&skb->sibling, &lrx_skb);
 }
 
@@ -83,7 +91,7 @@ int socket_shutdown(struct socket *sock)
 
 struct socket *sockfd_lookup(uint32_t sockfd)
 {
-	struct vfs_file *file = current_process->files->fd[sockfd];
+	struct vfs_file *file = fcheck(sockfd);
 	return SOCKET_I(file->f_dentry->d_inode);
 }
 
@@ -115,28 +123,52 @@ uint16_t singular_checksum(void *packet, uint16_t size)
 	return ~checksum & CHECKSUM_MASK;
 }
 
-uint16_t transport_calculate_checksum(void *segment, uint16_t segment_len, uint8_t protocal, uint32_t source_ip, uint32_t dest_ip)
+// one's complement sum (not inverted) of ip4 pseudo header
+uint16_t transport_pseudo_checksum(uint16_t segment_len, uint8_t protocal, uint32_t source_ip, uint32_t dest_ip)
 {
-	struct ip4_pseudo_header *ip4_pseudo_header = kcalloc(1, sizeof(struct ip4_pseudo_header));
-	ip4_pseudo_header->source_ip = htonl(source_ip);
-	ip4_pseudo_header->dest_ip = htonl(dest_ip);
-	ip4_pseudo_header->zeros = 0;
-	ip4_pseudo_header->protocal = protocal;
-	ip4_pseudo_header->transport_length = htons(segment_len);
+	struct ip4_pseudo_header ip4_pseudo_header;
+	ip4_pseudo_header.source_ip = htonl(source_ip);
+	ip4_pseudo_header.dest_ip = htonl(dest_ip);
+	ip4_pseudo_header.zeros = 0;
+	ip4_pseudo_header.protocal = protocal;
+	ip4_pseudo_header.transport_length = htons(segment_len);
+
+	return packet_checksum_start(&ip4_pseudo_header, sizeof(struct ip4_pseudo_header));
+}
 
-	uint32_t ip4_checksum_start = packet_checksum_start(ip4_pseudo_header, sizeof(struct ip4_pseudo_header));
-	uint32_t udp_checksum_start = packet_checksum_start(segment, segment_len);
-	uint32_t checksum = ip4_checksum_start + udp_checksum_start;
+static uint16_t transport_checksum_finish(uint32_t segment_checksum_start, uint16_t segment_len, uint8_t protocal, uint32_t source_ip, uint32_t dest_ip)
+{
+	uint32_t ip4_checksum_start = transport_pseudo_checksum(segment_len, protocal, source_ip, dest_ip);
+	uint32_t checksum = ip4_checksum_start + segment_checksum_start;
 
 	while (checksum > CHECKSUM_MASK)
 		checksum = (checksum & CHECKSUM_MASK) + (checksum >> 16);
 
-	kfree(ip4_pseudo_header);
 	return ~checksum & CHECKSUM_MASK;
 }
 
+uint16_t transport_calculate_checksum(void *segment, uint16_t segment_len, uint8_t protocal, uint32_t source_ip, uint32_t dest_ip)
+{
+	uint32_t segment_checksum_start = packet_checksum_start(segment, segment_len);
+	return transport_checksum_finish(segment_checksum_start, segment_len, protocal, source_ip, dest_ip);
+}
+
+// same as transport_calculate_checksum, segment starts at skb->h and might continue in fragments
+uint16_t skb_transport_checksum(struct sk_buff *skb, uint16_t segment_len, uint8_t protocal, uint32_t source_ip, uint32_t dest_ip)
+{
+	uint32_t segment_checksum_start = skb_checksum(skb, skb->h.raw - skb->data, segment_len, 0);
+	return transport_checksum_finish(segment_checksum_start, segment_len, protocal, source_ip, dest_ip);
+}
+
 void register_net_device(struct net_device *ndev)
 {
+	if (!ndev->rx_pool)
+		ndev->rx_pool = skb_pool_create("rx", SKB_POOL_BUFFER_SIZE, SKB_RX_POOL_SIZE);
+	if (!ndev->tx_pool)
+		ndev->tx_pool = skb_pool_create("tx", SKB_POOL_BUFFER_SIZE, SKB_TX_POOL_SIZE);
+	INIT_LIST_HEAD(&ndev->tx_queue);
+	INIT_LIST_HEAD(&ndev->tx_wait.list);
+
 	current_netdev = ndev;
 }
 
@@ -145,6 +177,51 @@ struct net_device *get_current_net_device()
 	return current_netdev;
 }
 
+// NOTE: MQ 2020-08-03
+// Called from device's interrupt handler (device has masked its interrupts)
+// the actual work is done later in net thread via dev->poll
+// NOTE: MQ 2020-08-12
+// nic irq only latches the device, waking net thread (scheduler queues) is done in softirq
+// polling stays in net thread because it allocates sk_buffs
+void napi_schedule(struct net_device *dev)
+{
+	dev->poll_scheduled = true;
+	raise_softirq(NET_RX_SOFTIRQ);
+}
+
+static void net_rx_action()
+{
+	lock_scheduler();
+	if (net_thread && net_thread->state == THREAD_WAITING)
+		update_thread(net_thread, THREAD_READY);
+	unlock_scheduler();
+}
+
+int dev_queue_xmit(struct sk_buff *skb)
+{
+	struct net_device *dev = skb->dev ? skb->dev : current_netdev;
+	int ret = dev->xmit(dev, skb);
+	if (ret < 0)
+		dev->stats.tx_dropped++;
+	return ret;
+}
+
+// device's tx ring has been drained -> let blocked senders continue
+void netif_wake_queue(struct net_device *dev)
+{
+	if (!netif_queue_stopped(dev))
+		wake_up(&dev->tx_wait);
+}
+
+// block sender until device accepts more frames, net thread never blocks (it is the one draining the ring)
+int netif_tx_wait(struct net_device *dev)
+{
+	if (!dev || current_thread == net_thread)
+		return 0;
+
+	return wait_event(&dev->tx_wait, !netif_queue_stopped(dev));
+}
+
 bool is_broadcast_mac_address(uint8_t *maddr)
 {
 	if (memcmp(current_netdev->broadcast_addr, maddr, 6) == 0 || memcmp(current_netdev->zero_addr, maddr, 6) == 0)
@@ -180,6 +257,19 @@ int inet_ioctl(struct socket *sock, unsigned int cmd, unsigned long arg)
 		sin->sin_addr = dev->dns_server_ip;
 		break;
 
+	case SIOCGIFSTATS:
+		memcpy(ifr->ifr_data, &dev->stats, sizeof(struct net_device_stats));
+		break;
+
+	case SIOCGIFSKBSTATS:
+	{
+		struct ifskbstats *stats = (struct ifskbstats *)ifr->ifr_data;
+		memcpy(&stats->rx, &dev->rx_pool->stats, sizeof(struct skb_pool_stats));
+		memcpy(&stats->tx, &dev->tx_pool->stats, sizeof(struct skb_pool_stats));
+		memcpy(&stats->head, skb_head_cache_stats(), sizeof(struct skb_pool_stats));
+		break;
+	}
+
 	default:
 		break;
 	}
@@ -189,14 +279,14 @@ int inet_ioctl(struct socket *sock, unsigned int cmd, unsigned long arg)
 
 // 1. Check icmp request to local ip -> send ICMP reply
 // 2. Check arp probe asking our mac address -> send arp reply
-// 3. Check arp annoucement -> update neighbour arp
+// 3. Check arp reply, annoucement or any arp from known host -> update neighbour
 int net_default_rx_handler(struct sk_buff *skb)
 {
 	int ret = ethernet_rcv(skb);
 	if (ret < 0)
 		return ret;
 
-	if (skb->mac.eh->type == htons(ETH_P_IP))
+	if (skb->mac.eh->type == htons(ETH_P_IP) && current_netdev->state & NETDEV_STATE_CONNECTED)
 	{
 		ret = ip4_rcv(skb);
 		if (ret < 0)
@@ -236,14 +326,24 @@ int net_default_rx_handler(struct sk_buff *skb)
 		if (ret < 0)
 			return ret;
 
-		if (skb->nh.arph->tpa == htonl(current_netdev->local_ip))
+		struct arp_packet *arph = skb->nh.arph;
+		uint32_t source_ip = ntohl(arph->spa);
+		if (current_netdev->local_ip && source_ip == current_netdev->local_ip && memcmp(arph->sha, current_netdev->dev_addr, 6) != 0)
+		{
+			char source_ip_text[sizeof "255.255.255.255"];
+			inet_ntop(source_ip, source_ip_text, sizeof(source_ip_text));
+			err("ARP: %s is also used by %x:%x:%x:%x:%x:%x",
+				source_ip_text,
+				arph->sha[0], arph->sha[1], arph->sha[2], arph->sha[3], arph->sha[4], arph->sha[5]);
+		}
+		else if (current_netdev->local_ip && arph->tpa == htonl(current_netdev->local_ip))
 		{
 			if (KERNEL_DEBUG)
 			{
 				char dest_ip_text[sizeof "255.255.255.255"];
-				inet_ntop(htonl(skb->nh.arph->tpa), dest_ip_text, sizeof(dest_ip_text));
+				inet_ntop(htonl(arph->tpa), dest_ip_text, sizeof(dest_ip_text));
 				char source_ip_text[sizeof "255.255.255.255"];
-				inet_ntop(htonl(skb->nh.arph->spa), source_ip_text, sizeof(source_ip_text));
+				inet_ntop(source_ip, source_ip_text, sizeof(source_ip_text));
 				log(
 					"ARP: %s at %x:%x:%x:%x:%x:%x, tell %s",
 					dest_ip_text,
@@ -251,21 +351,31 @@ int net_default_rx_handler(struct sk_buff *skb)
 					source_ip_text);
 			}
 
-			arp_send(current_netdev->dev_addr, current_netdev->local_ip, skb->nh.arph->sha, ntohl(skb->nh.arph->spa), ARP_REPLY);
+			// sender is going to talk to us -> cache its address without asking
+			if (arph->oper == htons(ARP_REQUEST))
+			{
+				neigh_update(current_netdev, source_ip, arph->sha, NUD_STALE, true);
+				arp_send(current_netdev, ARP_REPLY, current_netdev->local_ip, arph->sha, source_ip);
+			}
+			else
+				neigh_update(current_netdev, source_ip, arph->sha, NUD_REACHABLE, false);
 		}
-		else if (skb->nh.arph->tpa == skb->nh.arph->spa && is_broadcast_mac_address(skb->nh.arph->tha))
+		else if (source_ip && arph->tpa == arph->spa)
 		{
 			if (KERNEL_DEBUG)
 			{
 				char source_ip_text[sizeof "255.255.255.255"];
-				inet_ntop(htonl(skb->nh.arph->spa), source_ip_text, sizeof(source_ip_text));
+				inet_ntop(source_ip, source_ip_text, sizeof(source_ip_text));
 				log("ARP: %s at %x:%x:%x:%x:%x:%x",
 					source_ip_text,
-					current_netdev->dev_addr[0], current_netdev->dev_addr[1], current_netdev->dev_addr[2], current_netdev->dev_addr[3], current_netdev->dev_addr[4], current_netdev->dev_addr[5]);
+					arph->sha[0], arph->sha[1], arph->sha[2], arph->sha[3], arph->sha[4], arph->sha[5]);
 			}
 
-			neighbour_update_mapping(skb->nh.arph->sha, skb->nh.arph->spa);
+			// gratuitous arp only refreshes hosts we already know
+			neigh_update(current_netdev, source_ip, arph->sha, NUD_STALE, false);
 		}
+		else if (source_ip)
+			neigh_update(current_netdev, source_ip, arph->sha, NUD_STALE, false);
 	}
 	return 0;
 }
@@ -279,6 +389,22 @@ void net_rx_loop()
 	{
 		lock_scheduler();
 
+		// NOTE: MQ 2020-08-03
+		// drain at most NET_RX_BUDGET frames per round so a flood can't starve other threads
+		// if device still has pending frames, net thread stays ready and polls again in the next round
+		bool has_more_work = false;
+		struct net_device *dev = current_netdev;
+		if (dev && dev->poll_scheduled)
+		{
+			dev->poll_scheduled = false;
+			dev->stats.polls++;
+			if (dev->poll(dev, NET_RX_BUDGET) >= NET_RX_BUDGET)
+			{
+				dev->poll_scheduled = true;
+				has_more_work = true;
+			}
+		}
+
 		struct sk_buff *skb;
 		struct sk_buff *prev_skb = NULL;
 		list_for_each_entry(skb, &lrx_skb, sibling)
@@ -289,15 +415,19 @@ void net_rx_loop()
 				skb_free(prev_skb);
 			}
 
+			// NOTE: MQ 2020-08-02
+			// each socket gets its own sk_buff head, packet data is shared
+			// handler queues the clone into its rx_queue if it wants to keep it
 			struct socket *sock;
 			list_for_each_entry(sock, &lsocket, sibling)
 			{
 				struct sk_buff *skb_new = skb_clone(skb);
 				int ret = sock->ops->handler(sock, skb_new);
-				if (ret < 0)
+				if (ret < 0 || list_empty(&skb_new->sibling))
 					skb_free(skb_new);
 			}
-			if (current_netdev->state & NETDEV_STATE_CONNECTED)
+			// arp has to be handled while dhcp is still resolving router
+			if (current_netdev->state & (NETDEV_STATE_UP | NETDEV_STATE_CONNECTED))
 				net_default_rx_handler(skb);
 
 			prev_skb = skb;
@@ -308,35 +438,21 @@ void net_rx_loop()
 			skb_free(prev_skb);
 		}
 
-		update_thread(net_thread, THREAD_WAITING);
+		update_thread(net_thread, has_more_work ? THREAD_READY : THREAD_WAITING);
 		unlock_scheduler();
 		schedule();
 	}
 }
 
-void net_switch()
-{
-	if (list_empty(&lrx_skb))
-		return;
-
-	if (net_thread != current_thread)
-	{
-		update_thread(net_thread, THREAD_READY);
-		if (current_thread->state == THREAD_RUNNING)
-			update_thread(current_thread, THREAD_READY);
-		schedule();
-	}
-	else
-		update_thread(net_thread, THREAD_READY);
-}
-
 void net_init()
 {
 	INIT_LIST_HEAD(&lsocket);
 	INIT_LIST_HEAD(&lrx_skb);
 
 	log("Net: Setup neighbour");
-	neighbour_init();
+	neigh_init();
+
+	open_softirq(NET_RX_SOFTIRQ, net_rx_action);
 
 	log("Net: Setup net process");
 	net_process = create_system_process("net", net_rx_loop, 0);
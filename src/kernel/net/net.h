@@ -4,6 +4,7 @@
 #include <fs/vfs.h>
 #include <include/if_ether.h>
 #include <include/list.h>
+#include <proc/wait.h>
 
 #define AF_UNIX 1	 /* Unix domain sockets 		*/
 #define AF_INET 2	 /* Internet IP Protocol 	*/
@@ -20,7 +21,13 @@
 
 #define CHECKSUM_MASK 0xFFFF
 
+// maximum received frames a device hands to net thread in one poll
+#define NET_RX_BUDGET 16
+// frames waiting in software when device's tx ring is full
+#define NETDEV_TX_QUEUE_LEN 32
+
 struct sk_buff;
+struct skb_pool;
 
 /* Standard well-defined IP protocols.  */
 enum
@@ -199,6 +206,10 @@ static inline struct vfs_inode *SOCK_INODE(struct socket *socket)
 	return &container_of(socket, struct socket_alloc, socket)->inode;
 }
 
+// net_device features
+#define NETIF_F_HW_CSUM (1 << 0) // device can fill tcp/udp checksum (CHECKSUM_PARTIAL)
+#define NETIF_F_RXCSUM (1 << 1)	 // device can verify received checksum
+
 enum netdev_state
 {
 	NETDEV_STATE_OFF = 1,
@@ -206,6 +217,23 @@ enum netdev_state
 	NETDEV_STATE_CONNECTED = 1 << 2,  // interface connects and gets config (dhcp -> ip) from router
 };
 
+struct net_device_stats
+{
+	uint32_t rx_packets;
+	uint32_t tx_packets;
+	uint32_t rx_bytes;
+	uint32_t tx_bytes;
+	uint32_t rx_errors;
+	uint32_t tx_errors;
+	uint32_t rx_dropped;
+	uint32_t tx_dropped;
+	uint32_t rx_over_errors;  // receive ring overflow
+	uint32_t rx_missed_errors;
+	uint32_t tx_busy;  // tx ring was full -> frame waited in tx_queue
+	uint32_t irqs;
+	uint32_t polls;
+};
+
 struct net_device
 {
 	uint32_t base_addr;
@@ -221,24 +249,54 @@ struct net_device
 	uint8_t zero_addr[6];
 	uint8_t router_addr[6];
 	uint16_t mtu;
+	uint32_t features;
 	uint32_t dns_server_ip;
 	uint32_t dhcp_server_ip;
 	uint32_t router_ip;
 	uint32_t local_ip;
 	uint32_t subnet_mask;
 	uint32_t lease_time;
+
+	// preallocated data buffers for received/transmitted sk_buff
+	struct skb_pool *rx_pool;
+	struct skb_pool *tx_pool;
+
+	// NOTE: MQ 2020-08-03
+	// transmit a frame (data -> data + len), driver keeps its own reference if frame has to wait
+	int (*xmit)(struct net_device *dev, struct sk_buff *skb);
+	// called from net thread with device interrupts masked, returns number of received frames (<= budget)
+	// driver unmasks its interrupts when it has processed less than budget
+	int (*poll)(struct net_device *dev, int budget);
+	bool poll_scheduled;
+
+	struct list_head tx_queue;
+	uint32_t tx_queue_len;
+	struct wait_queue_head tx_wait;
+
+	struct net_device_stats stats;
 };
 
+static inline bool netif_queue_stopped(struct net_device *dev)
+{
+	return dev->tx_queue_len >= NETDEV_TX_QUEUE_LEN;
+}
+
 void net_init();
 void net_rx_loop();
-void net_switch();
+void napi_schedule(struct net_device *dev);
+int dev_queue_xmit(struct sk_buff *skb);
+void netif_wake_queue(struct net_device *dev);
+int netif_tx_wait(struct net_device *dev);
 void push_rx_queue(uint8_t *data, uint32_t size);
+void netif_receive_skb(struct sk_buff *skb);
 void socket_setup(int32_t family, enum socket_type type, int32_t protocal, struct vfs_file *file);
 int socket_shutdown(struct socket *sock);
 struct socket *sockfd_lookup(uint32_t fd);
 uint16_t singular_checksum(void *packet, uint16_t size);
 uint32_t packet_checksum_start(void *packet, uint16_t size);
 uint16_t transport_calculate_checksum(void *segment, uint16_t segment_len, uint8_t protocal, uint32_t source_ip, uint32_t dest_ip);
+uint16_t transport_pseudo_checksum(uint16_t segment_len, uint8_t protocal, uint32_t source_ip, uint32_t dest_ip);
+uint16_t skb_transport_checksum(struct sk_buff *skb, uint16_t segment_len, uint8_t protocal, uint32_t source_ip, uint32_t dest_ip);
 char *inet_ntop(uint32_t src, char *dst, uint16_t len);
 int inet_ioctl(struct socket *sock, unsigned int cmd, unsigned long arg);
 
@@ -37,21 +37,25 @@ int raw_sendmsg(struct socket *sock, void *msg, size_t msg_len)
 		return -ESHUTDOWN;
 
 	struct inet_sock *isk = inet_sk(sock->sk);
+	int ret = netif_tx_wait(isk->sk.dev);
+	if (ret < 0)
+		return ret;
+
 	struct sk_buff *skb = skb_alloc(RAW_HEADER_SIZE, msg_len);
 	skb->sk = sock->sk;
 	skb->dev = isk->sk.dev;
 
-	// increase tail -> copy msg into data-tail space
-	skb_put(skb, msg_len);
-	memcpy(skb->data, msg, msg_len);
+	// increase tail -> copy msg into data-tail space (and fragments if msg is too large)
+	skb_put_data(skb, msg, msg_len);
 
 	// decase data -> copy ip4 header into newdata-olddata
 	skb_push(skb, sizeof(struct ip4_packet));
 	skb->nh.iph = (struct ip4_packet *)skb->data;
 	ip4_build_header(skb->nh.iph, skb->len, sock->protocol, isk->ssin.sin_addr, isk->dsin.sin_addr, 0);
 
-	ip4_sendmsg(sock, skb);
-	return 0;
+	ret = ip4_sendmsg(sock, skb);
+	skb_free(skb);
+	return ret < 0 ? ret : 0;
 }
 
 int raw_recvmsg(struct socket *sock, void *msg, size_t msg_len)
@@ -67,6 +71,8 @@ int raw_recvmsg(struct socket *sock, void *msg, size_t msg_len)
 		skb = list_first_entry_or_null(&sk->rx_queue, struct sk_buff, sibling);
 		if (!skb)
 		{
+			if (fatal_signal_pending(current_thread))
+				return -EINTR;
 			update_thread(sk->owner_thread, THREAD_WAITING);
 			schedule();
 		}
@@ -1,43 +1,390 @@
 #include "sk_buff.h"
 
+#include <cpu/hal.h>
+#include <include/errno.h>
 #include <memory/vmm.h>
 #include <net/net.h>
+#include <utils/math.h>
 #include <utils/string.h>
 
+// NOTE: MQ 2020-08-02 sk_buff heads are recycled instead of going back to kmalloc
+static struct sk_buff *head_cache;
+static struct skb_pool_stats head_cache_stats;
+
+static struct sk_buff *skb_head_alloc()
+{
+	uint32_t flags = irq_save();
+	struct sk_buff *skb = head_cache;
+	if (skb)
+		head_cache = skb->next;
+	else
+		head_cache_stats.misses++;
+
+	head_cache_stats.allocs++;
+	head_cache_stats.in_use++;
+	head_cache_stats.peak = max(head_cache_stats.peak, head_cache_stats.in_use);
+	if (!skb)
+		head_cache_stats.capacity++;
+	irq_restore(flags);
+
+	if (!skb)
+		skb = kmalloc(sizeof(struct sk_buff));
+	memset(skb, 0, sizeof(struct sk_buff));
+	INIT_LIST_HEAD(&skb->sibling);
+	return skb;
+}
+
+static void skb_head_release(struct sk_buff *skb)
+{
+	uint32_t flags = irq_save();
+	skb->next = head_cache;
+	head_cache = skb;
+	head_cache_stats.in_use--;
+	irq_restore(flags);
+}
+
+struct skb_pool_stats *skb_head_cache_stats()
+{
+	return &head_cache_stats;
+}
+
+static uint32_t skb_pool_data_size(struct skb_pool *pool)
+{
+	return pool->buffer_size - sizeof(struct skb_shared_info);
+}
+
+struct skb_pool *skb_pool_create(const char *name, uint32_t buffer_size, uint32_t count)
+{
+	assert(buffer_size > sizeof(struct skb_shared_info) && buffer_size % WORD_SIZE == 0);
+
+	struct skb_pool *pool = kcalloc(1, sizeof(struct skb_pool));
+	strncpy(pool->name, name, sizeof(pool->name) - 1);
+	pool->buffer_size = buffer_size;
+	pool->buffers = kcalloc(count, buffer_size);
+	pool->stats.capacity = count;
+
+	for (int32_t i = count - 1; i >= 0; --i)
+	{
+		void **buffer = (void **)(pool->buffers + i * buffer_size);
+		*buffer = pool->free_list;
+		pool->free_list = buffer;
+	}
+
+	return pool;
+}
+
+static void *skb_pool_get(struct skb_pool *pool, uint32_t size)
+{
+	void *buffer = NULL;
+	uint32_t flags = irq_save();
+
+	if (size <= skb_pool_data_size(pool) && pool->free_list)
+	{
+		buffer = pool->free_list;
+		pool->free_list = *(void **)buffer;
+
+		pool->stats.allocs++;
+		pool->stats.in_use++;
+		pool->stats.peak = max(pool->stats.peak, pool->stats.in_use);
+	}
+	else
+		pool->stats.misses++;
+
+	irq_restore(flags);
+	return buffer;
+}
+
+static void skb_pool_put(struct skb_pool *pool, void *buffer)
+{
+	uint32_t flags = irq_save();
+	*(void **)buffer = pool->free_list;
+	pool->free_list = buffer;
+	pool->stats.in_use--;
+	irq_restore(flags);
+}
+
+// allocate sk_buff + linear buffer of size, from pool if possible otherwise from kmalloc
+static struct sk_buff *skb_alloc_linear(struct skb_pool *pool, uint32_t size)
+{
+	struct sk_buff *skb = skb_head_alloc();
+
+	uint8_t *data = pool ? skb_pool_get(pool, size) : NULL;
+	if (data)
+		size = skb_pool_data_size(pool);
+	else
+	{
+		size = WORD_ALIGN(size);
+		data = kmalloc(size + sizeof(struct skb_shared_info));
+		pool = NULL;
+	}
+
+	skb->true_size = size + sizeof(struct skb_shared_info) + sizeof(struct sk_buff);
+	skb->head = skb->data = skb->tail = data;
+	skb->end = data + size;
+
+	struct skb_shared_info *shinfo = skb_shinfo(skb);
+	atomic_set(&shinfo->dataref, 1);
+	shinfo->pool = pool;
+	shinfo->frag_list = NULL;
+	return skb;
+}
+
+static void skb_release_data(uint8_t *head, struct skb_shared_info *shinfo)
+{
+	if (!atomic_dec_and_test(&shinfo->dataref))
+		return;
+
+	struct sk_buff *frag = shinfo->frag_list;
+	while (frag)
+	{
+		struct sk_buff *next = frag->next;
+		skb_free(frag);
+		frag = next;
+	}
+
+	if (shinfo->pool)
+		skb_pool_put(shinfo->pool, head);
+	else
+		kfree(head);
+}
+
+// NOTE: MQ 2020-08-02
+// If payload doesn't fit into one pool buffer, the linear part only keeps headers + beginning of payload
+// the rest is spread into fragments, use skb_put_data to fill them
 struct sk_buff *skb_alloc(uint32_t header_size, uint32_t payload_size)
 {
-	struct sk_buff *skb = kcalloc(1, sizeof(struct sk_buff));
+	struct net_device *dev = get_current_net_device();
+	struct skb_pool *pool = dev ? dev->tx_pool : NULL;
 
 	// NOTE: MQ 2020-05-20 padding starting header (udp, tcp or raw headers) by word
 	uint32_t packet_size = header_size + payload_size + WORD_SIZE;
-	skb->true_size = packet_size + sizeof(struct sk_buff);
+	uint32_t linear_size = packet_size;
+	if (pool && packet_size > skb_pool_data_size(pool) && header_size + WORD_SIZE < skb_pool_data_size(pool))
+		linear_size = skb_pool_data_size(pool);
 
-	uint8_t *data = kcalloc(1, packet_size);
-	skb->head = data;
-	skb->data = skb->tail = (uint8_t *)WORD_ALIGN((uint32_t)data + header_size);
-	skb->end = data + packet_size;
+	struct sk_buff *skb = skb_alloc_linear(pool, linear_size);
+	// pool buffers are recycled, header builders expect zeroed memory like kcalloc
+	memset(skb->head, 0, linear_size);
+	skb->data = skb->tail = (uint8_t *)WORD_ALIGN((uint32_t)skb->head + header_size);
+
+	uint32_t linear_payload = skb->end - skb->tail;
+	if (payload_size <= linear_payload)
+		return skb;
+
+	struct sk_buff **pprev = &skb_shinfo(skb)->frag_list;
+	for (uint32_t remain = payload_size - linear_payload; remain > 0;)
+	{
+		struct sk_buff *frag = skb_alloc_linear(pool, min(remain, skb_pool_data_size(pool)));
+		uint32_t frag_size = min(remain, (uint32_t)(frag->end - frag->head));
+
+		skb->true_size += frag->true_size;
+		remain -= frag_size;
+		*pprev = frag;
+		pprev = &frag->next;
+	}
 	return skb;
 }
 
+// allocate rx sk_buff which can hold a received frame of size
+struct sk_buff *netdev_alloc_skb(struct net_device *dev, uint32_t size)
+{
+	return skb_alloc_linear(dev ? dev->rx_pool : NULL, size);
+}
+
+// returns linear copy of nonlinear skb (or skb itself), original is released
+struct sk_buff *skb_linearize(struct sk_buff *skb)
+{
+	if (!skb_is_nonlinear(skb))
+		return skb;
+
+	struct sk_buff *skb_new = netdev_alloc_skb(skb->dev, skb->len);
+	skb_new->dev = skb->dev;
+	skb_new->ip_summed = skb->ip_summed;
+	skb_copy_bits(skb, 0, skb_new->data, skb->len);
+	skb_put(skb_new, skb->len);
+
+	skb_free(skb);
+	return skb_new;
+}
+
+// NOTE: MQ 2020-08-02 clone only duplicates sk_buff head, data (and fragments) are shared and refcounted
 struct sk_buff *skb_clone(struct sk_buff *skb)
 {
-	struct sk_buff *skb_new = kcalloc(1, sizeof(struct sk_buff));
+	struct sk_buff *skb_new = skb_head_alloc();
 	memcpy(skb_new, skb, sizeof(struct sk_buff));
+	INIT_LIST_HEAD(&skb_new->sibling);
+	skb_new->next = NULL;
+
+	atomic_inc(&skb_shinfo(skb)->dataref);
+	return skb_new;
+}
 
-	uint32_t packet_size = skb->true_size - sizeof(struct sk_buff);
-	uint8_t *packet = kcalloc(1, skb->true_size - sizeof(struct sk_buff));
-	memcpy(packet, skb->head, packet_size);
+// make sure header is private (not shared with clones) and there is at least headroom in front of data
+int skb_cow_head(struct sk_buff *skb, uint32_t headroom)
+{
+	uint32_t old_headroom = skb_headroom(skb);
+	if (!skb_cloned(skb) && old_headroom >= headroom)
+		return 0;
 
-	skb_new->head = packet;
-	skb_new->data = packet + (skb->data - skb->head);
-	skb_new->tail = packet + (skb->tail - skb->head);
-	skb_new->end = packet + packet_size;
+	uint32_t delta = headroom > old_headroom ? WORD_ALIGN(headroom - old_headroom) : 0;
+	struct skb_shared_info *old_shinfo = skb_shinfo(skb);
+	struct sk_buff *tmp = skb_alloc_linear(old_shinfo->pool, delta + (skb->tail - skb->head));
+	uint8_t *old_head = skb->head;
+	uint32_t old_size = skb->end - old_head;
+	uint8_t *head = tmp->head;
+	uint8_t *end = tmp->end;
+	struct skb_shared_info *shinfo = skb_shinfo(tmp);
+	skb_head_release(tmp);
 
-	return skb_new;
+	memcpy(head + delta, old_head, skb->tail - old_head);
+
+	// fragments are shared with clones -> each new reference bumps their dataref
+	struct sk_buff **pprev = &shinfo->frag_list;
+	for (struct sk_buff *frag = old_shinfo->frag_list; frag; frag = frag->next)
+	{
+		*pprev = skb_clone(frag);
+		pprev = &(*pprev)->next;
+	}
+
+	int32_t offset = head + delta - old_head;
+	skb->head = head;
+	skb->data += offset;
+	skb->tail += offset;
+	skb->end = end;
+	skb->true_size = skb->true_size - old_size + (end - head);
+	if (skb->h.raw)
+		skb->h.raw += offset;
+	if (skb->nh.raw)
+		skb->nh.raw += offset;
+	if (skb->mac.raw)
+		skb->mac.raw += offset;
+
+	skb_release_data(old_head, old_shinfo);
+	return 0;
 }
 
 void skb_free(struct sk_buff *skb)
 {
-	kfree(skb->head);
-	kfree(skb);
+	skb_release_data(skb->head, skb_shinfo(skb));
+	skb_head_release(skb);
+}
+
+// append len bytes at tail, spilling into fragments when linear part is full
+void skb_put_data(struct sk_buff *skb, const void *data, uint32_t len)
+{
+	const uint8_t *from = data;
+
+	uint32_t copy = min(len, (uint32_t)(skb->end - skb->tail));
+	if (skb_is_nonlinear(skb))
+		copy = 0;
+	memcpy(skb->tail, from, copy);
+	skb->tail += copy;
+	skb->len += copy;
+	from += copy;
+	len -= copy;
+
+	for (struct sk_buff *frag = skb_shinfo(skb)->frag_list; frag && len > 0; frag = frag->next)
+	{
+		copy = min(len, (uint32_t)(frag->end - frag->tail));
+		memcpy(frag->tail, from, copy);
+		frag->tail += copy;
+		frag->len += copy;
+		skb->data_len += copy;
+		skb->len += copy;
+		from += copy;
+		len -= copy;
+	}
+
+	assert(!len, "sk_buff doesn't have enough room for data");
+}
+
+// copy len bytes starting at offset (from skb->data) into linear buffer
+int skb_copy_bits(struct sk_buff *skb, uint32_t offset, void *to, uint32_t len)
+{
+	if (offset + len > skb->len)
+		return -EFAULT;
+
+	uint8_t *dest = to;
+	uint32_t headlen = skb_headlen(skb);
+	if (offset < headlen)
+	{
+		uint32_t copy = min(len, headlen - offset);
+		memcpy(dest, skb->data + offset, copy);
+		dest += copy;
+		len -= copy;
+		offset = 0;
+	}
+	else
+		offset -= headlen;
+
+	for (struct sk_buff *frag = skb_shinfo(skb)->frag_list; frag && len > 0; frag = frag->next)
+	{
+		if (offset >= frag->len)
+		{
+			offset -= frag->len;
+			continue;
+		}
+
+		uint32_t copy = min(len, frag->len - offset);
+		memcpy(dest, frag->data + offset, copy);
+		dest += copy;
+		len -= copy;
+		offset = 0;
+	}
+
+	return 0;
+}
+
+// same as packet_checksum_start but chunks can start at odd position (pos counts from the first chunk)
+static uint32_t checksum_add(uint32_t checksum, uint8_t *buf, uint32_t len, uint32_t *pos)
+{
+	if (len > 0 && (*pos & 1))
+	{
+		checksum += *buf++ << 8;
+		len--;
+		(*pos)++;
+	}
+	for (; len > 1; len -= 2, buf += 2, *pos += 2)
+		checksum += *(uint16_t *)buf;
+	if (len == 1)
+	{
+		checksum += *buf;
+		(*pos)++;
+	}
+
+	while (checksum > CHECKSUM_MASK)
+		checksum = (checksum & CHECKSUM_MASK) + (checksum >> 16);
+	return checksum;
+}
+
+// one's complement sum (not inverted) of len bytes starting at offset (from skb->data), includes fragments
+uint32_t skb_checksum(struct sk_buff *skb, uint32_t offset, uint32_t len, uint32_t checksum)
+{
+	uint32_t pos = 0;
+	uint32_t headlen = skb_headlen(skb);
+	if (offset < headlen)
+	{
+		uint32_t chunk = min(len, headlen - offset);
+		checksum = checksum_add(checksum, skb->data + offset, chunk, &pos);
+		len -= chunk;
+		offset = 0;
+	}
+	else
+		offset -= headlen;
+
+	for (struct sk_buff *frag = skb_shinfo(skb)->frag_list; frag && len > 0; frag = frag->next)
+	{
+		if (offset >= frag->len)
+		{
+			offset -= frag->len;
+			continue;
+		}
+
+		uint32_t chunk = min(len, frag->len - offset);
+		checksum = checksum_add(checksum, frag->data + offset, chunk, &pos);
+		len -= chunk;
+		offset = 0;
+	}
+
+	return checksum;
 }
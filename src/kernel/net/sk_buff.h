@@ -1,8 +1,20 @@
 #ifndef NET_SK_BUFF_H
 #define NET_SK_BUFF_H
 
+#include <include/atomic.h>
 #include <include/list.h>
 #include <stdint.h>
+#include <utils/debug.h>
+
+// NOTE: MQ 2020-08-02 one buffer fits the largest ethernet frame + our headroom + skb_shared_info
+#define SKB_POOL_BUFFER_SIZE 2048
+#define SKB_RX_POOL_SIZE 64
+#define SKB_TX_POOL_SIZE 64
+
+// ip_summed
+#define CHECKSUM_NONE 0		   // rx: not verified by device, tx: checksum is filled by stack
+#define CHECKSUM_UNNECESSARY 1 // rx: device has verified checksum
+#define CHECKSUM_PARTIAL 2	   // tx: device fills checksum at h + csum_offset, rx: checksum is not filled (local host)
 
 struct udp_packet;
 struct tcp_packet;
@@ -10,13 +22,58 @@ struct icmp_packet;
 struct ip4_packet;
 struct arp_packet;
 struct ethernet_packet;
+struct net_device;
+
+struct skb_pool_stats
+{
+	uint32_t capacity;
+	uint32_t in_use;
+	uint32_t peak;
+	uint32_t allocs;
+	uint32_t misses;  // pool was empty (or buffer too small) -> fell back to kmalloc
+};
+
+// SIOCGIFSKBSTATS
+struct ifskbstats
+{
+	struct skb_pool_stats rx;
+	struct skb_pool_stats tx;
+	struct skb_pool_stats head;
+};
+
+// NOTE: MQ 2020-08-02
+// Fixed-size data buffers are carved from one allocation when a device registers
+// free buffers are kept in an intrusive stack (first word of the buffer points to the next one)
+struct skb_pool
+{
+	char name[16];
+	uint32_t buffer_size;
+	uint8_t *buffers;
+	void *free_list;
+	struct skb_pool_stats stats;
+};
+
+// NOTE: MQ 2020-08-02
+// Lives at skb->end (tail of the data buffer) and is shared by all clones of that buffer
+// nonlinear payload is chained in frag_list, each fragment is a sk_buff owning its own buffer
+struct skb_shared_info
+{
+	atomic_t dataref;
+	struct skb_pool *pool;
+	struct sk_buff *frag_list;
+};
 
 struct sk_buff
 {
 	struct sock *sk;
 	struct net_device *dev;
 	struct list_head sibling;
-	uint32_t len, true_size;
+	// len = linear (data -> tail) + data_len (bytes in fragments)
+	uint32_t len, data_len, true_size;
+	// next fragment when sk_buff is in frag_list
+	struct sk_buff *next;
+	uint8_t ip_summed;
+	uint16_t csum_offset;
 
 	union
 	{
@@ -47,6 +104,36 @@ struct sk_buff
 	uint8_t *end;
 };
 
+static inline struct skb_shared_info *skb_shinfo(struct sk_buff *skb)
+{
+	return (struct skb_shared_info *)skb->end;
+}
+
+static inline bool skb_is_nonlinear(struct sk_buff *skb)
+{
+	return skb->data_len > 0;
+}
+
+static inline bool skb_cloned(struct sk_buff *skb)
+{
+	return atomic_read(&skb_shinfo(skb)->dataref) > 1;
+}
+
+static inline uint32_t skb_headlen(struct sk_buff *skb)
+{
+	return skb->len - skb->data_len;
+}
+
+static inline uint32_t skb_headroom(struct sk_buff *skb)
+{
+	return skb->data - skb->head;
+}
+
+static inline uint32_t skb_tailroom(struct sk_buff *skb)
+{
+	return skb_is_nonlinear(skb) ? 0 : skb->end - skb->tail;
+}
+
 static inline void skb_reserve(struct sk_buff *skb, uint32_t len)
 {
 	skb->data += len;
@@ -55,12 +142,16 @@ static inline void skb_reserve(struct sk_buff *skb, uint32_t len)
 
 static inline void skb_put(struct sk_buff *skb, uint32_t len)
 {
+	assert(!skb_is_nonlinear(skb) && skb->tail + len <= skb->end);
+
 	skb->tail += len;
 	skb->len += len;
 };
 
 static inline void skb_push(struct sk_buff *skb, uint32_t len)
 {
+	assert(skb->data - len >= skb->head);
+
 	skb->data -= len;
 	skb->len += len;
 }
@@ -71,8 +162,16 @@ static inline void skb_pull(struct sk_buff *skb, uint32_t len)
 	skb->len -= len;
 }
 
+struct skb_pool *skb_pool_create(const char *name, uint32_t buffer_size, uint32_t count);
 struct sk_buff *skb_alloc(uint32_t header_size, uint32_t payload_size);
+struct sk_buff *netdev_alloc_skb(struct net_device *dev, uint32_t size);
+struct sk_buff *skb_linearize(struct sk_buff *skb);
 struct sk_buff *skb_clone(struct sk_buff *skb);
+int skb_cow_head(struct sk_buff *skb, uint32_t headroom);
 void skb_free(struct sk_buff *skb);
+void skb_put_data(struct sk_buff *skb, const void *data, uint32_t len);
+int skb_copy_bits(struct sk_buff *skb, uint32_t offset, void *to, uint32_t len);
+uint32_t skb_checksum(struct sk_buff *skb, uint32_t offset, uint32_t len, uint32_t checksum);
+struct skb_pool_stats *skb_head_cache_stats();
 
 #endif
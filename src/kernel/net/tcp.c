@@ -17,11 +17,8 @@ uint16_t tcp_calculate_checksum(struct tcp_packet *tcp, uint16_t tcp_len, uint32
 
 int tcp_validate_header(struct tcp_packet *tcp, uint16_t tcp_len, uint32_t source_ip, uint32_t dest_ip)
 {
-	uint16_t received_checksum = tcp->checksum;
-	uint16_t packet_checksum = tcp_calculate_checksum(tcp, tcp_len, source_ip, dest_ip);
-	tcp->checksum = received_checksum;
-
-	return packet_checksum != received_checksum ? -EPROTO : 0;
+	uint16_t packet_checksum = transport_calculate_checksum(tcp, tcp_len, IP4_PROTOCAL_TCP, source_ip, dest_ip);
+	return packet_checksum ? -EPROTO : 0;
 }
 
 uint8_t *tcp_set_option_value(uint8_t *options, uint8_t code, uint8_t len, void *value)
@@ -347,7 +344,8 @@ int tcp_sendmsg(struct socket *sock, void *msg, size_t msg_len)
 			msg_sent_len += advertised_window;
 		}
 
-		tcp_transmit(sock);
+		if (tcp_transmit(sock) < 0)
+			return -EINTR;
 	}
 
 	return tcp_return_code(sock, msg_sent_len);
@@ -379,6 +377,8 @@ int tcp_recvmsg(struct socket *sock, void *msg, size_t msg_len)
 		}
 		if (last_skb)
 			break;
+		if (fatal_signal_pending(current_thread))
+			return -EINTR;
 
 		update_thread(current_thread, THREAD_WAITING);
 		schedule();
@@ -394,7 +394,9 @@ int tcp_recvmsg(struct socket *sock, void *msg, size_t msg_len)
 		memcpy(msg + received_len, tcp_payload(iter), payload_len);
 		received_len += payload_len;
 
-		if (iter == last_skb)
+		bool is_last_skb = iter == last_skb;
+		skb_free(iter);
+		if (is_last_skb)
 			break;
 	}
 
@@ -417,6 +419,8 @@ int tcp_shutdown(struct socket *sock)
 
 	while (tsk->state != TCP_CLOSE)
 	{
+		if (fatal_signal_pending(current_thread))
+			return -EINTR;
 		update_thread(current_thread, THREAD_WAITING);
 		schedule();
 	}
@@ -443,9 +447,12 @@ int tcp_handler(struct socket *sock, struct sk_buff *skb)
 
 	struct tcp_packet *tcp = (struct tcp_packet *)skb->data;
 	int tcp_len = ntohs(skb->nh.iph->total_length) - sizeof(struct ip4_packet);
-	ret = tcp_validate_header(tcp, tcp_len, ntohl(skb->nh.iph->source_ip), ntohl(skb->nh.iph->dest_ip));
-	if (ret < 0)
-		return ret;
+	if (skb->ip_summed == CHECKSUM_NONE)
+	{
+		ret = tcp_validate_header(tcp, tcp_len, ntohl(skb->nh.iph->source_ip), ntohl(skb->nh.iph->dest_ip));
+		if (ret < 0)
+			return ret;
+	}
 
 	if (tsk->inet.ssin.sin_addr == ntohl(skb->nh.iph->dest_ip) && tsk->inet.ssin.sin_port == ntohs(tcp->dest_port) &&
 		tsk->inet.dsin.sin_addr == ntohl(skb->nh.iph->source_ip) && tsk->inet.dsin.sin_port == ntohs(tcp->source_port))
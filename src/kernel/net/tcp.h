@@ -162,8 +162,8 @@ struct sk_buff *tcp_create_skb(struct socket *sock,
 							   uint16_t flags,
 							   void *options, uint16_t option_len,
 							   void *payload, uint16_t payload_len);
-void tcp_transmit(struct socket *sock);
-void tcp_transmit_skb(struct socket *sock, struct sk_buff *skb);
+int tcp_transmit(struct socket *sock);
+int tcp_transmit_skb(struct socket *sock, struct sk_buff *skb);
 void tcp_tx_queue_add_skb(struct socket *sock, struct sk_buff *skb);
 void tcp_send_skb(struct socket *sock, struct sk_buff *skb, bool is_retransmitted);
 void tcp_handler_close(struct socket *sock, struct sk_buff *skb);
@@ -70,6 +70,7 @@ void tcp_accept_ack(struct socket *sock, uint32_t ack_number, bool is_acked_all)
 		{
 			assert(sock->sk->send_head != &iter->sibling);
 			list_del(&iter->sibling);
+			skb_free(iter);
 		}
 	}
 
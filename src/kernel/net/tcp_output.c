@@ -3,6 +3,7 @@
 #include <system/time.h>
 #include <utils/math.h>
 #include <utils/string.h>
+#include <utils/trace.h>
 
 #include "tcp.h"
 
@@ -18,8 +19,7 @@ struct sk_buff *tcp_create_skb(struct socket *sock,
 	struct sk_buff *skb = skb_alloc(MAX_TCP_HEADER + option_len, payload_len);
 	skb->dev = tsk->inet.sk.dev;
 
-	skb_put(skb, payload_len);
-	memcpy(skb->data, payload, payload_len);
+	skb_put_data(skb, payload, payload_len);
 
 	skb_push(skb, sizeof(struct tcp_packet) + option_len);
 	skb->h.tcph = (struct tcp_packet *)skb->data;
@@ -39,8 +39,7 @@ struct sk_buff *tcp_create_skb(struct socket *sock,
 
 	skb_push(skb, sizeof(struct ethernet_packet));
 	skb->mac.eh = (struct ethernet_packet *)skb->data;
-	uint8_t *dest_mac = lookup_mac_addr_for_ethernet(skb->dev, tsk->inet.dsin.sin_addr);
-	ethernet_build_header(skb->mac.eh, ETH_P_IP, skb->dev->dev_addr, dest_mac);
+	ethernet_build_header(skb->mac.eh, ETH_P_IP, skb->dev->dev_addr, skb->dev->zero_addr);
 
 	struct tcp_skb_cb *cb = (struct tcp_skb_cb *)skb->cb;
 	cb->seq = sequence_number;
@@ -58,6 +57,8 @@ void tcp_send_skb(struct socket *sock, struct sk_buff *skb, bool is_retransmitte
 	uint16_t payload_len = tcp_payload_lenth(skb);
 	bool is_actived_send = !is_retransmitted && (payload_len > 0 || skb->h.tcph->syn || skb->h.tcph->fin);
 
+	trace(TRACE_TCP_SEND_SKB, cb->seq, payload_len, is_retransmitted);
+
 	tsk->flight_size += payload_len;
 	// we increase snd nxt only if data, syn, fin (ghost segment) and not retransmitted segment
 	if (is_actived_send)
@@ -76,10 +77,14 @@ void tcp_send_skb(struct socket *sock, struct sk_buff *skb, bool is_retransmitte
 	if (!is_actived_timer(&tsk->retransmit_timer) && is_actived_send)
 		mod_timer(&tsk->retransmit_timer, cb->expires);
 
-	ethernet_sendmsg(skb);
+	neigh_output(skb, tsk->inet.dsin.sin_addr);
+	// segments which are not in tx_queue (ack, rst ...) are not retransmitted -> release them right away
+	if (list_empty(&skb->sibling))
+		skb_free(skb);
 }
 
-void tcp_transmit(struct socket *sock)
+// -EINTR when sender is being killed, outstanding segments are left for retransmission timer
+int tcp_transmit(struct socket *sock)
 {
 	struct tcp_sock *tsk = tcp_sk(sock->sk);
 
@@ -101,8 +106,10 @@ void tcp_transmit(struct socket *sock)
 		// - send all segments but get interrutped when just out of loop and haven't updated/scheduled yet
 		// - receive ack for all segments -> back to interrupted point above
 		// -> schedule again which don't have anything to wait -> thread is waiting forever
+		if (fatal_signal_pending(current_thread) || netif_tx_wait(sock->sk->dev) < 0)
+			return -EINTR;
 		lock_scheduler();
-		while (tcp_sender_available_window(tsk) > 0 && sock->sk->send_head)
+		while (tcp_sender_available_window(tsk) > 0 && sock->sk->send_head && !netif_queue_stopped(sock->sk->dev))
 		{
 			struct sk_buff *skb = list_entry(sock->sk->send_head, struct sk_buff, sibling);
 			tcp_send_skb(sock, skb, false);
@@ -125,6 +132,7 @@ void tcp_transmit(struct socket *sock)
 		unlock_scheduler();
 		schedule();
 	}
+	return 0;
 };
 
 void tcp_tx_queue_add_skb(struct socket *sock, struct sk_buff *skb)
@@ -134,8 +142,8 @@ void tcp_tx_queue_add_skb(struct socket *sock, struct sk_buff *skb)
 	list_add_tail(&skb->sibling, &sock->sk->tx_queue);
 }
 
-void tcp_transmit_skb(struct socket *sock, struct sk_buff *skb)
+int tcp_transmit_skb(struct socket *sock, struct sk_buff *skb)
 {
 	tcp_tx_queue_add_skb(sock, skb);
-	tcp_transmit(sock);
+	return tcp_transmit(sock);
 }
@@ -12,30 +12,35 @@
 
 #define MAX_UDP_HEADER (sizeof(struct ethernet_packet) + sizeof(struct ip4_packet) + sizeof(struct udp_packet))
 
-uint16_t udp_calculate_checksum(struct udp_packet *udp, uint16_t packet_len, uint32_t source_ip, uint32_t dest_ip)
-{
-	udp->checksum = 0;
-	return transport_calculate_checksum(udp, packet_len, IP4_PROTOCAL_UDP, source_ip, dest_ip);
-}
-
+// NOTE: MQ 2020-08-02
+// sk_buff data is shared between sockets -> don't zero the checksum field in place
+// summing over the received checksum yields 0 (after complement) for a valid segment
 int udp_validate_header(struct udp_packet *udp, uint32_t source_ip, uint32_t dest_ip)
 {
-	uint16_t received_checksum = udp->checksum;
-	if (!received_checksum)
+	if (!udp->checksum)
 		return 0;
 
-	uint16_t packet_checksum = udp_calculate_checksum(udp, ntohs(udp->length), source_ip, dest_ip);
-	udp->checksum = received_checksum;
-
-	return packet_checksum != received_checksum ? -EPROTO : 0;
+	uint16_t packet_checksum = transport_calculate_checksum(udp, ntohs(udp->length), IP4_PROTOCAL_UDP, source_ip, dest_ip);
+	return packet_checksum ? -EPROTO : 0;
 }
 
-void udp_build_header(struct udp_packet *udp, uint16_t packet_len, uint32_t source_ip, uint16_t source_port, uint32_t dest_ip, uint16_t dest_port)
+void udp_build_header(struct sk_buff *skb, uint16_t packet_len, uint32_t source_ip, uint16_t source_port, uint32_t dest_ip, uint16_t dest_port)
 {
+	struct udp_packet *udp = skb->h.udph;
 	udp->source_port = htons(source_port);
 	udp->dest_port = htons(dest_port);
 	udp->length = htons(packet_len);
-	udp->checksum = udp_calculate_checksum(udp, packet_len, source_ip, dest_ip);
+	udp->checksum = 0;
+
+	// device sums from udp header to the end and adds it on top of pseudo header's sum
+	if (skb->dev && skb->dev->features & NETIF_F_HW_CSUM)
+	{
+		udp->checksum = transport_pseudo_checksum(packet_len, IP4_PROTOCAL_UDP, source_ip, dest_ip);
+		skb->ip_summed = CHECKSUM_PARTIAL;
+		skb->csum_offset = offsetof(struct udp_packet, checksum);
+	}
+	else
+		udp->checksum = skb_transport_checksum(skb, packet_len, IP4_PROTOCAL_UDP, source_ip, dest_ip);
 }
 
 int udp_bind(struct socket *sock, struct sockaddr *myaddr, int sockaddr_len)
@@ -61,26 +66,30 @@ int udp_sendmsg(struct socket *sock, void *msg, size_t msg_len)
 		return -ESHUTDOWN;
 
 	struct inet_sock *isk = inet_sk(sock->sk);
+	int ret = netif_tx_wait(isk->sk.dev);
+	if (ret < 0)
+		return ret;
+
 	struct sk_buff *skb = skb_alloc(MAX_UDP_HEADER, msg_len);
 	skb->sk = sock->sk;
 	skb->dev = isk->sk.dev;
 
-	// increase tail -> copy msg into data-tail space
-	skb_put(skb, msg_len);
-	memcpy(skb->data, msg, msg_len);
+	// increase tail -> copy msg into data-tail space (and fragments if msg is too large)
+	skb_put_data(skb, msg, msg_len);
 
 	// decrease data -> copy udp header into new expanding newdata-olddata
 	skb_push(skb, sizeof(struct udp_packet));
 	skb->h.udph = (struct udp_packet *)skb->data;
-	udp_build_header(skb->h.udph, skb->len, isk->ssin.sin_addr, isk->ssin.sin_port, isk->dsin.sin_addr, isk->dsin.sin_port);
+	udp_build_header(skb, skb->len, isk->ssin.sin_addr, isk->ssin.sin_port, isk->dsin.sin_addr, isk->dsin.sin_port);
 
 	// decrease data -> copy ip4 header into new expending newdata-olddata
 	skb_push(skb, sizeof(struct ip4_packet));
 	skb->nh.iph = (struct ip4_packet *)skb->data;
 	ip4_build_header(skb->nh.iph, skb->len, IP4_PROTOCAL_UDP, isk->ssin.sin_addr, isk->dsin.sin_addr, rand());
 
-	ip4_sendmsg(sock, skb);
-	return 0;
+	ret = ip4_sendmsg(sock, skb);
+	skb_free(skb);
+	return ret < 0 ? ret : 0;
 }
 
 int udp_recvmsg(struct socket *sock, void *msg, size_t msg_len)
@@ -96,6 +105,8 @@ int udp_recvmsg(struct socket *sock, void *msg, size_t msg_len)
 		skb = list_first_entry_or_null(&sk->rx_queue, struct sk_buff, sibling);
 		if (!skb)
 		{
+			if (fatal_signal_pending(current_thread))
+				return -EINTR;
 			update_thread(sk->owner_thread, THREAD_WAITING);
 			schedule();
 		}
@@ -128,9 +139,12 @@ int udp_handler(struct socket *sock, struct sk_buff *skb)
 		return -EPROTO;
 
 	struct udp_packet *udp = (struct udp_packet *)skb->data;
-	ret = udp_validate_header(udp, ntohl(skb->nh.iph->source_ip), ntohl(skb->nh.iph->dest_ip));
-	if (ret < 0)
-		return ret;
+	if (skb->ip_summed == CHECKSUM_NONE)
+	{
+		ret = udp_validate_header(udp, ntohl(skb->nh.iph->source_ip), ntohl(skb->nh.iph->dest_ip));
+		if (ret < 0)
+			return ret;
+	}
 
 	if (htonl(skb->nh.iph->dest_ip) == isk->ssin.sin_addr && htons(udp->dest_port) == isk->ssin.sin_port &&
 		htonl(skb->nh.iph->source_ip) == isk->dsin.sin_addr && htons(udp->source_port) == isk->dsin.sin_port)
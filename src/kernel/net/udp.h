@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+struct sk_buff;
+
 struct __attribute__((packed)) udp_packet
 {
 	uint16_t source_port;
@@ -12,7 +14,7 @@ struct __attribute__((packed)) udp_packet
 	uint8_t payload[];
 };
 
-void udp_build_header(struct udp_packet *udp, uint16_t msg_len, uint32_t source_ip, uint16_t source_port, uint32_t dest_ip, uint16_t dest_port);
+void udp_build_header(struct sk_buff *skb, uint16_t msg_len, uint32_t source_ip, uint16_t source_port, uint32_t dest_ip, uint16_t dest_port);
 int udp_validate_header(struct udp_packet *udp, uint32_t source_ip, uint32_t dest_ip);
 
 #endif
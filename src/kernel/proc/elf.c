@@ -1,11 +1,15 @@
 #include "elf.h"
 
+#include <cpu/hal.h>
 #include <include/errno.h>
+#include <include/fcntl.h>
 #include <include/mman.h>
 #include <memory/pmm.h>
 #include <memory/vmm.h>
 #include <proc/task.h>
+#include <proc/vdso.h>
 #include <utils/debug.h>
+#include <utils/math.h>
 #include <utils/string.h>
 
 #define NO_ERROR 0
@@ -15,7 +19,7 @@
 #define ERR_WRONG_VERSION 4
 #define ERR_NOT_SUPPORTED_TYPE 5
 
-static int elf_verify(struct Elf32_Ehdr *elf_header)
+static int elf_verify(struct Elf32_Ehdr *elf_header, Elf32_Half type)
 {
 	if (!(elf_header->e_ident[EI_MAG0] == ELFMAG0 &&
 		  elf_header->e_ident[EI_MAG1] == ELFMAG1 &&
@@ -35,7 +39,7 @@ static int elf_verify(struct Elf32_Ehdr *elf_header)
 	if (elf_header->e_machine != EM_386)
 		return -ERR_NOT_SUPPORTED_PLATFORM;
 
-	if (elf_header->e_type != ET_EXEC)
+	if (elf_header->e_type != type)
 		return -ERR_NOT_SUPPORTED_TYPE;
 
 	return NO_ERROR;
@@ -60,59 +64,269 @@ static int elf_verify(struct Elf32_Ehdr *elf_header)
 * 	+---------------+
 */
 
-struct Elf32_Layout *elf_load(const char *path)
+// copy file's bytes to user address, data goes through page cache so the next exec doesn't hit the disk
+static int elf_copy_from_file(struct vfs_file *file, uint32_t vaddr, uint32_t offset, uint32_t count)
+{
+	while (count)
+	{
+		uint32_t in_page = offset % PMM_FRAME_SIZE;
+		uint32_t n = min_t(uint32_t, count, PMM_FRAME_SIZE - in_page);
+		struct page *p = read_cache_page(file, offset / PMM_FRAME_SIZE);
+		if (!p)
+			return -EIO;
+
+		memcpy((char *)vaddr, (char *)p->virtual + in_page, n);
+		vaddr += n;
+		offset += n;
+		count -= n;
+	}
+	return 0;
+}
+
+// segments can share a page at their boundary, the page which is mapped by previous segment is made private and kept
+static void elf_map_private_page(uint32_t vaddr)
 {
-	const char *buf = vfs_read(path);
-	struct Elf32_Ehdr *elf_header = (struct Elf32_Ehdr *)buf;
+	if (!vmm_is_mapped(vaddr))
+	{
+		vmm_map_address(current_process->pdir, vaddr, (uint32_t)pmm_alloc_block(), I86_PTE_PRESENT | I86_PTE_WRITABLE | I86_PTE_USER);
+		memset((char *)vaddr, 0, PMM_FRAME_SIZE);
+	}
+	else if (!(vmm_get_physical_address(vaddr, true) & I86_PTE_WRITABLE))
+	{
+		char *tmp = kcalloc(PMM_FRAME_SIZE, sizeof(char));
+		memcpy(tmp, (char *)vaddr, PMM_FRAME_SIZE);
+		vmm_map_address(current_process->pdir, vaddr, (uint32_t)pmm_alloc_block(), I86_PTE_PRESENT | I86_PTE_WRITABLE | I86_PTE_USER);
+		memcpy((char *)vaddr, tmp, PMM_FRAME_SIZE);
+		kfree(tmp);
+	}
+}
+
+// NOTE: MQ 2020-08-15
+// Read-only segments (text, rodata) are mapped straight from page cache and shared by every process running the file
+// writable segments (data) get private pages filled from page cache, bss beyond data's last page is left unmapped
+// and zero-filled on first touch (handle_mm_fault)
+static int elf_map_segment(struct vfs_file *file, struct Elf32_Phdr *ph)
+{
+	struct mm_struct *mm = current_process->mm;
+	uint32_t start = ALIGN_DOWN(ph->p_vaddr, PMM_FRAME_SIZE);
+	uint32_t file_end = ph->p_vaddr + ph->p_filesz;
+	uint32_t mem_end = ph->p_vaddr + ph->p_memsz;
+
+	struct vm_area_struct *prev = find_vma(mm, start);
+	uint32_t area_start = prev ? prev->vm_end : start;
+	if (area_start < PAGE_ALIGN(mem_end))
+	{
+		struct vm_area_struct *vma = get_unmapped_area(area_start, PAGE_ALIGN(mem_end) - area_start);
+		if (!vma)
+			return -ENOMEM;
+		// bss pages are faulted in with it
+		vma->vm_flags = (ph->p_flags & PF_R ? VM_READ : 0) |
+						(ph->p_flags & PF_W ? VM_WRITE : 0) |
+						(ph->p_flags & PF_X ? VM_EXEC : 0);
+	}
+
+	bool shared = !(ph->p_flags & PF_W) &&
+				  ph->p_filesz == ph->p_memsz &&
+				  (ph->p_vaddr - ph->p_offset) % PMM_FRAME_SIZE == 0;
 
-	if (elf_verify(elf_header) != NO_ERROR || elf_header->e_phoff == 0)
+	for (uint32_t vaddr = start; vaddr < file_end; vaddr += PMM_FRAME_SIZE)
+	{
+		if (shared)
+		{
+			struct page *p = read_cache_page(file, (ph->p_offset - (ph->p_vaddr - vaddr)) / PMM_FRAME_SIZE);
+			if (!p)
+				return -EIO;
+
+			if (!vmm_is_mapped(vaddr))
+				vmm_map_address(current_process->pdir, vaddr, p->frame, I86_PTE_PRESENT | I86_PTE_USER);
+			if ((vmm_get_physical_address(vaddr, true) & ~0xfff) == p->frame)
+				continue;
+		}
+
+		elf_map_private_page(vaddr);
+		uint32_t from = max(vaddr, ph->p_vaddr);
+		uint32_t to = min(vaddr + PMM_FRAME_SIZE, file_end);
+		if (elf_copy_from_file(file, from, ph->p_offset + (from - ph->p_vaddr), to - from) < 0)
+			return -EIO;
+	}
+
+	// the rest of data's last page belongs to bss
+	if (file_end < mem_end && file_end != PAGE_ALIGN(file_end))
+		memset((char *)file_end, 0, min(PAGE_ALIGN(file_end), mem_end) - file_end);
+
+	return 0;
+}
+
+// map file's loadable segments at `base` (0 for executable), program interpreter's path is returned in `interp`
+static int elf_load_file(struct vfs_file *file, const char *path, Elf32_Half type, uint32_t base, struct Elf32_Layout *layout, char **interp)
+{
+	struct Elf32_Ehdr elf_header;
+	if (file->f_op->read(file, (char *)&elf_header, sizeof(struct Elf32_Ehdr), 0) != sizeof(struct Elf32_Ehdr) ||
+		elf_verify(&elf_header, type) != NO_ERROR ||
+		elf_header.e_phoff == 0 ||
+		elf_header.e_phentsize != sizeof(struct Elf32_Phdr))
 	{
 		log("ELF: %s is not correct format", path);
-		return NULL;
+		return -ENOEXEC;
 	}
 
-	log("ELF: Load %s", path);
+	// only program headers are read, segments are paged in from page cache
+	uint32_t phsize = elf_header.e_phentsize * elf_header.e_phnum;
+	struct Elf32_Phdr *phdrs = kcalloc(1, phsize);
+	if (file->f_op->read(file, (char *)phdrs, phsize, elf_header.e_phoff) != phsize)
+	{
+		log("ELF: %s has truncated program headers", path);
+		kfree(phdrs);
+		return -ENOEXEC;
+	}
+
+	int ret = 0;
+	uint32_t phdr = 0;
 	struct mm_struct *mm = current_process->mm;
-	struct Elf32_Layout *layout = kcalloc(1, sizeof(struct Elf32_Layout));
-	layout->entry = elf_header->e_entry;
-	for (struct Elf32_Phdr *ph = (struct Elf32_Phdr *)(buf + elf_header->e_phoff);
-		 ph && (char *)ph < (buf + elf_header->e_phoff + elf_header->e_phentsize * elf_header->e_phnum);
-		 ++ph)
+	for (struct Elf32_Phdr *ph = phdrs; ph < phdrs + elf_header.e_phnum; ++ph)
 	{
+		if (ph->p_type == PT_PHDR)
+			phdr = ph->p_vaddr;
+		else if (ph->p_type == PT_INTERP && interp && !*interp)
+		{
+			*interp = kcalloc(ph->p_filesz + 1, sizeof(char));
+			if (file->f_op->read(file, *interp, ph->p_filesz, ph->p_offset) != ph->p_filesz)
+			{
+				ret = -ENOEXEC;
+				break;
+			}
+		}
+
 		if (ph->p_type != PT_LOAD)
 			continue;
 
+		// without PT_PHDR, program headers are found in the segment which contains them (usually the first one)
+		if (!phdr && ph->p_offset <= elf_header.e_phoff && elf_header.e_phoff + phsize <= ph->p_offset + ph->p_filesz)
+			phdr = ph->p_vaddr + (elf_header.e_phoff - ph->p_offset);
+
+		struct Elf32_Phdr segment = *ph;
+		segment.p_vaddr += base;
+		if (elf_map_segment(file, &segment) < 0)
+		{
+			log("ELF: Cannot map segment at 0x%x of %s", segment.p_vaddr, path);
+			ret = -EIO;
+			break;
+		}
+
+		// interpreter is not a part of program's code and data
+		if (base)
+			continue;
+
 		// text segment
 		if ((ph->p_flags & PF_X) != 0 && (ph->p_flags & PF_R) != 0)
 		{
-			do_mmap(ph->p_vaddr, ph->p_memsz, 0, 0, -1, 0);
 			mm->start_code = ph->p_vaddr;
 			mm->end_code = ph->p_vaddr + ph->p_memsz;
 		}
 		// data segment
 		else if ((ph->p_flags & PF_W) != 0 && (ph->p_flags & PF_R) != 0)
 		{
-			do_mmap(ph->p_vaddr, ph->p_memsz, 0, 0, -1, 0);
 			mm->start_data = ph->p_vaddr;
-			mm->end_data = ph->p_memsz;
+			mm->end_data = ph->p_vaddr + ph->p_memsz;
 		}
-		// eh frame
-		else
-			do_mmap(ph->p_vaddr, ph->p_memsz, 0, 0, -1, 0);
+	}
+	kfree(phdrs);
+	if (ret < 0)
+		return ret;
+
+	layout->entry = base + elf_header.e_entry;
+	layout->phdr = phdr ? base + phdr : 0;
+	layout->phnum = elf_header.e_phnum;
+	return 0;
+}
+
+// NOTE: MQ 2020-08-16
+// Dynamically linked program starts at its interpreter (runtime linker, ld.so) instead of its own entry
+// program is mapped as usual, interpreter is mapped at INTERP_BASE and finds the program via auxiliary vector
+static int elf_load_interp(const char *interp, struct Elf32_Layout *layout)
+{
+	int32_t fd = vfs_open(interp, O_RDONLY);
+	if (fd < 0)
+	{
+		log("ELF: Cannot open interpreter %s", interp);
+		return fd;
+	}
+
+	// interpreter sits below vdso, keep mmap's search starting after program
+	struct mm_struct *mm = current_process->mm;
+	uint32_t free_area_cache = mm->free_area_cache;
+	struct Elf32_Layout interp_layout = {0};
+	int ret = elf_load_file(fcheck(fd), interp, ET_DYN, INTERP_BASE, &interp_layout, NULL);
+	mm->free_area_cache = free_area_cache;
+	vfs_close(fd);
+	if (ret < 0)
+		return ret;
+
+	layout->entry = interp_layout.entry;
+	layout->interp_base = INTERP_BASE;
+	return 0;
+}
+
+// auxiliary vector is placed right above envp: argc, argv, envp, (type, value)..., AT_NULL
+static void elf_setup_auxv(struct Elf32_Layout *layout)
+{
+	uint32_t auxv[] = {
+		AT_PHDR, layout->phdr,
+		AT_PHENT, sizeof(struct Elf32_Phdr),
+		AT_PHNUM, layout->phnum,
+		AT_PAGESZ, PMM_FRAME_SIZE,
+		AT_BASE, layout->interp_base,
+		AT_ENTRY, layout->program_entry,
+		AT_NULL, 0,
+	};
+
+	layout->stack -= sizeof(auxv);
+	memcpy((char *)layout->stack, auxv, sizeof(auxv));
+}
 
-		// NOTE: MQ 2019-11-26 According to elf's spec, p_memsz may be larger than p_filesz due to bss section
-		memset((char *)ph->p_vaddr, 0, ph->p_memsz);
-		memcpy((char *)ph->p_vaddr, buf + ph->p_offset, ph->p_filesz);
+struct Elf32_Layout *elf_load(const char *path)
+{
+	uint64_t start = rdtsc();
+	int32_t fd = vfs_open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		log("ELF: Cannot open %s", path);
+		return NULL;
 	}
 
-	uint32_t heap_start = do_mmap(0, UHEAP_SIZE, 0, 0, -1, 0);
+	log("ELF: Load %s", path);
+	struct Elf32_Layout *layout = kcalloc(1, sizeof(struct Elf32_Layout));
+	char *interp = NULL;
+	int ret = elf_load_file(fcheck(fd), path, ET_EXEC, 0, layout, &interp);
+	vfs_close(fd);
+
+	layout->program_entry = layout->entry;
+	if (ret >= 0 && interp)
+	{
+		log("ELF: Load interpreter %s for %s", interp, path);
+		ret = elf_load_interp(interp, layout);
+	}
+	kfree(interp);
+
+	if (ret < 0)
+	{
+		kfree(layout);
+		return NULL;
+	}
+
+	struct mm_struct *mm = current_process->mm;
+	uint32_t heap_start = do_mmap(0, UHEAP_SIZE, PROT_READ | PROT_WRITE, 0, -1, 0);
 	mm->start_brk = heap_start;
 	mm->brk = heap_start;
 	mm->end_brk = USER_HEAP_TOP;
 
-	uint32_t stack_start = do_mmap(0, STACK_SIZE, 0, 0, -1, 0);
+	uint32_t stack_start = do_mmap(0, STACK_SIZE, PROT_READ | PROT_WRITE, 0, -1, 0);
 	layout->stack = stack_start + STACK_SIZE;
+	elf_setup_auxv(layout);
+
+	vdso_map();
 
+	log("ELF: Loaded %s in %llu cycles", path, rdtsc() - start);
 	return layout;
 }
 
@@ -125,10 +339,14 @@ void elf_unload()
 	struct vm_area_struct *iter, *next;
 	list_for_each_entry_safe(iter, next, &current_process->mm->mmap, vm_sibling)
 	{
-		if (!iter->vm_file && (iter->vm_flags & MAP_SHARED) == 0)
+		if (!(iter->vm_flags & VM_SHARED))
 		{
-			vmm_unmap_range(current_process->pdir, iter->vm_start, iter->vm_end);
-			list_del(&iter->vm_sibling);
+			if (iter->vm_file)
+				vmm_unmap_range(current_process->pdir, iter->vm_start, iter->vm_end);
+			else
+				vmm_release_range(current_process->pdir, iter->vm_start, iter->vm_end);
+			vma_unlink(current_process->mm, iter);
+			kfree(iter);
 		}
 	}
 	memset(current_process->mm, 0, sizeof(struct mm_struct));
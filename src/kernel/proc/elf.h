@@ -160,10 +160,26 @@ struct Elf32_Phdr
 	Elf32_Word p_align;
 };
 
+// auxiliary vector entries, they are placed above envp for runtime linker
+#define AT_NULL 0
+#define AT_PHDR 3
+#define AT_PHENT 4
+#define AT_PHNUM 5
+#define AT_PAGESZ 6
+#define AT_BASE 7
+#define AT_ENTRY 9
+
+// program interpreter (PT_INTERP) is loaded below vdso, shared libraries are mmaped above user heap
+#define INTERP_BASE 0xBF000000
+
 struct Elf32_Layout
 {
 	uint32_t stack;
 	uint32_t entry;
+	uint32_t phdr;
+	uint32_t phnum;
+	uint32_t program_entry;
+	uint32_t interp_base;
 };
 
 struct Elf32_Layout *elf_load(const char *path);
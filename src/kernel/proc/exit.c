@@ -1,7 +1,7 @@
 #include <devices/char/tty.h>
-#include <include/atomic.h>
 #include <include/errno.h>
 #include <ipc/signal.h>
+#include <locking/futex.h>
 #include <utils/debug.h>
 
 #include "task.h"
@@ -11,67 +11,145 @@ static void exit_mm(struct process *proc)
 	struct vm_area_struct *iter, *next;
 	list_for_each_entry_safe(iter, next, &proc->mm->mmap, vm_sibling)
 	{
-		if (!iter->vm_file)
+		// like munmap, private anonymous frames are given back, file pages belong to page cache or filesystem
+		if (iter->vm_file)
 			vmm_unmap_range(proc->pdir, iter->vm_start, iter->vm_end);
+		else
+			vmm_release_range(proc->pdir, iter->vm_start, iter->vm_end);
 
-		list_del(&iter->vm_sibling);
+		vma_unlink(proc->mm, iter);
 		kfree(iter);
 	}
 }
 
+// file might be shared with parent or children (fork, dup), only the last one releases it
 static void exit_files(struct process *proc)
 {
-	for (int i = 0; i < MAX_FD; ++i)
-	{
-		struct vfs_file *file = proc->files->fd[i];
-
-		if (file && atomic_read(&file->f_count) == 1 && file->f_op->release)
-		{
-			file->f_op->release(file->f_dentry->d_inode, file);
-			kfree(file);
-			proc->files->fd[i] = 0;
-		}
-	}
+	close_files(proc->files);
 }
 
-static void exit_thread(struct process *proc)
+static void exit_thread(struct thread *th)
 {
-	struct thread *th = proc->thread;
+	struct process *proc = th->parent;
 
 	update_thread(th, THREAD_TERMINATED);
 	del_timer(&th->sleep_timer);
-	vmm_unmap_range(proc->pdir, th->user_stack - STACK_SIZE, th->user_stack);
+	futex_unqueue(th);
+	list_del(&th->sibling);
+	if (proc->group_exit_thread && proc->group_exit_thread != th)
+		update_thread(proc->group_exit_thread, THREAD_READY);
+	reaper_wake();
+}
+
+// NOTE: MQ 2020-08-19
+// other threads are killed the way SIGKILL does it, they are woken up, give up their waits, unwind (releasing
+// locks and dequeuing wait entries on the way) and exit on their way back to userspace (handle_signal -> do_exit)
+// the calling thread sleeps until it's the only one left
+// return false if another thread got here first, the calling thread is one of the zapped ones then
+bool zap_other_threads(struct process *proc)
+{
+	lock_scheduler();
+
+	if (proc->flags & SIGNAL_GROUP_EXIT)
+	{
+		unlock_scheduler();
+		return false;
+	}
+
+	proc->flags |= SIGNAL_GROUP_EXIT;
+	proc->group_exit_thread = current_thread;
+
+	struct thread *iter;
+	list_for_each_entry(iter, &proc->threads, sibling)
+	{
+		if (iter == current_thread)
+			continue;
+
+		sigaddset(&iter->pending, SIGKILL);
+		update_thread(iter, THREAD_READY);
+	}
+
+	while (!list_is_singular(&proc->threads))
+	{
+		update_thread(current_thread, THREAD_WAITING);
+		unlock_scheduler();
+		schedule();
+		lock_scheduler();
+	}
+
+	proc->flags &= ~SIGNAL_GROUP_EXIT;
+	proc->group_exit_thread = NULL;
+	proc->thread = current_thread;
+
+	unlock_scheduler();
+	return true;
+}
+
+static bool is_zombie(struct process *proc)
+{
+	return proc->flags & (SIGNAL_TERMINATED | EXIT_TERMINATED);
 }
 
+// NOTE: MQ 2020-08-20 init (kernel_init) never waits, its children are released as soon as they are zombies
 static void exit_notify(struct process *proc)
 {
-	struct process *iter;
-	list_for_each_entry(iter, &proc->children, sibling)
+	struct process *init = find_process_by_pid(INIT_PID);
+	struct process *iter, *next;
+	list_for_each_entry_safe(iter, next, &proc->children, sibling)
 	{
-		iter->parent = find_process_by_pid(INIT_PID);
+		iter->parent = init;
+		list_del(&iter->sibling);
+		if (is_zombie(iter))
+			release_process(iter);
+		else
+			list_add_tail(&iter->sibling, &init->children);
 	}
 	if (!proc->caused_signal)
 		proc->flags |= EXIT_TERMINATED;
 
 	if (proc->pid == proc->sid && proc->tty && proc->pid == proc->tty->session)
 	{
+		pid_t pgrp = proc->tty->pgrp;
 		proc->tty->session = 0;
 		proc->tty->pgrp = 0;
-		do_kill(-proc->tty->pgrp, SIGHUP);
+		if (pgrp)
+			do_kill(-pgrp, SIGHUP);
 	}
 
 	do_kill(proc->parent->pid, SIGCHLD);
 	wake_up(&proc->parent->wait_chld);
+
+	if (proc->parent == init)
+	{
+		list_del(&proc->sibling);
+		release_process(proc);
+	}
 }
 
 void do_exit(int32_t code)
 {
+	// another thread is taking the process down, only the calling thread ends
+	if (!zap_other_threads(current_process))
+	{
+		log("Process: Exit zapped thread t%d of %s(p%d)", current_thread->tid, current_process->name, current_process->pid);
+		lock_scheduler();
+		exit_thread(current_thread);
+		unlock_scheduler();
+
+		schedule();
+		return;
+	}
+
 	log("Process: Exit %s(p%d)", current_process->name, current_process->pid);
+	// closing the last reference of a file might sleep (inode_lock, writing inode back), interrupts have to be on
+	exit_files(current_process);
+
 	lock_scheduler();
 
+	// user stack is one of anonymous areas
 	exit_mm(current_process);
-	exit_files(current_process);
-	exit_thread(current_process);
+	del_timer(&current_process->sig_alarm_timer);
+	exit_thread(current_thread);
 
 	current_process->exit_code = code;
 	exit_notify(current_process);
@@ -81,6 +159,107 @@ void do_exit(int32_t code)
 	schedule();
 }
 
+// exit(2) only ends the calling thread, process is ended with its last thread
+void do_exit_thread(int32_t code)
+{
+	struct process *proc = current_process;
+	struct thread *th = current_thread;
+
+	lock_scheduler();
+	bool last_thread = list_is_singular(&proc->threads);
+	unlock_scheduler();
+
+	if (last_thread)
+	{
+		do_exit(code);
+		return;
+	}
+
+	log("Process: Exit thread t%d of %s(p%d)", th->tid, proc->name, proc->pid);
+	// detached thread might have unmapped its own stack (where tid is) already
+	if (th->clear_child_tid && find_vma(proc->mm, (uint32_t)th->clear_child_tid))
+	{
+		*th->clear_child_tid = 0;
+		futex_wake(th->clear_child_tid, 1);
+	}
+
+	lock_scheduler();
+
+	exit_thread(th);
+	if (proc->thread == th)
+		proc->thread = list_first_entry(&proc->threads, struct thread, sibling);
+
+	unlock_scheduler();
+
+	schedule();
+}
+
+static bool is_waitable(struct process *proc, int options)
+{
+	return (options & WEXITED && is_zombie(proc)) ||
+		   (options & WSTOPPED && proc->flags & SIGNAL_STOPED) ||
+		   (options & WCONTINUED && proc->flags & SIGNAL_CONTINUED);
+}
+
+// waited child is unlinked from its parent's children (list_del clears sibling)
+static bool is_child(struct process *proc)
+{
+	return proc && proc->parent == current_process && proc->sibling.next;
+}
+
+// NOTE: MQ 2020-08-22
+// waitpid(pid) and waitpid(-pgrp) go through pid hash and group's members, only P_ALL walks every child
+static struct process *find_waitable_child(idtype_t idtype, id_t id, int options, bool *child_exist)
+{
+	struct process *iter, *pchild = NULL;
+
+	lock_scheduler();
+	if (idtype == P_PID)
+	{
+		iter = find_process_by_pid(id);
+		if (is_child(iter))
+		{
+			*child_exist = true;
+			if (is_waitable(iter, options))
+				pchild = iter;
+		}
+	}
+	else if (idtype == P_PGID)
+	{
+		struct pid *pgrp = find_pid(id);
+		if (pgrp)
+		{
+			for_each_pid_task(iter, pgrp, PIDTYPE_PGID)
+			{
+				if (!is_child(iter))
+					continue;
+
+				*child_exist = true;
+				if (is_waitable(iter, options))
+				{
+					pchild = iter;
+					break;
+				}
+			}
+		}
+	}
+	else if (idtype == P_ALL)
+	{
+		list_for_each_entry(iter, &current_process->children, sibling)
+		{
+			*child_exist = true;
+			if (is_waitable(iter, options))
+			{
+				pchild = iter;
+				break;
+			}
+		}
+	}
+	unlock_scheduler();
+
+	return pchild;
+}
+
 /*
  * Return:
  * - 1 if found a child process which status is available
@@ -95,28 +274,17 @@ int32_t do_wait(idtype_t idtype, id_t id, struct infop *infop, int options)
 	log("Process: Wait %s(p%d) with idtype=%d id=%d options=%d", current_process->name, current_process->pid, idtype, id, options);
 	struct process *pchild = NULL;
 	bool child_exist = false;
+	bool interrupted = false;
 	while (true)
 	{
-		struct process *iter;
-		list_for_each_entry(iter, &current_process->children, sibling)
-		{
-			if (!((idtype == P_PID && iter->pid == id) ||
-				  (idtype == P_PGID && iter->gid == id) ||
-				  idtype == P_ALL))
-				continue;
-
-			child_exist = true;
-			if ((options & WEXITED && (iter->flags & SIGNAL_TERMINATED || iter->flags & EXIT_TERMINATED)) ||
-				(options & WSTOPPED && iter->flags & SIGNAL_STOPED) ||
-				(options & WCONTINUED && iter->flags & SIGNAL_CONTINUED))
-			{
-				pchild = iter;
-				break;
-			}
-		}
-
+		pchild = find_waitable_child(idtype, id, options, &child_exist);
 		if (pchild || options & WNOHANG)
 			break;
+		if (fatal_signal_pending(current_thread))
+		{
+			interrupted = true;
+			break;
+		}
 
 		update_thread(current_thread, THREAD_WAITING);
 		schedule();
@@ -144,8 +312,12 @@ int32_t do_wait(idtype_t idtype, id_t id, struct infop *infop, int options)
 		// After waiting for terminated child, we remove it from parent
 		// the next waiting time, we don't find the same one again
 		list_del(&pchild->sibling);
+		if (is_zombie(pchild))
+			release_process(pchild);
 		ret = 1;
 	}
+	else if (interrupted)
+		ret = -EINTR;
 	else
 		ret = child_exist && options & WNOHANG ? 0 : -ECHILD;
 
@@ -0,0 +1,245 @@
+#include <include/bitops.h>
+#include <include/errno.h>
+#include <utils/debug.h>
+
+#include "pid.h"
+#include "task.h"
+
+// NOTE: MQ 2020-08-22
+// pid/tid numbers come from bitmaps, allocation continues after the last given number and wraps around to RESERVED_PIDS
+// -> released numbers are reused but not right away, a stale pid in userspace rarely hits a new process
+// processes are found through pid hash and every struct pid links processes of its group/session
+// -> kill(-pgrp), waitpid(-pgrp) and tty only visit members instead of every process
+#define BITS_PER_WORD 32
+
+struct pidmap
+{
+	int last;
+	uint32_t page[PID_MAX_LIMIT / BITS_PER_WORD];
+};
+
+static struct pidmap pid_map = {.last = -1};
+static struct pidmap tid_map = {.last = -1};
+static struct list_head pid_hash[PIDHASH_SIZE];
+LIST_HEAD(process_list);
+
+static int find_next_zero_nr(struct pidmap *map, int start)
+{
+	for (int idx = start / BITS_PER_WORD; idx < PID_MAX_LIMIT / BITS_PER_WORD; ++idx)
+	{
+		uint32_t word = map->page[idx];
+		if (idx == start / BITS_PER_WORD)
+			word |= (1u << (start % BITS_PER_WORD)) - 1;
+		if (word != ~0u)
+			return idx * BITS_PER_WORD + ffz(word);
+	}
+	return PID_MAX_LIMIT;
+}
+
+static int alloc_pidmap(struct pidmap *map)
+{
+	lock_scheduler();
+
+	int nr = find_next_zero_nr(map, map->last + 1);
+	if (nr >= PID_MAX_LIMIT)
+		nr = find_next_zero_nr(map, RESERVED_PIDS);
+
+	if (nr < PID_MAX_LIMIT)
+	{
+		set_bit(nr, map->page);
+		map->last = nr;
+	}
+	else
+		nr = -EAGAIN;
+
+	unlock_scheduler();
+	return nr;
+}
+
+static void free_pidmap(struct pidmap *map, int nr)
+{
+	lock_scheduler();
+	clear_bit(nr, map->page);
+	unlock_scheduler();
+}
+
+static struct list_head *pid_hashfn(pid_t nr)
+{
+	return &pid_hash[((uint32_t)nr * 0x9E3779B9) >> (32 - PIDHASH_BITS)];
+}
+
+// scheduler has to be locked for the rest, pid is unreferenced until the first process is attached to it
+static struct pid *alloc_pid()
+{
+	int nr = alloc_pidmap(&pid_map);
+	if (nr < 0)
+		return NULL;
+
+	struct pid *pid = kcalloc(1, sizeof(struct pid));
+	pid->nr = nr;
+	for (int type = 0; type < PIDTYPE_MAX; ++type)
+		INIT_LIST_HEAD(&pid->tasks[type]);
+	list_add_tail(&pid->hash_sibling, pid_hashfn(nr));
+
+	return pid;
+}
+
+static void put_pid(struct pid *pid)
+{
+	if (--pid->count)
+		return;
+
+	list_del(&pid->hash_sibling);
+	free_pidmap(&pid_map, pid->nr);
+	kfree(pid);
+}
+
+static void attach_pid(struct process *proc, enum pid_type type, struct pid *pid)
+{
+	pid->count++;
+	proc->pids[type] = pid;
+	list_add_tail(&proc->pid_sibling[type], &pid->tasks[type]);
+
+	if (type == PIDTYPE_PID)
+		proc->pid = pid->nr;
+	else if (type == PIDTYPE_PGID)
+		proc->gid = pid->nr;
+	else
+		proc->sid = pid->nr;
+}
+
+static void detach_pid(struct process *proc, enum pid_type type)
+{
+	list_del(&proc->pid_sibling[type]);
+	put_pid(proc->pids[type]);
+	proc->pids[type] = NULL;
+}
+
+static void change_pid(struct process *proc, enum pid_type type, struct pid *pid)
+{
+	if (proc->pids[type] == pid)
+		return;
+
+	detach_pid(proc, type);
+	attach_pid(proc, type, pid);
+}
+
+struct pid *find_pid(pid_t nr)
+{
+	struct pid *iter;
+	list_for_each_entry(iter, pid_hashfn(nr), hash_sibling)
+	{
+		if (iter->nr == nr)
+			return iter;
+	}
+	return NULL;
+}
+
+struct process *pid_task(struct pid *pid, enum pid_type type)
+{
+	if (!pid || list_empty(&pid->tasks[type]))
+		return NULL;
+
+	return list_first_entry(&pid->tasks[type], struct process, pid_sibling[type]);
+}
+
+struct process *find_process_by_pid(pid_t nr)
+{
+	lock_scheduler();
+	struct process *proc = pid_task(find_pid(nr), PIDTYPE_PID);
+	unlock_scheduler();
+
+	return proc;
+}
+
+// new process joins its parent's group and session, a process without parent leads its own ones
+int attach_process_pids(struct process *proc, struct process *parent)
+{
+	lock_scheduler();
+
+	struct pid *pid = alloc_pid();
+	if (!pid)
+	{
+		unlock_scheduler();
+		return -EAGAIN;
+	}
+
+	attach_pid(proc, PIDTYPE_PID, pid);
+	attach_pid(proc, PIDTYPE_PGID, parent ? parent->pids[PIDTYPE_PGID] : pid);
+	attach_pid(proc, PIDTYPE_SID, parent ? parent->pids[PIDTYPE_SID] : pid);
+	list_add_tail(&proc->process_sibling, &process_list);
+
+	unlock_scheduler();
+	return 0;
+}
+
+void detach_process_pids(struct process *proc)
+{
+	lock_scheduler();
+
+	for (int type = 0; type < PIDTYPE_MAX; ++type)
+		detach_pid(proc, type);
+	list_del(&proc->process_sibling);
+
+	unlock_scheduler();
+}
+
+// session leader stays in its group, other groups can only be joined inside the same session
+int do_setpgid(struct process *proc, pid_t pgid)
+{
+	if (pgid < 0)
+		return -EINVAL;
+
+	lock_scheduler();
+
+	int ret = 0;
+	struct pid *pgrp = !pgid || pgid == proc->pid ? proc->pids[PIDTYPE_PID] : find_pid(pgid);
+	if (pgrp != proc->pids[PIDTYPE_PGID])
+	{
+		struct process *member = pid_task(pgrp, PIDTYPE_PGID);
+		if (proc->pid == proc->sid)
+			ret = -EPERM;
+		else if (pgrp != proc->pids[PIDTYPE_PID] && (!member || member->sid != proc->sid))
+			ret = -EPERM;
+		else
+			change_pid(proc, PIDTYPE_PGID, pgrp);
+	}
+
+	unlock_scheduler();
+	return ret;
+}
+
+// a process whose pid is used by a group can't create a session, the group would span two sessions
+int do_setsid(struct process *proc)
+{
+	lock_scheduler();
+
+	int ret = -EPERM;
+	struct pid *pid = proc->pids[PIDTYPE_PID];
+	if (list_empty(&pid->tasks[PIDTYPE_PGID]))
+	{
+		change_pid(proc, PIDTYPE_SID, pid);
+		change_pid(proc, PIDTYPE_PGID, pid);
+		proc->tty = NULL;
+		ret = proc->sid;
+	}
+
+	unlock_scheduler();
+	return ret;
+}
+
+int alloc_tid()
+{
+	return alloc_pidmap(&tid_map);
+}
+
+void free_tid(int tid)
+{
+	free_pidmap(&tid_map, tid);
+}
+
+void pid_init()
+{
+	for (int i = 0; i < PIDHASH_SIZE; ++i)
+		INIT_LIST_HEAD(&pid_hash[i]);
+}
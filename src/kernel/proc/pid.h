@@ -0,0 +1,56 @@
+#ifndef PROC_PID_H
+#define PROC_PID_H
+
+#include <include/list.h>
+#include <include/types.h>
+#include <stdint.h>
+
+#define PID_MAX_LIMIT 0x8000
+// pids are reused from here after wrapping around, low pids stay with kernel daemons
+#define RESERVED_PIDS 300
+
+#define PIDHASH_BITS 8
+#define PIDHASH_SIZE (1 << PIDHASH_BITS)
+
+enum pid_type
+{
+	PIDTYPE_PID,
+	PIDTYPE_PGID,
+	PIDTYPE_SID,
+	PIDTYPE_MAX,
+};
+
+// NOTE: MQ 2020-08-22
+// A pid number is owned by `struct pid` as long as a process uses it as its pid, process group or session
+// -> a group id is not reused while the group has members even if its leader has been released
+struct pid
+{
+	pid_t nr;
+	uint32_t count;
+	struct list_head hash_sibling;
+	// processes which use this pid as PIDTYPE_*
+	struct list_head tasks[PIDTYPE_MAX];
+};
+
+struct process;
+
+#define for_each_pid_task(proc, pid, type) \
+	list_for_each_entry(proc, &(pid)->tasks[type], pid_sibling[type])
+
+extern struct list_head process_list;
+
+#define for_each_process(p) \
+	list_for_each_entry(p, &process_list, process_sibling)
+
+void pid_init();
+struct pid *find_pid(pid_t nr);
+struct process *pid_task(struct pid *pid, enum pid_type type);
+struct process *find_process_by_pid(pid_t nr);
+int attach_process_pids(struct process *proc, struct process *parent);
+void detach_process_pids(struct process *proc);
+int do_setpgid(struct process *proc, pid_t pgid);
+int do_setsid(struct process *proc);
+int alloc_tid();
+void free_tid(int tid);
+
+#endif
@@ -0,0 +1,267 @@
+#include <include/list.h>
+#include <utils/debug.h>
+#include <utils/string.h>
+#include <utils/vsprintf.h>
+
+#include "task.h"
+
+// NOTE: MQ 2020-08-20
+// Exit path only marks thread terminated and process zombie, everything else is torn down by kreaper
+// - thread's kernel stack can't be freed by itself (it's still running on it until the last switch)
+// - a batch of exits (e.g. shell's children) is reclaimed in one go instead of on every exit
+// terminated threads are taken from terminated_list, released (waited or auto-reaped) processes are queued in release_list
+#define STACK_CACHE_SIZE 16
+
+struct reaper_stat
+{
+	uint32_t batches;
+	uint32_t threads;
+	uint32_t processes;
+	uint32_t frames;
+	uint32_t stacks_freed;
+	uint32_t stack_cache_hits;
+	uint64_t reclaimed;
+};
+
+extern struct plist_head terminated_list;
+
+static struct thread *reaper_thread;
+static struct reaper_stat reaper_stat;
+static LIST_HEAD(release_list);
+static LIST_HEAD(thread_cache);
+static char *stack_cache[STACK_CACHE_SIZE];
+static int nr_cached_stacks;
+
+// return the top of stack (stack grows down)
+uint32_t kernel_stack_alloc()
+{
+	char *stack = NULL;
+
+	lock_scheduler();
+	if (nr_cached_stacks)
+	{
+		stack = stack_cache[--nr_cached_stacks];
+		reaper_stat.stack_cache_hits++;
+	}
+	unlock_scheduler();
+
+	if (!stack)
+		stack = kcalloc(STACK_SIZE, sizeof(char));
+	return (uint32_t)stack + STACK_SIZE;
+}
+
+static void kernel_stack_free(uint32_t kernel_stack)
+{
+	char *stack = (char *)(kernel_stack - STACK_SIZE);
+
+	lock_scheduler();
+	bool cached = nr_cached_stacks < STACK_CACHE_SIZE;
+	if (cached)
+		stack_cache[nr_cached_stacks++] = stack;
+	unlock_scheduler();
+
+	if (!cached)
+	{
+		kfree(stack);
+		reaper_stat.stacks_freed++;
+	}
+	reaper_stat.reclaimed += STACK_SIZE;
+}
+
+// NOTE: MQ 2020-08-20
+// thread structures are recycled instead of being freed, wait queue entries on heap (e.g. poll table) might still refer
+// a terminated thread, a late wake up only makes the new owner return from its wait loop once
+struct thread *thread_alloc()
+{
+	struct thread *th = NULL;
+
+	lock_scheduler();
+	if (!list_empty(&thread_cache))
+	{
+		th = list_first_entry(&thread_cache, struct thread, sibling);
+		list_del(&th->sibling);
+	}
+	unlock_scheduler();
+
+	if (th)
+		memset(th, 0, sizeof(struct thread));
+	else
+		th = kcalloc(1, sizeof(struct thread));
+
+	// a live thread holds a kernel stack, memory runs out long before tids
+	th->tid = alloc_tid();
+	assert(th->tid >= 0, "Task: No free tid");
+	return th;
+}
+
+static void thread_free(struct thread *th)
+{
+	free_tid(th->tid);
+
+	lock_scheduler();
+	list_add(&th->sibling, &thread_cache);
+	unlock_scheduler();
+
+	reaper_stat.reclaimed += sizeof(struct thread);
+}
+
+// thread has to be out of scheduler's lists (terminated_list)
+// nothing on its stack is queued anymore, threads only exit on their way back to userspace (see zap_other_threads)
+static void reap_thread(struct thread *th)
+{
+	kernel_stack_free(th->kernel_stack);
+	th->kernel_stack = 0;
+	reaper_stat.threads++;
+}
+
+// leader's structure is kept until its process is released, waiter still reads it through process
+static void reap_threads()
+{
+	while (true)
+	{
+		struct thread *th = NULL, *iter;
+
+		lock_scheduler();
+		plist_for_each_entry(iter, &terminated_list, sched_sibling)
+		{
+			if (iter != current_thread)
+			{
+				th = iter;
+				break;
+			}
+		}
+		if (th)
+			plist_del(&th->sched_sibling, &terminated_list);
+		unlock_scheduler();
+
+		if (!th)
+			break;
+
+		reap_thread(th);
+		if (th != th->parent->thread)
+			thread_free(th);
+	}
+}
+
+static void destroy_process(struct process *proc)
+{
+	log("Reaper: Destroy %s(p%d)", proc->name, proc->pid);
+	struct thread *leader = proc->thread;
+
+	// leader has been released before reaper got to its thread
+	if (leader->kernel_stack)
+	{
+		lock_scheduler();
+		plist_del(&leader->sched_sibling, &terminated_list);
+		unlock_scheduler();
+
+		reap_thread(leader);
+	}
+	thread_free(leader);
+
+	uint32_t frames = vmm_destroy_address_space(proc->pdir);
+	reaper_stat.frames += frames;
+	reaper_stat.reclaimed += frames * PMM_FRAME_SIZE;
+
+	kfree(proc->mm);
+	free_files(proc->files);
+	kfree(proc->fs);
+	kfree(proc->name);
+	kfree(proc);
+
+	reaper_stat.processes++;
+	reaper_stat.reclaimed += sizeof(struct process) + sizeof(struct mm_struct) + sizeof(struct files_struct) + sizeof(struct fs_struct);
+}
+
+static void reap()
+{
+	reaper_stat.batches++;
+
+	while (true)
+	{
+		// threads of a released process are always terminated before, they have to be reaped before process is gone
+		reap_threads();
+
+		struct process *proc = NULL;
+		lock_scheduler();
+		if (!list_empty(&release_list))
+		{
+			proc = list_first_entry(&release_list, struct process, sibling);
+			list_del(&proc->sibling);
+		}
+		unlock_scheduler();
+
+		if (!proc)
+			break;
+
+		destroy_process(proc);
+	}
+}
+
+static bool has_pending_work()
+{
+	return !plist_head_empty(&terminated_list) || !list_empty(&release_list);
+}
+
+static void reaper_loop()
+{
+	// explain in kernel_init#unlock_scheduler
+	unlock_scheduler();
+
+	while (true)
+	{
+		if (has_pending_work())
+			reap();
+
+		lock_scheduler();
+		if (!has_pending_work())
+			update_thread(reaper_thread, THREAD_WAITING);
+		unlock_scheduler();
+
+		schedule();
+	}
+}
+
+void reaper_wake()
+{
+	if (reaper_thread && reaper_thread->state == THREAD_WAITING)
+		update_thread(reaper_thread, THREAD_READY);
+}
+
+// nobody is going to wait for process anymore, it's unreachable by pid from now
+void release_process(struct process *proc)
+{
+	lock_scheduler();
+
+	detach_process_pids(proc);
+	list_add_tail(&proc->sibling, &release_list);
+	reaper_wake();
+
+	unlock_scheduler();
+}
+
+int reaper_stats_show(char *buf, size_t size)
+{
+	int len = snprintf(buf, size,
+					   "batches %u\n"
+					   "threads %u\n"
+					   "processes %u\n"
+					   "page_frames %u\n"
+					   "stacks_freed %u\n"
+					   "stack_cache %d\n"
+					   "stack_cache_hits %u\n"
+					   "reclaimed_kb %u\n",
+					   reaper_stat.batches, reaper_stat.threads, reaper_stat.processes, reaper_stat.frames,
+					   reaper_stat.stacks_freed, nr_cached_stacks, reaper_stat.stack_cache_hits,
+					   (uint32_t)(reaper_stat.reclaimed >> 10));
+
+	return len < size ? len : size;
+}
+
+void reaper_init()
+{
+	log("Reaper: Setup kreaper");
+	reaper_thread = create_system_process("kreaper", reaper_loop, 0)->thread;
+	// threads which have been terminated so far (e.g. swapper)
+	reaper_wake();
+}
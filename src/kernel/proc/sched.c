@@ -1,3 +1,4 @@
+#include <cpu/gdt.h>
 #include <cpu/hal.h>
 #include <cpu/idt.h>
 #include <cpu/pic.h>
@@ -8,6 +9,7 @@
 #include <memory/vmm.h>
 #include <system/time.h>
 #include <utils/debug.h>
+#include <utils/trace.h>
 
 #include "task.h"
 
@@ -120,7 +122,8 @@ static void remove_thread(struct thread *th)
 
 void update_thread(struct thread *th, uint8_t state)
 {
-	if (th->state == state)
+	// terminated thread is never brought back by a late wake up
+	if (th->state == state || th->state == THREAD_TERMINATED)
 		return;
 
 	lock_scheduler();
@@ -142,6 +145,7 @@ static void switch_thread(struct thread *nt)
 	}
 
 	struct thread *pt = current_thread;
+	trace(TRACE_SCHED_SWITCH, pt->tid, nt->tid, pt->state);
 
 	current_thread = nt;
 	current_thread->time_slice = 0;
@@ -150,6 +154,8 @@ static void switch_thread(struct thread *nt)
 
 	uint32_t paddr_cr3 = vmm_get_physical_address((uint32_t)current_thread->parent->pdir, true);
 	tss_set_stack(0x10, current_thread->kernel_stack);
+	// gs is reloaded (popped from user frame) before returning to userspace, new descriptor takes effect then
+	gdt_set_tls(current_thread->tls_base);
 	do_switch(&pt->esp, current_thread->esp, paddr_cr3);
 }
 
@@ -179,7 +185,8 @@ void schedule()
 	}
 	switch_thread(nt);
 
-	if (current_thread->pending && !(current_thread->flags & TIF_SIGNAL_MANUAL))
+	// fatal signal is left for the way back to userspace (signal_handler), blocked thread unwinds first
+	if (current_thread->pending && !(current_thread->flags & TIF_SIGNAL_MANUAL) && !fatal_signal_pending(current_thread))
 	{
 		struct interrupt_registers *regs = (struct interrupt_registers *)(current_thread->kernel_stack - sizeof(struct interrupt_registers));
 		handle_signal(regs, current_thread->blocked);
@@ -195,7 +202,6 @@ int32_t irq_schedule_handler(struct interrupt_registers *regs)
 
 	lock_scheduler();
 
-	bool is_schedulable = false;
 	current_thread->time_slice++;
 
 	if (current_thread->time_slice >= SLICE_THRESHOLD)
@@ -221,19 +227,13 @@ int32_t irq_schedule_handler(struct interrupt_registers *regs)
 				current_thread->sched_sibling.prio = last_thd->sched_sibling.prio + 1;
 			}
 			update_thread(current_thread, THREAD_READY);
-			is_schedulable = true;
+			// NOTE: MQ 2020-08-12 Switching happens in irq_exit, after timer softirq has run
+			current_thread->flags |= TIF_NEED_RESCHED;
 		}
 	}
 
 	unlock_scheduler();
 
-	// NOTE: MQ 2019-10-15 If counter is 1, it means that there is not running scheduler
-	if (is_schedulable && !scheduler_lock_counter)
-	{
-		log("Scheduler: Round-robin for %d", current_thread->tid);
-		schedule();
-	}
-
 	return IRQ_HANDLER_CONTINUE;
 }
 
@@ -243,6 +243,11 @@ int32_t thread_page_fault(struct interrupt_registers *regs)
 	__asm__ __volatile__("mov %%cr2, %0"
 						 : "=r"(faultAddr));
 
+	// not-present page in user's lazily filled area (elf's bss), both from user and kernel (copying into user buffer)
+	// err_code: bit 0 protection violation, bit 1 write access
+	if (!(regs->err_code & 0x1) && handle_mm_fault(faultAddr, regs->err_code & 0x2) == 0)
+		return IRQ_HANDLER_STOP;
+
 	if (regs->cs == 0x1B)
 	{
 		log("Page Fault: From userspace at 0x%x", faultAddr);
@@ -254,6 +259,8 @@ int32_t thread_page_fault(struct interrupt_registers *regs)
 		return IRQ_HANDLER_STOP;
 	}
 
+	if (is_vmalloc_addr((void *)faultAddr))
+		err("Page Fault: Kernel touches unmapped vmalloc page (guard page?) at 0x%x", faultAddr);
 	assert_not_reached();
 	return IRQ_HANDLER_CONTINUE;
 }
@@ -263,7 +270,7 @@ void wake_up(struct wait_queue_head *hq)
 	struct wait_queue_entry *iter, *next;
 	list_for_each_entry_safe(iter, next, &hq->list, sibling)
 	{
-		iter->func(iter->thread);
+		iter->func(iter);
 	}
 }
 
@@ -10,41 +10,45 @@
 #include <memory/pmm.h>
 #include <memory/vmm.h>
 #include <proc/elf.h>
+#include <proc/vdso.h>
 #include <system/sysapi.h>
 #include <system/time.h>
 #include <utils/debug.h>
-#include <utils/hashmap.h>
 #include <utils/string.h>
 
 extern void enter_usermode(uint32_t eip, uint32_t esp, uint32_t failed_address);
 extern void return_usermode(struct interrupt_registers *regs);
 
-static uint32_t next_pid = 0;
-static uint32_t next_tid = 0;
 volatile struct thread *current_thread = NULL;
 volatile struct process *current_process = NULL;
-volatile struct hashmap *mprocess = NULL;
 
-struct process *find_process_by_pid(pid_t pid)
+static struct files_struct *clone_file_descriptor_table(struct process *parent)
 {
-	return hashmap_get(mprocess, &pid);
+	return parent ? dup_files(parent->files) : alloc_files();
 }
 
-static struct files_struct *clone_file_descriptor_table(struct process *parent)
+// vma tree is copied with the same shape, colors and gaps, in-order walk rebuilds the sorted list
+static struct rb_node *clone_vma_tree(struct mm_struct *mm, struct rb_node *node, struct rb_node *parent)
 {
-	struct files_struct *files = kcalloc(1, sizeof(struct files_struct));
-
-	if (parent)
-	{
-		memcpy(files, parent->files, sizeof(struct files_struct));
-		// NOTE: MQ 2019-12-30 Increasing file description usage when forking because child refers to the same one
-		for (int i = 0; i < MAX_FD; ++i)
-			if (parent->files->fd[i])
-				atomic_inc(&parent->files->fd[i]->f_count);
-	}
-
-	sema_init(&files->lock, 1);
-	return files;
+	if (!node)
+		return NULL;
+
+	struct vm_area_struct *iter = rb_entry(node, struct vm_area_struct, vm_rb);
+	struct vm_area_struct *clone = kcalloc(1, sizeof(struct vm_area_struct));
+	clone->vm_start = iter->vm_start;
+	clone->vm_end = iter->vm_end;
+	clone->vm_file = iter->vm_file;
+	clone->vm_flags = iter->vm_flags;
+	clone->vm_mm = mm;
+	clone->rb_subtree_gap = iter->rb_subtree_gap;
+	clone->vm_rb.rb_parent = parent;
+	clone->vm_rb.rb_color = node->rb_color;
+
+	clone->vm_rb.rb_left = clone_vma_tree(mm, node->rb_left, &clone->vm_rb);
+	list_add_tail(&clone->vm_sibling, &mm->mmap);
+	clone->vm_rb.rb_right = clone_vma_tree(mm, node->rb_right, &clone->vm_rb);
+
+	return &clone->vm_rb;
 }
 
 static struct mm_struct *clone_mm_struct(struct process *parent)
@@ -52,18 +56,8 @@ static struct mm_struct *clone_mm_struct(struct process *parent)
 	struct mm_struct *mm = kcalloc(1, sizeof(struct mm_struct));
 	memcpy(mm, parent->mm, sizeof(struct mm_struct));
 	INIT_LIST_HEAD(&mm->mmap);
-
-	struct vm_area_struct *iter = NULL;
-	list_for_each_entry(iter, &parent->mm->mmap, vm_sibling)
-	{
-		struct vm_area_struct *clone = kcalloc(1, sizeof(struct vm_area_struct));
-		clone->vm_start = iter->vm_start;
-		clone->vm_end = iter->vm_end;
-		clone->vm_file = iter->vm_file;
-		clone->vm_flags = iter->vm_flags;
-		clone->vm_mm = mm;
-		list_add_tail(&clone->vm_sibling, &mm->mmap);
-	}
+	mm->mmap_cache = NULL;
+	mm->mm_rb.rb_node = clone_vma_tree(mm, parent->mm->mm_rb.rb_node, NULL);
 
 	return mm;
 }
@@ -83,8 +77,11 @@ static void thread_sleep_timer(struct timer_list *timer)
 
 void thread_sleep(uint32_t ms)
 {
+	// timer softirq can't wake us up before we are marked as waiting
+	lock_scheduler();
 	mod_timer(&current_thread->sleep_timer, get_milliseconds(NULL) + ms);
 	update_thread(current_thread, THREAD_WAITING);
+	unlock_scheduler();
 	schedule();
 }
 
@@ -99,9 +96,8 @@ struct thread *create_thread(struct process *parent, uint32_t eip, enum thread_s
 {
 	lock_scheduler();
 
-	struct thread *th = kcalloc(1, sizeof(struct thread));
-	th->tid = next_tid++;
-	th->kernel_stack = (uint32_t)(kcalloc(STACK_SIZE, sizeof(char)) + STACK_SIZE);
+	struct thread *th = thread_alloc();
+	th->kernel_stack = kernel_stack_alloc();
 	th->parent = parent;
 	th->state = state;
 	th->policy = policy;
@@ -127,6 +123,7 @@ struct thread *create_thread(struct process *parent, uint32_t eip, enum thread_s
 	frame->edi = 0;
 
 	parent->thread = th;
+	list_add_tail(&th->sibling, &parent->threads);
 
 	unlock_scheduler();
 
@@ -138,7 +135,8 @@ static struct process *create_process(struct process *parent, const char *name,
 	lock_scheduler();
 
 	struct process *proc = kcalloc(1, sizeof(struct process));
-	proc->pid = next_pid++;
+	int ret = attach_process_pids(proc, parent);
+	assert(!ret, "Task: No free pid for %s", name);
 	if (pdir)
 		proc->pdir = vmm_create_address_space(pdir);
 	else
@@ -150,6 +148,7 @@ static struct process *create_process(struct process *parent, const char *name,
 	proc->mm = kcalloc(1, sizeof(struct mm_struct));
 	proc->sig_alarm_timer = (struct timer_list)TIMER_INITIALIZER(process_sig_alarm_timer, UINT32_MAX);
 	INIT_LIST_HEAD(&proc->wait_chld.list);
+	INIT_LIST_HEAD(&proc->threads);
 	INIT_LIST_HEAD(&proc->mm->mmap);
 
 	for (int i = 0; i < NSIG; ++i)
@@ -157,16 +156,12 @@ static struct process *create_process(struct process *parent, const char *name,
 
 	if (parent)
 	{
-		proc->gid = parent->gid;
-		proc->sid = parent->sid;
 		memcpy(proc->fs, parent->fs, sizeof(struct fs_struct));
 		list_add_tail(&proc->sibling, &parent->children);
 	}
 
 	INIT_LIST_HEAD(&proc->children);
 
-	hashmap_put(mprocess, &proc->pid, proc);
-
 	unlock_scheduler();
 
 	return proc;
@@ -190,8 +185,7 @@ void task_init(void *func)
 {
 	log("Task: Initializing");
 
-	mprocess = kcalloc(1, sizeof(struct hashmap));
-	hashmap_init(mprocess, hashmap_hash_uint32, hashmap_compare_uint32, 0);
+	pid_init();
 	sched_init();
 
 	log("Task: Setup swapper process");
@@ -199,8 +193,7 @@ void task_init(void *func)
 
 	log("Task: Setup init process");
 	struct process *init = create_process(current_process, "init", current_process->pdir);
-	init->gid = init->pid;
-	init->sid = init->pid;
+	do_setsid(init);
 
 	struct thread *nt = create_thread(init, (uint32_t)func, THREAD_WAITING, THREAD_KERNEL_POLICY, 1);
 	update_thread(current_thread, THREAD_TERMINATED);
@@ -220,6 +213,8 @@ static void user_thread_entry(struct thread *th)
 	unlock_scheduler();
 
 	tss_set_stack(0x10, th->kernel_stack);
+	// proc page is copied from parent
+	vdso_update_proc();
 	log("Kernel: Return to usermode %s(p%d)", current_process->name, current_process->pid);
 	return_usermode(&th->uregs);
 }
@@ -245,12 +240,11 @@ struct thread *create_user_thread(struct process *parent, const char *path, enum
 {
 	lock_scheduler();
 
-	struct thread *th = kcalloc(1, sizeof(struct thread));
-	th->tid = next_tid++;
+	struct thread *th = thread_alloc();
 	th->parent = parent;
 	th->state = state;
 	th->policy = policy;
-	th->kernel_stack = (uint32_t)(kcalloc(STACK_SIZE, sizeof(char)) + STACK_SIZE);
+	th->kernel_stack = kernel_stack_alloc();
 	th->esp = th->kernel_stack - sizeof(struct trap_frame);
 	plist_node_init(&th->sched_sibling, priority);
 	th->sleep_timer = (struct timer_list)TIMER_INITIALIZER(thread_sleep_timer, UINT32_MAX);
@@ -274,6 +268,7 @@ struct thread *create_user_thread(struct process *parent, const char *path, enum
 	frame->edi = 0;
 
 	parent->thread = th;
+	list_add_tail(&th->sibling, &parent->threads);
 
 	unlock_scheduler();
 
@@ -302,6 +297,44 @@ void process_load(const char *pname, const char *path, enum thread_policy policy
 	queue_thread(th);
 }
 
+// copied thread returns to the same user context as `parent_thread` except eax=0 (child's fork/clone result)
+static struct thread *clone_user_thread(struct process *proc, struct thread *parent_thread)
+{
+	struct thread *th = thread_alloc();
+	th->state = THREAD_READY;
+	th->policy = THREAD_APP_POLICY;
+	th->time_slice = 0;
+	th->parent = proc;
+	th->kernel_stack = kernel_stack_alloc();
+	th->tls_base = parent_thread->tls_base;
+	th->blocked = parent_thread->blocked;
+	// NOTE: MQ 2019-12-18 Setup trap frame
+	th->esp = th->kernel_stack - sizeof(struct trap_frame);
+	plist_node_init(&th->sched_sibling, parent_thread->sched_sibling.prio);
+	th->sleep_timer = (struct timer_list)TIMER_INITIALIZER(thread_sleep_timer, UINT32_MAX);
+
+	memcpy(&th->uregs, task_user_regs(parent_thread), sizeof(struct interrupt_registers));
+	th->uregs.eax = 0;
+
+	struct trap_frame *frame = (struct trap_frame *)th->esp;
+	frame->parameter1 = (uint32_t)th;
+	frame->return_address = PROCESS_TRAPPED_PAGE_FAULT;
+	frame->eip = (uint32_t)user_thread_entry;
+
+	frame->eax = 0;
+	frame->ecx = 0;
+	frame->edx = 0;
+	frame->ebx = 0;
+	frame->esp = 0;
+	frame->ebp = 0;
+	frame->esi = 0;
+	frame->edi = 0;
+
+	list_add_tail(&th->sibling, &proc->threads);
+
+	return th;
+}
+
 struct process *process_fork(struct process *parent)
 {
 	log("Task: Fork from %s(p%d)", parent->name, parent->pid);
@@ -309,13 +342,17 @@ struct process *process_fork(struct process *parent)
 
 	// fork process
 	struct process *proc = kcalloc(1, sizeof(struct process));
-	proc->pid = next_pid++;
-	proc->gid = parent->gid;
-	proc->sid = parent->sid;
+	if (attach_process_pids(proc, parent) < 0)
+	{
+		unlock_scheduler();
+		kfree(proc);
+		return NULL;
+	}
 	proc->parent = parent;
 	proc->tty = parent->tty;
 	proc->name = strdup(parent->name);
 	INIT_LIST_HEAD(&proc->wait_chld.list);
+	INIT_LIST_HEAD(&proc->threads);
 	proc->mm = clone_mm_struct(parent);
 	memcpy(&proc->sighand, &parent->sighand, sizeof(parent->sighand));
 	proc->sig_alarm_timer = (struct timer_list)TIMER_INITIALIZER(process_sig_alarm_timer, UINT32_MAX);
@@ -330,48 +367,43 @@ struct process *process_fork(struct process *parent)
 	proc->files = clone_file_descriptor_table(parent);
 	proc->pdir = vmm_fork(parent->pdir);
 
-	// copy active parent's thread
-	struct thread *parent_thread = parent->thread;
-	struct thread *th = kcalloc(1, sizeof(struct thread));
-	th->tid = next_tid++;
-	th->state = THREAD_READY;
-	th->policy = THREAD_APP_POLICY;
-	th->time_slice = 0;
-	th->parent = proc;
-	th->kernel_stack = (uint32_t)(kcalloc(STACK_SIZE, sizeof(char)) + STACK_SIZE);
-	th->user_stack = parent_thread->user_stack;
-	// NOTE: MQ 2019-12-18 Setup trap frame
-	th->esp = th->kernel_stack - sizeof(struct trap_frame);
-	plist_node_init(&th->sched_sibling, parent_thread->sched_sibling.prio);
+	// only the calling thread is copied, it becomes child's leader
+	struct thread *th = clone_user_thread(proc, current_thread);
+	th->user_stack = current_thread->user_stack;
 
-	memcpy(&th->uregs, &parent_thread->uregs, sizeof(struct interrupt_registers));
-	th->uregs.eax = 0;
+	proc->thread = th;
 
-	struct trap_frame *frame = (struct trap_frame *)th->esp;
-	frame->parameter1 = (uint32_t)th;
-	frame->return_address = PROCESS_TRAPPED_PAGE_FAULT;
-	frame->eip = (uint32_t)user_thread_entry;
+	unlock_scheduler();
 
-	frame->eax = 0;
-	frame->ecx = 0;
-	frame->edx = 0;
-	frame->ebx = 0;
-	frame->esp = 0;
-	frame->ebp = 0;
-	frame->esi = 0;
-	frame->edi = 0;
+	return proc;
+}
 
-	proc->thread = th;
-	hashmap_put(mprocess, &proc->pid, proc);
+// new thread shares everything of `proc` and starts on `stack` (the same user stack if it's zero)
+struct thread *process_clone_thread(struct process *proc, uint32_t stack)
+{
+	log("Task: Clone thread of %s(p%d)", proc->name, proc->pid);
+	lock_scheduler();
+
+	struct thread *th = clone_user_thread(proc, current_thread);
+	th->policy = current_thread->policy;
+	if (stack)
+		th->uregs.useresp = stack;
+	// process is being taken down, the new thread goes with it
+	if (proc->flags & SIGNAL_GROUP_EXIT)
+		sigaddset(&th->pending, SIGKILL);
 
 	unlock_scheduler();
 
-	return proc;
+	return th;
 }
 
 int32_t process_execve(const char *path, char *const argv[], char *const envp[])
 {
 	log("Task: Exec %s", path);
+	// new image starts with only the calling thread
+	if (!zap_other_threads(current_process))
+		return -EINTR;
+
 	int argv_length = count_array_of_pointers(argv);
 	char **kernel_argv = kcalloc(argv_length, sizeof(char *));
 	for (int i = 0; i < argv_length; ++i)
@@ -392,10 +424,15 @@ int32_t process_execve(const char *path, char *const argv[], char *const envp[])
 	kfree(current_process->name);
 	current_process->name = strdup(path);
 
+	current_thread->tls_base = 0;
+	current_thread->clear_child_tid = NULL;
+
 	char *tmp_path = strdup(path);
 	elf_unload();
 	struct Elf32_Layout *elf_layout = elf_load(tmp_path);
 	kfree(tmp_path);
+	// descriptors which are marked by O_CLOEXEC/FD_CLOEXEC don't survive into new image
+	do_close_on_exec(current_process->files);
 
 	// copy argv back to userspace
 	char **user_argv = (char **)sys_sbrk(argv_length + 1);
@@ -4,18 +4,20 @@
 #include <cpu/idt.h>
 #include <include/list.h>
 #include <ipc/signal.h>
-#include <locking/semaphore.h>
+#include <locking/mutex.h>
 #include <memory/vmm.h>
 #include <proc/elf.h>
+#include <proc/pid.h>
 #include <stdint.h>
 #include <system/timer.h>
-#include <utils/hashmap.h>
 #include <utils/plist.h>
+#include <utils/rbtree.h>
 
 #define SWAPPER_PID 0
 #define INIT_PID 1
 
-#define MAX_FD 256
+#define NR_OPEN_DEFAULT 32
+#define NR_OPEN_MAX 16384
 #define PROCESS_TRAPPED_PAGE_FAULT 0xFFFFFFFF
 #define MAX_THREADS 0x10000
 #define STACK_SIZE 0x2000
@@ -31,6 +33,8 @@
 #define SIGNAL_CONTINUED 0x02
 #define SIGNAL_TERMINATED 0x04
 #define EXIT_TERMINATED 0x08
+// one thread is killing the others (exit_group, execve), see zap_other_threads
+#define SIGNAL_GROUP_EXIT 0x10
 
 struct vfs_file;
 struct vfs_dentry;
@@ -53,10 +57,19 @@ enum thread_policy
 	THREAD_APP_POLICY,
 } thread_policy;
 
+// fd, open_fds and close_on_exec grow together (doubled) up to NR_OPEN_MAX, small tables use embedded arrays
 struct files_struct
 {
-	struct semaphore lock;
-	struct vfs_file *fd[MAX_FD];
+	struct mutex lock;
+	uint32_t max_fds;
+	// no free fd below it
+	uint32_t next_fd;
+	struct vfs_file **fd;
+	uint32_t *open_fds;
+	uint32_t *close_on_exec;
+	struct vfs_file *fd_array[NR_OPEN_DEFAULT];
+	uint32_t open_fds_init[NR_OPEN_DEFAULT / 32];
+	uint32_t close_on_exec_init[NR_OPEN_DEFAULT / 32];
 };
 
 struct fs_struct
@@ -80,13 +93,21 @@ struct vm_area_struct
 	uint32_t vm_end;
 	uint32_t vm_flags;
 
+	// NOTE: MQ 2020-08-17
+	// areas are kept both in address order list (iteration) and rbtree (lookup)
+	// rb_subtree_gap is the largest free gap below an area's start (vm_start - previous area's vm_end) in its subtree
 	struct list_head vm_sibling;
+	struct rb_node vm_rb;
+	uint32_t rb_subtree_gap;
 	struct vfs_file *vm_file;
 };
 
 struct mm_struct
 {
 	struct list_head mmap;
+	struct rb_root mm_rb;
+	struct vm_area_struct *mmap_cache;
+	uint32_t map_count;
 	uint32_t free_area_cache;
 	uint32_t start_code, end_code, start_data, end_data;
 	// NOTE: MQ 2020-01-30
@@ -96,6 +117,7 @@ struct mm_struct
 };
 
 #define TIF_SIGNAL_MANUAL 0x1
+#define TIF_NEED_RESCHED 0x2
 
 struct thread
 {
@@ -119,6 +141,17 @@ struct thread
 
 	struct plist_node sched_sibling;
 	struct timer_list sleep_timer;
+
+	// NOTE: MQ 2020-08-19
+	// threads of a process share its mm, files and signal handlers, each one has own kernel stack, user registers and tls
+	// tls_base is loaded into GDT_TLS_ENTRY when thread is switched in, user space reaches it via gs
+	struct list_head sibling;
+	uint32_t tls_base;
+	// cleared and woken (futex) when thread exits, pthread_join waits on it
+	uint32_t *clear_child_tid;
+	// user address of futex which thread is waiting on (0 if not waiting), sibling is in futex's hash bucket
+	uint32_t futex_key;
+	struct list_head futex_sibling;
 };
 
 struct process
@@ -126,10 +159,18 @@ struct process
 	pid_t pid;
 	gid_t gid;
 	sid_t sid;
+	// numbers above are kept in sync with pids, see pid.c
+	struct pid *pids[PIDTYPE_MAX];
+	struct list_head pid_sibling[PIDTYPE_MAX];
+	struct list_head process_sibling;
 
 	char *name;
 	struct process *parent;
+	// group leader, signals are delivered to it
 	struct thread *thread;
+	struct list_head threads;
+	// thread which waits in zap_other_threads, exiting threads wake it up
+	struct thread *group_exit_thread;
 	struct pdirectory *pdir;
 
 	struct fs_struct *fs;
@@ -148,22 +189,20 @@ struct process
 	struct timer_list sig_alarm_timer;
 };
 
+// NOTE: MQ 2020-08-11 Frame pushed when entering kernel from userspace (int 0x7F, sysenter or irq) is always on top of kernel stack
+#define task_user_regs(th) ((struct interrupt_registers *)((th)->kernel_stack - sizeof(struct interrupt_registers)))
+
 extern volatile struct thread *current_thread;
 extern volatile struct process *current_process;
-extern volatile struct hashmap *mprocess;
-
-#define for_each_process(p)         \
-	struct hashmap_iter *__hm_iter; \
-	for (__hm_iter = hashmap_iter(mprocess), p = hashmap_iter_get_data(__hm_iter); __hm_iter; __hm_iter = hashmap_iter_next(mprocess, __hm_iter), p = hashmap_iter_get_data(__hm_iter))
 
 // task.c
 void task_init();
 struct process *create_system_process(const char *pname, void *func, int32_t priority);
 void process_load(const char *pname, const char *path, enum thread_policy policy, int priority, void (*setup)(struct Elf32_Layout *));
 struct process *process_fork(struct process *parent);
+struct thread *process_clone_thread(struct process *proc, uint32_t stack);
 int32_t process_execve(const char *pathname, char *const argv[], char *const envp[]);
 void thread_sleep(uint32_t ms);
-struct process *find_process_by_pid(pid_t pid);
 void setup_user_thread_stack(struct Elf32_Layout *layout, int argc, char *const argv[], char *const envp[]);
 
 // sched.c
@@ -181,5 +220,15 @@ int32_t irq_schedule_handler(struct interrupt_registers *regs);
 // exit.c
 int32_t do_wait(idtype_t idtype, id_t id, struct infop *infop, int options);
 void do_exit(int32_t code);
+void do_exit_thread(int32_t code);
+bool zap_other_threads(struct process *proc);
+
+// reaper.c
+void reaper_init();
+void reaper_wake();
+void release_process(struct process *proc);
+struct thread *thread_alloc();
+uint32_t kernel_stack_alloc();
+int reaper_stats_show(char *buf, size_t size);
 
 #endif
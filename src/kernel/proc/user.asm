@@ -40,6 +40,9 @@ return_usermode:
 
 	mov eax, [esp + 4]
 
+	mov bx, [eax] ;thread's gs (user data or tls segment)
+	mov gs, bx
+
 	push dword [eax + 18*4] ;user data segment
 	push dword [eax + 17*4] ;push our current stack
 	push dword [eax + 16*4]	;EFLAGS
@@ -0,0 +1,155 @@
+; NOTE: MQ 2020-08-11
+; vDSO text page, kernel copies it into a page which is mapped at VDSO_TEXT in every process
+; code only uses relative jumps and absolute vdso addresses -> it doesn't matter where the blob is linked
+; keep these in sync with proc/vdso.h, system/time.h and system/sysapi.c
+
+%define VDSO_TEXT 0xBFFFD000
+%define VDSO_DATA 0xBFFFE000
+%define VDSO_PROC 0xBFFFF000
+%define VDSO_MAGIC 0x4F53444D
+%define VDSO_ADDR(label) (VDSO_TEXT + (label - vdso_text_start))
+
+; struct vdso_header
+%define VH_SYSCALL 4
+
+; struct vdso_data
+%define VD_SEQ 0
+%define VD_REALTIME 4
+%define VD_MONOTONIC 12
+
+%define CLOCK_REALTIME 0
+%define CLOCK_MONOTONIC 1
+%define CLOCK_PROCESS_CPUTIME_ID 2
+%define EFAULT 14
+%define __NR_clock_gettime 265
+
+[global vdso_text_start]
+[global vdso_text_end]
+[global vdso_int_syscall]
+[global vdso_sysenter_return]
+
+section .rodata
+
+vdso_text_start:
+    ; struct vdso_header
+    dd VDSO_MAGIC
+    dd VDSO_ADDR(sysenter_syscall)
+    dd VDSO_ADDR(clock_gettime)
+    dd VDSO_ADDR(gettimeofday)
+    dd VDSO_ADDR(time)
+    dd VDSO_ADDR(getpid)
+
+; eax = syscall number, ebx/ecx/edx/esi/edi = arguments like `int 0x7F`
+; header's syscall is replaced by vdso_int_syscall if cpu doesn't support sysenter
+sysenter_syscall:
+    push ecx
+    push edx
+    push ebp
+    mov ebp, esp
+    sysenter
+sysenter_return:
+    pop ebp
+    pop edx
+    pop ecx
+    ret
+
+vdso_int_syscall:
+    int 0x7F
+    ret
+
+; time is updated each pit tick, seq is odd while kernel is writing
+; int clock_gettime(clockid_t clk_id, struct timespec *tp)
+clock_gettime:
+    cmp dword [esp + 8], 0
+    je .efault
+    mov eax, [esp + 4]
+    mov ecx, VDSO_DATA + VD_REALTIME
+    cmp eax, CLOCK_REALTIME
+    je .read
+    ; kernel reports wall time for process clock (see sys_clock_gettime)
+    cmp eax, CLOCK_PROCESS_CPUTIME_ID
+    je .read
+    mov ecx, VDSO_DATA + VD_MONOTONIC
+    cmp eax, CLOCK_MONOTONIC
+    je .read
+
+    push ebx
+    mov ebx, eax
+    mov ecx, [esp + 12]
+    mov eax, __NR_clock_gettime
+    call [VDSO_TEXT + VH_SYSCALL]
+    pop ebx
+    ret
+.read:
+    push esi
+.retry:
+    mov esi, [VDSO_DATA + VD_SEQ]
+    test esi, 1
+    jnz .wait
+    mov eax, [ecx]
+    mov edx, [ecx + 4]
+    cmp esi, [VDSO_DATA + VD_SEQ]
+    jne .retry
+    mov ecx, [esp + 12]
+    mov [ecx], eax
+    mov [ecx + 4], edx
+    pop esi
+    xor eax, eax
+    ret
+.wait:
+    pause
+    jmp .retry
+.efault:
+    mov eax, -EFAULT
+    ret
+
+; int gettimeofday(struct timeval *tv, void *tz)
+gettimeofday:
+    push esi
+.retry:
+    mov esi, [VDSO_DATA + VD_SEQ]
+    test esi, 1
+    jnz .wait
+    mov ecx, [VDSO_DATA + VD_REALTIME]
+    mov eax, [VDSO_DATA + VD_REALTIME + 4]
+    cmp esi, [VDSO_DATA + VD_SEQ]
+    jne .retry
+    pop esi
+    mov edx, [esp + 4]
+    test edx, edx
+    jz .done
+    mov [edx], ecx
+    mov ecx, 1000
+    xor edx, edx
+    div ecx
+    mov edx, [esp + 4]
+    mov [edx + 4], eax
+.done:
+    xor eax, eax
+    ret
+.wait:
+    pause
+    jmp .retry
+
+; time_t time(time_t *tloc)
+time:
+    mov eax, [VDSO_DATA + VD_REALTIME]
+    mov ecx, [esp + 4]
+    test ecx, ecx
+    jz .done
+    mov [ecx], eax
+.done:
+    ret
+
+; pid_t getpid()
+getpid:
+    mov eax, [VDSO_PROC]
+    ret
+
+vdso_text_end:
+
+section .data
+
+; user address where sysexit returns to
+vdso_sysenter_return:
+    dd VDSO_ADDR(sysenter_return)
@@ -0,0 +1,87 @@
+#include "vdso.h"
+
+#include <cpu/sysenter.h>
+#include <locking/spinlock.h>
+#include <memory/pmm.h>
+#include <memory/vmm.h>
+#include <proc/task.h>
+#include <system/time.h>
+#include <utils/debug.h>
+#include <utils/string.h>
+
+extern volatile uint64_t jiffies;
+extern char vdso_text_start[], vdso_text_end[], vdso_int_syscall[];
+
+static struct vdso_data *vdso_data;
+static uint32_t text_paddr, data_paddr;
+
+void vdso_init()
+{
+	log("vDSO: Initializing");
+
+	uint32_t text_size = vdso_text_end - vdso_text_start;
+	assert(text_size <= PMM_FRAME_SIZE, "vDSO: text is larger than a page");
+
+	// NOTE: MQ 2020-08-11 Both pages are mapped into userspace -> they have to be aligned by 4096
+	char *pages = vmalloc(2 * PMM_FRAME_SIZE);
+
+	memcpy(pages, vdso_text_start, text_size);
+	if (!sysenter_enabled())
+		((struct vdso_header *)pages)->syscall = VDSO_TEXT + (vdso_int_syscall - vdso_text_start);
+
+	text_paddr = vmm_get_physical_address((uint32_t)pages, false);
+	data_paddr = vmm_get_physical_address((uint32_t)pages + PMM_FRAME_SIZE, false);
+	vdso_data = (struct vdso_data *)(pages + PMM_FRAME_SIZE);
+	vdso_update_time();
+
+	log("vDSO: Done");
+}
+
+// called from pit irq
+void vdso_update_time()
+{
+	if (!vdso_data)
+		return;
+
+	uint64_t realtime = get_milliseconds_since_epoch();
+	uint64_t monotonic = jiffies;
+
+	vdso_data->seq++;
+	barrier();
+	vdso_data->realtime_sec = realtime / 1000;
+	vdso_data->realtime_nsec = (realtime % 1000) * 1000000;
+	vdso_data->monotonic_sec = monotonic / 1000;
+	vdso_data->monotonic_nsec = (monotonic % 1000) * 1000000;
+	barrier();
+	vdso_data->seq++;
+}
+
+// map vdso into current process, text and data are shared and proc page is its own
+void vdso_map()
+{
+	struct mm_struct *mm = current_process->mm;
+	struct vm_area_struct *vma = kcalloc(1, sizeof(struct vm_area_struct));
+	vma->vm_start = VDSO_BASE;
+	vma->vm_end = VDSO_END;
+	// the highest user area, linked without touching free_area_cache
+	vma_link(mm, vma);
+
+	vmm_map_address(current_process->pdir, VDSO_TEXT, text_paddr, I86_PTE_PRESENT | I86_PTE_USER);
+	vmm_map_address(current_process->pdir, VDSO_DATA, data_paddr, I86_PTE_PRESENT | I86_PTE_USER);
+	vmm_map_address(current_process->pdir, VDSO_PROC, (uint32_t)pmm_alloc_block(), I86_PTE_PRESENT | I86_PTE_USER | I86_PTE_PRIVATE);
+
+	memset((char *)VDSO_PROC, 0, PMM_FRAME_SIZE);
+	vdso_update_proc();
+}
+
+// proc page is read-only for userspace, kernel writes it directly (cr0.WP is not set)
+void vdso_update_proc()
+{
+	struct vdso_proc *proc = (struct vdso_proc *)VDSO_PROC;
+	proc->pid = current_process->pid;
+}
+
+bool vdso_is_shared_page(uint32_t vaddr)
+{
+	return vaddr == VDSO_TEXT || vaddr == VDSO_DATA;
+}
@@ -0,0 +1,54 @@
+#ifndef PROC_VDSO_H
+#define PROC_VDSO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// NOTE: MQ 2020-08-11
+// vDSO is mapped right below kernel space in every process (same addresses in proc/vdso.asm and libc/sys/vdso.h)
+// +-------------+ VDSO_END (0xC0000000)
+// | proc page   | per process (pid), copied on fork
+// +-------------+ VDSO_PROC
+// | data page   | shared, kernel updates time each pit tick
+// +-------------+ VDSO_DATA
+// | text page   | shared, syscall stubs and time functions from proc/vdso.asm
+// +-------------+ VDSO_BASE
+#define VDSO_BASE 0xBFFFD000
+#define VDSO_TEXT VDSO_BASE
+#define VDSO_DATA (VDSO_BASE + 0x1000)
+#define VDSO_PROC (VDSO_BASE + 0x2000)
+#define VDSO_END (VDSO_BASE + 0x3000)
+
+#define VDSO_MAGIC 0x4F53444D
+
+// at the beginning of text page, entries are user addresses
+struct vdso_header
+{
+	uint32_t magic;
+	uint32_t syscall;  // sysenter stub or int 0x7F stub if cpu doesn't support it
+	uint32_t clock_gettime;
+	uint32_t gettimeofday;
+	uint32_t time;
+	uint32_t getpid;
+};
+
+// seq is odd while kernel is updating, readers retry until they see the same even seq
+struct vdso_data
+{
+	volatile uint32_t seq;
+	volatile int32_t realtime_sec, realtime_nsec;
+	volatile int32_t monotonic_sec, monotonic_nsec;
+};
+
+struct vdso_proc
+{
+	int32_t pid;
+};
+
+void vdso_init();
+void vdso_update_time();
+void vdso_map();
+void vdso_update_proc();
+bool vdso_is_shared_page(uint32_t vaddr);
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef PROC_WAIT_H
 #define PROC_WAIT_H
 
+#include <include/errno.h>
 #include <include/list.h>
 #include <include/types.h>
 #include <stdint.h>
@@ -38,8 +39,10 @@ struct infop
 };
 
 struct thread;
+struct wait_queue_entry;
 
-typedef void (*wait_queue_func)(struct thread *);
+// NOTE: MQ 2020-08-08 entry is passed so a waiter can find its container (e.g. epoll item)
+typedef void (*wait_queue_func)(struct wait_queue_entry *);
 
 struct wait_queue_head
 {
@@ -55,6 +58,7 @@ struct wait_queue_entry
 
 extern volatile struct thread *current_thread;
 extern void schedule();
+extern bool fatal_signal_pending(struct thread *th);
 
 #define DEFINE_WAIT(name)            \
 	struct wait_queue_entry name = { \
@@ -63,38 +67,61 @@ extern void schedule();
 	}
 
 // NOTE: MQ 2020-08-17 continue if receiving a signal
+// except a fatal one, waiting is given up with -EINTR (0 when cond is met) so the thread can unwind and exit
 #define wait_until(cond) ({                            \
+	int __ret = 0;                                     \
 	for (; !(cond);)                                   \
 	{                                                  \
+		if (fatal_signal_pending(current_thread))      \
+		{                                              \
+			__ret = -EINTR;                            \
+			break;                                     \
+		}                                              \
 		update_thread(current_thread, THREAD_WAITING); \
 		schedule();                                    \
 	}                                                  \
+	__ret;                                             \
 })
 
 #define wait_until_with_prework(cond, prework) ({      \
+	int __ret = 0;                                     \
 	for (; !(cond);)                                   \
 	{                                                  \
+		if (fatal_signal_pending(current_thread))      \
+		{                                              \
+			__ret = -EINTR;                            \
+			break;                                     \
+		}                                              \
 		prework;                                       \
 		update_thread(current_thread, THREAD_WAITING); \
 		schedule();                                    \
 	}                                                  \
+	__ret;                                             \
 })
 
 #define wait_until_with_setup(cond, prework, afterwork) ({ \
+	int __ret = 0;                                         \
 	for (; !(cond);)                                       \
 	{                                                      \
+		if (fatal_signal_pending(current_thread))          \
+		{                                                  \
+			__ret = -EINTR;                                \
+			break;                                         \
+		}                                                  \
 		prework;                                           \
 		update_thread(current_thread, THREAD_WAITING);     \
 		schedule();                                        \
 		afterwork;                                         \
 	}                                                      \
+	__ret;                                                 \
 })
 
 #define wait_event(wh, cond) ({                  \
 	DEFINE_WAIT(__wait);                         \
 	list_add_tail(&__wait.sibling, &(wh)->list); \
-	wait_until(cond);                            \
+	int __wret = wait_until(cond);               \
 	list_del(&__wait.sibling);                   \
+	__wret;                                      \
 })
 
 #endif
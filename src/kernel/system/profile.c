@@ -0,0 +1,136 @@
+#include "profile.h"
+
+#include <cpu/hal.h>
+#include <include/errno.h>
+#include <memory/vmm.h>
+#include <proc/task.h>
+#include <utils/string.h>
+#include <utils/vsprintf.h>
+
+#define PIT_TICKS_PER_SECOND 1000
+
+// NOTE: MQ 2020-08-14
+// Sampling profiler, pit calls profile_tick every millisecond and we take a sample every `profile_interval` ticks
+// a sample is eip plus return addresses found by walking saved frame pointers (kernel/libc are built with them)
+// when a user thread is interrupted in kernel, its user stack is appended after kernel frames
+// kernel is uniprocessor so there is one sample ring, readers have their own cursor like /dev/trace
+static struct profile_sample profile_ring[PROFILE_RING_SIZE];
+static volatile uint32_t profile_head;
+static volatile uint32_t profile_interval;
+
+static bool profile_frame_valid(uint32_t ebp, uint32_t low, uint32_t high, bool user)
+{
+	if (ebp & 3 || ebp < low || ebp + 8 > high)
+		return false;
+
+	// user page might be swapped out or not even mapped, reading it must not fault in irq
+	return !user || (vmm_is_mapped(ebp) && vmm_is_mapped(ebp + 4));
+}
+
+static int profile_walk(uint32_t *ips, int depth, uint32_t eip, uint32_t ebp, uint32_t low, uint32_t high, bool user)
+{
+	if (depth >= PROFILE_MAX_DEPTH)
+		return depth;
+
+	ips[depth++] = eip;
+	while (depth < PROFILE_MAX_DEPTH && profile_frame_valid(ebp, low, high, user))
+	{
+		uint32_t *frame = (uint32_t *)ebp;
+		if (!frame[1])
+			break;
+
+		ips[depth++] = frame[1];
+		// stack grows down, caller's frame always sits above
+		if (frame[0] <= ebp)
+			break;
+		ebp = frame[0];
+	}
+	return depth;
+}
+
+void profile_tick(struct interrupt_registers *regs, uint64_t ticks)
+{
+	if (!profile_interval || ticks % profile_interval || !current_thread)
+		return;
+
+	uint32_t slot = profile_head;
+	struct profile_sample *sample = &profile_ring[slot & (PROFILE_RING_SIZE - 1)];
+	struct thread *th = current_thread;
+
+	sample->seq = 0;
+	sample->pid = th->parent->pid;
+	sample->tid = th->tid;
+	sample->user = regs->cs == 0x1B;
+	strncpy(sample->comm, th->parent->name, PROFILE_COMM_LEN - 1);
+	sample->comm[PROFILE_COMM_LEN - 1] = 0;
+
+	int depth = 0;
+	if (!sample->user)
+	{
+		depth = profile_walk(sample->ips, depth, regs->eip, regs->ebp, th->kernel_stack - STACK_SIZE, th->kernel_stack, false);
+
+		struct interrupt_registers *uregs = task_user_regs(th);
+		if (th->policy != THREAD_KERNEL_POLICY && uregs->cs == 0x1B && uregs != regs)
+			regs = uregs;
+		else
+			regs = NULL;
+	}
+	if (regs)
+		depth = profile_walk(sample->ips, depth, regs->eip, regs->ebp, PMM_FRAME_SIZE, KERNEL_HIGHER_HALF, true);
+
+	sample->depth = depth;
+	sample->seq = slot + 1;
+	profile_head = slot + 1;
+}
+
+int profile_set_frequency(uint32_t hz)
+{
+	if (hz > PIT_TICKS_PER_SECOND)
+		return -EINVAL;
+
+	profile_interval = hz ? PIT_TICKS_PER_SECOND / hz : 0;
+	return 0;
+}
+
+uint32_t profile_first_cursor()
+{
+	return profile_head > PROFILE_RING_SIZE ? profile_head - PROFILE_RING_SIZE : 0;
+}
+
+// one sample per line: comm pid/tid mode ip...
+int profile_format(uint32_t *cursor, char *buf, size_t size)
+{
+	int len = 0;
+
+	while (*cursor != profile_head)
+	{
+		if (profile_head - *cursor > PROFILE_RING_SIZE)
+			*cursor = profile_head - PROFILE_RING_SIZE;
+
+		struct profile_sample sample;
+		uint32_t flags = irq_save();
+		memcpy(&sample, &profile_ring[*cursor & (PROFILE_RING_SIZE - 1)], sizeof(struct profile_sample));
+		irq_restore(flags);
+
+		if (sample.seq != *cursor + 1)
+		{
+			(*cursor)++;
+			continue;
+		}
+
+		char line[PROFILE_COMM_LEN + 32 + PROFILE_MAX_DEPTH * 11];
+		int n = scnprintf(line, sizeof(line), "%s %d/%d %s", sample.comm, sample.pid, sample.tid, sample.user ? "user" : "kernel");
+		for (int i = 0; i < sample.depth; ++i)
+			n += scnprintf(line + n, sizeof(line) - n, " %x", sample.ips[i]);
+		n += scnprintf(line + n, sizeof(line) - n, "\n");
+
+		if (len + n > size)
+			break;
+
+		memcpy(buf + len, line, n);
+		len += n;
+		(*cursor)++;
+	}
+
+	return len;
+}
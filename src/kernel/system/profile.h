@@ -0,0 +1,29 @@
+#ifndef SYSTEM_PROFILE_H
+#define SYSTEM_PROFILE_H
+
+#include <cpu/idt.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PROFILE_RING_SIZE 1024	// must be power of two
+#define PROFILE_MAX_DEPTH 24
+#define PROFILE_COMM_LEN 16
+
+struct profile_sample
+{
+	uint32_t seq;
+	int32_t pid;
+	int32_t tid;
+	bool user;	// interrupted in user mode
+	uint8_t depth;
+	char comm[PROFILE_COMM_LEN];
+	uint32_t ips[PROFILE_MAX_DEPTH];  // leaf first
+};
+
+void profile_tick(struct interrupt_registers *regs, uint64_t ticks);
+int profile_set_frequency(uint32_t hz);
+uint32_t profile_first_cursor();
+int profile_format(uint32_t *cursor, char *buf, size_t size);
+
+#endif
@@ -1,7 +1,9 @@
 #include "sysapi.h"
 
+#include <cpu/gdt.h>
 #include <cpu/hal.h>
 #include <devices/char/tty.h>
+#include <fs/eventpoll.h>
 #include <fs/pipefs/pipe.h>
 #include <fs/sockfs/sockfs.h>
 #include <fs/vfs.h>
@@ -9,15 +11,18 @@
 #include <include/fcntl.h>
 #include <include/limits.h>
 #include <include/mman.h>
+#include <include/sched.h>
 #include <include/utsname.h>
 #include <ipc/message_queue.h>
 #include <ipc/signal.h>
+#include <locking/futex.h>
 #include <net/net.h>
 #include <proc/elf.h>
 #include <proc/task.h>
 #include <system/time.h>
 #include <utils/debug.h>
 #include <utils/string.h>
+#include <utils/trace.h>
 
 extern volatile uint64_t jiffies;
 
@@ -27,7 +32,7 @@ static int interpret_path_from_fd(int dirfd, const char *path, char **interprete
 		*interpreted_path = path;
 	else
 	{
-		struct vfs_file *df = current_process->files->fd[dirfd];
+		struct vfs_file *df = fcheck(dirfd);
 		if (!df)
 			return -EBADF;
 		if (!(df->f_dentry->d_inode->i_mode & S_IFDIR))
@@ -42,6 +47,11 @@ static int interpret_path_from_fd(int dirfd, const char *path, char **interprete
 }
 
 static void sys_exit(int32_t code)
+{
+	do_exit_thread(code & 0xff);
+}
+
+static void sys_exit_group(int32_t code)
 {
 	do_exit(code & 0xff);
 }
@@ -49,11 +59,72 @@ static void sys_exit(int32_t code)
 pid_t sys_fork()
 {
 	struct process *child = process_fork(current_process);
+	if (!child)
+		return -EAGAIN;
 	queue_thread(child->thread);
 
 	return child->pid;
 }
 
+// NOTE: MQ 2020-08-19
+// clone either creates a thread (CLONE_VM | CLONE_SIGHAND | CLONE_THREAD, files and fs are always shared within process)
+// or forks a process which can start on other stack, sharing address space between processes is not supported
+// tls is base address of thread's tls block (linux i386 passes struct user_desc)
+static int32_t sys_clone(uint32_t flags, void *stack, pid_t *ptid, uint32_t tls, pid_t *ctid)
+{
+	if (!(flags & CLONE_THREAD))
+	{
+		if (flags & CLONE_VM)
+			return -EINVAL;
+
+		struct process *child = process_fork(current_process);
+		if (!child)
+			return -EAGAIN;
+		if (stack)
+			child->thread->uregs.useresp = (uint32_t)stack;
+		queue_thread(child->thread);
+		return child->pid;
+	}
+
+	if ((flags & (CLONE_VM | CLONE_SIGHAND)) != (CLONE_VM | CLONE_SIGHAND))
+		return -EINVAL;
+
+	struct thread *th = process_clone_thread(current_process, (uint32_t)stack);
+	if (flags & CLONE_SETTLS)
+	{
+		th->tls_base = tls;
+		th->uregs.gs = GDT_TLS_SELECTOR;
+	}
+	if (flags & CLONE_PARENT_SETTID)
+		*ptid = th->tid;
+	if (flags & CLONE_CHILD_SETTID)
+		*ctid = th->tid;
+	if (flags & CLONE_CHILD_CLEARTID)
+		th->clear_child_tid = (uint32_t *)ctid;
+
+	queue_thread(th);
+	return th->tid;
+}
+
+static int32_t sys_set_thread_area(uint32_t base)
+{
+	current_thread->tls_base = base;
+	gdt_set_tls(base);
+	// gs is popped from user frame when returning to userspace
+	task_user_regs(current_thread)->gs = GDT_TLS_SELECTOR;
+	return 0;
+}
+
+static int32_t sys_gettid()
+{
+	return current_thread->tid;
+}
+
+static int32_t sys_futex(uint32_t *uaddr, int32_t op, uint32_t val, uint32_t val2, uint32_t *uaddr2)
+{
+	return do_futex(uaddr, op, val, val2, uaddr2);
+}
+
 static int32_t sys_waitid(idtype_t idtype, id_t id, struct infop *infop, int options)
 {
 	int ret = do_wait(idtype, id, infop, options);
@@ -90,6 +161,11 @@ static int32_t sys_close(uint32_t fd)
 	return vfs_close(fd);
 }
 
+static int32_t sys_close_range(uint32_t fd, uint32_t max_fd, uint32_t flags)
+{
+	return do_close_range(fd, max_fd, flags);
+}
+
 static int32_t sys_lseek(int fd, off_t offset, int whence)
 {
 	return vfs_flseek(fd, offset, whence);
@@ -168,7 +244,7 @@ static int32_t sys_renameat(int olddirfd, const char *oldpath,
 
 static int32_t sys_fchmod(int fildes, mode_t mode)
 {
-	struct vfs_file *filp = current_process->files->fd[fildes];
+	struct vfs_file *filp = fcheck(fildes);
 	if (!filp)
 		return -EBADF;
 
@@ -227,7 +303,7 @@ static int32_t sys_getcwd(char *buf, size_t size)
 
 static int32_t sys_getdents(unsigned int fd, struct dirent *dirent, unsigned int count)
 {
-	struct vfs_file *file = current_process->files->fd[fd];
+	struct vfs_file *file = fcheck(fd);
 
 	if (!file)
 		return -EBADF;
@@ -259,7 +335,7 @@ static int32_t sys_gettimeofday(struct timeval *restrict tp, void *restrict tzp)
 {
 	uint64_t ms = get_milliseconds_since_epoch();
 	tp->tv_sec = ms / 1000;
-	tp->tv_usec = ms * 1000;
+	tp->tv_usec = (ms % 1000) * 1000;
 
 	return 0;
 }
@@ -271,8 +347,7 @@ static int32_t sys_execve(const char *pathname, char *const argv[], char *const
 
 int32_t sys_dup2(int oldfd, int newfd)
 {
-	current_process->files->fd[newfd] = current_process->files->fd[oldfd];
-	return newfd;
+	return do_dup2(oldfd, newfd);
 }
 
 static int32_t sys_pipe(int32_t *fd)
@@ -290,6 +365,16 @@ static int32_t sys_munmap(void *addr, size_t len)
 	return do_munmap(current_process->mm, (uint32_t)addr, len);
 }
 
+static int32_t sys_mprotect(void *addr, size_t len, int prot)
+{
+	return do_mprotect(current_process->mm, (uint32_t)addr, len, prot);
+}
+
+static int32_t sys_mremap(void *addr, size_t old_len, size_t new_len, int flags)
+{
+	return do_mremap(current_process->mm, (uint32_t)addr, old_len, new_len, flags);
+}
+
 static int32_t sys_truncate(const char *path, int32_t length)
 {
 	return vfs_truncate(path, length);
@@ -300,6 +385,22 @@ static int32_t sys_ftruncate(uint32_t fd, int32_t length)
 	return vfs_ftruncate(fd, length);
 }
 
+static int32_t sys_sync()
+{
+	sync_inodes();
+	return 0;
+}
+
+static int32_t sys_fsync(int32_t fd)
+{
+	return vfs_fsync(fd, false);
+}
+
+static int32_t sys_fdatasync(int32_t fd)
+{
+	return vfs_fsync(fd, true);
+}
+
 static int32_t sys_access(const char *path, int amode)
 {
 	return vfs_access(path, amode);
@@ -363,7 +464,7 @@ static int32_t sys_mkdirat(int fd, const char *path, mode_t mode)
 
 static int32_t sys_fchdir(int fildes)
 {
-	struct vfs_file *filp = current_process->files->fd[fildes];
+	struct vfs_file *filp = fcheck(fildes);
 	if (!filp)
 		return -EBADF;
 
@@ -386,8 +487,7 @@ static int32_t sys_brk(uint32_t brk)
 	if (brk < current_mm->start_brk)
 		return -EINVAL;
 
-	do_brk(current_mm->start_brk, brk - current_mm->start_brk);
-	return 0;
+	return do_brk(current_mm->start_brk, brk - current_mm->start_brk);
 }
 
 int32_t sys_sbrk(intptr_t increment)
@@ -416,7 +516,7 @@ static int32_t sys_getpgid(pid_t pid)
 	if (!p)
 		return -ESRCH;
 
-	return current_process->gid;
+	return p->gid;
 }
 
 static int32_t sys_getppid()
@@ -427,13 +527,10 @@ static int32_t sys_getppid()
 static int32_t sys_setpgid(pid_t pid, pid_t pgid)
 {
 	struct process *p = !pid ? current_process : find_process_by_pid(pid);
-	struct process *l = !pgid ? p : find_process_by_pid(pgid);
-
-	if (l->sid != p->sid)
-		return -1;
+	if (!p)
+		return -ESRCH;
 
-	p->gid = l->pid;
-	return 0;
+	return do_setpgid(p, pgid);
 }
 
 static int32_t sys_getsid()
@@ -443,12 +540,7 @@ static int32_t sys_getsid()
 
 static int32_t sys_setsid()
 {
-	if (current_process->pid == current_process->gid)
-		return -1;
-
-	current_process->sid = current_process->gid = current_process->pid;
-	current_process->tty = NULL;
-	return 0;
+	return do_setsid(current_process);
 }
 
 static int32_t sys_getuid()
@@ -541,7 +633,7 @@ int32_t sys_socket(int32_t family, enum socket_type type, int32_t protocal)
 {
 	char *path = get_next_socket_path();
 	int32_t fd = vfs_open(path, O_RDWR | O_CREAT, S_IFSOCK);
-	socket_setup(family, type, protocal, current_process->files->fd[fd]);
+	socket_setup(family, type, protocal, fcheck(fd));
 	return fd;
 }
 
@@ -576,14 +668,29 @@ static int32_t sys_nanosleep(const struct timespec *req, struct timespec *rem)
 	return 0;
 }
 
-static int32_t sys_poll(struct pollfd *fds, uint32_t nfds)
+static int32_t sys_poll(struct pollfd *fds, uint32_t nfds, int32_t timeout)
+{
+	return do_poll(fds, nfds, timeout);
+}
+
+static int32_t sys_epoll_create(int32_t size)
+{
+	return do_epoll_create(size);
+}
+
+static int32_t sys_epoll_ctl(int32_t epfd, int32_t op, int32_t fd, struct epoll_event *event)
+{
+	return do_epoll_ctl(epfd, op, fd, event);
+}
+
+static int32_t sys_epoll_wait(int32_t epfd, struct epoll_event *events, int32_t maxevents, int32_t timeout)
 {
-	return do_poll(fds, nfds);
+	return do_epoll_wait(epfd, events, maxevents, timeout);
 }
 
 static int32_t sys_ioctl(int fd, unsigned int cmd, unsigned long arg)
 {
-	struct vfs_file *file = current_process->files->fd[fd];
+	struct vfs_file *file = fcheck(fd);
 
 	if (file && file->f_op->ioctl)
 		return file->f_op->ioctl(file->f_dentry->d_inode, file, cmd, arg);
@@ -617,19 +724,25 @@ static int32_t sys_mq_unlink(const char *name)
 	return mq_unlink(name);
 }
 
-static int32_t sys_mq_send(int32_t fd, char *buf, uint32_t priority, uint32_t msize)
+// mq_send and mq_receive are timed ones without timeout
+static int32_t sys_mq_timedsend(int32_t fd, char *buf, uint32_t priority, uint32_t msize, const struct timespec *abs_timeout)
 {
-	return mq_send(fd, buf, priority, msize);
+	return mq_send(fd, buf, priority, msize, abs_timeout);
 }
 
-static int32_t sys_mq_receive(int32_t fd, char *buf, uint32_t priority, uint32_t msize)
+static int32_t sys_mq_timedreceive(int32_t fd, char *buf, uint32_t *priority, uint32_t msize, const struct timespec *abs_timeout)
 {
-	return mq_receive(fd, buf, priority, msize);
+	return mq_receive(fd, buf, priority, msize, abs_timeout);
+}
+
+static int32_t sys_mq_notify(int32_t fd, const struct sigevent *sevp)
+{
+	return mq_notify(fd, sevp);
 }
 
 static int32_t sys_getptsname(int32_t fdm, char *buf)
 {
-	struct tty_struct *ttym = current_process->files->fd[fdm]->private_data;
+	struct tty_struct *ttym = fcheck(fdm)->private_data;
 	if (!ttym || ttym->magic != TTY_MAGIC)
 		return -ENOTTY;
 
@@ -640,14 +753,15 @@ static int32_t sys_getptsname(int32_t fdm, char *buf)
 
 static int32_t sys_clock_gettime(clockid_t clk_id, struct timespec *tp)
 {
-	if (clk_id != CLOCK_PROCESS_CPUTIME_ID)
+	if (clk_id != CLOCK_REALTIME && clk_id != CLOCK_MONOTONIC && clk_id != CLOCK_PROCESS_CPUTIME_ID)
 		return -EINVAL;
 	if (!tp)
 		return -EFAULT;
 
-	uint64_t msec = get_milliseconds_since_epoch();
+	// NOTE: MQ 2020-08-11 Same clocks as vdso (proc/vdso.asm), process clock is still wall time
+	uint64_t msec = clk_id == CLOCK_MONOTONIC ? jiffies : get_milliseconds_since_epoch();
 	tp->tv_sec = msec / 1000;
-	tp->tv_nsec = (msec % 1000) * 1000;
+	tp->tv_nsec = (msec % 1000) * 1000000;
 
 	return 0;
 }
@@ -695,6 +809,7 @@ static int32_t sys_debug_println(enum debug_level level, const char *out)
 #define __NR_getuid 24
 #define __NR_alarm 27
 #define __NR_access 33
+#define __NR_sync 36
 #define __NR_kill 37
 #define __NR_rename 38
 #define __NR_mkdir 39
@@ -733,21 +848,34 @@ static int32_t sys_debug_println(enum debug_level level, const char *out)
 #define __NR_listen 105
 #define __NR_stat 106
 #define __NR_fstat 108
+#define __NR_fsync 118
+#define __NR_clone 120
 #define __NR_uname 122
+#define __NR_mprotect 125
 #define __NR_sigprocmask 126
 #define __NR_fchdir 133
 #define __NR_getpgid 132
 #define __NR_getdents 141
 #define __NR_getsid 147
+#define __NR_fdatasync 148
 #define __NR_nanosleep 162
+#define __NR_mremap 163
 #define __NR_poll 168
 #define __NR_getcwd 183
+#define __NR_gettid 224
+#define __NR_futex 240
+#define __NR_set_thread_area 243
+#define __NR_exit_group 252
+#define __NR_epoll_create 254
+#define __NR_epoll_ctl 255
+#define __NR_epoll_wait 256
 #define __NR_clock_gettime 265
 #define __NR_mq_open 277
 #define __NR_mq_close (__NR_mq_open + 1)
 #define __NR_mq_unlink (__NR_mq_open + 2)
-#define __NR_mq_send (__NR_mq_open + 3)
-#define __NR_mq_receive (__NR_mq_open + 4)
+#define __NR_mq_timedsend (__NR_mq_open + 3)
+#define __NR_mq_timedreceive (__NR_mq_open + 4)
+#define __NR_mq_notify (__NR_mq_open + 5)
 #define __NR_waitid 284
 #define __NR_mkdirat 296
 #define __NR_mknodat 297
@@ -757,6 +885,7 @@ static int32_t sys_debug_println(enum debug_level level, const char *out)
 #define __NR_sendto 369
 // TODO: MQ 2020-09-05 Use ioctl-FIODGNAME to get pts name
 #define __NR_getptsname 370
+#define __NR_close_range 436
 // TODO: MQ 2020-09-16 Replace by writting to /dev/ttyS0
 #define __NR_dprintf 512
 #define __NR_dprintln 513
@@ -765,12 +894,18 @@ static int32_t sys_debug_println(enum debug_level level, const char *out)
 static void *syscalls[] = {
 	[__NR_exit] = sys_exit,
 	[__NR_fork] = sys_fork,
+	[__NR_clone] = sys_clone,
+	[__NR_exit_group] = sys_exit_group,
+	[__NR_gettid] = sys_gettid,
+	[__NR_set_thread_area] = sys_set_thread_area,
+	[__NR_futex] = sys_futex,
 	[__NR_read] = sys_read,
 	[__NR_write] = sys_write,
 	[__NR_open] = sys_open,
 	[__NR_stat] = sys_stat,
 	[__NR_fstat] = sys_fstat,
 	[__NR_close] = sys_close,
+	[__NR_close_range] = sys_close_range,
 	[__NR_lseek] = sys_lseek,
 	[__NR_rename] = sys_rename,
 	[__NR_renameat] = sys_renameat,
@@ -822,8 +957,13 @@ static void *syscalls[] = {
 	[__NR_posix_spawn] = sys_posix_spawn,
 	[__NR_mmap] = sys_mmap,
 	[__NR_munmap] = sys_munmap,
+	[__NR_mprotect] = sys_mprotect,
+	[__NR_mremap] = sys_mremap,
 	[__NR_truncate] = sys_truncate,
 	[__NR_ftruncate] = sys_ftruncate,
+	[__NR_sync] = sys_sync,
+	[__NR_fsync] = sys_fsync,
+	[__NR_fdatasync] = sys_fdatasync,
 	[__NR_socket] = sys_socket,
 	[__NR_connect] = sys_connect,
 	[__NR_bind] = sys_bind,
@@ -831,11 +971,15 @@ static void *syscalls[] = {
 	[__NR_recv] = sys_recv,
 	[__NR_nanosleep] = sys_nanosleep,
 	[__NR_poll] = sys_poll,
+	[__NR_epoll_create] = sys_epoll_create,
+	[__NR_epoll_ctl] = sys_epoll_ctl,
+	[__NR_epoll_wait] = sys_epoll_wait,
 	[__NR_mq_open] = sys_mq_open,
 	[__NR_mq_close] = sys_mq_close,
 	[__NR_mq_unlink] = sys_mq_unlink,
-	[__NR_mq_send] = sys_mq_send,
-	[__NR_mq_receive] = sys_mq_receive,
+	[__NR_mq_timedsend] = sys_mq_timedsend,
+	[__NR_mq_timedreceive] = sys_mq_timedreceive,
+	[__NR_mq_notify] = sys_mq_notify,
 	[__NR_waitid] = sys_waitid,
 	[__NR_uname] = sys_uname,
 	[__NR_getptsname] = sys_getptsname,
@@ -853,10 +997,10 @@ static int32_t syscall_dispatcher(struct interrupt_registers *regs)
 	if (!func)
 		return IRQ_HANDLER_STOP;
 
-	memcpy(&current_thread->uregs, regs, sizeof(struct interrupt_registers));
-
+	trace(TRACE_SYSCALL_ENTRY, idx, regs->ebx, regs->ecx, regs->edx);
 	uint32_t ret = func(regs->ebx, regs->ecx, regs->edx, regs->esi, regs->edi);
 	regs->eax = ret;
+	trace(TRACE_SYSCALL_EXIT, idx, ret);
 
 	return IRQ_HANDLER_CONTINUE;
 }
@@ -1,6 +1,8 @@
 #include "timer.h"
 
+#include <cpu/hal.h>
 #include <cpu/idt.h>
+#include <cpu/softirq.h>
 #include <system/time.h>
 
 static struct list_head list_of_timer;
@@ -18,6 +20,7 @@ bool is_actived_timer(struct timer_list *timer)
 
 void add_timer(struct timer_list *timer)
 {
+	uint32_t flags = irq_save();
 	struct timer_list *iter, *node = NULL;
 	list_for_each_entry(iter, &list_of_timer, sibling)
 	{
@@ -31,11 +34,14 @@ void add_timer(struct timer_list *timer)
 		list_add(&timer->sibling, &node->sibling);
 	else
 		list_add_tail(&timer->sibling, &list_of_timer);
+	irq_restore(flags);
 }
 
 void del_timer(struct timer_list *timer)
 {
+	uint32_t flags = irq_save();
 	list_del(&timer->sibling);
+	irq_restore(flags);
 }
 
 void mod_timer(struct timer_list *timer, uint64_t expires)
@@ -45,16 +51,27 @@ void mod_timer(struct timer_list *timer, uint64_t expires)
 	add_timer(timer);
 }
 
-static int32_t timer_schedule_handler(struct interrupt_registers *regs)
+// NOTE: MQ 2020-08-12 Timers are sorted by expires, so we stop at the first one which is not expired
+// callbacks run with interrupts disabled, they are free to del/mod their own timer
+static void run_timer_softirq()
 {
+	uint32_t flags = irq_save();
 	struct timer_list *iter, *next;
 	uint64_t cms = get_milliseconds(NULL);
 	list_for_each_entry_safe(iter, next, &list_of_timer, sibling)
 	{
 		assert_timer_valid(iter);
-		if (iter->expires <= cms)
-			iter->function(iter);
+		if (iter->expires > cms)
+			break;
+		iter->function(iter);
 	}
+	irq_restore(flags);
+}
+
+static int32_t timer_schedule_handler(struct interrupt_registers *regs)
+{
+	if (!list_empty(&list_of_timer))
+		raise_softirq(TIMER_SOFTIRQ);
 
 	return IRQ_HANDLER_CONTINUE;
 }
@@ -62,5 +79,6 @@ static int32_t timer_schedule_handler(struct interrupt_registers *regs)
 void timer_init()
 {
 	INIT_LIST_HEAD(&list_of_timer);
+	open_softirq(TIMER_SOFTIRQ, run_timer_softirq);
 	register_interrupt_handler(IRQ8, timer_schedule_handler);
 }
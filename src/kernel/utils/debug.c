@@ -1,5 +1,6 @@
 #include "debug.h"
 
+#include <cpu/hal.h>
 #include <cpu/rtc.h>
 #include <devices/char/tty.h>
 #include <include/ctype.h>
@@ -8,6 +9,8 @@
 #include <utils/string.h>
 
 #define SERIAL_PORT_A 0x3f8
+#define LOG_RING_SIZE 16384
+#define LOG_DRAIN_INTERVAL 10
 
 extern struct time current_time;
 
@@ -22,14 +25,61 @@ static char *DEBUG_NAME[] = {
 	[DEBUG_FATAL] = "FATAL",
 };
 
+// NOTE: MQ 2020-08-13
+// Messages are copied into a ring and written to serial by klogd, so logging doesn't stall on uart
+// before klogd is running, for errors, or when the ring is full, we write through synchronously
+static char log_ring[LOG_RING_SIZE];
+static volatile uint32_t log_head, log_tail;
+static struct thread *klogd_thread;
+
+static bool debug_drain_one()
+{
+	uint32_t flags = irq_save();
+	bool has_data = log_tail != log_head;
+	if (has_data)
+	{
+		serial_output(SERIAL_PORT_A, log_ring[log_tail % LOG_RING_SIZE]);
+		log_tail++;
+	}
+	irq_restore(flags);
+	return has_data;
+}
+
+void debug_flush()
+{
+	while (debug_drain_one())
+		;
+}
+
 static void debug_write(const char *str)
 {
 	for (char *ch = str; *ch; ++ch)
-		serial_output(SERIAL_PORT_A, *ch);
+	{
+		if (log_head - log_tail >= LOG_RING_SIZE)
+			debug_drain_one();
+		log_ring[log_head % LOG_RING_SIZE] = *ch;
+		log_head++;
+	}
+
+	if (!klogd_thread)
+		debug_flush();
+}
+
+static void klogd_loop()
+{
+	// explain in kernel_init#unlock_scheduler
+	unlock_scheduler();
+
+	while (true)
+	{
+		debug_flush();
+		thread_sleep(LOG_DRAIN_INTERVAL);
+	}
 }
 
 static int debug_vsprintf(enum debug_level level, const char *fmt, va_list args)
 {
+	uint32_t flags = irq_save();
 	vsprintf(log_body, fmt, args);
 
 	pid_t pid = current_process ? current_process->pid : 0;
@@ -61,6 +111,10 @@ static int debug_vsprintf(enum debug_level level, const char *fmt, va_list args)
 	}
 
 	debug_write(log_buffer);
+	if (level >= DEBUG_ERROR)
+		debug_flush();
+	irq_restore(flags);
+
 	return out;
 }
 
@@ -83,7 +137,9 @@ int debug_println(enum debug_level level, const char *fmt, ...)
 	va_start(args, fmt);
 
 	out = debug_vsprintf(level, fmt, args);
+	uint32_t flags = irq_save();
 	debug_write("\n");
+	irq_restore(flags);
 
 	va_end(args);
 	return out + 1;
@@ -94,6 +150,11 @@ void debug_init()
 	serial_enable(SERIAL_PORT_A);
 }
 
+void debug_start_drainer()
+{
+	klogd_thread = create_system_process("klogd", klogd_loop, 0)->thread;
+}
+
 void __dbg(enum debug_level level, bool prefix, const char *file, int line, const char *func, ...)
 {
 	va_list args;
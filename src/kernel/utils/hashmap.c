@@ -18,34 +18,21 @@
 #define HASHMAP_ASSERT(expr) ((void)0)
 
 /* Table sizes must be powers of 2 */
-#define HASHMAP_SIZE_MIN (1 << 5)	  /* 32 */
-#define HASHMAP_SIZE_DEFAULT (1 << 8) /* 256 */
-#define HASHMAP_SIZE_MOD(map, val) ((val) & ((map)->table_size - 1))
+#define HASHMAP_SIZE_MIN (1 << 3)	  /* 8 */
+#define HASHMAP_SIZE_DEFAULT (1 << 5) /* 32 */
 
-/* Limit for probing is 1/2 of table_size */
-#define HASHMAP_PROBE_LEN(map) ((map)->table_size >> 1)
-/* Return the next linear probe index */
-#define HASHMAP_PROBE_NEXT(map, index) HASHMAP_SIZE_MOD(map, (index) + 1)
+/* Slots of the old table which are moved by each put while growing */
+#define HASHMAP_MIGRATE_SLOTS 16
 
-/* Check if index b is less than or equal to index a */
-#define HASHMAP_INDEX_LE(map, a, b) \
-	((a) == (b) || (((b) - (a)) & ((map)->table_size >> 1)) != 0)
-
-struct hashmap_entry
-{
-	void *key;
-	void *data;
-#ifdef HASHMAP_METRICS
-	size_t num_collisions;
-#endif
-};
+#define HASHMAP_CTRL(table, index) (((uint8_t *)(table)->ctrl)[index])
+#define HASHMAP_CTRL_IS_FULL(ctrl) (!((ctrl) & HASHMAP_CTRL_EMPTY))
 
 /*
- * Enforce a maximum 0.75 load factor.
+ * Enforce a maximum 7/8 load factor.
  */
-static inline size_t hashmap_table_min_size_calc(size_t num_entries)
+static inline size_t hashmap_table_max_load(size_t table_size)
 {
-	return num_entries + (num_entries / 3);
+	return table_size - table_size / 8;
 }
 
 /*
@@ -54,191 +41,178 @@ static inline size_t hashmap_table_min_size_calc(size_t num_entries)
  */
 static size_t hashmap_table_size_calc(size_t num_entries)
 {
-	size_t table_size;
-	size_t min_size;
-
-	table_size = hashmap_table_min_size_calc(num_entries);
+	size_t min_size = HASHMAP_SIZE_MIN;
 
 	/* Table size is always a power of 2 */
-	min_size = HASHMAP_SIZE_MIN;
-	while (min_size < table_size)
+	while (hashmap_table_max_load(min_size) < num_entries)
 	{
 		min_size <<= 1;
 	}
 	return min_size;
 }
 
-/*
- * Get a valid hash table index from a key.
- */
-static inline size_t hashmap_calc_index(const struct hashmap *map,
-										const void *key)
+static int hashmap_table_alloc(struct hashmap_table *table, size_t table_size)
 {
-	return HASHMAP_SIZE_MOD(map, map->hash(key));
+	HASHMAP_ASSERT(table_size >= HASHMAP_SIZE_MIN);
+	HASHMAP_ASSERT((table_size & (table_size - 1)) == 0);
+
+	/* Slots and their control bytes share one allocation */
+	struct hashmap_slot *slots = (struct hashmap_slot *)kcalloc(table_size,
+																sizeof(struct hashmap_slot) + 1);
+	if (!slots)
+	{
+		return -ENOMEM;
+	}
+	table->capacity = table_size;
+	table->growth_left = hashmap_table_max_load(table_size);
+	table->slots = slots;
+	table->ctrl = (uint32_t *)(slots + table_size);
+	memset(table->ctrl, HASHMAP_CTRL_EMPTY, table_size);
+	return 0;
+}
+
+static void hashmap_table_free(struct hashmap_table *table)
+{
+	kfree(table->slots);
+	memset(table, 0, sizeof(*table));
+}
+
+static bool hashmap_table_contains(const struct hashmap_table *table,
+								   const struct hashmap_slot *slot)
+{
+	return table->capacity && slot >= table->slots &&
+		   slot < &table->slots[table->capacity];
 }
 
 /*
- * Return the next populated entry, starting with the specified one.
- * Returns NULL if there are no more valid entries.
+ * Take the first free (empty or deleted) slot in the probe sequence.
+ * The key must not be in the table and growth_left must be non-zero.
  */
-static struct hashmap_entry *hashmap_entry_get_populated(
-	const struct hashmap *map, struct hashmap_entry *entry)
+static struct hashmap_slot *hashmap_table_insert(struct hashmap_table *table,
+												 uint32_t hash)
 {
-	for (; entry < &map->table[map->table_size]; ++entry)
+	size_t groups = table->capacity / HASHMAP_GROUP_WIDTH;
+	size_t group = (hash >> 7) & (groups - 1);
+	size_t step = 0;
+	uint32_t match;
+	size_t index;
+
+	while (!(match = hashmap_group_match_free(table->ctrl[group])))
 	{
-		if (entry->key)
-		{
-			return entry;
-		}
+		group = (group + ++step) & (groups - 1);
 	}
-	return NULL;
+	index = group * HASHMAP_GROUP_WIDTH + __builtin_ctz(match) / 8;
+	if (HASHMAP_CTRL(table, index) == HASHMAP_CTRL_EMPTY)
+	{
+		--table->growth_left;
+	}
+	HASHMAP_CTRL(table, index) = hash & 0x7F;
+	return &table->slots[index];
 }
 
 /*
- * Find the hashmap entry with the specified key, or an empty slot.
- * Returns NULL if the entire table has been searched without finding a match.
+ * A slot in a group which still has an empty slot can become empty again,
+ * no probe sequence has ever passed that group. Otherwise it's a tombstone.
  */
-static struct hashmap_entry *hashmap_entry_find(const struct hashmap *map,
-												const void *key, bool find_empty)
+static void hashmap_table_erase(struct hashmap_table *table, size_t index)
 {
-	size_t i;
-	size_t index;
-	size_t probe_len = HASHMAP_PROBE_LEN(map);
-	struct hashmap_entry *entry;
+	if (hashmap_group_match_empty(table->ctrl[index / HASHMAP_GROUP_WIDTH]))
+	{
+		HASHMAP_CTRL(table, index) = HASHMAP_CTRL_EMPTY;
+		++table->growth_left;
+	}
+	else
+	{
+		HASHMAP_CTRL(table, index) = HASHMAP_CTRL_DELETED;
+	}
+}
 
-	index = hashmap_calc_index(map, key);
+static struct hashmap_slot *hashmap_table_find(const struct hashmap *map,
+											   const struct hashmap_table *table,
+											   uint32_t hash, const void *key)
+{
+	struct hashmap_probe probe;
+	struct hashmap_slot *slot;
 
-	/* Linear probing */
-	for (i = 0; i < probe_len; ++i)
+	hashmap_probe_start(&probe, table, hash);
+	while ((slot = hashmap_probe_next(&probe)))
 	{
-		entry = &map->table[index];
-		if (!entry->key)
-		{
-			if (find_empty)
-			{
-#ifdef HASHMAP_METRICS
-				entry->num_collisions = i;
-#endif
-				return entry;
-			}
-			return NULL;
-		}
-		if (map->key_compare(key, entry->key) == 0)
+		if (slot->hash == hash && map->key_compare(key, slot->key) == 0)
 		{
-			return entry;
+			return slot;
 		}
-		index = HASHMAP_PROBE_NEXT(map, index);
 	}
 	return NULL;
 }
 
+static struct hashmap_slot *hashmap_slot_find(const struct hashmap *map,
+											  uint32_t hash, const void *key)
+{
+	struct hashmap_slot *slot = hashmap_table_find(map, &map->table, hash, key);
+
+	if (!slot)
+	{
+		slot = hashmap_table_find(map, &map->old, hash, key);
+	}
+	return slot;
+}
+
 /*
- * Removes the specified entry and processes the proceeding entries to reduce
- * the load factor and keep the chain continuous.  This is a required
- * step for hash maps using linear probing.
+ * Move up to nr_slots slots of the old table into the current one,
+ * the old table is freed once every slot has been visited.
  */
-static void hashmap_entry_remove(struct hashmap *map,
-								 struct hashmap_entry *removed_entry)
+static void hashmap_migrate(struct hashmap *map, size_t nr_slots)
 {
-	size_t i;
-#ifdef HASHMAP_METRICS
-	size_t removed_i = 0;
-#endif
+	struct hashmap_table *old = &map->old;
+	struct hashmap_slot *slot;
 	size_t index;
-	size_t entry_index;
-	size_t removed_index = (removed_entry - map->table);
-	struct hashmap_entry *entry;
 
-	/* Free the key */
-	if (map->key_free)
+	if (!old->capacity)
 	{
-		map->key_free(removed_entry->key);
+		return;
 	}
-	--map->num_entries;
-
-	/* Fill the free slot in the chain */
-	index = HASHMAP_PROBE_NEXT(map, removed_index);
-	for (i = 1; i < map->table_size; ++i)
+	for (; nr_slots && map->migrate_pos < old->capacity; --nr_slots)
 	{
-		entry = &map->table[index];
-		if (!entry->key)
+		index = map->migrate_pos++;
+		if (!HASHMAP_CTRL_IS_FULL(HASHMAP_CTRL(old, index)))
 		{
-			/* Reached end of chain */
-			break;
-		}
-		entry_index = hashmap_calc_index(map, entry->key);
-		/* Shift in entries with an index <= to the removed slot */
-		if (HASHMAP_INDEX_LE(map, removed_index, entry_index))
-		{
-#ifdef HASHMAP_METRICS
-			entry->num_collisions -= (i - removed_i);
-			removed_i = i;
-#endif
-			memcpy(removed_entry, entry, sizeof(*removed_entry));
-			removed_index = index;
-			removed_entry = entry;
+			continue;
 		}
-		index = HASHMAP_PROBE_NEXT(map, index);
+		slot = hashmap_table_insert(&map->table, old->slots[index].hash);
+		*slot = old->slots[index];
+		HASHMAP_CTRL(old, index) = HASHMAP_CTRL_DELETED;
+	}
+	if (map->migrate_pos == old->capacity)
+	{
+		hashmap_table_free(old);
 	}
-	/* Clear the last removed entry */
-	memset(removed_entry, 0, sizeof(*removed_entry));
 }
 
 /*
- * Reallocates the hash table to the new size and rehashes all entries.
- * new_size MUST be a power of 2.
- * Returns 0 on success and -errno on allocation or hash function failure.
+ * Start moving entries into a new table, 2x capacity unless most of the
+ * used slots are tombstones. The previous migration (if any) is finished first.
+ * Entries of the current table are at most 7/8 of it and migration is done
+ * after table_size / HASHMAP_MIGRATE_SLOTS puts, so the new table can't fill up.
+ * Returns 0 on success and -errno on allocation failure.
  */
-static int hashmap_rehash(struct hashmap *map, size_t new_size)
+static int hashmap_grow(struct hashmap *map)
 {
-	size_t old_size;
-	struct hashmap_entry *old_table;
-	struct hashmap_entry *new_table;
-	struct hashmap_entry *entry;
-	struct hashmap_entry *new_entry;
-
-	HASHMAP_ASSERT(new_size >= HASHMAP_SIZE_MIN);
-	HASHMAP_ASSERT((new_size & (new_size - 1)) == 0);
+	size_t table_size = map->table.capacity;
+	struct hashmap_table table;
 
-	new_table = (struct hashmap_entry *)kcalloc(new_size,
-												sizeof(struct hashmap_entry));
-	if (!new_table)
+	hashmap_migrate(map, SIZE_MAX);
+	if (map->num_entries > table_size * 7 / 16)
 	{
-		return -ENOMEM;
+		table_size <<= 1;
 	}
-	/* Backup old elements in case of rehash failure */
-	old_size = map->table_size;
-	old_table = map->table;
-	map->table_size = new_size;
-	map->table = new_table;
-	/* Rehash */
-	for (entry = old_table; entry < &old_table[old_size]; ++entry)
+	if (hashmap_table_alloc(&table, table_size) < 0)
 	{
-		if (!entry->data)
-		{
-			/* Only copy entries with data */
-			continue;
-		}
-		new_entry = hashmap_entry_find(map, entry->key, true);
-		if (!new_entry)
-		{
-			/*
-             * The load factor is too high with the new table
-             * size, or a poor hash function was used.
-             */
-			goto revert;
-		}
-		/* Shallow copy (intentionally omits num_collisions) */
-		new_entry->key = entry->key;
-		new_entry->data = entry->data;
+		return -ENOMEM;
 	}
-	kfree(old_table);
+	map->old = map->table;
+	map->table = table;
+	map->migrate_pos = 0;
 	return 0;
-revert:
-	map->table_size = old_size;
-	map->table = old_table;
-	kfree(new_table);
-	return -EINVAL;
 }
 
 /*
@@ -259,6 +233,34 @@ static void hashmap_free_keys(struct hashmap *map)
 	}
 }
 
+/*
+ * Return the first full slot from the specified one, moving on to the
+ * old table after the current one. Returns NULL if there are no more entries.
+ */
+static struct hashmap_slot *hashmap_slot_get_populated(const struct hashmap *map,
+													   const struct hashmap_table *table,
+													   size_t index)
+{
+	for (; index < table->capacity; ++index)
+	{
+		if (HASHMAP_CTRL_IS_FULL(HASHMAP_CTRL(table, index)))
+		{
+			return &table->slots[index];
+		}
+	}
+	if (table == &map->table)
+	{
+		return hashmap_slot_get_populated(map, &map->old, 0);
+	}
+	return NULL;
+}
+
+static const struct hashmap_table *hashmap_slot_table(const struct hashmap *map,
+													  const struct hashmap_slot *slot)
+{
+	return hashmap_table_contains(&map->table, slot) ? &map->table : &map->old;
+}
+
 /*
  * Initialize an empty hashmap.
  *
@@ -283,6 +285,7 @@ int hashmap_init(struct hashmap *map, size_t (*hash_func)(const void *),
 {
 	HASHMAP_ASSERT(map != NULL);
 
+	memset(map, 0, sizeof(*map));
 	if (!initial_size)
 	{
 		initial_size = HASHMAP_SIZE_DEFAULT;
@@ -293,18 +296,12 @@ int hashmap_init(struct hashmap *map, size_t (*hash_func)(const void *),
 		initial_size = hashmap_table_size_calc(initial_size);
 	}
 	map->table_size_init = initial_size;
-	map->table_size = initial_size;
-	map->num_entries = 0;
-	map->table = (struct hashmap_entry *)kcalloc(initial_size,
-												 sizeof(struct hashmap_entry));
-	if (!map->table)
+	if (hashmap_table_alloc(&map->table, initial_size) < 0)
 	{
 		return -ENOMEM;
 	}
 	map->hash = hash_func ? hash_func : hashmap_hash_string;
 	map->key_compare = key_compare_func ? key_compare_func : hashmap_compare_string;
-	map->key_alloc = NULL;
-	map->key_free = NULL;
 	return 0;
 }
 
@@ -318,7 +315,8 @@ void hashmap_destroy(struct hashmap *map)
 		return;
 	}
 	hashmap_free_keys(map);
-	kfree(map->table);
+	hashmap_table_free(&map->table);
+	hashmap_table_free(&map->old);
 	memset(map, 0, sizeof(*map));
 }
 
@@ -336,65 +334,65 @@ void hashmap_set_key_alloc_funcs(struct hashmap *map,
 }
 
 /*
- * Add an entry to the hashmap.  If an entry with a matching key already
- * exists and has a data pointer associated with it, the existing data
- * pointer is returned, instead of assigning the new value.  Compare
- * the return value with the data passed in to determine if a new entry was
- * created.  Returns NULL if memory allocation failed.
+ * Add an entry whose key is known to be absent, `hash` is map->hash(key).
+ * Returns NULL if memory allocation failed.
  */
-void *hashmap_put(struct hashmap *map, const void *key, void *data)
+void *hashmap_insert_hashed(struct hashmap *map, uint32_t hash, const void *key, void *data)
 {
-	struct hashmap_entry *entry;
+	struct hashmap_slot *slot;
 
 	HASHMAP_ASSERT(map != NULL);
 	HASHMAP_ASSERT(key != NULL);
 
-	/* Rehash with 2x capacity if load factor is approaching 0.75 */
-	if (map->table_size <= hashmap_table_min_size_calc(map->num_entries))
+	hashmap_migrate(map, HASHMAP_MIGRATE_SLOTS);
+	if (!map->table.growth_left && hashmap_grow(map) < 0)
 	{
-		hashmap_rehash(map, map->table_size << 1);
+		return NULL;
 	}
-	entry = hashmap_entry_find(map, key, true);
-	if (!entry)
+	/* Allocate copy of key to simplify memory management */
+	if (map->key_alloc)
 	{
-		/*
-         * Cannot find an empty slot.  Either out of memory, or using
-         * a poor hash function.  Attempt to rehash once to reduce
-         * chain length.
-         */
-		if (hashmap_rehash(map, map->table_size << 1) < 0)
-		{
-			return NULL;
-		}
-		entry = hashmap_entry_find(map, key, true);
-		if (!entry)
+		key = map->key_alloc(key);
+		if (!key)
 		{
 			return NULL;
 		}
 	}
-	if (!entry->key)
+	slot = hashmap_table_insert(&map->table, hash);
+	slot->hash = hash;
+	slot->key = key;
+	slot->data = data;
+	++map->num_entries;
+	return data;
+}
+
+/*
+ * Add an entry to the hashmap.  If an entry with a matching key already
+ * exists and has a data pointer associated with it, the existing data
+ * pointer is returned, instead of assigning the new value.  Compare
+ * the return value with the data passed in to determine if a new entry was
+ * created.  Returns NULL if memory allocation failed.
+ */
+void *hashmap_put(struct hashmap *map, const void *key, void *data)
+{
+	struct hashmap_slot *slot;
+	uint32_t hash;
+
+	HASHMAP_ASSERT(map != NULL);
+	HASHMAP_ASSERT(key != NULL);
+
+	hash = map->hash(key);
+	slot = hashmap_slot_find(map, hash, key);
+	if (!slot)
 	{
-		/* Allocate copy of key to simplify memory management */
-		if (map->key_alloc)
-		{
-			entry->key = map->key_alloc(key);
-			if (!entry->key)
-			{
-				return NULL;
-			}
-		}
-		else
-		{
-			entry->key = (void *)key;
-		}
-		++map->num_entries;
+		return hashmap_insert_hashed(map, hash, key, data);
 	}
-	else if (entry->data)
+	if (slot->data)
 	{
 		/* Do not overwrite existing data */
-		return entry->data;
+		return slot->data;
 	}
-	entry->data = data;
+	slot->data = data;
 	return data;
 }
 
@@ -403,17 +401,34 @@ void *hashmap_put(struct hashmap *map, const void *key, void *data)
  */
 void *hashmap_get(const struct hashmap *map, const void *key)
 {
-	struct hashmap_entry *entry;
+	struct hashmap_slot *slot;
 
 	HASHMAP_ASSERT(map != NULL);
 	HASHMAP_ASSERT(key != NULL);
 
-	entry = hashmap_entry_find(map, key, false);
-	if (!entry)
+	slot = hashmap_slot_find(map, map->hash(key), key);
+	if (!slot)
 	{
 		return NULL;
 	}
-	return entry->data;
+	return slot->data;
+}
+
+/*
+ * Remove the entry of a slot found by probing. Other entries never move,
+ * iterators and hashmap_foreach() stay valid.
+ */
+void hashmap_remove_slot(struct hashmap *map, struct hashmap_slot *slot)
+{
+	struct hashmap_table *table = (struct hashmap_table *)hashmap_slot_table(map, slot);
+
+	/* Free the key */
+	if (map->key_free)
+	{
+		map->key_free((void *)slot->key);
+	}
+	--map->num_entries;
+	hashmap_table_erase(table, slot - table->slots);
 }
 
 /*
@@ -422,20 +437,19 @@ void *hashmap_get(const struct hashmap *map, const void *key)
  */
 void *hashmap_remove(struct hashmap *map, const void *key)
 {
-	struct hashmap_entry *entry;
+	struct hashmap_slot *slot;
 	void *data;
 
 	HASHMAP_ASSERT(map != NULL);
 	HASHMAP_ASSERT(key != NULL);
 
-	entry = hashmap_entry_find(map, key, false);
-	if (!entry)
+	slot = hashmap_slot_find(map, map->hash(key), key);
+	if (!slot)
 	{
 		return NULL;
 	}
-	data = entry->data;
-	/* Clear the entry and make the chain contiguous */
-	hashmap_entry_remove(map, entry);
+	data = slot->data;
+	hashmap_remove_slot(map, slot);
 	return data;
 }
 
@@ -447,8 +461,10 @@ void hashmap_clear(struct hashmap *map)
 	HASHMAP_ASSERT(map != NULL);
 
 	hashmap_free_keys(map);
+	hashmap_table_free(&map->old);
 	map->num_entries = 0;
-	memset(map->table, 0, sizeof(struct hashmap_entry) * map->table_size);
+	map->table.growth_left = hashmap_table_max_load(map->table.capacity);
+	memset(map->table.ctrl, HASHMAP_CTRL_EMPTY, map->table.capacity);
 }
 
 /*
@@ -456,23 +472,21 @@ void hashmap_clear(struct hashmap *map)
  */
 void hashmap_reset(struct hashmap *map)
 {
-	struct hashmap_entry *new_table;
+	struct hashmap_table table;
 
 	HASHMAP_ASSERT(map != NULL);
 
 	hashmap_clear(map);
-	if (map->table_size == map->table_size_init)
+	if (map->table.capacity == map->table_size_init)
 	{
 		return;
 	}
-	new_table = (struct hashmap_entry *)krealloc(map->table,
-												 sizeof(struct hashmap_entry) * map->table_size_init);
-	if (!new_table)
+	if (hashmap_table_alloc(&table, map->table_size_init) < 0)
 	{
 		return;
 	}
-	map->table = new_table;
-	map->table_size = map->table_size_init;
+	hashmap_table_free(&map->table);
+	map->table = table;
 }
 
 /*
@@ -499,8 +513,7 @@ struct hashmap_iter *hashmap_iter(const struct hashmap *map)
 	{
 		return NULL;
 	}
-	return (struct hashmap_iter *)hashmap_entry_get_populated(map,
-															  map->table);
+	return (struct hashmap_iter *)hashmap_slot_get_populated(map, &map->table, 0);
 }
 
 /*
@@ -510,7 +523,8 @@ struct hashmap_iter *hashmap_iter(const struct hashmap *map)
 struct hashmap_iter *hashmap_iter_next(const struct hashmap *map,
 									   const struct hashmap_iter *iter)
 {
-	struct hashmap_entry *entry = (struct hashmap_entry *)iter;
+	struct hashmap_slot *slot = (struct hashmap_slot *)iter;
+	const struct hashmap_table *table;
 
 	HASHMAP_ASSERT(map != NULL);
 
@@ -518,8 +532,9 @@ struct hashmap_iter *hashmap_iter_next(const struct hashmap *map,
 	{
 		return NULL;
 	}
-	return (struct hashmap_iter *)hashmap_entry_get_populated(map,
-															  entry + 1);
+	table = hashmap_slot_table(map, slot);
+	return (struct hashmap_iter *)hashmap_slot_get_populated(map, table,
+															 slot - table->slots + 1);
 }
 
 /*
@@ -529,7 +544,8 @@ struct hashmap_iter *hashmap_iter_next(const struct hashmap *map,
 struct hashmap_iter *hashmap_iter_remove(struct hashmap *map,
 										 const struct hashmap_iter *iter)
 {
-	struct hashmap_entry *entry = (struct hashmap_entry *)iter;
+	struct hashmap_slot *slot = (struct hashmap_slot *)iter;
+	const struct hashmap_table *table;
 
 	HASHMAP_ASSERT(map != NULL);
 
@@ -537,13 +553,12 @@ struct hashmap_iter *hashmap_iter_remove(struct hashmap *map,
 	{
 		return NULL;
 	}
-	if (!entry->key)
+	table = hashmap_slot_table(map, slot);
+	if (HASHMAP_CTRL_IS_FULL(HASHMAP_CTRL(table, slot - table->slots)))
 	{
-		/* Iterator is invalid, so just return the next valid entry */
-		return hashmap_iter_next(map, iter);
+		hashmap_remove_slot(map, slot);
 	}
-	hashmap_entry_remove(map, entry);
-	return (struct hashmap_iter *)hashmap_entry_get_populated(map, entry);
+	return hashmap_iter_next(map, iter);
 }
 
 /*
@@ -555,7 +570,7 @@ const void *hashmap_iter_get_key(const struct hashmap_iter *iter)
 	{
 		return NULL;
 	}
-	return (const void *)((struct hashmap_entry *)iter)->key;
+	return ((struct hashmap_slot *)iter)->key;
 }
 
 /*
@@ -567,7 +582,7 @@ void *hashmap_iter_get_data(const struct hashmap_iter *iter)
 	{
 		return NULL;
 	}
-	return ((struct hashmap_entry *)iter)->data;
+	return ((struct hashmap_slot *)iter)->data;
 }
 
 /*
@@ -579,7 +594,7 @@ void hashmap_iter_set_data(const struct hashmap_iter *iter, void *data)
 	{
 		return;
 	}
-	((struct hashmap_entry *)iter)->data = data;
+	((struct hashmap_slot *)iter)->data = data;
 }
 
 /*
@@ -593,25 +608,21 @@ void hashmap_iter_set_data(const struct hashmap_iter *iter, void *data)
 int hashmap_foreach(const struct hashmap *map,
 					int (*func)(const void *, void *, void *), void *arg)
 {
-	struct hashmap_entry *entry;
+	struct hashmap_slot *slot;
+	const struct hashmap_table *table;
 	size_t num_entries;
-	const void *key;
+	size_t index;
 	int rc;
 
 	HASHMAP_ASSERT(map != NULL);
 	HASHMAP_ASSERT(func != NULL);
 
-	entry = map->table;
-	for (entry = map->table; entry < &map->table[map->table_size];
-		 ++entry)
+	for (slot = hashmap_slot_get_populated(map, &map->table, 0); slot;)
 	{
-		if (!entry->key)
-		{
-			continue;
-		}
+		table = hashmap_slot_table(map, slot);
+		index = slot - table->slots;
 		num_entries = map->num_entries;
-		key = entry->key;
-		rc = func(entry->key, entry->data, arg);
+		rc = func(slot->key, slot->data, arg);
 		if (rc < 0)
 		{
 			return rc;
@@ -620,40 +631,67 @@ int hashmap_foreach(const struct hashmap *map,
 		{
 			return 0;
 		}
-		/* Run this entry again if func() deleted it */
-		if (entry->key != key)
+		/* Stop immediately if func put another entry (tables might be gone) */
+		if (map->num_entries > num_entries)
 		{
-			--entry;
+			return -1;
 		}
-		else if (num_entries != map->num_entries)
+		/* Only the current entry might have been removed */
+		if (map->num_entries != num_entries - !HASHMAP_CTRL_IS_FULL(HASHMAP_CTRL(table, index)))
 		{
-			/* Stop immediately if func put/removed another entry */
 			return -1;
 		}
+		slot = hashmap_slot_get_populated(map, table, index + 1);
 	}
 	return 0;
 }
 
 /*
- * Default hash function for string keys.
- * This is an implementation of the well-documented Jenkins one-at-a-time
- * hash function.
+ * murmur3 round, a 32-bit word of key is mixed into hash.
  */
-size_t hashmap_hash_string(const void *key)
+static inline uint32_t hashmap_hash_round(uint32_t hash, uint32_t word)
 {
-	const char *key_str = (const char *)key;
-	size_t hash = 0;
+	word *= 0xcc9e2d51;
+	word = (word << 15) | (word >> 17);
+	word *= 0x1b873593;
+	hash ^= word;
+	hash = (hash << 13) | (hash >> 19);
+	return hash * 5 + 0xe6546b64;
+}
 
-	for (; *key_str; ++key_str)
+static inline size_t hashmap_hash_str(const char *key_str, bool fold)
+{
+	uint32_t hash = 0;
+	uint32_t word = 0;
+	uint32_t len = 0;
+
+	for (; *key_str; ++key_str, ++len)
 	{
-		hash += *key_str;
-		hash += (hash << 10);
-		hash ^= (hash >> 6);
+		unsigned char c = fold ? tolower((unsigned char)*key_str) : *key_str;
+
+		word |= (uint32_t)c << ((len % 4) * 8);
+		if (len % 4 == 3)
+		{
+			hash = hashmap_hash_round(hash, word);
+			word = 0;
+		}
 	}
-	hash += (hash << 3);
-	hash ^= (hash >> 11);
-	hash += (hash << 15);
-	return hash;
+	if (len % 4)
+	{
+		word *= 0xcc9e2d51;
+		word = (word << 15) | (word >> 17);
+		hash ^= word * 0x1b873593;
+	}
+	return hashmap_mix32(hash ^ len);
+}
+
+/*
+ * Default hash function for string keys.
+ * Bytes are mixed a 32-bit word at a time (murmur3 rounds).
+ */
+size_t hashmap_hash_string(const void *key)
+{
+	return hashmap_hash_str((const char *)key, false);
 }
 
 /*
@@ -678,19 +716,7 @@ void *hashmap_alloc_key_string(const void *key)
  */
 size_t hashmap_hash_string_i(const void *key)
 {
-	const char *key_str = (const char *)key;
-	size_t hash = 0;
-
-	for (; *key_str; ++key_str)
-	{
-		hash += tolower(*key_str);
-		hash += (hash << 10);
-		hash ^= (hash >> 6);
-	}
-	hash += (hash << 3);
-	hash ^= (hash >> 11);
-	hash += (hash << 15);
-	return hash;
+	return hashmap_hash_str((const char *)key, true);
 }
 
 /*
@@ -702,6 +728,24 @@ int hashmap_compare_string_i(const void *a, const void *b)
 }
 
 #ifdef HASHMAP_METRICS
+/*
+ * Return the number of groups probed before the one of a slot.
+ */
+static size_t hashmap_slot_collisions(const struct hashmap_table *table,
+									  const struct hashmap_slot *slot)
+{
+	size_t groups = table->capacity / HASHMAP_GROUP_WIDTH;
+	size_t group = (slot->hash >> 7) & (groups - 1);
+	size_t target = (slot - table->slots) / HASHMAP_GROUP_WIDTH;
+	size_t step = 0;
+
+	while (group != target && step < groups)
+	{
+		group = (group + ++step) & (groups - 1);
+	}
+	return step;
+}
+
 /*
  * Return the load factor.
  */
@@ -709,11 +753,11 @@ double hashmap_load_factor(const struct hashmap *map)
 {
 	HASHMAP_ASSERT(map != NULL);
 
-	if (!map->table_size)
+	if (!map->table.capacity)
 	{
 		return 0;
 	}
-	return (double)map->num_entries / map->table_size;
+	return (double)map->num_entries / (map->table.capacity + map->old.capacity);
 }
 
 /*
@@ -721,7 +765,7 @@ double hashmap_load_factor(const struct hashmap *map)
  */
 double hashmap_collisions_mean(const struct hashmap *map)
 {
-	struct hashmap_entry *entry;
+	struct hashmap_iter *iter;
 	size_t total_collisions = 0;
 
 	HASHMAP_ASSERT(map != NULL);
@@ -730,14 +774,10 @@ double hashmap_collisions_mean(const struct hashmap *map)
 	{
 		return 0;
 	}
-	for (entry = map->table; entry < &map->table[map->table_size];
-		 ++entry)
+	for (iter = hashmap_iter(map); iter; iter = hashmap_iter_next(map, iter))
 	{
-		if (!entry->key)
-		{
-			continue;
-		}
-		total_collisions += entry->num_collisions;
+		struct hashmap_slot *slot = (struct hashmap_slot *)iter;
+		total_collisions += hashmap_slot_collisions(hashmap_slot_table(map, slot), slot);
 	}
 	return (double)total_collisions / map->num_entries;
 }
@@ -748,7 +788,7 @@ double hashmap_collisions_mean(const struct hashmap *map)
  */
 double hashmap_collisions_variance(const struct hashmap *map)
 {
-	struct hashmap_entry *entry;
+	struct hashmap_iter *iter;
 	double mean_collisions;
 	double variance;
 	double total_variance = 0;
@@ -760,14 +800,10 @@ double hashmap_collisions_variance(const struct hashmap *map)
 		return 0;
 	}
 	mean_collisions = hashmap_collisions_mean(map);
-	for (entry = map->table; entry < &map->table[map->table_size];
-		 ++entry)
+	for (iter = hashmap_iter(map); iter; iter = hashmap_iter_next(map, iter))
 	{
-		if (!entry->key)
-		{
-			continue;
-		}
-		variance = (double)entry->num_collisions - mean_collisions;
+		struct hashmap_slot *slot = (struct hashmap_slot *)iter;
+		variance = (double)hashmap_slot_collisions(hashmap_slot_table(map, slot), slot) - mean_collisions;
 		total_variance += variance * variance;
 	}
 	return total_variance / map->num_entries;
@@ -776,7 +812,7 @@ double hashmap_collisions_variance(const struct hashmap *map)
 
 size_t hashmap_hash_uint32(const void *key)
 {
-	return *(uint32_t *)key;
+	return hashmap_mix32(*(uint32_t *)key);
 }
 
 int hashmap_compare_uint32(const void *a, const void *b)
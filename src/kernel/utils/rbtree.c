@@ -0,0 +1,304 @@
+#include "rbtree.h"
+
+static bool rb_is_black(struct rb_node *node)
+{
+	return !node || node->rb_color == RB_BLACK;
+}
+
+static void rb_change_child(struct rb_node *old, struct rb_node *new, struct rb_node *parent, struct rb_root *root)
+{
+	if (!parent)
+		root->rb_node = new;
+	else if (parent->rb_left == old)
+		parent->rb_left = new;
+	else
+		parent->rb_right = new;
+}
+
+// rotation doesn't change the set of nodes below the top, only two rotated nodes have to be augmented again
+static void rb_rotate_left(struct rb_node *node, struct rb_root *root, rb_augment_f augment)
+{
+	struct rb_node *right = node->rb_right;
+
+	node->rb_right = right->rb_left;
+	if (right->rb_left)
+		right->rb_left->rb_parent = node;
+
+	right->rb_parent = node->rb_parent;
+	rb_change_child(node, right, node->rb_parent, root);
+
+	right->rb_left = node;
+	node->rb_parent = right;
+
+	if (augment)
+	{
+		augment(node);
+		augment(right);
+	}
+}
+
+static void rb_rotate_right(struct rb_node *node, struct rb_root *root, rb_augment_f augment)
+{
+	struct rb_node *left = node->rb_left;
+
+	node->rb_left = left->rb_right;
+	if (left->rb_right)
+		left->rb_right->rb_parent = node;
+
+	left->rb_parent = node->rb_parent;
+	rb_change_child(node, left, node->rb_parent, root);
+
+	left->rb_right = node;
+	node->rb_parent = left;
+
+	if (augment)
+	{
+		augment(node);
+		augment(left);
+	}
+}
+
+void rb_augment_propagate(struct rb_node *node, rb_augment_f augment)
+{
+	for (; node; node = node->rb_parent)
+		augment(node);
+}
+
+void rb_insert_color(struct rb_node *node, struct rb_root *root, rb_augment_f augment)
+{
+	if (augment)
+		rb_augment_propagate(node, augment);
+
+	struct rb_node *parent;
+	while ((parent = node->rb_parent) && parent->rb_color == RB_RED)
+	{
+		// red node is never the root, grandparent exists
+		struct rb_node *gparent = parent->rb_parent;
+
+		if (parent == gparent->rb_left)
+		{
+			struct rb_node *uncle = gparent->rb_right;
+			if (!rb_is_black(uncle))
+			{
+				parent->rb_color = RB_BLACK;
+				uncle->rb_color = RB_BLACK;
+				gparent->rb_color = RB_RED;
+				node = gparent;
+				continue;
+			}
+
+			if (node == parent->rb_right)
+			{
+				rb_rotate_left(parent, root, augment);
+				node = parent;
+				parent = node->rb_parent;
+			}
+			parent->rb_color = RB_BLACK;
+			gparent->rb_color = RB_RED;
+			rb_rotate_right(gparent, root, augment);
+		}
+		else
+		{
+			struct rb_node *uncle = gparent->rb_left;
+			if (!rb_is_black(uncle))
+			{
+				parent->rb_color = RB_BLACK;
+				uncle->rb_color = RB_BLACK;
+				gparent->rb_color = RB_RED;
+				node = gparent;
+				continue;
+			}
+
+			if (node == parent->rb_left)
+			{
+				rb_rotate_right(parent, root, augment);
+				node = parent;
+				parent = node->rb_parent;
+			}
+			parent->rb_color = RB_BLACK;
+			gparent->rb_color = RB_RED;
+			rb_rotate_left(gparent, root, augment);
+		}
+	}
+
+	root->rb_node->rb_color = RB_BLACK;
+}
+
+// `node` (might be null) has one black less than its sibling, `parent` is its parent
+static void rb_erase_color(struct rb_node *node, struct rb_node *parent, struct rb_root *root, rb_augment_f augment)
+{
+	while (node != root->rb_node && rb_is_black(node))
+	{
+		if (node == parent->rb_left)
+		{
+			struct rb_node *sibling = parent->rb_right;
+			if (!rb_is_black(sibling))
+			{
+				sibling->rb_color = RB_BLACK;
+				parent->rb_color = RB_RED;
+				rb_rotate_left(parent, root, augment);
+				sibling = parent->rb_right;
+			}
+
+			if (rb_is_black(sibling->rb_left) && rb_is_black(sibling->rb_right))
+			{
+				sibling->rb_color = RB_RED;
+				node = parent;
+				parent = node->rb_parent;
+				continue;
+			}
+
+			if (rb_is_black(sibling->rb_right))
+			{
+				sibling->rb_left->rb_color = RB_BLACK;
+				sibling->rb_color = RB_RED;
+				rb_rotate_right(sibling, root, augment);
+				sibling = parent->rb_right;
+			}
+			sibling->rb_color = parent->rb_color;
+			parent->rb_color = RB_BLACK;
+			sibling->rb_right->rb_color = RB_BLACK;
+			rb_rotate_left(parent, root, augment);
+			node = root->rb_node;
+		}
+		else
+		{
+			struct rb_node *sibling = parent->rb_left;
+			if (!rb_is_black(sibling))
+			{
+				sibling->rb_color = RB_BLACK;
+				parent->rb_color = RB_RED;
+				rb_rotate_right(parent, root, augment);
+				sibling = parent->rb_left;
+			}
+
+			if (rb_is_black(sibling->rb_left) && rb_is_black(sibling->rb_right))
+			{
+				sibling->rb_color = RB_RED;
+				node = parent;
+				parent = node->rb_parent;
+				continue;
+			}
+
+			if (rb_is_black(sibling->rb_left))
+			{
+				sibling->rb_right->rb_color = RB_BLACK;
+				sibling->rb_color = RB_RED;
+				rb_rotate_left(sibling, root, augment);
+				sibling = parent->rb_left;
+			}
+			sibling->rb_color = parent->rb_color;
+			parent->rb_color = RB_BLACK;
+			sibling->rb_left->rb_color = RB_BLACK;
+			rb_rotate_right(parent, root, augment);
+			node = root->rb_node;
+		}
+	}
+
+	if (node)
+		node->rb_color = RB_BLACK;
+}
+
+void rb_erase(struct rb_node *node, struct rb_root *root, rb_augment_f augment)
+{
+	struct rb_node *child, *parent;
+	int color;
+
+	if (!node->rb_left || !node->rb_right)
+	{
+		child = node->rb_left ? node->rb_left : node->rb_right;
+		parent = node->rb_parent;
+		color = node->rb_color;
+
+		rb_change_child(node, child, parent, root);
+		if (child)
+			child->rb_parent = parent;
+	}
+	else
+	{
+		// successor takes node's place and color, fix-up starts where successor was removed
+		struct rb_node *successor = node->rb_right;
+		while (successor->rb_left)
+			successor = successor->rb_left;
+
+		color = successor->rb_color;
+		child = successor->rb_right;
+		if (successor->rb_parent == node)
+			parent = successor;
+		else
+		{
+			parent = successor->rb_parent;
+			parent->rb_left = child;
+			if (child)
+				child->rb_parent = parent;
+
+			successor->rb_right = node->rb_right;
+			node->rb_right->rb_parent = successor;
+		}
+
+		rb_change_child(node, successor, node->rb_parent, root);
+		successor->rb_parent = node->rb_parent;
+		successor->rb_left = node->rb_left;
+		node->rb_left->rb_parent = successor;
+		successor->rb_color = node->rb_color;
+	}
+
+	// every node from the removed position up to root has lost a descendant
+	if (augment)
+		rb_augment_propagate(parent, augment);
+
+	if (color == RB_BLACK)
+		rb_erase_color(child, parent, root, augment);
+}
+
+struct rb_node *rb_first(const struct rb_root *root)
+{
+	struct rb_node *node = root->rb_node;
+	if (!node)
+		return NULL;
+	while (node->rb_left)
+		node = node->rb_left;
+	return node;
+}
+
+struct rb_node *rb_last(const struct rb_root *root)
+{
+	struct rb_node *node = root->rb_node;
+	if (!node)
+		return NULL;
+	while (node->rb_right)
+		node = node->rb_right;
+	return node;
+}
+
+struct rb_node *rb_next(const struct rb_node *node)
+{
+	if (node->rb_right)
+	{
+		node = node->rb_right;
+		while (node->rb_left)
+			node = node->rb_left;
+		return (struct rb_node *)node;
+	}
+
+	struct rb_node *parent;
+	while ((parent = node->rb_parent) && node == parent->rb_right)
+		node = parent;
+	return parent;
+}
+
+struct rb_node *rb_prev(const struct rb_node *node)
+{
+	if (node->rb_left)
+	{
+		node = node->rb_left;
+		while (node->rb_right)
+			node = node->rb_right;
+		return (struct rb_node *)node;
+	}
+
+	struct rb_node *parent;
+	while ((parent = node->rb_parent) && node == parent->rb_left)
+		node = parent;
+	return parent;
+}
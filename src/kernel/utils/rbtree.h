@@ -0,0 +1,56 @@
+#ifndef UTILS_RBTREE_H
+#define UTILS_RBTREE_H
+
+#include <include/cdefs.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define RB_RED 0
+#define RB_BLACK 1
+
+struct rb_node
+{
+	struct rb_node *rb_parent;
+	struct rb_node *rb_left;
+	struct rb_node *rb_right;
+	int rb_color;
+};
+
+struct rb_root
+{
+	struct rb_node *rb_node;
+};
+
+// NOTE: MQ 2020-08-17
+// Augmented tree keeps a value in every node which is computed from the node and its children (e.g. the largest gap in subtree)
+// tree calls `augment` bottom-up for nodes whose children are changed, user calls rb_augment_propagate when node's own key changes
+typedef void (*rb_augment_f)(struct rb_node *node);
+
+#define RB_ROOT \
+	(struct rb_root) { NULL }
+
+#define rb_entry(ptr, type, member) container_of(ptr, type, member)
+
+#define rb_entry_safe(ptr, type, member) ({          \
+	struct rb_node *____ptr = (ptr);                 \
+	____ptr ? rb_entry(____ptr, type, member) : NULL; \
+})
+
+static inline void rb_link_node(struct rb_node *node, struct rb_node *parent, struct rb_node **link)
+{
+	node->rb_parent = parent;
+	node->rb_left = node->rb_right = NULL;
+	node->rb_color = RB_RED;
+	*link = node;
+}
+
+void rb_insert_color(struct rb_node *node, struct rb_root *root, rb_augment_f augment);
+void rb_erase(struct rb_node *node, struct rb_root *root, rb_augment_f augment);
+void rb_augment_propagate(struct rb_node *node, rb_augment_f augment);
+
+struct rb_node *rb_first(const struct rb_root *root);
+struct rb_node *rb_last(const struct rb_root *root);
+struct rb_node *rb_next(const struct rb_node *node);
+struct rb_node *rb_prev(const struct rb_node *node);
+
+#endif
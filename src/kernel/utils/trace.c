@@ -0,0 +1,100 @@
+#include "trace.h"
+
+#include <cpu/hal.h>
+#include <locking/spinlock.h>
+#include <proc/task.h>
+#include <stdarg.h>
+#include <utils/string.h>
+#include <utils/vsprintf.h>
+
+struct trace_event_format
+{
+	const char *name;
+	const char *fmt;
+	uint8_t nargs;
+};
+
+static struct trace_event_format trace_formats[NR_TRACE_EVENTS] = {
+	[TRACE_SCHED_SWITCH] = {"sched_switch", "prev=%d next=%d prev_state=%d", 3},
+	[TRACE_IRQ_ENTRY] = {"irq_entry", "vector=%d", 1},
+	[TRACE_IRQ_EXIT] = {"irq_exit", "vector=%d cycles=%u", 2},
+	[TRACE_SYSCALL_ENTRY] = {"syscall_entry", "nr=%d args=(0x%x, 0x%x, 0x%x)", 4},
+	[TRACE_SYSCALL_EXIT] = {"syscall_exit", "nr=%d ret=%d", 2},
+	[TRACE_BREAD] = {"bread", "sector=%u size=%u", 2},
+	[TRACE_TCP_SEND_SKB] = {"tcp_send_skb", "seq=%u len=%u retransmitted=%d", 3},
+};
+
+// NOTE: MQ 2020-08-13
+// Writers reserve a slot with an atomic increment so tracepoints can nest (thread -> irq -> softirq) without locking
+// kernel is uniprocessor, there is one ring, a smp kernel would keep one per cpu
+static struct trace_entry trace_ring[TRACE_RING_SIZE];
+static volatile uint32_t trace_head;
+volatile bool trace_enabled = true;
+
+void trace_record(enum trace_event event, ...)
+{
+	uint32_t slot = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED);
+	struct trace_entry *entry = &trace_ring[slot & (TRACE_RING_SIZE - 1)];
+
+	entry->seq = 0;
+	barrier();
+
+	entry->event = event;
+	entry->tid = current_thread ? current_thread->tid : 0;
+	entry->tsc = rdtsc();
+
+	va_list args;
+	va_start(args, event);
+	for (int i = 0; i < trace_formats[event].nargs; ++i)
+		entry->args[i] = va_arg(args, uint32_t);
+	va_end(args);
+
+	barrier();
+	entry->seq = slot + 1;
+}
+
+uint32_t trace_first_cursor()
+{
+	return trace_head > TRACE_RING_SIZE ? trace_head - TRACE_RING_SIZE : 0;
+}
+
+// consume committed entries from cursor and format them as lines, stop at an entry which is being written
+int trace_format(uint32_t *cursor, char *buf, size_t size)
+{
+	int len = 0;
+
+	while (*cursor != trace_head)
+	{
+		// reader is too slow, oldest entries have been overwritten
+		if (trace_head - *cursor > TRACE_RING_SIZE)
+			*cursor = trace_head - TRACE_RING_SIZE;
+
+		struct trace_entry *entry = &trace_ring[*cursor & (TRACE_RING_SIZE - 1)];
+		struct trace_entry copy = *entry;
+		barrier();
+		if (copy.seq != *cursor + 1 || entry->seq != copy.seq)
+		{
+			if ((int32_t)(entry->seq - (*cursor + 1)) > 0)
+			{
+				(*cursor)++;
+				continue;
+			}
+			break;
+		}
+
+		char line[128];
+		struct trace_event_format *format = &trace_formats[copy.event];
+		int n = scnprintf(line, sizeof(line), "%llu %d %s: ", copy.tsc, copy.tid, format->name);
+		n += scnprintf(line + n, sizeof(line) - n, format->fmt, copy.args[0], copy.args[1], copy.args[2], copy.args[3]);
+		n += scnprintf(line + n, sizeof(line) - n, "\n");
+
+		if (len + n > size)
+			break;
+
+		memcpy(buf + len, line, n);
+		len += n;
+		(*cursor)++;
+	}
+
+	return len;
+}
@@ -0,0 +1,46 @@
+#ifndef UTILS_TRACE_H
+#define UTILS_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// NOTE: MQ 2020-08-13
+// Static tracepoints record a fixed-size binary entry (tsc, tid and up to 4 arguments) into a ring
+// formatting is deferred until the ring is read via /dev/trace
+#define TRACE_RING_SIZE 4096  // must be power of two
+#define TRACE_MAX_ARGS 4
+
+enum trace_event
+{
+	TRACE_SCHED_SWITCH,
+	TRACE_IRQ_ENTRY,
+	TRACE_IRQ_EXIT,
+	TRACE_SYSCALL_ENTRY,
+	TRACE_SYSCALL_EXIT,
+	TRACE_BREAD,
+	TRACE_TCP_SEND_SKB,
+	NR_TRACE_EVENTS,
+};
+
+struct trace_entry
+{
+	uint32_t seq;  // slot + 1 when entry is committed, 0 while it is written
+	uint16_t event;
+	uint16_t tid;
+	uint64_t tsc;
+	uint32_t args[TRACE_MAX_ARGS];
+};
+
+extern volatile bool trace_enabled;
+
+#define trace(event, ...) ({                \
+	if (trace_enabled)                      \
+		trace_record(event, ##__VA_ARGS__); \
+})
+
+void trace_record(enum trace_event event, ...);
+uint32_t trace_first_cursor();
+int trace_format(uint32_t *cursor, char *buf, size_t size);
+
+#endif
@@ -2,16 +2,22 @@
 #define _LIBC_FILE_H
 
 #include <list.h>
+#include <pthread.h>
 
 struct __FILE
 {
 	int fd;
 	int _flags;
-	int _offset;
+	int _offset; // offset of fd (read: end of get area, write: start of put area)
+	// persistent buffer (allocated on first use), get and put area are never active at the same time
+	char *_IO_buf_base, *_IO_buf_end;
 	char *_IO_read_ptr, *_IO_read_base, *_IO_read_end;
 	char *_IO_write_ptr, *_IO_write_base, *_IO_write_end;
-	int bkup_chr;  // for ungetc
 	int blksize;
+	// stream lock, owner is 0 when it is free and _lock_count is the owner's nesting
+	pthread_mutex_t _lock;
+	int _lock_owner;
+	int _lock_count;
 	struct list_head sibling;
 
 	/* The following fields are used to support backing up and undo. */
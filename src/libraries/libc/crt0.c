@@ -1,13 +1,17 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/vdso.h>
 #include <unistd.h>
 
 extern void _stdio_init();
+extern void _pthread_init();
 extern int main(int, char**, char**);
 
 void _start(int argc, char** argv, char** envp)
 {
+	_vdso_init();
+	_pthread_init();
 	environ = envp;
 	_stdio_init();
 
@@ -22,6 +22,7 @@
 #define O_LARGEFILE 0400000 /* will be set by the kernel on every open */
 #define O_DIRECT 02000000	/* direct disk access - should check with OSF/1 */
 #define O_NOATIME 04000000
+#define O_CLOEXEC 010000000
 
 #define F_DUPFD 0 /* dup */
 #define F_GETFD 1 /* get close_on_exec */
@@ -35,9 +36,12 @@
 #define F_GETOWN 9	/* for sockets. */
 #define F_SETSIG 10 /* for sockets. */
 #define F_GETSIG 11 /* for sockets. */
+#define F_DUPFD_CLOEXEC 1030
 
 #define FD_CLOEXEC 1
 
+#define CLOSE_RANGE_CLOEXEC (1U << 2)
+
 #define AT_FDCWD -2
 
 /* Flag values for faccessat2) et al. */
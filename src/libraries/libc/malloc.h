@@ -0,0 +1,27 @@
+#ifndef _LIBC_MALLOC_H
+#define _LIBC_MALLOC_H 1
+
+#include <stddef.h>
+
+struct mallinfo
+{
+	size_t arena;	 // bytes are obtained from sbrk
+	size_t ordblks;	 // free chunks in bins
+	size_t smblks;	 // chunks in per-size caches
+	size_t hblks;	 // mmapped chunks
+	size_t hblkhd;	 // bytes in mmapped chunks
+	size_t fsmblks;	 // bytes in per-size caches
+	size_t uordblks; // bytes are in use (excluding mmapped chunks)
+	size_t fordblks; // bytes in bins
+	size_t keepcost; // bytes in top chunk (releasable by malloc_trim)
+};
+
+void *malloc(size_t size);
+void *calloc(size_t n, size_t size);
+void *realloc(void *ptr, size_t size);
+void free(void *ptr);
+size_t malloc_usable_size(void *ptr);
+int malloc_trim(size_t pad);
+struct mallinfo mallinfo();
+
+#endif
@@ -20,14 +20,30 @@ int mq_unlink(const char *name)
 	SYSCALL_RETURN(syscall_mq_unlink(name));
 }
 
-_syscall4(mq_send, int, char *, unsigned int, unsigned int);
-int mq_send(int fd, char *buf, unsigned int priorty, unsigned int msize)
+_syscall5(mq_timedsend, int, char *, unsigned int, unsigned int, const struct timespec *);
+int mq_timedsend(int fd, char *buf, unsigned int priority, unsigned int msize, const struct timespec *abs_timeout)
 {
-	SYSCALL_RETURN_ORIGINAL(syscall_mq_send(fd, buf, priorty, msize));
+	SYSCALL_RETURN(syscall_mq_timedsend(fd, buf, priority, msize, abs_timeout));
 }
 
-_syscall4(mq_receive, int, char *, unsigned int, unsigned int);
-int mq_receive(int fd, char *buf, unsigned int priorty, unsigned int msize)
+int mq_send(int fd, char *buf, unsigned int priority, unsigned int msize)
 {
-	SYSCALL_RETURN_ORIGINAL(syscall_mq_receive(fd, buf, priorty, msize));
+	return mq_timedsend(fd, buf, priority, msize, NULL);
+}
+
+_syscall5(mq_timedreceive, int, char *, unsigned int *, unsigned int, const struct timespec *);
+int mq_timedreceive(int fd, char *buf, unsigned int *priority, unsigned int msize, const struct timespec *abs_timeout)
+{
+	SYSCALL_RETURN_ORIGINAL(syscall_mq_timedreceive(fd, buf, priority, msize, abs_timeout));
+}
+
+int mq_receive(int fd, char *buf, unsigned int *priority, unsigned int msize)
+{
+	return mq_timedreceive(fd, buf, priority, msize, NULL);
+}
+
+_syscall2(mq_notify, int, const struct sigevent *);
+int mq_notify(int fd, const struct sigevent *sevp)
+{
+	SYSCALL_RETURN(syscall_mq_notify(fd, sevp));
 }
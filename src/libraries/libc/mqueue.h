@@ -1,6 +1,11 @@
 #ifndef _LIBC_MQUEUE_H
 #define _LIBC_MQUEUE_H 1
 
+#include <signal.h>
+#include <time.h>
+
+#define MQ_PRIO_MAX 32
+
 struct mq_attr
 {
 	long mq_flags;	 /* Flags (ignored for mq_open()) */
@@ -13,7 +18,10 @@ struct mq_attr
 int mq_open(const char *name, int flags, struct mq_attr *attr);
 int mq_close(int fd);
 int mq_unlink(const char *name);
-int mq_send(int fd, char *buf, unsigned int priorty, unsigned int msize);
-int mq_receive(int fd, char *buf, unsigned int priorty, unsigned int msize);
+int mq_send(int fd, char *buf, unsigned int priority, unsigned int msize);
+int mq_timedsend(int fd, char *buf, unsigned int priority, unsigned int msize, const struct timespec *abs_timeout);
+int mq_receive(int fd, char *buf, unsigned int *priority, unsigned int msize);
+int mq_timedreceive(int fd, char *buf, unsigned int *priority, unsigned int msize, const struct timespec *abs_timeout);
+int mq_notify(int fd, const struct sigevent *sevp);
 
 #endif
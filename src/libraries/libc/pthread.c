@@ -0,0 +1,479 @@
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+#define FUTEX_REQUEUE 3
+#define FUTEX_PRIVATE_FLAG 128
+
+#define PTHREAD_EXITED 2
+
+// NOTE: MQ 2020-08-19
+// thread descriptor is at the top of thread's mmaped block and stack grows down below it
+// gs points to descriptor (set_thread_area/CLONE_SETTLS) -> pthread_self is a single load
+// locks only enter kernel (futex) when they are contended
+struct pthread
+{
+	struct pthread *self;
+	// cleared and woken up by kernel when thread exits
+	volatile pid_t tid;
+	volatile int detach_state;
+	void *(*start_routine)(void *);
+	void *arg;
+	void *result;
+	// 0 for main thread
+	void *map_base;
+	size_t map_size;
+};
+
+extern int __clone(int (*fn)(void *), void *stack, int flags, void *arg, pid_t *ptid, void *tls, pid_t *ctid);
+extern void __unmapself(void *addr, size_t len) __attribute__((noreturn));
+
+static struct pthread main_thread;
+
+_syscall5(futex, volatile int *, int, int, const struct timespec *, volatile int *);
+_syscall1(set_thread_area, void *);
+_syscall1(exit, int);
+
+static inline int atomic_cas(volatile int *p, int expected, int desired)
+{
+	__asm__ __volatile__("lock; cmpxchgl %2, %1"
+						 : "+a"(expected), "+m"(*p)
+						 : "r"(desired)
+						 : "memory");
+	return expected;
+}
+
+static inline int atomic_swap(volatile int *p, int v)
+{
+	__asm__ __volatile__("xchgl %0, %1"
+						 : "+r"(v), "+m"(*p)
+						 :
+						 : "memory");
+	return v;
+}
+
+static inline int atomic_fetch_add(volatile int *p, int v)
+{
+	__asm__ __volatile__("lock; xaddl %0, %1"
+						 : "+r"(v), "+m"(*p)
+						 :
+						 : "memory");
+	return v;
+}
+
+static int futex_wait(volatile int *addr, int val, const struct timespec *timeout)
+{
+	return syscall_futex(addr, FUTEX_WAIT | FUTEX_PRIVATE_FLAG, val, timeout, NULL);
+}
+
+static int futex_wake(volatile int *addr, int nr)
+{
+	return syscall_futex(addr, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, nr, NULL, NULL);
+}
+
+static int futex_requeue(volatile int *addr, int nr_wake, int nr_requeue, volatile int *addr2)
+{
+	return syscall_futex(addr, FUTEX_REQUEUE | FUTEX_PRIVATE_FLAG, nr_wake, (const struct timespec *)nr_requeue, addr2);
+}
+
+void _pthread_init()
+{
+	main_thread.self = &main_thread;
+	main_thread.tid = gettid();
+	syscall_set_thread_area(&main_thread);
+}
+
+pthread_t pthread_self()
+{
+	struct pthread *self;
+	__asm__("movl %%gs:0, %0"
+			: "=r"(self));
+	return self;
+}
+
+int pthread_equal(pthread_t t1, pthread_t t2)
+{
+	return t1 == t2;
+}
+
+int pthread_attr_init(pthread_attr_t *attr)
+{
+	attr->detach_state = PTHREAD_CREATE_JOINABLE;
+	attr->stack_size = PTHREAD_STACK_DEFAULT;
+	return 0;
+}
+
+int pthread_attr_destroy(pthread_attr_t *attr)
+{
+	return 0;
+}
+
+int pthread_attr_setdetachstate(pthread_attr_t *attr, int detach_state)
+{
+	if (detach_state != PTHREAD_CREATE_JOINABLE && detach_state != PTHREAD_CREATE_DETACHED)
+		return EINVAL;
+
+	attr->detach_state = detach_state;
+	return 0;
+}
+
+int pthread_attr_getdetachstate(const pthread_attr_t *attr, int *detach_state)
+{
+	*detach_state = attr->detach_state;
+	return 0;
+}
+
+int pthread_attr_setstacksize(pthread_attr_t *attr, size_t stack_size)
+{
+	if (stack_size < PTHREAD_STACK_MIN)
+		return EINVAL;
+
+	attr->stack_size = stack_size;
+	return 0;
+}
+
+int pthread_attr_getstacksize(const pthread_attr_t *attr, size_t *stack_size)
+{
+	*stack_size = attr->stack_size;
+	return 0;
+}
+
+static int pthread_start(void *arg)
+{
+	struct pthread *self = arg;
+	pthread_exit(self->start_routine(self->arg));
+}
+
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*start_routine)(void *), void *arg)
+{
+	size_t stack_size = attr ? attr->stack_size : PTHREAD_STACK_DEFAULT;
+	size_t map_size = (stack_size + sizeof(struct pthread) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+
+	char *map_base = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map_base == MAP_FAILED)
+		return EAGAIN;
+
+	struct pthread *th = (struct pthread *)((uint32_t)(map_base + map_size - sizeof(struct pthread)) & ~0xf);
+	memset(th, 0, sizeof(struct pthread));
+	th->self = th;
+	th->start_routine = start_routine;
+	th->arg = arg;
+	th->detach_state = attr ? attr->detach_state : PTHREAD_CREATE_JOINABLE;
+	th->map_base = map_base;
+	th->map_size = map_size;
+
+	// tid is set before child runs and cleared when it exits, join waits on it
+	int flags = CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | CLONE_THREAD | CLONE_SYSVSEM |
+				CLONE_SETTLS | CLONE_PARENT_SETTID | CLONE_CHILD_CLEARTID;
+	int ret = __clone(pthread_start, th, flags, th, (pid_t *)&th->tid, th, (pid_t *)&th->tid);
+	if (ret < 0)
+	{
+		munmap(map_base, map_size);
+		return -ret;
+	}
+
+	*thread = th;
+	return 0;
+}
+
+void pthread_exit(void *retval)
+{
+	struct pthread *self = pthread_self();
+	self->result = retval;
+
+	// nobody is going to join detached thread, it releases its own stack
+	if (atomic_cas(&self->detach_state, PTHREAD_CREATE_JOINABLE, PTHREAD_EXITED) == PTHREAD_CREATE_DETACHED && self->map_base)
+		__unmapself(self->map_base, self->map_size);
+
+	syscall_exit(0);
+	__builtin_unreachable();
+}
+
+int pthread_join(pthread_t thread, void **retval)
+{
+	if (thread == pthread_self())
+		return EDEADLK;
+	if (thread->detach_state == PTHREAD_CREATE_DETACHED)
+		return EINVAL;
+
+	pid_t tid;
+	while ((tid = thread->tid))
+		futex_wait(&thread->tid, tid, NULL);
+
+	if (retval)
+		*retval = thread->result;
+	if (thread->map_base)
+		munmap(thread->map_base, thread->map_size);
+	return 0;
+}
+
+int pthread_detach(pthread_t thread)
+{
+	int state = atomic_cas(&thread->detach_state, PTHREAD_CREATE_JOINABLE, PTHREAD_CREATE_DETACHED);
+	if (state == PTHREAD_CREATE_DETACHED)
+		return EINVAL;
+	// thread is already exiting, it won't release its stack
+	if (state == PTHREAD_EXITED)
+		return pthread_join(thread, NULL);
+	return 0;
+}
+
+int pthread_mutexattr_init(pthread_mutexattr_t *attr)
+{
+	attr->type = PTHREAD_MUTEX_DEFAULT;
+	return 0;
+}
+
+int pthread_mutexattr_destroy(pthread_mutexattr_t *attr)
+{
+	return 0;
+}
+
+int pthread_mutexattr_settype(pthread_mutexattr_t *attr, int type)
+{
+	if (type != PTHREAD_MUTEX_NORMAL && type != PTHREAD_MUTEX_RECURSIVE && type != PTHREAD_MUTEX_ERRORCHECK)
+		return EINVAL;
+
+	attr->type = type;
+	return 0;
+}
+
+int pthread_mutexattr_gettype(const pthread_mutexattr_t *attr, int *type)
+{
+	*type = attr->type;
+	return 0;
+}
+
+int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr)
+{
+	memset(mutex, 0, sizeof(pthread_mutex_t));
+	mutex->type = attr ? attr->type : PTHREAD_MUTEX_DEFAULT;
+	return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t *mutex)
+{
+	return mutex->lock ? EBUSY : 0;
+}
+
+// contended path, lock is marked as 2 so unlocker knows that it has to wake someone up
+static void mutex_lock_slow(pthread_mutex_t *mutex, int state)
+{
+	if (state != 2)
+		state = atomic_swap(&mutex->lock, 2);
+	while (state)
+	{
+		futex_wait(&mutex->lock, 2, NULL);
+		state = atomic_swap(&mutex->lock, 2);
+	}
+}
+
+static int mutex_owned(pthread_mutex_t *mutex)
+{
+	return mutex->type != PTHREAD_MUTEX_NORMAL && mutex->lock && mutex->owner == pthread_self()->tid;
+}
+
+static void mutex_acquired(pthread_mutex_t *mutex)
+{
+	if (mutex->type != PTHREAD_MUTEX_NORMAL)
+	{
+		mutex->owner = pthread_self()->tid;
+		mutex->count = 1;
+	}
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+	if (mutex_owned(mutex))
+	{
+		if (mutex->type == PTHREAD_MUTEX_ERRORCHECK)
+			return EDEADLK;
+		mutex->count++;
+		return 0;
+	}
+
+	int state = atomic_cas(&mutex->lock, 0, 1);
+	if (state)
+		mutex_lock_slow(mutex, state);
+
+	mutex_acquired(mutex);
+	return 0;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *mutex)
+{
+	if (mutex_owned(mutex))
+	{
+		if (mutex->type == PTHREAD_MUTEX_ERRORCHECK)
+			return EBUSY;
+		mutex->count++;
+		return 0;
+	}
+
+	if (atomic_cas(&mutex->lock, 0, 1))
+		return EBUSY;
+
+	mutex_acquired(mutex);
+	return 0;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *mutex)
+{
+	if (mutex->type != PTHREAD_MUTEX_NORMAL)
+	{
+		if (!mutex_owned(mutex))
+			return EPERM;
+		if (--mutex->count)
+			return 0;
+		mutex->owner = 0;
+	}
+
+	if (atomic_fetch_add(&mutex->lock, -1) != 1)
+	{
+		mutex->lock = 0;
+		futex_wake(&mutex->lock, 1);
+	}
+	return 0;
+}
+
+int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr)
+{
+	memset(cond, 0, sizeof(pthread_cond_t));
+	return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t *cond)
+{
+	return 0;
+}
+
+static int cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *timeout)
+{
+	int seq = cond->seq;
+	cond->mutex = mutex;
+
+	unsigned int count = mutex->count;
+	mutex->count = 1;
+	pthread_mutex_unlock(mutex);
+
+	int ret = futex_wait(&cond->seq, seq, timeout);
+
+	// broadcast might have requeued other waiters on mutex -> always take it as contended
+	mutex_lock_slow(mutex, 1);
+	mutex_acquired(mutex);
+	if (mutex->type != PTHREAD_MUTEX_NORMAL)
+		mutex->count = count;
+
+	return ret == -ETIMEDOUT ? ETIMEDOUT : 0;
+}
+
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+	return cond_wait(cond, mutex, NULL);
+}
+
+int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime)
+{
+	if (abstime->tv_nsec < 0 || abstime->tv_nsec >= 1000000000)
+		return EINVAL;
+
+	struct timespec now, timeout;
+	clock_gettime(CLOCK_REALTIME, &now);
+	timeout.tv_sec = abstime->tv_sec - now.tv_sec;
+	timeout.tv_nsec = abstime->tv_nsec - now.tv_nsec;
+	if (timeout.tv_nsec < 0)
+	{
+		timeout.tv_sec--;
+		timeout.tv_nsec += 1000000000;
+	}
+	if (timeout.tv_sec < 0)
+		return ETIMEDOUT;
+
+	return cond_wait(cond, mutex, &timeout);
+}
+
+int pthread_cond_signal(pthread_cond_t *cond)
+{
+	atomic_fetch_add(&cond->seq, 1);
+	futex_wake(&cond->seq, 1);
+	return 0;
+}
+
+// only one waiter is woken up, the rest is moved onto mutex and woken up one by one when it's unlocked
+int pthread_cond_broadcast(pthread_cond_t *cond)
+{
+	atomic_fetch_add(&cond->seq, 1);
+	if (cond->mutex)
+		futex_requeue(&cond->seq, 1, INT_MAX, &cond->mutex->lock);
+	else
+		futex_wake(&cond->seq, INT_MAX);
+	return 0;
+}
+
+int pthread_rwlock_init(pthread_rwlock_t *rwlock, const pthread_rwlockattr_t *attr)
+{
+	memset(rwlock, 0, sizeof(pthread_rwlock_t));
+	return 0;
+}
+
+int pthread_rwlock_destroy(pthread_rwlock_t *rwlock)
+{
+	return rwlock->lock ? EBUSY : 0;
+}
+
+int pthread_rwlock_tryrdlock(pthread_rwlock_t *rwlock)
+{
+	int state;
+	while ((state = rwlock->lock) >= 0)
+	{
+		if (atomic_cas(&rwlock->lock, state, state + 1) == state)
+			return 0;
+	}
+	return EBUSY;
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t *rwlock)
+{
+	while (pthread_rwlock_tryrdlock(rwlock))
+	{
+		atomic_fetch_add(&rwlock->waiters, 1);
+		futex_wait(&rwlock->lock, -1, NULL);
+		atomic_fetch_add(&rwlock->waiters, -1);
+	}
+	return 0;
+}
+
+int pthread_rwlock_trywrlock(pthread_rwlock_t *rwlock)
+{
+	return atomic_cas(&rwlock->lock, 0, -1) ? EBUSY : 0;
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t *rwlock)
+{
+	int state;
+	while ((state = atomic_cas(&rwlock->lock, 0, -1)))
+	{
+		atomic_fetch_add(&rwlock->waiters, 1);
+		futex_wait(&rwlock->lock, state, NULL);
+		atomic_fetch_add(&rwlock->waiters, -1);
+	}
+	return 0;
+}
+
+int pthread_rwlock_unlock(pthread_rwlock_t *rwlock)
+{
+	int state = rwlock->lock;
+	if (state == -1)
+		rwlock->lock = 0;
+	else if (atomic_fetch_add(&rwlock->lock, -1) != 1)
+		return 0;
+
+	if (rwlock->waiters)
+		futex_wake(&rwlock->lock, INT_MAX);
+	return 0;
+}
@@ -0,0 +1,126 @@
+#ifndef _LIBC_PTHREAD_H
+#define _LIBC_PTHREAD_H 1
+
+#include <limits.h>
+#include <sched.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+
+#define PTHREAD_CREATE_JOINABLE 0
+#define PTHREAD_CREATE_DETACHED 1
+
+#define PTHREAD_MUTEX_NORMAL 0
+#define PTHREAD_MUTEX_RECURSIVE 1
+#define PTHREAD_MUTEX_ERRORCHECK 2
+#define PTHREAD_MUTEX_DEFAULT PTHREAD_MUTEX_NORMAL
+
+#define PTHREAD_STACK_DEFAULT PTHREAD_STACK_MIN
+
+struct pthread;
+typedef struct pthread *pthread_t;
+
+typedef struct
+{
+	int detach_state;
+	size_t stack_size;
+} pthread_attr_t;
+
+typedef struct
+{
+	int type;
+} pthread_mutexattr_t;
+
+// lock: 0 unlocked, 1 locked, 2 locked and there might be waiters (unlock has to wake one up)
+typedef struct
+{
+	volatile int lock;
+	int type;
+	pid_t owner;
+	unsigned int count;
+} pthread_mutex_t;
+
+typedef struct
+{
+	int unused;
+} pthread_condattr_t;
+
+// seq is bumped by every signal/broadcast, waiters sleep on its value
+typedef struct
+{
+	volatile int seq;
+	pthread_mutex_t *mutex;
+} pthread_cond_t;
+
+typedef struct
+{
+	int unused;
+} pthread_rwlockattr_t;
+
+// lock: 0 free, n > 0 held by n readers, -1 held by writer
+typedef struct
+{
+	volatile int lock;
+	volatile int waiters;
+} pthread_rwlock_t;
+
+#define PTHREAD_MUTEX_INITIALIZER     \
+	{                                 \
+		.lock = 0,                    \
+		.type = PTHREAD_MUTEX_NORMAL, \
+	}
+#define PTHREAD_RECURSIVE_MUTEX_INITIALIZER \
+	{                                       \
+		.lock = 0,                          \
+		.type = PTHREAD_MUTEX_RECURSIVE,    \
+	}
+#define PTHREAD_COND_INITIALIZER \
+	{                            \
+		0                        \
+	}
+#define PTHREAD_RWLOCK_INITIALIZER \
+	{                              \
+		0                          \
+	}
+
+int pthread_attr_init(pthread_attr_t *attr);
+int pthread_attr_destroy(pthread_attr_t *attr);
+int pthread_attr_setdetachstate(pthread_attr_t *attr, int detach_state);
+int pthread_attr_getdetachstate(const pthread_attr_t *attr, int *detach_state);
+int pthread_attr_setstacksize(pthread_attr_t *attr, size_t stack_size);
+int pthread_attr_getstacksize(const pthread_attr_t *attr, size_t *stack_size);
+
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*start_routine)(void *), void *arg);
+int pthread_join(pthread_t thread, void **retval);
+int pthread_detach(pthread_t thread);
+void pthread_exit(void *retval) __attribute__((noreturn));
+pthread_t pthread_self();
+int pthread_equal(pthread_t t1, pthread_t t2);
+
+int pthread_mutexattr_init(pthread_mutexattr_t *attr);
+int pthread_mutexattr_destroy(pthread_mutexattr_t *attr);
+int pthread_mutexattr_settype(pthread_mutexattr_t *attr, int type);
+int pthread_mutexattr_gettype(const pthread_mutexattr_t *attr, int *type);
+
+int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr);
+int pthread_mutex_destroy(pthread_mutex_t *mutex);
+int pthread_mutex_lock(pthread_mutex_t *mutex);
+int pthread_mutex_trylock(pthread_mutex_t *mutex);
+int pthread_mutex_unlock(pthread_mutex_t *mutex);
+
+int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr);
+int pthread_cond_destroy(pthread_cond_t *cond);
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
+int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime);
+int pthread_cond_signal(pthread_cond_t *cond);
+int pthread_cond_broadcast(pthread_cond_t *cond);
+
+int pthread_rwlock_init(pthread_rwlock_t *rwlock, const pthread_rwlockattr_t *attr);
+int pthread_rwlock_destroy(pthread_rwlock_t *rwlock);
+int pthread_rwlock_rdlock(pthread_rwlock_t *rwlock);
+int pthread_rwlock_tryrdlock(pthread_rwlock_t *rwlock);
+int pthread_rwlock_wrlock(pthread_rwlock_t *rwlock);
+int pthread_rwlock_trywrlock(pthread_rwlock_t *rwlock);
+int pthread_rwlock_unlock(pthread_rwlock_t *rwlock);
+
+#endif
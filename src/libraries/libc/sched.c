@@ -0,0 +1,23 @@
+#include <errno.h>
+#include <sched.h>
+#include <stdarg.h>
+
+extern int __clone(int (*fn)(void *), void *stack, int flags, void *arg, pid_t *ptid, void *tls, pid_t *ctid);
+
+int clone(int (*fn)(void *), void *stack, int flags, void *arg, ...)
+{
+	va_list ap;
+	va_start(ap, arg);
+	pid_t *ptid = va_arg(ap, pid_t *);
+	void *tls = va_arg(ap, void *);
+	pid_t *ctid = va_arg(ap, pid_t *);
+	va_end(ap);
+
+	if (!fn || !stack)
+		return errno = EINVAL, -1;
+
+	int ret = __clone(fn, stack, flags, arg, ptid, tls, ctid);
+	if (ret < 0)
+		return errno = -ret, -1;
+	return ret;
+}
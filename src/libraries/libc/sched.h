@@ -0,0 +1,25 @@
+#ifndef _LIBC_SCHED_H
+#define _LIBC_SCHED_H 1
+
+#include <sys/types.h>
+
+/*
+ * cloning flags:
+ */
+#define CSIGNAL 0x000000ff				/* signal mask to be sent at exit */
+#define CLONE_VM 0x00000100				/* set if VM shared between processes */
+#define CLONE_FS 0x00000200				/* set if fs info shared between processes */
+#define CLONE_FILES 0x00000400			/* set if open files shared between processes */
+#define CLONE_SIGHAND 0x00000800		/* set if signal handlers and blocked signals shared */
+#define CLONE_THREAD 0x00010000			/* Same thread group? */
+#define CLONE_SYSVSEM 0x00040000		/* share system V SEM_UNDO semantics */
+#define CLONE_SETTLS 0x00080000			/* create a new TLS for the child */
+#define CLONE_PARENT_SETTID 0x00100000	/* set the TID in the parent */
+#define CLONE_CHILD_CLEARTID 0x00200000 /* clear the TID in the child */
+#define CLONE_CHILD_SETTID 0x01000000	/* set the TID in the child */
+
+// child runs fn(arg) on stack and exits (only the thread) with its result
+// optional arguments: pid_t *ptid, void *tls (base address of tls block), pid_t *ctid
+int clone(int (*fn)(void *), void *stack, int flags, void *arg, ...);
+
+#endif
@@ -77,6 +77,25 @@ struct sigaction
 	sigset_t sa_mask;
 };
 
+#define SIGEV_SIGNAL 0 /* notify via signal */
+#define SIGEV_NONE 1   /* other notification: meaningless */
+#define SIGEV_THREAD 2 /* deliver via thread creation (not supported) */
+
+union sigval
+{
+	int sival_int;
+	void *sival_ptr;
+};
+
+struct sigevent
+{
+	int sigev_notify;
+	int sigev_signo;
+	union sigval sigev_value;
+	void (*sigev_notify_function)(union sigval);
+	void *sigev_notify_attributes;
+};
+
 int kill(pid_t pid, int sig);
 int raise(int32_t sig);
 int sigaction(int signum, const struct sigaction *act, struct sigaction *oldact);
@@ -2,6 +2,43 @@
 #define _LIBC_SOCKIOS_H 1
 
 #define SIOCGIFDNSADDR 0x8900
+#define SIOCGIFSKBSTATS 0x8901 /* get sk_buff pool stats (struct ifskbstats via ifr_data) */
+#define SIOCGIFSTATS 0x8902	   /* get device counters (struct net_device_stats via ifr_data) */
+
+#include <stdint.h>
+
+struct skb_pool_stats
+{
+	uint32_t capacity;
+	uint32_t in_use;
+	uint32_t peak;
+	uint32_t allocs;
+	uint32_t misses;
+};
+
+struct ifskbstats
+{
+	struct skb_pool_stats rx;
+	struct skb_pool_stats tx;
+	struct skb_pool_stats head;
+};
+
+struct net_device_stats
+{
+	uint32_t rx_packets;
+	uint32_t tx_packets;
+	uint32_t rx_bytes;
+	uint32_t tx_bytes;
+	uint32_t rx_errors;
+	uint32_t tx_errors;
+	uint32_t rx_dropped;
+	uint32_t tx_dropped;
+	uint32_t rx_over_errors;
+	uint32_t rx_missed_errors;
+	uint32_t tx_busy;
+	uint32_t irqs;
+	uint32_t polls;
+};
 
 /* Socket configuration controls. */
 #define SIOCGIFNAME 0x8910	  /* get iface name		*/
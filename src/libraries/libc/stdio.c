@@ -3,6 +3,7 @@
 #include <fcntl.h>
 #include <libc-pointer-arith.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,8 +11,11 @@
 #include <unistd.h>
 
 #define MAX_BUF_LEN 4096
+// bytes are reserved before get area so ungetc never has to move the buffer
+#define PUTBACK_SIZE 8
 
 struct list_head lstream;
+static pthread_mutex_t lstream_lock = PTHREAD_MUTEX_INITIALIZER;
 
 FILE *stdin, *stdout, *stderr;
 
@@ -31,8 +35,8 @@ bool valid_stream(FILE *stream)
 
 void assert_stream(FILE *stream)
 {
-	assert(stream->_IO_read_base <= stream->_IO_read_ptr && stream->_IO_read_ptr <= stream->_IO_read_end + 1);
-	assert(stream->_IO_write_base <= stream->_IO_write_ptr && stream->_IO_write_ptr <= stream->_IO_write_end + 1);
+	assert(stream->_IO_read_base <= stream->_IO_read_ptr && stream->_IO_read_ptr <= stream->_IO_read_end);
+	assert(stream->_IO_write_base <= stream->_IO_write_ptr && stream->_IO_write_ptr <= stream->_IO_buf_end);
 }
 
 FILE *fopen(const char *filename, const char *mode)
@@ -73,8 +77,9 @@ FILE *fdopen(int fd, const char *mode)
 {
 	FILE *stream = calloc(1, sizeof(FILE));
 	stream->fd = fd;
-	stream->bkup_chr = -1;
+	pthread_mutex_lock(&lstream_lock);
 	list_add_tail(&stream->sibling, &lstream);
+	pthread_mutex_unlock(&lstream_lock);
 
 	fchange_mode(stream, mode);
 
@@ -83,13 +88,13 @@ FILE *fdopen(int fd, const char *mode)
 	fstat(fd, &stat);
 
 	if (S_ISREG(stat.st_mode))
-		stream->_flags |= _IO_FULLY_BUF;
+		stream->_flags |= _IO_FULLY_BUF | _IO_IS_FILEBUF;
 	else if (isatty(fd))
 		stream->_flags |= _IO_LINE_BUF;
 	else
 		stream->_flags |= _IO_UNBUFFERED;
 
-	stream->blksize = stat.st_blksize;
+	stream->blksize = max(stat.st_blksize, BUFSIZ);
 	return stream;
 }
 
@@ -135,89 +140,319 @@ int fileno(FILE *stream)
 
 void clearerr(FILE *stream)
 {
-	stream->_flags &= ~(_IO_ERR_SEEN || _IO_EOF_SEEN);
+	stream->_flags &= ~(_IO_ERR_SEEN | _IO_EOF_SEEN);
 }
 
-static size_t fnget(void *ptr, size_t size, FILE *stream)
+static int stream_buffer(FILE *stream)
 {
-	assert_stream(stream);
+	if (stream->_IO_buf_base)
+		return 0;
 
-	if (stream->_IO_read_ptr + size > stream->_IO_read_end || !stream->_IO_read_end)
+	char *buf = malloc(stream->blksize + PUTBACK_SIZE);
+	if (!buf)
 	{
-		if (stream->_flags & _IO_EOF_SEEN)
-			return EOF;
+		stream->_flags |= _IO_ERR_SEEN;
+		return EOF;
+	}
 
-		int count = (stream->_flags & _IO_FULLY_BUF || stream->_flags & _IO_LINE_BUF)
-						? ALIGN_UP(stream->_offset + size, max(stream->blksize, 1)) - stream->_offset
-						: size;
-		char *buf = calloc(count, sizeof(char));
+	stream->_IO_buf_base = buf;
+	stream->_IO_buf_end = buf + stream->blksize + PUTBACK_SIZE;
+	return 0;
+}
 
-		count = read(stream->fd, buf, count);
-		// end of file
-		if (!count)
+static int write_all(FILE *stream, const char *s, size_t size)
+{
+	while (size)
+	{
+		int count = write(stream->fd, s, size);
+		if (count <= 0)
 		{
-			stream->_flags |= _IO_EOF_SEEN;
-			free(buf);
+			stream->_flags |= _IO_ERR_SEEN;
 			return EOF;
 		}
 
-		free(stream->_IO_read_base);
-		stream->_IO_read_base = stream->_IO_read_ptr = buf;
-		stream->_IO_read_end = buf + count;
+		s += count;
+		size -= count;
+		stream->_offset += count;
 	}
+	return 0;
+}
 
-	memcpy(ptr, stream->_IO_read_ptr, size);
-	stream->_offset += size;
-	stream->_IO_read_ptr += size;
-	return size;
+// write out put area but keep it active
+static int flush_write(FILE *stream)
+{
+	int unwritten_len = stream->_IO_write_ptr - stream->_IO_write_base;
+	if (!unwritten_len)
+		return 0;
+
+	stream->_IO_write_ptr = stream->_IO_write_base;
+	return write_all(stream, stream->_IO_write_base, unwritten_len);
+}
+
+// drop read-ahead, for seekable streams fd's offset is moved back to the logical position
+static void drop_read(FILE *stream)
+{
+	int unread_len = stream->_IO_read_end - stream->_IO_read_ptr;
+	if (unread_len && stream->_flags & _IO_IS_FILEBUF)
+		stream->_offset = lseek(stream->fd, stream->_offset - unread_len, SEEK_SET);
+
+	stream->_IO_read_base = stream->_IO_read_ptr = stream->_IO_read_end = NULL;
+}
+
+static int switch_to_get(FILE *stream)
+{
+	if (stream->_flags & _IO_NO_READS)
+	{
+		stream->_flags |= _IO_ERR_SEEN;
+		return errno = EBADF, EOF;
+	}
+
+	if (stream->_IO_write_base)
+	{
+		if (flush_write(stream) == EOF)
+			return EOF;
+		stream->_IO_write_base = stream->_IO_write_ptr = stream->_IO_write_end = NULL;
+	}
+
+	if (!stream->_IO_read_base)
+	{
+		if (stream_buffer(stream) == EOF)
+			return EOF;
+		stream->_IO_read_base = stream->_IO_read_ptr = stream->_IO_read_end = stream->_IO_buf_base + PUTBACK_SIZE;
+	}
+	return 0;
+}
+
+static int switch_to_put(FILE *stream)
+{
+	if (stream->_flags & _IO_NO_WRITES)
+	{
+		stream->_flags |= _IO_ERR_SEEN;
+		return errno = EBADF, EOF;
+	}
+
+	if (stream->_IO_write_base)
+		return 0;
+
+	if (stream->_IO_read_base)
+		drop_read(stream);
+
+	if (stream_buffer(stream) == EOF)
+		return EOF;
+
+	stream->_IO_write_base = stream->_IO_write_ptr = stream->_IO_buf_base + PUTBACK_SIZE;
+	// NOTE: MQ 2020-08-10 putc_unlocked only fills put area up to write_end, unbuffered streams always take slow path
+	stream->_IO_write_end = stream->_flags & _IO_UNBUFFERED ? stream->_IO_write_base : stream->_IO_buf_end;
+	return 0;
+}
+
+// refill get area, returns number of bytes are read (0 on end of file or error)
+int __underflow(FILE *stream)
+{
+	if (switch_to_get(stream) == EOF)
+		return 0;
+
+	if (stream->_IO_read_ptr < stream->_IO_read_end)
+		return stream->_IO_read_end - stream->_IO_read_ptr;
+
+	if (stream->_flags & _IO_EOF_SEEN)
+		return 0;
+
+	// reading from an interactive stream, prompts should be visible
+	if (stream->_flags & (_IO_LINE_BUF | _IO_UNBUFFERED) && stdout && stdout->_IO_write_base)
+		flush_write(stdout);
+
+	int count = 1;
+	if (stream->_flags & _IO_FULLY_BUF)
+		count = stream->blksize - stream->_offset % stream->blksize;
+	else if (stream->_flags & _IO_LINE_BUF)
+		count = stream->blksize;
+
+	char *buf = stream->_IO_buf_base + PUTBACK_SIZE;
+	count = read(stream->fd, buf, count);
+	if (count <= 0)
+	{
+		stream->_flags |= count ? _IO_ERR_SEEN : _IO_EOF_SEEN;
+		return 0;
+	}
+
+	stream->_offset += count;
+	stream->_IO_read_base = stream->_IO_read_ptr = buf;
+	stream->_IO_read_end = buf + count;
+	return count;
+}
+
+int __uflow(FILE *stream)
+{
+	if (!__underflow(stream))
+		return EOF;
+	return (unsigned char)*stream->_IO_read_ptr++;
+}
+
+static size_t fnget(char *ptr, size_t size, FILE *stream)
+{
+	if (switch_to_get(stream) == EOF)
+		return 0;
+
+	size_t copied = 0;
+	while (copied < size)
+	{
+		size_t available = stream->_IO_read_end - stream->_IO_read_ptr;
+		if (available)
+		{
+			size_t count = min(available, size - copied);
+			memcpy(ptr + copied, stream->_IO_read_ptr, count);
+			stream->_IO_read_ptr += count;
+			copied += count;
+			continue;
+		}
+
+		if (stream->_flags & _IO_EOF_SEEN)
+			break;
+
+		// NOTE: MQ 2020-08-10 large reads go directly into caller's buffer
+		size_t remaining = size - copied;
+		if (remaining >= (size_t)stream->blksize || stream->_flags & _IO_UNBUFFERED)
+		{
+			int count = read(stream->fd, ptr + copied, remaining);
+			if (count <= 0)
+			{
+				stream->_flags |= count ? _IO_ERR_SEEN : _IO_EOF_SEEN;
+				break;
+			}
+			stream->_offset += count;
+			copied += count;
+		}
+		else if (!__underflow(stream))
+			break;
+	}
+	return copied;
 }
 
 int fgetc(FILE *stream)
 {
-	char ch;
-	int ret = fnget(&ch, 1, stream);
-	return ret == EOF ? ret : (unsigned char)ch;
+	flockfile(stream);
+	int ch = getc_unlocked(stream);
+	funlockfile(stream);
+	return ch;
 }
 
 char *fgets(char *s, int n, FILE *stream)
 {
-	int i;
-	for (i = 0; i < n; ++i)
-	{
-		int ch = fgetc(stream);
+	if (n <= 0)
+		return NULL;
 
-		if (ch == '\n')
+	flockfile(stream);
+
+	char *p = s;
+	int remaining = n - 1;
+	while (remaining > 0)
+	{
+		int available = stream->_IO_read_end - stream->_IO_read_ptr;
+		if (!available && !(available = __underflow(stream)))
 			break;
-		if (ch == EOF)
-			return NULL;
 
-		s[i] = ch;
+		int count = min(available, remaining);
+		char *newline = memchr(stream->_IO_read_ptr, '\n', count);
+		if (newline)
+			count = newline - stream->_IO_read_ptr + 1;
+
+		memcpy(p, stream->_IO_read_ptr, count);
+		stream->_IO_read_ptr += count;
+		p += count;
+		remaining -= count;
+
+		if (newline)
+			break;
 	}
 
-	s[i] = 0;
+	funlockfile(stream);
+
+	if (p == s)
+		return NULL;
+
+	*p = 0;
 	return s;
 }
 
-size_t fread(void *ptr, size_t size, size_t nitems, FILE *stream)
+ssize_t getdelim(char **lineptr, size_t *n, int delim, FILE *stream)
 {
-	size_t i;
-	for (i = 0; i < nitems; ++i)
+	if (!lineptr || !n)
+		return errno = EINVAL, -1;
+	if (!*lineptr)
+		*n = 0;
+
+	flockfile(stream);
+
+	size_t len = 0;
+	while (true)
 	{
-		int count = fnget((char *)ptr + i * size, size, stream);
-		if (count == EOF)
-			return i;
+		size_t available = stream->_IO_read_end - stream->_IO_read_ptr;
+		if (!available && !(available = __underflow(stream)))
+			break;
+
+		char *end = memchr(stream->_IO_read_ptr, delim, available);
+		size_t count = end ? (size_t)(end - stream->_IO_read_ptr + 1) : available;
+
+		if (!*lineptr || len + count + 1 > *n)
+		{
+			size_t new_size = max(max(*n * 2, len + count + 1), (size_t)128);
+			char *buf = realloc(*lineptr, new_size);
+			if (!buf)
+			{
+				stream->_flags |= _IO_ERR_SEEN;
+				funlockfile(stream);
+				return errno = ENOMEM, -1;
+			}
+			*lineptr = buf;
+			*n = new_size;
+		}
+
+		memcpy(*lineptr + len, stream->_IO_read_ptr, count);
+		stream->_IO_read_ptr += count;
+		len += count;
+
+		if (end)
+			break;
 	}
-	return i;
+
+	funlockfile(stream);
+
+	if (!len)
+		return -1;
+
+	(*lineptr)[len] = 0;
+	return len;
+}
+
+ssize_t getline(char **lineptr, size_t *n, FILE *stream)
+{
+	return getdelim(lineptr, n, '\n', stream);
+}
+
+size_t fread(void *ptr, size_t size, size_t nitems, FILE *stream)
+{
+	size_t total = size * nitems;
+	if (!total)
+		return 0;
+
+	flockfile(stream);
+	size_t count = fnget(ptr, total, stream);
+	funlockfile(stream);
+
+	return count / size;
 }
 
 long int ftell(FILE *stream)
 {
-	return stream->_offset;
+	if (stream->_IO_write_base)
+		return stream->_offset + (stream->_IO_write_ptr - stream->_IO_write_base);
+	return stream->_offset - (stream->_IO_read_end - stream->_IO_read_ptr);
 }
 
 off_t ftello(FILE *stream)
 {
-	return stream->_offset;
+	return ftell(stream);
 }
 
 int getchar()
@@ -227,26 +462,16 @@ int getchar()
 
 int ungetc(int c, FILE *stream)
 {
-	assert_stream(stream);
-
-	if (c == EOF || stream->bkup_chr != -1)
+	if (c == EOF || switch_to_get(stream) == EOF)
 		return EOF;
 
-	if (stream->_IO_read_ptr == stream->_IO_read_base)
-	{
-		int size = stream->_IO_read_end - stream->_IO_read_base + 2;
-		char *buf = calloc(size, sizeof(char));
+	if (stream->_IO_read_ptr == stream->_IO_buf_base)
+		return EOF;
 
-		memcpy(buf + 1, stream->_IO_read_base, size - 1);
-		free(stream->_IO_read_base);
+	*--stream->_IO_read_ptr = (unsigned char)c;
+	if (stream->_IO_read_ptr < stream->_IO_read_base)
+		stream->_IO_read_base = stream->_IO_read_ptr;
 
-		stream->_IO_read_base = buf;
-		stream->_IO_read_ptr = buf + 1;
-		stream->_IO_read_end = buf + size;
-	}
-	stream->_offset--;
-	stream->bkup_chr = *stream->_IO_read_ptr--;
-	*stream->_IO_read_ptr = (unsigned char)c;
 	stream->_flags &= ~_IO_EOF_SEEN;
 	return (unsigned char)c;
 }
@@ -261,22 +486,25 @@ int fseek(FILE *stream, long int off, int whence)
 {
 	assert_stream(stream);
 
-	fflush(stream);
-
-	struct stat stat = {0};
-	fstat(stream->fd, &stat);
+	if (stream->_IO_write_base && flush_write(stream) == EOF)
+		return -1;
 
 	loff_t offset = off;
 	if (whence == SEEK_CUR)
-		offset = stream->_offset + off;
+		offset = ftell(stream) + off;
 	else if (whence == SEEK_END)
+	{
+		struct stat stat = {0};
+		fstat(stream->fd, &stat);
 		offset = stat.st_size + off;
-	stream->_offset = offset;
-	lseek(stream->fd, offset, SEEK_SET);
+	}
 
-	free(stream->_IO_read_base);
-	stream->_IO_read_base = stream->_IO_read_end = stream->_IO_read_ptr = NULL;
-	stream->bkup_chr = -1;
+	if (lseek(stream->fd, offset, SEEK_SET) < 0)
+		return -1;
+
+	stream->_offset = offset;
+	stream->_IO_read_base = stream->_IO_read_ptr = stream->_IO_read_end = NULL;
+	stream->_IO_write_base = stream->_IO_write_ptr = stream->_IO_write_end = NULL;
 
 	stream->_flags &= ~_IO_EOF_SEEN;
 	return 0;
@@ -287,38 +515,52 @@ int fseeko(FILE *stream, off_t offset, int whence)
 	return fseek(stream, offset, whence);
 }
 
-#define MIN_WRITE_BUF_LEN 32
-
-static int fnput(const char *s, int size, FILE *stream)
+// returns number of bytes are accepted, unbuffered streams are written out by caller via put_done
+static size_t fnput(const char *s, size_t size, FILE *stream)
 {
-	assert_stream(stream);
-
-	int remaining_len = stream->_IO_write_end - stream->_IO_write_ptr;
-	int current_len = stream->_IO_write_end - stream->_IO_write_base;
+	if (switch_to_put(stream) == EOF)
+		return 0;
 
-	if (remaining_len < size)
+	size_t capacity = stream->_IO_buf_end - stream->_IO_write_base;
+	if (size > (size_t)(stream->_IO_buf_end - stream->_IO_write_ptr))
 	{
-		int new_len = max(max(size, current_len * 2), MIN_WRITE_BUF_LEN);
-		char *buf = calloc(new_len, sizeof(char));
-
-		memcpy(buf, stream->_IO_write_base, current_len);
-		free(stream->_IO_write_base);
+		if (flush_write(stream) == EOF)
+			return 0;
 
-		stream->_IO_write_base = buf;
-		stream->_IO_write_ptr = buf + current_len - remaining_len;
-		stream->_IO_write_end = buf + new_len;
+		// NOTE: MQ 2020-08-10 large writes go directly from caller's buffer
+		if (size >= capacity)
+			return write_all(stream, s, size) == EOF ? 0 : size;
 	}
+
 	memcpy(stream->_IO_write_ptr, s, size);
 	stream->_IO_write_ptr += size;
-	stream->_offset += size;
+
+	if (stream->_flags & _IO_LINE_BUF && memchr(s, '\n', size) && flush_write(stream) == EOF)
+		return 0;
 	return size;
 }
 
+static int put_done(FILE *stream)
+{
+	if (stream->_flags & _IO_UNBUFFERED && stream->_IO_write_base)
+		return flush_write(stream);
+	return 0;
+}
+
+int __overflow(FILE *stream, int c)
+{
+	char ch = c;
+	if (!fnput(&ch, 1, stream) || put_done(stream) == EOF)
+		return EOF;
+	return (unsigned char)c;
+}
+
 int fputc(int c, FILE *stream)
 {
-	char ch = (unsigned char)c;
-	fnput(&ch, 1, stream);
-	return ch;
+	flockfile(stream);
+	int ret = putc_unlocked(c, stream);
+	funlockfile(stream);
+	return ret;
 }
 
 int putchar(int c)
@@ -328,28 +570,36 @@ int putchar(int c)
 
 int fputs(const char *s, FILE *stream)
 {
-	assert_stream(stream);
+	size_t slen = strlen(s);
+
+	flockfile(stream);
+	size_t count = fnput(s, slen, stream);
+	int ret = count < slen || put_done(stream) == EOF ? EOF : (int)count;
+	funlockfile(stream);
 
-	int slen = strlen(s);
-	return fnput(s, slen, stream);
+	return ret;
 }
 
 int puts(const char *s)
 {
-	fputs(s, stdout);
+	if (fputs(s, stdout) == EOF)
+		return EOF;
 	return fputc('\n', stdout);
 }
 
 size_t fwrite(const void *ptr, size_t size, size_t nitems, FILE *stream)
 {
-	int i;
-	for (i = 0; i < nitems; ++i)
-	{
-		if (fnput((char *)ptr + i * size, size, stream) == EOF)
-			break;
-	}
+	size_t total = size * nitems;
+	if (!total)
+		return 0;
 
-	return i * size;
+	flockfile(stream);
+	size_t count = fnput(ptr, total, stream);
+	if (put_done(stream) == EOF)
+		count = 0;
+	funlockfile(stream);
+
+	return count / size;
 }
 
 int fflush(FILE *stream)
@@ -357,11 +607,13 @@ int fflush(FILE *stream)
 	if (!stream)
 	{
 		FILE *iter;
+		pthread_mutex_lock(&lstream_lock);
 		list_for_each_entry(iter, &lstream, sibling)
 		{
-			if (!(iter->_flags & _IO_NO_WRITES))
+			if (!(iter->_flags & _IO_NO_WRITES) && valid_stream(iter))
 				fflush(iter);
 		}
+		pthread_mutex_unlock(&lstream_lock);
 		return 0;
 	}
 
@@ -369,15 +621,10 @@ int fflush(FILE *stream)
 	if (!valid_stream(stream))
 		return -EBADF;
 
-	int unwritten_len = stream->_IO_write_ptr - stream->_IO_write_base;
-
-	if (!unwritten_len)
-		return 0;
-
-	write(stream->fd, stream->_IO_write_base, unwritten_len);
-	free(stream->_IO_write_base);
-
-	stream->_IO_write_base = stream->_IO_write_ptr = stream->_IO_write_end = NULL;
+	if (stream->_IO_write_base)
+		return flush_write(stream);
+	if (stream->_IO_read_base && stream->_flags & _IO_IS_FILEBUF)
+		drop_read(stream);
 	return 0;
 }
 
@@ -388,8 +635,11 @@ int fclose(FILE *stream)
 		return -EBADF;
 
 	fflush(stream);
-	free(stream->_IO_read_base);
+	if (!(stream->_flags & _IO_USER_BUF))
+		free(stream->_IO_buf_base);
+	stream->_IO_buf_base = stream->_IO_buf_end = NULL;
 	stream->_IO_read_base = stream->_IO_read_ptr = stream->_IO_read_end = NULL;
+	stream->_IO_write_base = stream->_IO_write_ptr = stream->_IO_write_end = NULL;
 
 	close(stream->fd);
 	stream->fd = -1;
@@ -399,29 +649,31 @@ int fclose(FILE *stream)
 
 int fgetpos(FILE *stream, fpos_t *pos)
 {
-	*pos = stream->_offset;
+	*pos = ftell(stream);
 	return 0;
 }
 
 int fsetpos(FILE *stream, const fpos_t *pos)
 {
-	fflush(stream);
-
-	stream->_offset = *pos;
-	stream->_flags &= ~_IO_EOF_SEEN;
-
-	if (stream->bkup_chr == -1)
-		*stream->_IO_write_ptr++ = stream->bkup_chr;
+	return fseek(stream, *pos, SEEK_SET);
+}
 
-	return 0;
+static size_t vfprintf_callback(void *ctx, const char *s, size_t len)
+{
+	return fnput(s, len, (FILE *)ctx);
 }
 
 int vfprintf(FILE *stream, const char *fmt, va_list args)
 {
-	char text[MAX_BUF_LEN] = {0};
-	vsprintf(text, fmt, args);
+	flockfile(stream);
+
+	// NOTE: MQ 2020-08-10 conversions are formatted straight into stream's buffer, unbuffered streams are written once per call
+	int ret = vcbprintf(stream, vfprintf_callback, fmt, args);
+	if (put_done(stream) == EOF)
+		ret = -1;
 
-	return fputs(text, stream);
+	funlockfile(stream);
+	return ret;
 }
 
 int vprintf(const char *fmt, va_list args)
@@ -495,6 +747,10 @@ int setvbuf(FILE *stream, char *buf, int mode, size_t size)
 {
 	assert_stream(stream);
 
+	fflush(stream);
+	stream->_IO_read_base = stream->_IO_read_ptr = stream->_IO_read_end = NULL;
+	stream->_IO_write_base = stream->_IO_write_ptr = stream->_IO_write_end = NULL;
+
 	if (mode == _IOFBF)
 	{
 		stream->_flags &= ~(_IO_LINE_BUF | _IO_UNBUFFERED);
@@ -511,7 +767,16 @@ int setvbuf(FILE *stream, char *buf, int mode, size_t size)
 		stream->_flags |= _IO_UNBUFFERED;
 	}
 
-	// TODO: MQ 2020-10-26 Implement customized stream buffer
+	if (buf && size > PUTBACK_SIZE)
+	{
+		if (!(stream->_flags & _IO_USER_BUF))
+			free(stream->_IO_buf_base);
+
+		stream->_flags |= _IO_USER_BUF;
+		stream->_IO_buf_base = buf;
+		stream->_IO_buf_end = buf + size;
+		stream->blksize = size - PUTBACK_SIZE;
+	}
 	return 0;
 }
 
@@ -520,14 +785,64 @@ void setbuf(FILE *stream, char *buf)
 	setvbuf(stream, buf, buf ? _IOFBF : _IONBF, BUFSIZ);
 }
 
+// NOTE: MQ 2020-08-10
+// Stream lock is an owner + nesting count on top of a normal pthread mutex (futex when it's contended)
+// owner is the thread descriptor, reading it is a single load through gs
+static inline int file_lock_self()
+{
+	return (int)pthread_self();
+}
+
+static inline void file_lock_acquire(FILE *fp)
+{
+	pthread_mutex_lock(&fp->_lock);
+}
+
+static inline bool file_lock_try(FILE *fp)
+{
+	return !pthread_mutex_trylock(&fp->_lock);
+}
+
+static inline void file_lock_release(FILE *fp)
+{
+	pthread_mutex_unlock(&fp->_lock);
+}
+
 void flockfile(FILE *fp)
 {
-	assert_not_implemented();
+	int self = file_lock_self();
+
+	if (fp->_lock_owner != self)
+	{
+		file_lock_acquire(fp);
+		fp->_lock_owner = self;
+	}
+	fp->_lock_count++;
+}
+
+int ftrylockfile(FILE *fp)
+{
+	int self = file_lock_self();
+
+	if (fp->_lock_owner != self)
+	{
+		if (!file_lock_try(fp))
+			return -1;
+		fp->_lock_owner = self;
+	}
+	fp->_lock_count++;
+	return 0;
 }
 
 void funlockfile(FILE *fp)
 {
-	assert_not_implemented();
+	assert(fp->_lock_owner == file_lock_self() && fp->_lock_count > 0);
+
+	if (--fp->_lock_count == 0)
+	{
+		fp->_lock_owner = 0;
+		file_lock_release(fp);
+	}
 }
 
 _syscall2(rename, const char *, const char *);
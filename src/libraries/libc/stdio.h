@@ -61,11 +61,12 @@ int fileno(FILE *stream);
 void clearerr(FILE *stream);
 int fgetc(FILE *stream);
 char *fgets(char *s, int n, FILE *stream);
+ssize_t getdelim(char **lineptr, size_t *n, int delim, FILE *stream);
+ssize_t getline(char **lineptr, size_t *n, FILE *stream);
 size_t fread(void *ptr, size_t size, size_t nitems, FILE *stream);
 long int ftell(FILE *stream);
 off_t ftello(FILE *stream);
 void rewind(FILE *stream);
-#define getc(stream) fgetc(stream)
 int getchar();
 int ungetc(int c, FILE *stream);
 int fseek(FILE *stream, long int offset, int whence);
@@ -77,7 +78,6 @@ int fflush(FILE *stream);
 int fclose(FILE *stream);
 int fgetpos(FILE *stream, fpos_t *pos);
 int fsetpos(FILE *stream, const fpos_t *pos);
-#define putc(c, stream) fputc(c, stream)
 int putchar(int c);
 int fprintf(FILE *stream, const char *format, ...);
 int printf(const char *format, ...);
@@ -115,6 +115,34 @@ int vcbscanf(void *fp,
 			 va_list ap);
 
 void flockfile(FILE *fp);
+int ftrylockfile(FILE *fp);
 void funlockfile(FILE *fp);
 
+// slow paths of getc_unlocked/putc_unlocked
+int __underflow(FILE *stream);
+int __uflow(FILE *stream);
+int __overflow(FILE *stream, int c);
+
+// NOTE: MQ 2020-08-10
+// getc/putc take the stream lock (they are functions), *_unlocked variants work directly on stream's buffer
+// and only call into libc when get area is empty, put area is full or a newline is written to line buffered stream
+#define getc_unlocked(stream) ({                                               \
+	FILE *__stream = (stream);                                                 \
+	__stream->_IO_read_ptr < __stream->_IO_read_end                            \
+		? (unsigned char)*__stream->_IO_read_ptr++                             \
+		: __uflow(__stream);                                                   \
+})
+#define putc_unlocked(c, stream) ({                                            \
+	FILE *__stream = (stream);                                                 \
+	unsigned char __ch = (c);                                                  \
+	__stream->_IO_write_ptr < __stream->_IO_write_end &&                       \
+			(__ch != '\n' || !(__stream->_flags & _IO_LINE_BUF))                \
+		? (*__stream->_IO_write_ptr++ = __ch)                                  \
+		: __overflow(__stream, __ch);                                          \
+})
+#define getc(stream) fgetc(stream)
+#define putc(c, stream) fputc(c, stream)
+#define getchar_unlocked() getc_unlocked(stdin)
+#define putchar_unlocked(c) putc_unlocked(c, stdout)
+
 #endif
@@ -1,152 +1,591 @@
 #include <assert.h>
 #include <errno.h>
 #include <libc-pointer-arith.h>
+#include <limits.h>
+#include <malloc.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
-#define BLOCK_MAGIC 0x464E
-#define UPPER_LIMIT 0x2000000
+// NOTE: MQ 2020-08-09
+// Boundary-tag allocator
+// chunk = [prev_size][size | flags][payload ...]
+// - prev_size is only valid when the previous chunk is free (it is the footer of that chunk)
+// - free chunks reuse their payload for bin links
+// - small chunks are cached per size class first (they stay "in use" so malloc/free are a push/pop)
+// - other free chunks are coalesced with their neighbours and kept in bins (exact size below SMALLBIN_LIMIT, power of two above)
+// - the last chunk (top) grows with sbrk and is trimmed with negative sbrk
+// - large requests are served by mmap directly
+#define SIZE_SZ (sizeof(size_t))
+#define MALLOC_ALIGNMENT (2 * SIZE_SZ)
+#define CHUNK_OVERHEAD (2 * SIZE_SZ)
+#define MIN_CHUNK_SIZE (4 * SIZE_SZ)
 
-static uint32_t user_remaining_from_last_used = 0;
-static uint32_t user_heap_current = 0;
+#define PREV_INUSE 0x1
+#define IS_MMAPPED 0x2
+#define SIZE_BITS (PREV_INUSE | IS_MMAPPED)
 
-struct block_meta
+#define HEAP_GROW_SIZE 0x10000
+#define TRIM_THRESHOLD 0x20000
+#define MMAP_THRESHOLD 0x20000
+
+#define NSMALLBINS 64
+#define SMALLBIN_LIMIT (NSMALLBINS * MALLOC_ALIGNMENT)
+#define NBINS 96
+#define BINMAP_SIZE (NBINS / 32)
+
+#define TCACHE_BINS 32
+#define TCACHE_MAX_SIZE ((TCACHE_BINS - 1) * MALLOC_ALIGNMENT)
+#define TCACHE_FILL_COUNT 16
+
+struct malloc_chunk
 {
+	size_t prev_size;
 	size_t size;
-	struct block_meta *next;
-	bool free;
-	uint32_t magic;
+	// only used when chunk is free
+	struct malloc_chunk *fd;
+	struct malloc_chunk *bk;
 };
 
-static struct block_meta *blocklist = NULL;
+static struct malloc_state
+{
+	char *heap_start;
+	char *heap_end;
+	struct malloc_chunk *top;
+
+	struct malloc_chunk *bins[NBINS];
+	uint32_t binmap[BINMAP_SIZE];
+
+	struct malloc_chunk *tcache[TCACHE_BINS];
+	uint32_t tcache_count[TCACHE_BINS];
+
+	size_t arena;
+	size_t binned_chunks, binned_bytes;
+	size_t cached_chunks, cached_bytes;
+	size_t mmapped_chunks, mmapped_bytes;
+} ms;
+
+#ifdef TEST
+// NOTE: MQ 2020-08-09 host tests run against a static arena instead of the break of the test runner
+#define TEST_ARENA_SIZE 0x2000000
+
+static char test_arena[TEST_ARENA_SIZE] __attribute__((aligned(PAGE_SIZE)));
+static size_t test_brk;
+
+static void *heap_sbrk(intptr_t increment)
+{
+	if ((increment > 0 && test_brk + increment > TEST_ARENA_SIZE) ||
+		(increment < 0 && test_brk < (size_t)-increment))
+		return (void *)-1;
+
+	char *brk = test_arena + test_brk;
+	test_brk += increment;
+	return brk;
+}
+
+static void malloc_lock()
+{
+}
+
+static void malloc_unlock()
+{
+}
+#else
+static void *heap_sbrk(intptr_t increment)
+{
+	return (void *)sbrk(increment);
+}
+
+// NOTE: MQ 2020-08-19
+// one lock for the whole state, it's a normal pthread mutex (a single atomic op when uncontended, futex otherwise)
+// public functions take it and call int_* ones, which never call back into the public ones
+static pthread_mutex_t malloc_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void malloc_lock()
+{
+	pthread_mutex_lock(&malloc_mutex);
+}
+
+static void malloc_unlock()
+{
+	pthread_mutex_unlock(&malloc_mutex);
+}
+#endif
+
+static inline void *chunk2mem(struct malloc_chunk *c)
+{
+	return (char *)c + CHUNK_OVERHEAD;
+}
+
+static inline struct malloc_chunk *mem2chunk(void *mem)
+{
+	return (struct malloc_chunk *)((char *)mem - CHUNK_OVERHEAD);
+}
+
+static inline size_t chunksize(struct malloc_chunk *c)
+{
+	return c->size & ~SIZE_BITS;
+}
+
+static inline struct malloc_chunk *chunk_at(struct malloc_chunk *c, size_t offset)
+{
+	return (struct malloc_chunk *)((char *)c + offset);
+}
+
+static inline struct malloc_chunk *prev_chunk(struct malloc_chunk *c)
+{
+	return (struct malloc_chunk *)((char *)c - c->prev_size);
+}
+
+static inline bool prev_inuse(struct malloc_chunk *c)
+{
+	return c->size & PREV_INUSE;
+}
+
+static inline bool chunk_inuse(struct malloc_chunk *c)
+{
+	return prev_inuse(chunk_at(c, chunksize(c)));
+}
+
+static inline void set_foot(struct malloc_chunk *c, size_t size)
+{
+	struct malloc_chunk *next = chunk_at(c, size);
+	next->prev_size = size;
+	next->size &= ~PREV_INUSE;
+}
+
+static bool request2size(size_t request, size_t *nb)
+{
+	if (request > (size_t)-1 - CHUNK_OVERHEAD - MALLOC_ALIGNMENT)
+		return false;
+
+	*nb = ALIGN_UP(request + CHUNK_OVERHEAD, MALLOC_ALIGNMENT);
+	if (*nb < MIN_CHUNK_SIZE)
+		*nb = MIN_CHUNK_SIZE;
+	return true;
+}
 
-void assert_block_valid(struct block_meta *block, bool throw)
+static inline uint32_t fls(size_t size)
 {
-	if (block->magic != BLOCK_MAGIC)
+	return sizeof(unsigned long) * 8 - 1 - __builtin_clzl(size);
+}
+
+static inline uint32_t bin_index(size_t size)
+{
+	if (size < SMALLBIN_LIMIT)
+		return size / MALLOC_ALIGNMENT;
+
+	uint32_t index = NSMALLBINS + fls(size) - fls(SMALLBIN_LIMIT);
+	return index < NBINS ? index : NBINS - 1;
+}
+
+static inline uint32_t tcache_index(size_t size)
+{
+	return size / MALLOC_ALIGNMENT;
+}
+
+static void insert_chunk(struct malloc_chunk *c)
+{
+	uint32_t index = bin_index(chunksize(c));
+
+	c->bk = NULL;
+	c->fd = ms.bins[index];
+	if (c->fd)
+		c->fd->bk = c;
+	ms.bins[index] = c;
+	ms.binmap[index / 32] |= 1u << (index % 32);
+
+	ms.binned_chunks++;
+	ms.binned_bytes += chunksize(c);
+}
+
+static void unlink_chunk(struct malloc_chunk *c)
+{
+	uint32_t index = bin_index(chunksize(c));
+
+	if (c->bk)
+		c->bk->fd = c->fd;
+	else
+		ms.bins[index] = c->fd;
+	if (c->fd)
+		c->fd->bk = c->bk;
+	if (!ms.bins[index])
+		ms.binmap[index / 32] &= ~(1u << (index % 32));
+
+	ms.binned_chunks--;
+	ms.binned_bytes -= chunksize(c);
+}
+
+// next non-empty bin which is greater than index
+static int32_t next_bin(uint32_t index)
+{
+	for (uint32_t i = (index + 1) / 32, bit = (index + 1) % 32; i < BINMAP_SIZE; ++i, bit = 0)
+	{
+		uint32_t map = ms.binmap[i] & ~((1u << bit) - 1);
+		if (map)
+			return i * 32 + __builtin_ctz(map);
+	}
+	return -1;
+}
+
+static int heap_trim(size_t pad)
+{
+	size_t top_size = chunksize(ms.top);
+	if (top_size < pad + MIN_CHUNK_SIZE + PAGE_SIZE)
+		return 0;
+
+	// someone else has moved the break, our top is not at the end anymore
+	if (heap_sbrk(0) != ms.heap_end)
+		return 0;
+
+	size_t extra = ALIGN_DOWN(top_size - pad - MIN_CHUNK_SIZE, PAGE_SIZE);
+	if (heap_sbrk(-(intptr_t)extra) == (void *)-1)
+		return 0;
+
+	ms.heap_end -= extra;
+	ms.arena -= extra;
+	ms.top->size -= extra;
+	return 1;
+}
+
+static void free_chunk(struct malloc_chunk *c)
+{
+	size_t size = chunksize(c);
+
+	if (!prev_inuse(c))
+	{
+		struct malloc_chunk *prev = prev_chunk(c);
+		size += chunksize(prev);
+		unlink_chunk(prev);
+		c = prev;
+	}
+
+	struct malloc_chunk *next = chunk_at(c, size);
+	if (next == ms.top)
 	{
-		if (throw)
-			assert_not_reached();
-		else
-			dlog("0x%x is not allocated by malloc", block + 1);
+		c->size = (size + chunksize(next)) | PREV_INUSE;
+		ms.top = c;
+		if (chunksize(c) >= TRIM_THRESHOLD)
+			heap_trim(HEAP_GROW_SIZE);
+		return;
 	}
-	else if (block->size > UPPER_LIMIT)
+
+	if (!chunk_inuse(next))
 	{
-		if (throw)
-			assert_not_reached();
-		else
-			dlog("0x%x is larger than 0x%x", block + 1, UPPER_LIMIT);
+		size += chunksize(next);
+		unlink_chunk(next);
 	}
+
+	c->size = size | PREV_INUSE;
+	set_foot(c, size);
+	insert_chunk(c);
 }
 
-struct block_meta *find_free_block(struct block_meta **last, size_t size)
+// the old top cannot grow anymore, it is closed by two in-use fenceposts and the rest goes to bins
+static void fence_top()
 {
-	uint32_t bcount = 0;
-	struct block_meta *current = (struct block_meta *)blocklist;
-	while (current && !(current->free && current->size >= size))
+	struct malloc_chunk *top = ms.top;
+	size_t top_size = chunksize(top);
+	size_t rest = top_size - MIN_CHUNK_SIZE;
+	struct malloc_chunk *fence;
+
+	if (rest >= MIN_CHUNK_SIZE)
 	{
-		bcount++;
-		*last = current;
-		current = current->next;
-		if (current)
-			assert_block_valid(current, true);
+		top->size = rest | PREV_INUSE;
+		fence = chunk_at(top, rest);
+		fence->size = CHUNK_OVERHEAD | PREV_INUSE;
 	}
-	return current;
+	else
+	{
+		fence = top;
+		fence->size = (top_size - CHUNK_OVERHEAD) | PREV_INUSE;
+	}
+	chunk_at(fence, chunksize(fence))->size = CHUNK_OVERHEAD | PREV_INUSE;
+
+	if (fence != top)
+		free_chunk(top);
 }
 
-void split_block(struct block_meta *block, size_t size)
+static bool heap_grow(size_t nb)
 {
-	if (block->size > size + sizeof(struct block_meta))
-	{
-		struct block_meta *splited_block = (struct block_meta *)((char *)block + size + sizeof(struct block_meta));
-		splited_block->free = true;
-		splited_block->magic = BLOCK_MAGIC;
-		splited_block->size = block->size - size - sizeof(struct block_meta);
-		splited_block->next = block->next;
+	bool contiguous = ms.top && heap_sbrk(0) == ms.heap_end;
+	size_t need = nb + MIN_CHUNK_SIZE + (contiguous ? 0 : MALLOC_ALIGNMENT);
+	if (contiguous)
+		need = need > chunksize(ms.top) ? need - chunksize(ms.top) : 0;
+	size_t grow = ALIGN_UP(need, HEAP_GROW_SIZE);
+
+	char *brk = heap_sbrk(grow);
+	if (brk == (void *)-1 || !brk)
+		return false;
 
-		block->size = size;
-		block->next = splited_block;
+	ms.arena += grow;
+	if (brk == ms.heap_end)
+	{
+		ms.heap_end += grow;
+		ms.top->size += grow;
+		return true;
 	}
+
+	if (ms.top)
+		fence_top();
+	else
+		ms.heap_start = brk;
+
+	struct malloc_chunk *top = (struct malloc_chunk *)PTR_ALIGN_UP(brk, MALLOC_ALIGNMENT);
+	ms.heap_end = brk + grow;
+	ms.top = top;
+	top->size = (ms.heap_end - (char *)top) | PREV_INUSE;
+	return true;
 }
 
-void *get_heap(uint32_t size)
+static struct malloc_chunk *top_alloc(size_t nb)
 {
-	if (!user_heap_current)
-		user_heap_current = sbrk(0);
+	if ((!ms.top || chunksize(ms.top) < nb + MIN_CHUNK_SIZE) && !heap_grow(nb))
+		return NULL;
+
+	struct malloc_chunk *c = ms.top;
+	size_t top_size = chunksize(c);
 
-	uint32_t heap_base = user_heap_current;
-	if (size <= user_remaining_from_last_used)
-		user_remaining_from_last_used -= size;
+	ms.top = chunk_at(c, nb);
+	ms.top->size = (top_size - nb) | PREV_INUSE;
+	c->size = nb | PREV_INUSE;
+	return c;
+}
+
+// cut chunk down to nb, the remainder is freed (and merged with the next chunk if possible)
+static void shrink_chunk(struct malloc_chunk *c, size_t nb)
+{
+	size_t size = chunksize(c);
+	if (size - nb < MIN_CHUNK_SIZE)
+		return;
+
+	struct malloc_chunk *remainder = chunk_at(c, nb);
+	remainder->size = (size - nb) | PREV_INUSE;
+	c->size = nb | (c->size & PREV_INUSE);
+	free_chunk(remainder);
+}
+
+static struct malloc_chunk *bin_alloc(size_t nb)
+{
+	uint32_t index = bin_index(nb);
+	struct malloc_chunk *c = NULL;
+
+	if (index < NSMALLBINS)
+		c = ms.bins[index];
 	else
 	{
-		sbrk(size);
-		user_remaining_from_last_used = sbrk(0) - (user_heap_current + size);
+		// best fit in the same range
+		for (struct malloc_chunk *iter = ms.bins[index]; iter; iter = iter->fd)
+			if (chunksize(iter) >= nb && (!c || chunksize(iter) < chunksize(c)))
+				c = iter;
 	}
 
-	user_heap_current += size;
-	return (void *)heap_base;
+	if (!c)
+	{
+		int32_t next = next_bin(index);
+		if (next < 0)
+			return NULL;
+		c = ms.bins[next];
+	}
+
+	unlink_chunk(c);
+
+	size_t size = chunksize(c);
+	if (size - nb >= MIN_CHUNK_SIZE)
+	{
+		struct malloc_chunk *remainder = chunk_at(c, nb);
+		remainder->size = (size - nb) | PREV_INUSE;
+		set_foot(remainder, size - nb);
+		insert_chunk(remainder);
+		c->size = nb | PREV_INUSE;
+	}
+	else
+		chunk_at(c, size)->size |= PREV_INUSE;
+
+	return c;
 }
 
-struct block_meta *request_space(struct block_meta *last, size_t size)
+static struct malloc_chunk *mmap_alloc(size_t nb)
 {
-	struct block_meta *block = get_heap(size + sizeof(struct block_meta));
+	size_t len = ALIGN_UP(nb, PAGE_SIZE);
+	char *addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED || !addr)
+		return NULL;
 
-	if (last)
-		last->next = block;
+	struct malloc_chunk *c = (struct malloc_chunk *)addr;
+	c->prev_size = 0;
+	c->size = len | IS_MMAPPED;
 
-	block->size = size;
-	block->next = NULL;
-	block->free = false;
-	block->magic = BLOCK_MAGIC;
-	return block;
+	ms.mmapped_chunks++;
+	ms.mmapped_bytes += len;
+	return c;
 }
 
-void *malloc(size_t size)
+static bool chunk_valid(struct malloc_chunk *c)
 {
-	if (size <= 0)
-		return NULL;
+	if ((uintptr_t)chunk2mem(c) & (MALLOC_ALIGNMENT - 1))
+		return false;
+	if (c->size & IS_MMAPPED)
+		return !((uintptr_t)c & (PAGE_SIZE - 1)) && chunksize(c) >= PAGE_SIZE;
 
-	struct block_meta *block, *last;
+	size_t size = chunksize(c);
+	return (char *)c >= ms.heap_start && (char *)c + size <= ms.heap_end &&
+		   size >= MIN_CHUNK_SIZE && c != ms.top && chunk_inuse(c);
+}
 
-	size = ALIGN_UP(size, 4);
+// NOTE: MQ 2020-08-09 calloc must not call malloc + memset, gcc folds it back into a call to calloc
+static void *int_malloc(size_t size)
+{
+	size_t nb;
+	if (!request2size(size, &nb))
+		return errno = ENOMEM, (void *)NULL;
 
-	if (blocklist)
+	if (nb <= TCACHE_MAX_SIZE)
 	{
-		block = find_free_block(&last, size);
-		if (block)
+		uint32_t index = tcache_index(nb);
+		struct malloc_chunk *c = ms.tcache[index];
+		if (c)
 		{
-			block->free = false;
-			split_block(block, size);
+			ms.tcache[index] = c->fd;
+			ms.tcache_count[index]--;
+			ms.cached_chunks--;
+			ms.cached_bytes -= nb;
+			return chunk2mem(c);
 		}
-		else
-			block = request_space(last, size);
 	}
-	else
+
+	struct malloc_chunk *c = NULL;
+	if (nb >= MMAP_THRESHOLD)
+		c = mmap_alloc(nb);
+	if (!c)
+		c = bin_alloc(nb);
+	if (!c)
+		c = top_alloc(nb);
+
+	if (!c)
+		return errno = ENOMEM, (void *)NULL;
+	return chunk2mem(c);
+}
+
+static void int_free(void *ptr)
+{
+
+	struct malloc_chunk *c = mem2chunk(ptr);
+	if (!chunk_valid(c))
 	{
-		block = request_space(NULL, size);
-		blocklist = block;
+		dlog("0x%x is not allocated by malloc", ptr);
+		return;
 	}
 
-	assert_block_valid(block, true);
+	size_t size = chunksize(c);
+	if (c->size & IS_MMAPPED)
+	{
+		ms.mmapped_chunks--;
+		ms.mmapped_bytes -= size;
+		munmap(c, size);
+		return;
+	}
 
-	if (block)
-		return block + 1;
+	if (size <= TCACHE_MAX_SIZE)
+	{
+		uint32_t index = tcache_index(size);
+		if (ms.tcache_count[index] < TCACHE_FILL_COUNT)
+		{
+			c->fd = ms.tcache[index];
+			ms.tcache[index] = c;
+			ms.tcache_count[index]++;
+			ms.cached_chunks++;
+			ms.cached_bytes += size;
+			return;
+		}
+	}
+
+	free_chunk(c);
+}
+
+static void *int_realloc(void *ptr, size_t size)
+{
+	size_t nb;
+	if (!request2size(size, &nb))
+		return errno = ENOMEM, (void *)NULL;
+
+	struct malloc_chunk *c = mem2chunk(ptr);
+	if (!chunk_valid(c))
+	{
+		dlog("0x%x is not allocated by malloc", ptr);
+		return errno = EINVAL, (void *)NULL;
+	}
+
+	size_t old_size = chunksize(c);
+	if (c->size & IS_MMAPPED)
+	{
+		if (nb <= old_size && nb >= MMAP_THRESHOLD)
+			return ptr;
+	}
+	else if (nb <= old_size)
+	{
+		shrink_chunk(c, nb);
+		return ptr;
+	}
 	else
+	{
+		struct malloc_chunk *next = chunk_at(c, old_size);
+		if (next == ms.top && old_size + chunksize(next) < nb + MIN_CHUNK_SIZE)
+			heap_grow(nb - old_size);
+
+		if (next == ms.top && old_size + chunksize(next) >= nb + MIN_CHUNK_SIZE)
+		{
+			size_t top_size = old_size + chunksize(next);
+			c->size = nb | (c->size & PREV_INUSE);
+			ms.top = chunk_at(c, nb);
+			ms.top->size = (top_size - nb) | PREV_INUSE;
+			return ptr;
+		}
+
+		if (next != ms.top && !chunk_inuse(next) && old_size + chunksize(next) >= nb)
+		{
+			unlink_chunk(next);
+			c->size = (old_size + chunksize(next)) | (c->size & PREV_INUSE);
+			chunk_at(c, chunksize(c))->size |= PREV_INUSE;
+			shrink_chunk(c, nb);
+			return ptr;
+		}
+	}
+
+	void *new_ptr = int_malloc(size);
+	if (!new_ptr)
 		return NULL;
+
+	memcpy(new_ptr, ptr, old_size - CHUNK_OVERHEAD < size ? old_size - CHUNK_OVERHEAD : size);
+	int_free(ptr);
+	return new_ptr;
 }
 
-void *calloc(size_t n, size_t size)
+void *malloc(size_t size)
 {
-	void *block = malloc(n * size);
-	if (block)
-		memset(block, 0, n * size);
-	return block;
+	malloc_lock();
+	void *ptr = int_malloc(size);
+	malloc_unlock();
+	return ptr;
 }
 
-struct block_meta *get_block_ptr(void *ptr)
+void *calloc(size_t n, size_t size)
 {
-	return ((struct block_meta *)ptr) - 1;
+	if (size && n > (size_t)-1 / size)
+		return errno = ENOMEM, (void *)NULL;
+
+	malloc_lock();
+	void *ptr = int_malloc(n * size);
+	malloc_unlock();
+
+	// mmapped chunks come from fresh anonymous pages which are already zeroed
+	if (ptr && !(mem2chunk(ptr)->size & IS_MMAPPED))
+		memset(ptr, 0, n * size);
+	return ptr;
 }
 
 void free(void *ptr)
@@ -154,24 +593,25 @@ void free(void *ptr)
 	if (!ptr)
 		return;
 
-	struct block_meta *block = get_block_ptr(ptr);
-	assert_block_valid(block, false);
-	block->free = true;
+	malloc_lock();
+	int_free(ptr);
+	malloc_unlock();
 }
 
 void *realloc(void *ptr, size_t size)
 {
-	if (!ptr && size == 0)
+	if (!ptr)
+		return malloc(size);
+	if (!size)
 	{
 		free(ptr);
 		return NULL;
 	}
-	else if (!ptr)
-		return calloc(size, sizeof(char));
 
-	void *newptr = calloc(size, sizeof(char));
-	memcpy(newptr, ptr, size);
-	return newptr;
+	malloc_lock();
+	void *new_ptr = int_realloc(ptr, size);
+	malloc_unlock();
+	return new_ptr;
 }
 
 void *reallocarray(void *ptr, size_t nmemb, size_t size)
@@ -180,3 +620,54 @@ void *reallocarray(void *ptr, size_t nmemb, size_t size)
 		return errno = ENOMEM, (void *)NULL;
 	return realloc(ptr, nmemb * size);
 }
+
+size_t malloc_usable_size(void *ptr)
+{
+	if (!ptr)
+		return 0;
+
+	return chunksize(mem2chunk(ptr)) - CHUNK_OVERHEAD;
+}
+
+int malloc_trim(size_t pad)
+{
+	malloc_lock();
+
+	// cached chunks are given back to bins so they can be merged into top
+	for (uint32_t i = 0; i < TCACHE_BINS; ++i)
+		while (ms.tcache[i])
+		{
+			struct malloc_chunk *c = ms.tcache[i];
+			ms.tcache[i] = c->fd;
+			ms.tcache_count[i]--;
+			ms.cached_chunks--;
+			ms.cached_bytes -= chunksize(c);
+			free_chunk(c);
+		}
+
+	int ret = ms.top ? heap_trim(pad) : 0;
+
+	malloc_unlock();
+	return ret;
+}
+
+struct mallinfo mallinfo()
+{
+	malloc_lock();
+
+	size_t top_size = ms.top ? chunksize(ms.top) : 0;
+	struct mallinfo info = {
+		.arena = ms.arena,
+		.ordblks = ms.binned_chunks,
+		.smblks = ms.cached_chunks,
+		.hblks = ms.mmapped_chunks,
+		.hblkhd = ms.mmapped_bytes,
+		.fsmblks = ms.cached_bytes,
+		.uordblks = ms.arena - ms.binned_bytes - ms.cached_bytes - top_size,
+		.fordblks = ms.binned_bytes,
+		.keepcost = top_size,
+	};
+
+	malloc_unlock();
+	return info;
+}
@@ -0,0 +1,21 @@
+#include <errno.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+_syscall1(epoll_create, int);
+int epoll_create(int size)
+{
+	SYSCALL_RETURN_ORIGINAL(syscall_epoll_create(size));
+}
+
+_syscall4(epoll_ctl, int, int, int, struct epoll_event *);
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+	SYSCALL_RETURN(syscall_epoll_ctl(epfd, op, fd, event));
+}
+
+_syscall4(epoll_wait, int, struct epoll_event *, int, int);
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+	SYSCALL_RETURN_ORIGINAL(syscall_epoll_wait(epfd, events, maxevents, timeout));
+}
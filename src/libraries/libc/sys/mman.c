@@ -21,3 +21,15 @@ int munmap(void *addr, size_t len)
 {
 	SYSCALL_RETURN(syscall_munmap(addr, len));
 }
+
+_syscall3(mprotect, void *, size_t, int);
+int mprotect(void *addr, size_t len, int prot)
+{
+	SYSCALL_RETURN(syscall_mprotect(addr, len, prot));
+}
+
+_syscall4(mremap, void *, size_t, size_t, int);
+void *mremap(void *old_address, size_t old_size, size_t new_size, int flags)
+{
+	SYSCALL_RETURN_POINTER(syscall_mremap(old_address, old_size, new_size, flags));
+}
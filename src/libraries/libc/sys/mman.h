@@ -20,6 +20,8 @@
 
 #define MAP_FAILED ((void *)-1)
 
+#define MREMAP_MAYMOVE 1
+
 struct mmap_args
 {
 	void *addr;
@@ -32,5 +34,7 @@ struct mmap_args
 
 void *mmap(void *addr, size_t len, int prot, int flags, int fildes, off_t off);
 int munmap(void *addr, size_t len);
+int mprotect(void *addr, size_t len, int prot);
+void *mremap(void *old_address, size_t old_size, size_t new_size, int flags);
 
 #endif
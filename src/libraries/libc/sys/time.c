@@ -1,9 +1,12 @@
 #include <errno.h>
 #include <sys/time.h>
+#include <sys/vdso.h>
 #include <unistd.h>
 
 _syscall2(gettimeofday, struct timeval *restrict, void *restrict);
 int gettimeofday(struct timeval *restrict tv, void *restrict buf)
 {
+	if (__vdso)
+		SYSCALL_RETURN(vdso_call(gettimeofday, tv, buf));
 	SYSCALL_RETURN(syscall_gettimeofday(tv, buf));
 }
@@ -0,0 +1,14 @@
+#include <sys/vdso.h>
+#include <unistd.h>
+
+struct vdso_header *__vdso;
+
+void _vdso_init()
+{
+	struct vdso_header *header = (struct vdso_header *)VDSO_TEXT;
+	if (header->magic != VDSO_MAGIC)
+		return;
+
+	__vdso = header;
+	__syscall_entry = header->syscall;
+}
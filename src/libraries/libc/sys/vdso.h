@@ -0,0 +1,26 @@
+#ifndef _LIBC_SYS_VDSO_H
+#define _LIBC_SYS_VDSO_H 1
+
+#include <stdint.h>
+
+// keep in sync with kernel/proc/vdso.h
+#define VDSO_TEXT 0xBFFFD000
+#define VDSO_MAGIC 0x4F53444D
+
+struct vdso_header
+{
+	uint32_t magic;
+	uint32_t syscall;
+	uint32_t clock_gettime;
+	uint32_t gettimeofday;
+	uint32_t time;
+	uint32_t getpid;
+};
+
+extern struct vdso_header *__vdso;
+
+#define vdso_call(name, ...) (((__typeof__(name) *)__vdso->name)(__VA_ARGS__))
+
+void _vdso_init();
+
+#endif
@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <sys/vdso.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -11,6 +12,8 @@ char *tzname[2];
 _syscall1(time, time_t *);
 time_t time(time_t *tloc)
 {
+	if (__vdso)
+		return vdso_call(time, tloc);
 	SYSCALL_RETURN_ORIGINAL(syscall_time(tloc));
 }
 
@@ -23,6 +26,8 @@ int nanosleep(const struct timespec *req, struct timespec *rem)
 _syscall2(clock_gettime, clockid_t, struct timespec *);
 int clock_gettime(clockid_t clk_id, struct timespec *tp)
 {
+	if (__vdso)
+		SYSCALL_RETURN(vdso_call(clock_gettime, clk_id, tp));
 	SYSCALL_RETURN(syscall_clock_gettime(clk_id, tp));
 }
 
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/vdso.h>
 #include <termio.h>
 #include <time.h>
 #include <unistd.h>
@@ -61,9 +62,17 @@ int getpgrp()
 _syscall0(getpid);
 int getpid()
 {
+	if (__vdso)
+		return vdso_call(getpid);
 	SYSCALL_RETURN_ORIGINAL(syscall_getpid());
 }
 
+_syscall0(gettid);
+pid_t gettid()
+{
+	return syscall_gettid();
+}
+
 _syscall0(getuid);
 int getuid()
 {
@@ -148,6 +157,24 @@ int ftruncate(int fd, off_t length)
 	SYSCALL_RETURN(syscall_ftruncate(fd, length));
 }
 
+_syscall0(sync);
+void sync()
+{
+	syscall_sync();
+}
+
+_syscall1(fsync, int);
+int fsync(int fd)
+{
+	SYSCALL_RETURN(syscall_fsync(fd));
+}
+
+_syscall1(fdatasync, int);
+int fdatasync(int fd)
+{
+	SYSCALL_RETURN(syscall_fdatasync(fd));
+}
+
 _syscall2(truncate, const char *, off_t);
 int truncate(const char *name, off_t length)
 {
@@ -336,6 +363,12 @@ int close(int fd)
 	SYSCALL_RETURN(syscall_close(fd));
 }
 
+_syscall3(close_range, unsigned int, unsigned int, int);
+int close_range(unsigned int first, unsigned int last, int flags)
+{
+	SYSCALL_RETURN(syscall_close_range(first, last, flags));
+}
+
 _syscall3(write, int, const char *, size_t);
 int write(int fd, const char *buf, size_t size)
 {
@@ -348,10 +381,11 @@ int read(int fd, char *buf, size_t size)
 	SYSCALL_RETURN_ORIGINAL(syscall_read(fd, buf, size));
 }
 
-_syscall1(exit, int);
+// exit syscall only ends the calling thread, the whole process is ended by exit_group
+_syscall1(exit_group, int);
 void __attribute__((noreturn)) _exit(int code)
 {
-	syscall_exit(code);
+	syscall_exit_group(code);
 	__builtin_unreachable();
 }
 
@@ -419,18 +453,6 @@ char *getcwd(char *buf, size_t size)
 	SYSCALL_RETURN_POINTER(syscall_getcwd(buf, size));
 }
 
-int fsync(int fd)
-{
-	assert_not_reached();
-	__builtin_unreachable();
-}
-
-int fdatasync(int fd)
-{
-	assert_not_reached();
-	__builtin_unreachable();
-}
-
 int link(const char *path1, const char *path2)
 {
 	assert_not_reached();
@@ -132,6 +132,7 @@
 #define __NR_getuid 24
 #define __NR_alarm 27
 #define __NR_access 33
+#define __NR_sync 36
 #define __NR_kill 37
 #define __NR_rename 38
 #define __NR_mkdir 39
@@ -170,21 +171,34 @@
 #define __NR_listen 105
 #define __NR_stat 106
 #define __NR_fstat 108
+#define __NR_fsync 118
+#define __NR_clone 120
 #define __NR_uname 122
+#define __NR_mprotect 125
 #define __NR_sigprocmask 126
 #define __NR_fchdir 133
 #define __NR_getpgid 132
 #define __NR_getdents 141
 #define __NR_getsid 147
+#define __NR_fdatasync 148
 #define __NR_nanosleep 162
+#define __NR_mremap 163
 #define __NR_poll 168
 #define __NR_getcwd 183
+#define __NR_gettid 224
+#define __NR_futex 240
+#define __NR_set_thread_area 243
+#define __NR_exit_group 252
+#define __NR_epoll_create 254
+#define __NR_epoll_ctl 255
+#define __NR_epoll_wait 256
 #define __NR_clock_gettime 265
 #define __NR_mq_open 277
 #define __NR_mq_close (__NR_mq_open + 1)
 #define __NR_mq_unlink (__NR_mq_open + 2)
-#define __NR_mq_send (__NR_mq_open + 3)
-#define __NR_mq_receive (__NR_mq_open + 4)
+#define __NR_mq_timedsend (__NR_mq_open + 3)
+#define __NR_mq_timedreceive (__NR_mq_open + 4)
+#define __NR_mq_notify (__NR_mq_open + 5)
 #define __NR_waitid 284
 #define __NR_mkdirat 296
 #define __NR_mknodat 297
@@ -194,25 +208,39 @@
 #define __NR_sendto 369
 // TODO: MQ 2020-09-05 Use ioctl-FIODGNAME to get pts name
 #define __NR_getptsname 370
+#define __NR_close_range 436
 // TODO: MQ 2020-09-16 Replace by writting to /dev/ttyS0
 #define __NR_dprintf 512
 #define __NR_dprintln 513
 #define __NR_posix_spawn 514
 
-#define _syscall0(name)                           \
-	static inline int32_t syscall_##name()        \
-	{                                             \
-		int32_t ret;                              \
-		__asm__ __volatile__("int $0x7F"          \
-							 : "=a"(ret)          \
-							 : "0"(__NR_##name)); \
-		return ret;                               \
+// NOTE: MQ 2020-08-11
+// system calls go through __syscall_entry, it is `int 0x7F` stub and replaced by vdso's one (sysenter) at startup
+extern uintptr_t __syscall_entry;
+
+// NOTE: MQ 2020-08-16
+// position independent code (libc.so) cannot refer to __syscall_entry by its absolute address
+// it calls __syscall_pic which loads the entry via GOT, ebx is already taken by the first argument
+#ifdef __PIC__
+#define __SYSCALL_CALL "call __syscall_pic"
+#else
+#define __SYSCALL_CALL "call *__syscall_entry"
+#endif
+
+#define _syscall0(name)                              \
+	static inline int32_t syscall_##name()           \
+	{                                                \
+		int32_t ret;                                 \
+		__asm__ __volatile__(__SYSCALL_CALL          \
+							 : "=a"(ret)             \
+							 : "0"(__NR_##name));    \
+		return ret;                                  \
 	}
 #define _syscall1(name, type1)                               \
 	static inline int32_t syscall_##name(type1 arg1)         \
 	{                                                        \
 		int32_t ret;                                         \
-		__asm__ __volatile__("int $0x7F"                     \
+		__asm__ __volatile__(__SYSCALL_CALL                  \
 							 : "=a"(ret)                     \
 							 : "0"(__NR_##name), "b"(arg1)); \
 		return ret;                                          \
@@ -222,7 +250,7 @@
 	static inline int32_t syscall_##name(type1 arg1, type2 arg2)        \
 	{                                                                   \
 		int32_t ret;                                                    \
-		__asm__ __volatile__("int $0x7F"                                \
+		__asm__ __volatile__(__SYSCALL_CALL                             \
 							 : "=a"(ret)                                \
 							 : "0"(__NR_##name), "b"(arg1), "c"(arg2)); \
 		return ret;                                                     \
@@ -232,7 +260,7 @@
 	static inline int32_t syscall_##name(type1 arg1, type2 arg2, type3 arg3)       \
 	{                                                                              \
 		int32_t ret;                                                               \
-		__asm__ __volatile__("int $0x7F"                                           \
+		__asm__ __volatile__(__SYSCALL_CALL                                        \
 							 : "=a"(ret)                                           \
 							 : "0"(__NR_##name), "b"(arg1), "c"(arg2), "d"(arg3)); \
 		return ret;                                                                \
@@ -242,7 +270,7 @@
 	static inline int32_t syscall_##name(type1 arg1, type2 arg2, type3 arg3, type4 arg4)      \
 	{                                                                                         \
 		int32_t ret;                                                                          \
-		__asm__ __volatile__("int $0x7F"                                                      \
+		__asm__ __volatile__(__SYSCALL_CALL                                                   \
 							 : "=a"(ret)                                                      \
 							 : "0"(__NR_##name), "b"(arg1), "c"(arg2), "d"(arg3), "S"(arg4)); \
 		return ret;                                                                           \
@@ -252,7 +280,7 @@
 	static inline int32_t syscall_##name(type1 arg1, type2 arg2, type3 arg3, type4 arg4, type5 arg5)     \
 	{                                                                                                    \
 		int32_t ret;                                                                                     \
-		__asm__ __volatile__("int $0x7F"                                                                 \
+		__asm__ __volatile__(__SYSCALL_CALL                                                              \
 							 : "=a"(ret)                                                                 \
 							 : "0"(__NR_##name), "b"(arg1), "c"(arg2), "d"(arg3), "S"(arg4), "D"(arg5)); \
 		return ret;                                                                                      \
@@ -272,6 +300,7 @@ void _exit(int code);
 int read(int fd, char *buf, size_t size);
 int write(int fd, const char *buf, size_t size);
 int close(int fd);
+int close_range(unsigned int first, unsigned int last, int flags);
 int lseek(int fd, off_t offset, int whence);
 int execve(const char *pathname, char *const argv[], char *const envp[]);
 int execl(const char *path, const char *arg0, ...);
@@ -290,6 +319,7 @@ int truncate(const char *name, off_t length);
 int ftruncate(int fd, off_t length);
 char *getcwd(char *buf, size_t size);
 int getpid();
+pid_t gettid();
 int getuid();
 int setuid(uid_t uid);
 int getegid();
@@ -334,6 +364,7 @@ int dup(int fildes);
 int chdir(const char *path);
 int fchdir(int fildes);
 
+void sync();
 int fsync(int fd);
 int fdatasync(int fd);
 
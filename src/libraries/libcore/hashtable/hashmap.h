@@ -18,9 +18,18 @@
 /* #define HASHMAP_METRICS */
 
 /*
- * Define HASHMAP_NOASSERT to compile out all assertions used internally.
+ * NOTE: MQ 2020-08-22
+ * Swiss table: every slot has a control byte, a full slot keeps 7 bits of its
+ * hash (h2), the rest (h1) selects the first group. Control bytes of a group
+ * are compared with h2 at once (SWAR in a 32-bit word, FPU/SSE state is not
+ * saved by kernel so SSE2 is not an option), only matching slots are compared
+ * by key. Probing stops at the first group which has an empty slot.
+ * Growing moves entries into the new table a few slots per put, lookups check
+ * both tables until the old one is drained -> no latency spike on rehash.
  */
-/* #define HASHMAP_NOASSERT */
+#define HASHMAP_GROUP_WIDTH 4
+#define HASHMAP_CTRL_EMPTY 0x80
+#define HASHMAP_CTRL_DELETED 0xFE
 
 /*
  * Macros to declare type-specific versions of hashmap_*() functions to
@@ -96,8 +105,85 @@
 							   __##name##_hashmap_foreach_callback, &s);           \
 	}
 
+/*
+ * Macro to create inline type-specialized init/put/get/remove.
+ * hash_func(const key_type *) and compare_func(const key_type *, const key_type *)
+ * are called directly (and are usually inlined) instead of through the map's
+ * function pointers. The map has to be initialized with name##_hashmap_init().
+ */
+#define HASHMAP_INLINE_FUNCS_CREATE(name, key_type, data_type, hash_func, compare_func) \
+	static inline size_t __##name##_hashmap_hash(const void *key)                       \
+	{                                                                                   \
+		return hash_func((const key_type *)key);                                        \
+	}                                                                                   \
+	static inline int __##name##_hashmap_compare(const void *a, const void *b)          \
+	{                                                                                   \
+		return compare_func((const key_type *)a, (const key_type *)b);                  \
+	}                                                                                   \
+	static inline int name##_hashmap_init(struct hashmap *map, size_t initial_size)    \
+	{                                                                                   \
+		return hashmap_init(map, __##name##_hashmap_hash,                               \
+							__##name##_hashmap_compare, initial_size);                  \
+	}                                                                                   \
+	static inline struct hashmap_slot *__##name##_hashmap_find(                        \
+		const struct hashmap *map, const key_type *key, uint32_t hash)                  \
+	{                                                                                   \
+		struct hashmap_probe probe;                                                     \
+		struct hashmap_slot *slot;                                                      \
+		hashmap_probe_start(&probe, &map->table, hash);                                 \
+		while ((slot = hashmap_probe_next(&probe)))                                     \
+			if (slot->hash == hash && !compare_func(key, (const key_type *)slot->key))  \
+				return slot;                                                            \
+		hashmap_probe_start(&probe, &map->old, hash);                                   \
+		while ((slot = hashmap_probe_next(&probe)))                                     \
+			if (slot->hash == hash && !compare_func(key, (const key_type *)slot->key))  \
+				return slot;                                                            \
+		return NULL;                                                                    \
+	}                                                                                   \
+	static inline data_type *name##_hashmap_put(struct hashmap *map,                   \
+												const key_type *key, data_type *data)   \
+	{                                                                                   \
+		uint32_t hash = hash_func(key);                                                 \
+		struct hashmap_slot *slot = __##name##_hashmap_find(map, key, hash);            \
+		if (!slot)                                                                      \
+			return (data_type *)hashmap_insert_hashed(map, hash, key, (void *)data);    \
+		if (!slot->data)                                                                \
+			slot->data = (void *)data;                                                  \
+		return (data_type *)slot->data;                                                 \
+	}                                                                                   \
+	static inline data_type *name##_hashmap_get(const struct hashmap *map,             \
+												const key_type *key)                    \
+	{                                                                                   \
+		struct hashmap_slot *slot = __##name##_hashmap_find(map, key, hash_func(key));  \
+		return slot ? (data_type *)slot->data : NULL;                                   \
+	}                                                                                   \
+	static inline data_type *name##_hashmap_remove(struct hashmap *map,                \
+												   const key_type *key)                 \
+	{                                                                                   \
+		struct hashmap_slot *slot = __##name##_hashmap_find(map, key, hash_func(key));  \
+		if (!slot)                                                                      \
+			return NULL;                                                                \
+		data_type *data = (data_type *)slot->data;                                      \
+		hashmap_remove_slot(map, slot);                                                 \
+		return data;                                                                    \
+	}
+
 struct hashmap_iter;
-struct hashmap_entry;
+
+struct hashmap_slot
+{
+	uint32_t hash;
+	const void *key;
+	void *data;
+};
+
+struct hashmap_table
+{
+	size_t capacity; /* number of slots, power of 2 */
+	size_t growth_left; /* empty slots which can be taken before growing */
+	uint32_t *ctrl;	 /* control bytes, a word per group */
+	struct hashmap_slot *slots;
+};
 
 /*
  * The hashmap state structure.
@@ -105,15 +191,96 @@ struct hashmap_entry;
 struct hashmap
 {
 	size_t table_size_init;
-	size_t table_size;
 	size_t num_entries;
-	struct hashmap_entry *table;
+	struct hashmap_table table;
+	/* table which is being migrated into `table` (capacity is 0 if none) */
+	struct hashmap_table old;
+	size_t migrate_pos;
 	size_t (*hash)(const void *);
 	int (*key_compare)(const void *, const void *);
 	void *(*key_alloc)(const void *);
 	void (*key_free)(void *);
 };
 
+/*
+ * Group matching, a byte of the result has its high bit set for each
+ * candidate slot. hashmap_group_match might report a false positive next
+ * to a real match, callers always compare keys.
+ */
+static inline uint32_t hashmap_group_match(uint32_t group, uint8_t h2)
+{
+	uint32_t x = group ^ (0x01010101u * h2);
+	return (x - 0x01010101u) & ~x & 0x80808080u;
+}
+
+static inline uint32_t hashmap_group_match_empty(uint32_t group)
+{
+	return group & (~group << 6) & 0x80808080u;
+}
+
+static inline uint32_t hashmap_group_match_free(uint32_t group)
+{
+	return group & 0x80808080u;
+}
+
+/* murmur3 finalizer, every input bit affects both h1 and h2 */
+static inline uint32_t hashmap_mix32(uint32_t hash)
+{
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+/*
+ * Probe sequence of a hash in a table, hashmap_probe_next() returns slots
+ * whose control byte matches h2 and NULL after a group with an empty slot.
+ */
+struct hashmap_probe
+{
+	const struct hashmap_table *table;
+	size_t group;
+	size_t step;
+	uint32_t match;
+	uint8_t h2;
+};
+
+static inline void hashmap_probe_start(struct hashmap_probe *probe,
+									   const struct hashmap_table *table, uint32_t hash)
+{
+	probe->table = table;
+	probe->step = 0;
+	probe->h2 = hash & 0x7F;
+	probe->group = 0;
+	probe->match = 0;
+	if (table->capacity)
+	{
+		probe->group = (hash >> 7) & (table->capacity / HASHMAP_GROUP_WIDTH - 1);
+		probe->match = hashmap_group_match(table->ctrl[probe->group], probe->h2);
+	}
+}
+
+static inline struct hashmap_slot *hashmap_probe_next(struct hashmap_probe *probe)
+{
+	const struct hashmap_table *table = probe->table;
+	size_t groups = table->capacity / HASHMAP_GROUP_WIDTH;
+
+	while (!probe->match)
+	{
+		if (!groups || hashmap_group_match_empty(table->ctrl[probe->group]) || ++probe->step >= groups)
+			return NULL;
+		/* triangular probing visits every group of a power of 2 table */
+		probe->group = (probe->group + probe->step) & (groups - 1);
+		probe->match = hashmap_group_match(table->ctrl[probe->group], probe->h2);
+	}
+
+	unsigned int bit = __builtin_ctz(probe->match);
+	probe->match &= probe->match - 1;
+	return &table->slots[probe->group * HASHMAP_GROUP_WIDTH + bit / 8];
+}
+
 /*
  * Initialize an empty hashmap.
  *
@@ -168,6 +335,18 @@ void *hashmap_get(const struct hashmap *map, const void *key);
  */
 void *hashmap_remove(struct hashmap *map, const void *key);
 
+/*
+ * Add an entry whose key is known to be absent, `hash` is map->hash(key).
+ * Used by HASHMAP_INLINE_FUNCS_CREATE.  Returns NULL if memory allocation failed.
+ */
+void *hashmap_insert_hashed(struct hashmap *map, uint32_t hash, const void *key, void *data);
+
+/*
+ * Remove the entry of a slot found by probing.
+ * Used by HASHMAP_INLINE_FUNCS_CREATE.
+ */
+void hashmap_remove_slot(struct hashmap *map, struct hashmap_slot *slot);
+
 /*
  * Remove all entries.
  */
@@ -233,8 +412,7 @@ int hashmap_foreach(const struct hashmap *map,
 
 /*
  * Default hash function for string keys.
- * This is an implementation of the well-documented Jenkins one-at-a-time
- * hash function.
+ * Bytes are mixed a 32-bit word at a time (murmur3 rounds).
  */
 size_t hashmap_hash_string(const void *key);
 
@@ -244,7 +422,7 @@ size_t hashmap_hash_string(const void *key);
 int hashmap_compare_string(const void *a, const void *b);
 
 /*
- * Default key allocation function for string keys.  Use kfree() for the
+ * Default key allocation function for string keys.  Use free() for the
  * key_free_func.
  */
 void *hashmap_alloc_key_string(const void *key);
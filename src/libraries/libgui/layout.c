@@ -9,6 +9,7 @@
 #include <poll.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -40,6 +41,19 @@ int get_character_height(char ch)
 	return font->height;
 }
 
+// window server's queue is opened once and kept for the lifetime of process
+static int32_t get_server_queue()
+{
+	static int32_t sfd = -1;
+
+	if (sfd < 0)
+		sfd = mq_open(WINDOW_SERVER_QUEUE, O_WRONLY, &(struct mq_attr){
+														 .mq_msgsize = sizeof(struct msgui),
+														 .mq_maxmsg = 32,
+													 });
+	return sfd;
+}
+
 static struct window *find_child_element_from_position(struct window *win, int32_t px, int32_t py, int32_t mx, int32_t my)
 {
 	struct window *iter_win;
@@ -97,12 +111,7 @@ static void gui_create_window(struct window *parent, struct window *win, int32_t
 		memcpy(msgwin->parent, parent->name, WINDOW_NAME_LENGTH);
 	memcpy(msgwin->sender, pid, WINDOW_NAME_LENGTH);
 	free(pid);
-	int32_t sfd = mq_open(WINDOW_SERVER_QUEUE, O_WRONLY, &(struct mq_attr){
-															 .mq_msgsize = sizeof(struct msgui),
-															 .mq_maxmsg = 32,
-														 });
-	mq_send(sfd, (char *)msgui_sender, 0, sizeof(struct msgui));
-	mq_close(sfd);
+	mq_send(get_server_queue(), (char *)msgui_sender, 0, sizeof(struct msgui));
 	free(msgui_sender);
 
 	win->graphic.x = x;
@@ -119,12 +128,14 @@ static void gui_create_window(struct window *parent, struct window *win, int32_t
 	if (parent)
 		list_add_tail(&win->sibling, &parent->children);
 
-	int32_t wfd = mq_open(msgwin->sender, O_RDONLY | O_CREAT, &(struct mq_attr){
-																  .mq_msgsize = WINDOW_NAME_LENGTH,
-																  .mq_maxmsg = 32,
-															  });
+	// process's reply queue is reused for every window it creates
+	static int32_t wfd = -1;
+	if (wfd < 0)
+		wfd = mq_open(msgwin->sender, O_RDONLY | O_CREAT, &(struct mq_attr){
+															  .mq_msgsize = WINDOW_NAME_LENGTH,
+															  .mq_maxmsg = 32,
+														  });
 	mq_receive(wfd, win->name, 0, WINDOW_NAME_LENGTH);
-	mq_close(wfd);
 
 	uint32_t buf_size = width * height * 4;
 	int32_t fd = shm_open(win->name, O_RDWR, 0);
@@ -169,12 +180,7 @@ void gui_render(struct window *win)
 	struct msgui_render *msgrender = (struct msgui_render *)msgui->data;
 	memcpy(msgrender->sender, win->name, WINDOW_NAME_LENGTH);
 
-	int32_t sfd = mq_open(WINDOW_SERVER_QUEUE, O_WRONLY, &(struct mq_attr){
-															 .mq_msgsize = sizeof(struct msgui),
-															 .mq_maxmsg = 32,
-														 });
-	mq_send(sfd, (char *)msgui, 0, sizeof(struct msgui));
-	mq_close(sfd);
+	mq_send(get_server_queue(), (char *)msgui, 0, sizeof(struct msgui));
 	free(msgui);
 }
 
@@ -185,12 +191,7 @@ void gui_focus(struct window *win)
 	struct msgui_focus *msgfocus = (struct msgui_focus *)msgui->data;
 	memcpy(msgfocus->sender, win->name, WINDOW_NAME_LENGTH);
 
-	int32_t sfd = mq_open(WINDOW_SERVER_QUEUE, O_WRONLY, &(struct mq_attr){
-															 .mq_msgsize = sizeof(struct msgui),
-															 .mq_maxmsg = 32,
-														 });
-	mq_send(sfd, (char *)msgui, 0, sizeof(struct msgui));
-	mq_close(sfd);
+	mq_send(get_server_queue(), (char *)msgui, 0, sizeof(struct msgui));
 	free(msgui);
 }
 
@@ -201,12 +202,7 @@ void gui_close(struct window *win)
 	struct msgui_close *msgclose = (struct msgui_close *)msgui->data;
 	memcpy(msgclose->sender, win->name, WINDOW_NAME_LENGTH);
 
-	int32_t sfd = mq_open(WINDOW_SERVER_QUEUE, O_WRONLY, &(struct mq_attr){
-															 .mq_msgsize = sizeof(struct msgui),
-															 .mq_maxmsg = 32,
-														 });
-	mq_send(sfd, (char *)msgui, 0, sizeof(struct msgui));
-	mq_close(sfd);
+	mq_send(get_server_queue(), (char *)msgui, 0, sizeof(struct msgui));
 	free(msgui);
 }
 
@@ -295,30 +291,43 @@ void enter_event_loop(struct window *win, void (*event_callback)(struct xevent *
 														 });
 	memset(event, 0, sizeof(struct xevent));
 
-	struct pollfd pfds[MAX_FD] = {
-		{.fd = wfd, .events = POLLIN},
-	};
-	for (int i = 1; i < MAX_FD; ++i)
-	{
-		pfds[i].fd = -1;
-		pfds[i].events = POLLIN;
-	}
+	// interest list is kept in kernel, only ready fds are returned
+	int epfd = epoll_create(MAX_FD);
+	epoll_ctl(epfd, EPOLL_CTL_ADD, wfd, &(struct epoll_event){.events = EPOLLIN, .data.fd = wfd});
+
+	int watched_fds[MAX_FD];
+	for (int i = 0; i < MAX_FD; ++i)
+		watched_fds[i] = -1;
+
+	struct epoll_event events[MAX_FD];
+	struct pollfd pfds[MAX_FD];
 
 	while (true)
 	{
-		for (unsigned int i = 0; i < nfds; ++i)
-			pfds[i + 1].fd = fds[i];
+		// caller might replace its fds between rounds
+		for (unsigned int i = 0; i < nfds && i < MAX_FD - 1; ++i)
+		{
+			if (watched_fds[i] == fds[i])
+				continue;
 
-		int nr = poll(pfds, MAX_FD);
+			if (watched_fds[i] >= 0)
+				epoll_ctl(epfd, EPOLL_CTL_DEL, watched_fds[i], NULL);
+			if (fds[i] >= 0)
+				epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i], &(struct epoll_event){.events = EPOLLIN, .data.fd = fds[i]});
+			watched_fds[i] = fds[i];
+		}
+
+		int nr = epoll_wait(epfd, events, MAX_FD, -1);
 		if (nr <= 0)
 			continue;
 
-		for (int32_t i = 0; i < MAX_FD; ++i)
+		unsigned int npfds = 0;
+		for (int32_t i = 0; i < nr; ++i)
 		{
-			if (!(pfds[i].revents & POLLIN))
+			if (!(events[i].events & EPOLLIN))
 				continue;
 
-			if (pfds[i].fd == wfd)
+			if (events[i].data.fd == wfd)
 			{
 				mq_receive(wfd, (char *)event, 0, sizeof(struct xevent));
 
@@ -341,11 +350,20 @@ void enter_event_loop(struct window *win, void (*event_callback)(struct xevent *
 					event_callback(event);
 				memset(event, 0, sizeof(struct xevent));
 			}
-			else if (fds_callback)
-				fds_callback(pfds, MAX_FD);
+			else
+			{
+				pfds[npfds].fd = events[i].data.fd;
+				pfds[npfds].events = POLLIN;
+				pfds[npfds].revents = events[i].events;
+				npfds++;
+			}
 		};
+
+		if (npfds && fds_callback)
+			fds_callback(pfds, npfds);
 	}
 
+	close(epfd);
 	mq_close(wfd);
 	free(event);
 }
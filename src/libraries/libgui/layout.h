@@ -66,6 +66,8 @@ struct window
 	struct list_head sibling;
 	struct list_head children;
 	struct hashmap events;
+	// window server's end of window's event queue, it's opened at the first event (-1 before)
+	int32_t event_fd;
 	void (*add_event_listener)(struct window *win, char *event_name, EVENT_HANDLER handler);
 };
 
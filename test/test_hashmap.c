@@ -0,0 +1,284 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hashmap.h"
+#include "legacy_hashmap.h"
+#include "unity.h"
+
+#define NR_KEYS 4096
+#define BENCH_KEYS 65536
+#define BENCH_ROUNDS 8
+
+static inline size_t uint32_key_hash(const uint32_t *key)
+{
+	return hashmap_mix32(*key);
+}
+
+static inline int uint32_key_compare(const uint32_t *a, const uint32_t *b)
+{
+	return *a != *b;
+}
+
+HASHMAP_INLINE_FUNCS_CREATE(u32, uint32_t, uint32_t, uint32_key_hash, uint32_key_compare)
+
+static uint32_t keys[BENCH_KEYS];
+static char names[BENCH_KEYS][16];
+
+void setUp(void)
+{
+	for (uint32_t i = 0; i < BENCH_KEYS; ++i)
+	{
+		keys[i] = i * 2654435761u;
+		snprintf(names[i], sizeof(names[i]), "icon-%u", i);
+	}
+}
+
+void tearDown(void)
+{
+}
+
+void test_hashmap_should_find_every_entry_while_growing(void)
+{
+	struct hashmap map;
+	TEST_ASSERT_EQUAL_INT(0, hashmap_init(&map, hashmap_hash_uint32, hashmap_compare_uint32, 0));
+
+	for (int i = 0; i < NR_KEYS; ++i)
+	{
+		TEST_ASSERT_EQUAL_PTR(&keys[i], hashmap_put(&map, &keys[i], &keys[i]));
+		// entries which are still in the old table are found as well
+		TEST_ASSERT_EQUAL_PTR(&keys[i / 2], hashmap_get(&map, &keys[i / 2]));
+	}
+	TEST_ASSERT_EQUAL_UINT32(NR_KEYS, hashmap_size(&map));
+
+	for (int i = 0; i < NR_KEYS; ++i)
+		TEST_ASSERT_EQUAL_PTR(&keys[i], hashmap_get(&map, &keys[i]));
+	TEST_ASSERT_NULL(hashmap_get(&map, &keys[NR_KEYS]));
+
+	hashmap_destroy(&map);
+}
+
+void test_hashmap_put_should_keep_existing_data(void)
+{
+	struct hashmap map;
+	int a, b;
+	hashmap_init(&map, NULL, NULL, 0);
+
+	TEST_ASSERT_EQUAL_PTR(&a, hashmap_put(&map, "window", &a));
+	TEST_ASSERT_EQUAL_PTR(&a, hashmap_put(&map, "window", &b));
+	TEST_ASSERT_EQUAL_UINT32(1, hashmap_size(&map));
+
+	hashmap_destroy(&map);
+}
+
+void test_hashmap_remove_should_not_grow_table_forever(void)
+{
+	struct hashmap map;
+	hashmap_init(&map, hashmap_hash_uint32, hashmap_compare_uint32, 64);
+	size_t capacity = map.table.capacity;
+
+	for (int round = 0; round < 100; ++round)
+	{
+		for (int i = 0; i < 64; ++i)
+			hashmap_put(&map, &keys[round * 64 + i], &keys[i]);
+		for (int i = 0; i < 64; ++i)
+			TEST_ASSERT_EQUAL_PTR(&keys[i], hashmap_remove(&map, &keys[round * 64 + i]));
+	}
+	TEST_ASSERT_EQUAL_UINT32(0, hashmap_size(&map));
+	// tombstones are dropped by rehashing into a table of the same size
+	TEST_ASSERT_TRUE(map.table.capacity <= 2 * capacity);
+
+	hashmap_destroy(&map);
+}
+
+void test_hashmap_iter_should_visit_each_entry_once_while_migrating(void)
+{
+	struct hashmap map;
+	static uint8_t seen[NR_KEYS];
+	hashmap_init(&map, hashmap_hash_uint32, hashmap_compare_uint32, 0);
+
+	int nr = 0;
+	// stop right after a grow so that both tables have entries
+	for (int i = 0; i < NR_KEYS && (nr < 256 || !map.old.capacity); ++i, ++nr)
+		hashmap_put(&map, &keys[i], &keys[i]);
+	TEST_ASSERT_TRUE(map.old.capacity > 0);
+
+	memset(seen, 0, sizeof(seen));
+	for (struct hashmap_iter *iter = hashmap_iter(&map); iter; iter = hashmap_iter_next(&map, iter))
+	{
+		uint32_t *key = (uint32_t *)hashmap_iter_get_data(iter);
+		seen[key - keys]++;
+	}
+	for (int i = 0; i < nr; ++i)
+		TEST_ASSERT_EQUAL_UINT8(1, seen[i]);
+
+	struct hashmap_iter *iter = hashmap_iter(&map);
+	while (iter)
+		iter = hashmap_iter_remove(&map, iter);
+	TEST_ASSERT_EQUAL_UINT32(0, hashmap_size(&map));
+	TEST_ASSERT_NULL(hashmap_get(&map, &keys[0]));
+
+	hashmap_destroy(&map);
+}
+
+void test_hashmap_string_keys_should_be_case_insensitive_with_i_funcs(void)
+{
+	struct hashmap map;
+	int data;
+	hashmap_init(&map, hashmap_hash_string_i, hashmap_compare_string_i, 0);
+	hashmap_set_key_alloc_funcs(&map, hashmap_alloc_key_string, free);
+
+	char key[] = "Terminal";
+	hashmap_put(&map, key, &data);
+	key[0] = 'X';
+	TEST_ASSERT_EQUAL_PTR(&data, hashmap_get(&map, "TERMINAL"));
+	TEST_ASSERT_NULL(hashmap_get(&map, key));
+
+	hashmap_destroy(&map);
+}
+
+void test_hashmap_inline_funcs_should_match_generic_ones(void)
+{
+	struct hashmap map;
+	u32_hashmap_init(&map, 0);
+
+	for (int i = 0; i < NR_KEYS; ++i)
+		u32_hashmap_put(&map, &keys[i], &keys[i]);
+	for (int i = 0; i < NR_KEYS; ++i)
+	{
+		TEST_ASSERT_EQUAL_PTR(&keys[i], u32_hashmap_get(&map, &keys[i]));
+		TEST_ASSERT_EQUAL_PTR(&keys[i], hashmap_get(&map, &keys[i]));
+	}
+	for (int i = 0; i < NR_KEYS; i += 2)
+		TEST_ASSERT_EQUAL_PTR(&keys[i], u32_hashmap_remove(&map, &keys[i]));
+	TEST_ASSERT_EQUAL_UINT32(NR_KEYS / 2, hashmap_size(&map));
+	TEST_ASSERT_NULL(u32_hashmap_get(&map, &keys[0]));
+	TEST_ASSERT_EQUAL_PTR(&keys[1], u32_hashmap_get(&map, &keys[1]));
+
+	hashmap_destroy(&map);
+}
+
+static long elapsed_us(clock_t start)
+{
+	return (long)((clock() - start) * 1000000 / CLOCKS_PER_SEC);
+}
+
+static void report(const char *what, long legacy_us, long swiss_us)
+{
+	char message[128];
+	snprintf(message, sizeof(message), "%s: legacy %ld us, swiss %ld us",
+			 what, legacy_us, swiss_us);
+	TEST_MESSAGE(message);
+}
+
+void test_benchmark_uint32_keys(void)
+{
+	struct legacy_hashmap legacy;
+	struct hashmap swiss, typed;
+	clock_t start;
+	long legacy_us, swiss_us, typed_us;
+
+	start = clock();
+	for (int round = 0; round < BENCH_ROUNDS; ++round)
+	{
+		legacy_hashmap_init(&legacy, legacy_hashmap_hash_uint32, legacy_hashmap_compare_uint32, 0);
+		for (int i = 0; i < BENCH_KEYS; ++i)
+			legacy_hashmap_put(&legacy, &keys[i], &keys[i]);
+		for (int i = 0; i < BENCH_KEYS; ++i)
+			TEST_ASSERT_NOT_NULL(legacy_hashmap_get(&legacy, &keys[i]));
+		legacy_hashmap_destroy(&legacy);
+	}
+	legacy_us = elapsed_us(start);
+
+	start = clock();
+	for (int round = 0; round < BENCH_ROUNDS; ++round)
+	{
+		hashmap_init(&swiss, hashmap_hash_uint32, hashmap_compare_uint32, 0);
+		for (int i = 0; i < BENCH_KEYS; ++i)
+			hashmap_put(&swiss, &keys[i], &keys[i]);
+		for (int i = 0; i < BENCH_KEYS; ++i)
+			TEST_ASSERT_NOT_NULL(hashmap_get(&swiss, &keys[i]));
+		hashmap_destroy(&swiss);
+	}
+	swiss_us = elapsed_us(start);
+
+	start = clock();
+	for (int round = 0; round < BENCH_ROUNDS; ++round)
+	{
+		u32_hashmap_init(&typed, 0);
+		for (int i = 0; i < BENCH_KEYS; ++i)
+			u32_hashmap_put(&typed, &keys[i], &keys[i]);
+		for (int i = 0; i < BENCH_KEYS; ++i)
+			TEST_ASSERT_NOT_NULL(u32_hashmap_get(&typed, &keys[i]));
+		hashmap_destroy(&typed);
+	}
+	typed_us = elapsed_us(start);
+
+	report("uint32 put+get", legacy_us, swiss_us);
+	report("uint32 put+get (inline funcs)", legacy_us, typed_us);
+}
+
+void test_benchmark_string_keys(void)
+{
+	struct legacy_hashmap legacy;
+	struct hashmap swiss;
+	clock_t start;
+	long legacy_us, swiss_us;
+
+	start = clock();
+	for (int round = 0; round < BENCH_ROUNDS; ++round)
+	{
+		legacy_hashmap_init(&legacy, legacy_hashmap_hash_string, legacy_hashmap_compare_string, 0);
+		for (int i = 0; i < BENCH_KEYS; ++i)
+			legacy_hashmap_put(&legacy, names[i], names[i]);
+		for (int i = 0; i < BENCH_KEYS; ++i)
+			TEST_ASSERT_NOT_NULL(legacy_hashmap_get(&legacy, names[i]));
+		legacy_hashmap_destroy(&legacy);
+	}
+	legacy_us = elapsed_us(start);
+
+	start = clock();
+	for (int round = 0; round < BENCH_ROUNDS; ++round)
+	{
+		hashmap_init(&swiss, hashmap_hash_string, hashmap_compare_string, 0);
+		for (int i = 0; i < BENCH_KEYS; ++i)
+			hashmap_put(&swiss, names[i], names[i]);
+		for (int i = 0; i < BENCH_KEYS; ++i)
+			TEST_ASSERT_NOT_NULL(hashmap_get(&swiss, names[i]));
+		hashmap_destroy(&swiss);
+	}
+	swiss_us = elapsed_us(start);
+
+	report("string put+get", legacy_us, swiss_us);
+}
+
+void test_benchmark_worst_put_latency(void)
+{
+	struct legacy_hashmap legacy;
+	struct hashmap swiss;
+	clock_t start, worst_legacy = 0, worst_swiss = 0;
+
+	legacy_hashmap_init(&legacy, legacy_hashmap_hash_uint32, legacy_hashmap_compare_uint32, 0);
+	hashmap_init(&swiss, hashmap_hash_uint32, hashmap_compare_uint32, 0);
+	for (int i = 0; i < BENCH_KEYS; ++i)
+	{
+		start = clock();
+		legacy_hashmap_put(&legacy, &keys[i], &keys[i]);
+		if (clock() - start > worst_legacy)
+			worst_legacy = clock() - start;
+
+		start = clock();
+		hashmap_put(&swiss, &keys[i], &keys[i]);
+		if (clock() - start > worst_swiss)
+			worst_swiss = clock() - start;
+	}
+	legacy_hashmap_destroy(&legacy);
+	hashmap_destroy(&swiss);
+
+	// legacy rehashes the whole table in one put, swiss moves 16 slots per put
+	report("worst single put",
+		   (long)(worst_legacy * 1000000 / CLOCKS_PER_SEC),
+		   (long)(worst_swiss * 1000000 / CLOCKS_PER_SEC));
+}
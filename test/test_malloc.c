@@ -0,0 +1,172 @@
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "unity.h"
+
+#define BENCH_SLOTS 1024
+#define BENCH_ROUNDS 1000000
+
+void setUp(void)
+{
+	malloc_trim(0);
+}
+
+void tearDown(void)
+{
+}
+
+void test_malloc_should_return_aligned_and_usable_memory(void)
+{
+	for (size_t size = 0; size < 1024; size += 7)
+	{
+		char *ptr = malloc(size);
+		TEST_ASSERT_NOT_NULL(ptr);
+		TEST_ASSERT_EQUAL_UINT32(0, (uintptr_t)ptr % (2 * sizeof(size_t)));
+		TEST_ASSERT_TRUE(malloc_usable_size(ptr) >= size);
+		memset(ptr, 0xAB, size);
+		free(ptr);
+	}
+}
+
+void test_free_should_reuse_cached_chunk_of_the_same_size(void)
+{
+	void *a = malloc(40);
+	free(a);
+	void *b = malloc(40);
+	TEST_ASSERT_EQUAL_PTR(a, b);
+	free(b);
+}
+
+void test_free_should_coalesce_neighbours(void)
+{
+	char *a = malloc(1000);
+	char *b = malloc(1000);
+	char *c = malloc(1000);
+	char *guard = malloc(1000);
+
+	free(a);
+	free(c);
+	free(b);
+
+	char *merged = malloc(2900);
+	TEST_ASSERT_EQUAL_PTR(a, merged);
+
+	free(merged);
+	free(guard);
+}
+
+void test_realloc_should_shrink_in_place_and_reuse_the_tail(void)
+{
+	char *a = malloc(4000);
+	char *guard = malloc(1000);
+	memset(a, 'x', 100);
+
+	char *b = realloc(a, 100);
+	TEST_ASSERT_EQUAL_PTR(a, b);
+	TEST_ASSERT_EACH_EQUAL_INT8('x', b, 100);
+
+	char *tail = malloc(2000);
+	TEST_ASSERT_TRUE(tail > b && tail < b + 4000);
+
+	free(tail);
+	free(b);
+	free(guard);
+}
+
+void test_realloc_should_grow_in_place_into_free_neighbour(void)
+{
+	char *a = malloc(1000);
+	char *b = malloc(1000);
+	char *guard = malloc(1000);
+	memset(a, 'y', 1000);
+	free(b);
+
+	char *c = realloc(a, 1800);
+	TEST_ASSERT_EQUAL_PTR(a, c);
+	TEST_ASSERT_EACH_EQUAL_INT8('y', c, 1000);
+
+	free(c);
+	free(guard);
+}
+
+void test_realloc_should_grow_in_place_into_top(void)
+{
+	// bigger than every binned chunk together -> it's carved from top and borders it
+	size_t size = mallinfo().fordblks + 1000;
+	char *a = malloc(size);
+	memset(a, 'z', size);
+
+	char *b = realloc(a, size + 100000);
+	TEST_ASSERT_EQUAL_PTR(a, b);
+	TEST_ASSERT_TRUE(malloc_usable_size(b) >= size + 100000);
+	TEST_ASSERT_EACH_EQUAL_INT8('z', b, size);
+
+	free(b);
+}
+
+void test_large_allocation_should_be_mmapped(void)
+{
+	struct mallinfo before = mallinfo();
+	char *ptr = malloc(1 << 20);
+	TEST_ASSERT_NOT_NULL(ptr);
+	ptr[0] = ptr[(1 << 20) - 1] = 1;
+	TEST_ASSERT_EQUAL_UINT32(before.hblks + 1, mallinfo().hblks);
+
+	free(ptr);
+	TEST_ASSERT_EQUAL_UINT32(before.hblks, mallinfo().hblks);
+}
+
+void test_free_should_trim_heap(void)
+{
+	size_t arena = mallinfo().arena;
+	void *ptrs[16];
+
+	for (int i = 0; i < 16; ++i)
+		ptrs[i] = malloc(100000);
+	TEST_ASSERT_TRUE(mallinfo().arena > arena + 15 * 100000);
+
+	for (int i = 0; i < 16; ++i)
+		free(ptrs[i]);
+	TEST_ASSERT_TRUE(mallinfo().arena <= arena + 0x20000);
+}
+
+void test_calloc_should_fail_on_overflow(void)
+{
+	TEST_ASSERT_NULL(calloc((size_t)-1 / 2, 4));
+
+	int *zeros = calloc(64, sizeof(int));
+	TEST_ASSERT_EACH_EQUAL_INT(0, zeros, 64);
+	free(zeros);
+}
+
+void test_benchmark_mixed_sizes(void)
+{
+	static void *slots[BENCH_SLOTS];
+	uint32_t seed = 0x12345678;
+
+	clock_t start = clock();
+	for (int i = 0; i < BENCH_ROUNDS; ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+		uint32_t slot = (seed >> 8) % BENCH_SLOTS;
+		// mostly small objects with some medium ones, like a typical userland program
+		size_t size = (seed >> 20) % 8 ? 8 + (seed >> 16) % 256 : 512 + (seed >> 12) % 8192;
+
+		if (slots[slot])
+			free(slots[slot]);
+		slots[slot] = malloc(size);
+		TEST_ASSERT_NOT_NULL(slots[slot]);
+	}
+	clock_t elapsed = clock() - start;
+
+	for (int i = 0; i < BENCH_SLOTS; ++i)
+		free(slots[i]);
+
+	char message[128];
+	snprintf(message, sizeof(message), "%d malloc/free pairs in %ld ms",
+			 BENCH_ROUNDS, (long)(elapsed * 1000 / CLOCKS_PER_SEC));
+	TEST_MESSAGE(message);
+}
@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "unity.h"
+
+// NOTE: MQ 2020-08-10
+// Streams in this test are backed by an in-memory file so we measure stdio itself (and count how often it hits read/write)
+// other fds are forwarded to the host, unity prints through our stdout
+#define MEMFILE_FD 100
+#define MEMFILE_SIZE (8 * 1024 * 1024)
+#define BENCH_LINE "the quick brown fox jumps over the lazy dog 0123456789\n"
+
+// host's dynamic linker, libc headers don't have dlfcn.h
+#define RTLD_NEXT ((void *)-1l)
+extern void *dlsym(void *handle, const char *symbol);
+
+static char memfile[MEMFILE_SIZE];
+static size_t memfile_len, memfile_pos;
+static int nreads, nwrites;
+
+extern void _stdio_init();
+
+static void __attribute__((constructor)) stdio_init()
+{
+	_stdio_init();
+}
+
+int read(int fd, char *buf, size_t size)
+{
+	if (fd != MEMFILE_FD)
+		return ((int (*)(int, char *, size_t))dlsym(RTLD_NEXT, "read"))(fd, buf, size);
+
+	nreads++;
+	size_t count = memfile_pos < memfile_len ? memfile_len - memfile_pos : 0;
+	count = size < count ? size : count;
+	memcpy(buf, memfile + memfile_pos, count);
+	memfile_pos += count;
+	return count;
+}
+
+int write(int fd, const char *buf, size_t size)
+{
+	if (fd != MEMFILE_FD)
+		return ((int (*)(int, const char *, size_t))dlsym(RTLD_NEXT, "write"))(fd, buf, size);
+
+	nwrites++;
+	if (memfile_pos + size > MEMFILE_SIZE)
+		return -1;
+	memcpy(memfile + memfile_pos, buf, size);
+	memfile_pos += size;
+	if (memfile_pos > memfile_len)
+		memfile_len = memfile_pos;
+	return size;
+}
+
+int lseek(int fd, off_t offset, int whence)
+{
+	if (fd != MEMFILE_FD)
+		return -1;
+
+	if (whence == SEEK_CUR)
+		offset += memfile_pos;
+	else if (whence == SEEK_END)
+		offset += memfile_len;
+	memfile_pos = offset;
+	return offset;
+}
+
+int fstat(int fd, struct stat *stat)
+{
+	memset(stat, 0, sizeof(struct stat));
+	stat->st_mode = fd == MEMFILE_FD ? S_IFREG : S_IFCHR;
+	stat->st_size = fd == MEMFILE_FD ? memfile_len : 0;
+	stat->st_blksize = 4096;
+	return 0;
+}
+
+int close(int fd)
+{
+	return 0;
+}
+
+static FILE *memfile_open(const char *mode)
+{
+	memfile_pos = 0;
+	nreads = nwrites = 0;
+	return fdopen(MEMFILE_FD, mode);
+}
+
+static void memfile_fill_lines(int nlines)
+{
+	memfile_len = 0;
+	for (int i = 0; i < nlines; ++i)
+	{
+		memcpy(memfile + memfile_len, BENCH_LINE, sizeof(BENCH_LINE) - 1);
+		memfile_len += sizeof(BENCH_LINE) - 1;
+	}
+}
+
+static long elapsed_ms(clock_t start)
+{
+	return (long)((clock() - start) * 1000 / CLOCKS_PER_SEC);
+}
+
+static void report(const char *name, size_t bytes, clock_t start)
+{
+	char message[128];
+	long ms = elapsed_ms(start);
+	snprintf(message, sizeof(message), "%s: %u KB in %ld ms, %d reads, %d writes",
+			 name, (unsigned)(bytes / 1024), ms, nreads, nwrites);
+	TEST_MESSAGE(message);
+}
+
+void setUp(void)
+{
+	memfile_len = memfile_pos = 0;
+}
+
+void tearDown(void)
+{
+}
+
+void test_putc_unlocked_should_only_write_full_blocks(void)
+{
+	FILE *stream = memfile_open("w");
+	for (int i = 0; i < 4096 * 3; ++i)
+		putc_unlocked('a' + i % 26, stream);
+	TEST_ASSERT_EQUAL_INT(2, nwrites);
+
+	fclose(stream);
+	TEST_ASSERT_EQUAL_INT(3, nwrites);
+	TEST_ASSERT_EQUAL_UINT32(4096 * 3, memfile_len);
+	TEST_ASSERT_EQUAL_CHAR('a' + 4097 % 26, memfile[4097]);
+}
+
+void test_fwrite_and_fread_should_bypass_buffer_for_large_chunks(void)
+{
+	static char chunk[64 * 1024];
+	memset(chunk, 'x', sizeof(chunk));
+
+	FILE *stream = memfile_open("w");
+	fputs("header", stream);
+	TEST_ASSERT_EQUAL_UINT32(1, fwrite(chunk, sizeof(chunk), 1, stream));
+	// pending header is flushed, then the chunk goes out in one write
+	TEST_ASSERT_EQUAL_INT(2, nwrites);
+	fclose(stream);
+
+	stream = memfile_open("r");
+	char header[6];
+	TEST_ASSERT_EQUAL_UINT32(6, fread(header, 1, 6, stream));
+	TEST_ASSERT_EQUAL_UINT32(sizeof(chunk), fread(chunk, 1, sizeof(chunk), stream));
+	TEST_ASSERT_EQUAL_MEMORY("header", header, 6);
+	TEST_ASSERT_EACH_EQUAL_CHAR('x', chunk, sizeof(chunk));
+	TEST_ASSERT_TRUE(nreads <= 3);
+	fclose(stream);
+}
+
+void test_fgets_should_keep_newline_and_split_long_lines(void)
+{
+	memcpy(memfile, "first\nsecond line\n", 18);
+	memfile_len = 18;
+
+	FILE *stream = memfile_open("r");
+	char buf[8];
+	TEST_ASSERT_EQUAL_STRING("first\n", fgets(buf, sizeof(buf), stream));
+	TEST_ASSERT_EQUAL_STRING("second ", fgets(buf, sizeof(buf), stream));
+	TEST_ASSERT_EQUAL_STRING("line\n", fgets(buf, sizeof(buf), stream));
+	TEST_ASSERT_NULL(fgets(buf, sizeof(buf), stream));
+	TEST_ASSERT_TRUE(feof(stream));
+	fclose(stream);
+}
+
+void test_ungetc_and_ftell_should_track_logical_position(void)
+{
+	memcpy(memfile, "abcdef", 6);
+	memfile_len = 6;
+
+	FILE *stream = memfile_open("r+");
+	TEST_ASSERT_EQUAL_INT('a', fgetc(stream));
+	TEST_ASSERT_EQUAL_INT('b', fgetc(stream));
+	TEST_ASSERT_EQUAL_INT(2, ftell(stream));
+
+	TEST_ASSERT_EQUAL_INT('z', ungetc('z', stream));
+	TEST_ASSERT_EQUAL_INT(1, ftell(stream));
+	TEST_ASSERT_EQUAL_INT('z', fgetc(stream));
+
+	// switching to write puts data at the logical position, not after read-ahead
+	fputc('C', stream);
+	TEST_ASSERT_EQUAL_INT(3, ftell(stream));
+	fseek(stream, 0, SEEK_SET);
+	TEST_ASSERT_EQUAL_INT('a', fgetc(stream));
+	fclose(stream);
+	TEST_ASSERT_EQUAL_MEMORY("abCdef", memfile, 6);
+}
+
+void test_benchmark_line_io(void)
+{
+	const int nlines = 100000;
+	size_t bytes = nlines * (sizeof(BENCH_LINE) - 1);
+
+	FILE *stream = memfile_open("w");
+	clock_t start = clock();
+	for (int i = 0; i < nlines; ++i)
+		fputs(BENCH_LINE, stream);
+	fclose(stream);
+	report("fputs", bytes, start);
+
+	stream = memfile_open("w");
+	start = clock();
+	for (int i = 0; i < nlines; ++i)
+		for (const char *s = BENCH_LINE; *s; ++s)
+			putc_unlocked(*s, stream);
+	fclose(stream);
+	report("putc_unlocked", bytes, start);
+
+	memfile_fill_lines(nlines);
+	char line[128];
+	int count = 0;
+	stream = memfile_open("r");
+	start = clock();
+	while (fgets(line, sizeof(line), stream))
+		count++;
+	fclose(stream);
+	report("fgets", bytes, start);
+	TEST_ASSERT_EQUAL_INT(nlines, count);
+
+	char *lineptr = NULL;
+	size_t n = 0;
+	count = 0;
+	stream = memfile_open("r");
+	start = clock();
+	while (getline(&lineptr, &n, stream) > 0)
+		count++;
+	fclose(stream);
+	report("getline", bytes, start);
+	TEST_ASSERT_EQUAL_INT(nlines, count);
+
+	count = 0;
+	stream = memfile_open("r");
+	start = clock();
+	for (int ch; (ch = getc_unlocked(stream)) != EOF;)
+		count += ch == '\n';
+	fclose(stream);
+	report("getc_unlocked", bytes, start);
+	TEST_ASSERT_EQUAL_INT(nlines, count);
+}
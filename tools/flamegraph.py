@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+"""Symbolize /dev/profile samples and render them as a flame graph.
+
+On mOS:
+    $ echo 250 > /dev/profile          # start sampling at 250Hz
+    $ cat /dev/profile > /profile.txt  # samples since boot (ring keeps the latest 1024)
+    $ echo 0 > /dev/profile
+
+On host (copy profile.txt out of the disk image):
+    $ tools/flamegraph.py profile.txt --kernel src/isodir/boot/mos.bin \
+        --sysroot src/apps --elf "window server=src/apps/window_server/window_server" > profile.svg
+    $ tools/flamegraph.py profile.txt --kernel ... --folded > profile.folded  # for flamegraph.pl, speedscope ...
+"""
+
+import argparse
+import bisect
+import collections
+import html
+import os
+import subprocess
+import sys
+import zlib
+
+KERNEL_BASE = 0xC0000000
+VDSO_BASE = 0xBFFFD000
+
+
+class Symbols:
+    def __init__(self, path, nm):
+        self.addrs, self.names = [], []
+        if not path:
+            return
+        output = subprocess.run([nm, "-n", "--defined-only", path],
+                                check=True, capture_output=True, text=True).stdout
+        for line in output.splitlines():
+            parts = line.split()
+            if len(parts) == 3 and parts[1] in "tTwW":
+                self.addrs.append(int(parts[0], 16))
+                self.names.append(parts[2])
+
+    def lookup(self, addr):
+        i = bisect.bisect_right(self.addrs, addr) - 1
+        return self.names[i] if i >= 0 else None
+
+
+def find_elf(comm, elfs, sysroot):
+    if comm in elfs:
+        return elfs[comm]
+    if sysroot:
+        name = os.path.basename(comm).replace(" ", "_")
+        for root, _, files in os.walk(sysroot):
+            if name in files:
+                return os.path.join(root, name)
+    return None
+
+
+def fold(samples, kernel, elfs, sysroot, nm):
+    cache = {}
+    folded = collections.Counter()
+    for comm, mode, ips in samples:
+        if comm not in cache:
+            path = find_elf(comm, elfs, sysroot)
+            cache[comm] = Symbols(path, nm) if path else Symbols(None, nm)
+        user = cache[comm]
+
+        frames = []
+        for ip in ips:
+            if ip >= KERNEL_BASE:
+                name = kernel.lookup(ip)
+                frames.append((name or hex(ip)) + "_[k]")
+            elif ip >= VDSO_BASE:
+                frames.append("[vdso]")
+            else:
+                frames.append(user.lookup(ip) or hex(ip))
+        # samples are leaf first, folded stacks are root first
+        folded[";".join([comm] + frames[::-1])] += 1
+    return folded
+
+
+def parse(lines):
+    for line in lines:
+        # comm may contain spaces, pid/tid and mode are the first tokens after it
+        parts = line.split()
+        for i, token in enumerate(parts):
+            if "/" in token and token.replace("/", "").isdigit() and i + 1 < len(parts):
+                comm = " ".join(parts[:i])
+                yield comm, parts[i + 1], [int(ip, 16) for ip in parts[i + 2:]]
+                break
+
+
+def render_svg(folded, out, width=1200, frame_height=16):
+    root = {"name": "all", "value": 0, "children": {}}
+    for stack, count in folded.items():
+        node = root
+        node["value"] += count
+        for frame in stack.split(";"):
+            node = node["children"].setdefault(frame, {"name": frame, "value": 0, "children": {}})
+            node["value"] += count
+
+    def depth(node):
+        return 1 + max((depth(c) for c in node["children"].values()), default=0)
+
+    height = depth(root) * frame_height + 20
+    total = max(root["value"], 1)
+    rects = []
+
+    def layout(node, x, level):
+        w = node["value"] * width / total
+        if w >= 0.5:
+            y = height - (level + 1) * frame_height
+            kernel = node["name"].endswith("_[k]")
+            hue = 20 + zlib.crc32(node["name"].encode()) % 30
+            color = "rgb(%d,%d,%d)" % ((230, 120 + hue, 60) if kernel else (240, 150 + hue, 50 + hue))
+            label = html.escape(node["name"])
+            title = "%s (%d samples, %.2f%%)" % (label, node["value"], node["value"] * 100.0 / total)
+            text = label[:int(w / 7)] if w > 21 else ""
+            rects.append('<g><title>%s</title><rect x="%.1f" y="%d" width="%.1f" height="%d" fill="%s"/>'
+                         '<text x="%.1f" y="%d">%s</text></g>'
+                         % (title, x, y, w, frame_height - 1, color, x + 3, y + frame_height - 4, text))
+        for child in sorted(node["children"].values(), key=lambda c: c["name"]):
+            layout(child, x, level + 1)
+            x += child["value"] * width / total
+
+    layout(root, 0, 0)
+    out.write('<svg xmlns="http://www.w3.org/2000/svg" width="%d" height="%d" font-family="monospace" font-size="11">\n'
+              % (width, height))
+    out.write("\n".join(rects))
+    out.write("\n</svg>\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("profile", help="output of /dev/profile")
+    parser.add_argument("--kernel", help="kernel binary with symbols (mos.bin)")
+    parser.add_argument("--elf", action="append", default=[], metavar="COMM=PATH",
+                        help="user binary for a process name, can be repeated")
+    parser.add_argument("--sysroot", help="directory searched for user binaries by process name")
+    parser.add_argument("--nm", default=os.environ.get("NM", "i386-mos-nm"), help="nm to use (default: i386-mos-nm)")
+    parser.add_argument("--folded", action="store_true", help="print folded stacks instead of svg")
+    args = parser.parse_args()
+
+    elfs = dict(item.split("=", 1) for item in args.elf)
+    kernel = Symbols(args.kernel, args.nm)
+    with open(args.profile) as f:
+        folded = fold(parse(f), kernel, elfs, args.sysroot, args.nm)
+
+    if args.folded:
+        for stack, count in sorted(folded.items()):
+            sys.stdout.write("%s %d\n" % (stack, count))
+    else:
+        render_svg(folded, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()